@@ -0,0 +1,701 @@
+/**
+ * @file benchmarks.c
+ * @author Nathan Seymour
+ * @brief Microbenchmarks of the proton-chess hot paths.
+ *
+ * Usage: benchmarks [-o results.json] [-c baseline.json] [-t threshold] [-r repetitions] [filter]
+ *
+ * Every benchmark is first calibrated, doubling its iteration count until a
+ * repetition takes at least CALIBRATION_NS, then warmed up, then repeated.
+ * The median and percentiles of the time per operation over the repetitions
+ * are printed, and written as JSON with -o.
+ *
+ * With -c, the results are compared against a baseline written earlier with
+ * -o. The program fails if the median of any benchmark is more than
+ * threshold percent (10 by default) slower than in the baseline, Ex:
+ *
+ *     ./benchmarks -o baseline.json
+ *     ... changes ...
+ *     ./benchmarks -c baseline.json -t 5
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "chess.h"
+#include "evaluation.h"
+#include "movement.h"
+#include "legality.h"
+#include "transposition.h"
+#include "search.h"
+#include "position_encoding.h"
+
+#define CALIBRATION_NS      10000000.0
+#define WARMUP_REPETITIONS  3
+#define MAX_REPETITIONS     1000
+#define MAX_BENCHMARKS      32
+#define NAME_LENGTH         64
+#define BENCHMARK_FILE_PATH "benchmark.pcgpf"
+
+typedef struct {
+    const char *name;
+    void (*run)(size_t iterations);
+} benchmark;
+
+typedef struct {
+    char name[NAME_LENGTH];
+    size_t iterations;
+    double median_ns;
+    double p10_ns;
+    double p90_ns;
+    double min_ns;
+} benchmark_result;
+
+/*
+ * Results are folded into this, so that the compiler cannot drop the work
+ * being measured.
+ */
+static volatile uchar sink;
+
+static double now_ns()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (double)time.tv_sec * 1e9 + (double)time.tv_nsec;
+}
+
+static void benchmark_get_square(size_t iterations)
+{
+    chess_board board;
+    uchar accumulator = 0;
+
+    cb_initialize_game(&board);
+    for(size_t i = 0; i < iterations; i++)
+    {
+        accumulator ^= cb_get_board_value_at_square_index(&board, (uchar)(i & 63));
+    }
+
+    sink = accumulator;
+}
+
+static void benchmark_set_square(size_t iterations)
+{
+    chess_board board;
+
+    cb_initialize_game(&board);
+    for(size_t i = 0; i < iterations; i++)
+    {
+        cb_set_board_value_at_square_index(&board, (uchar)(i & 63), (uchar)(i & 0xF));
+    }
+
+    sink = cb_get_board_value_at_square_index(&board, 21);
+}
+
+static void benchmark_point_evaluation(size_t iterations)
+{
+    chess_board board;
+    cb_board_evaluation evaluation;
+    uchar accumulator = 0;
+
+    cb_initialize_game(&board);
+    for(size_t i = 0; i < iterations; i++)
+    {
+        cb_board_point_evaluation(&board, &evaluation);
+        accumulator ^= evaluation.white_points;
+    }
+
+    sink = accumulator;
+}
+
+static void benchmark_perform_movement(size_t iterations)
+{
+    chess_board board;
+    cb_move forward = {6, 21, EMPTY_SQUARE};
+    cb_move backward = {21, 6, EMPTY_SQUARE};
+
+    cb_initialize_game(&board);
+    for(size_t i = 0; i < iterations; i++)
+    {
+        cb_perform_movement(&board, (i & 1) ? &backward : &forward);
+    }
+
+    sink = cb_get_board_value_at_square_index(&board, 21);
+}
+
+#ifdef FEN_EXTENSIONS
+static const char *benchmark_fen = "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1";
+
+static void benchmark_parse_fen(size_t iterations)
+{
+    chess_board board;
+
+    for(size_t i = 0; i < iterations; i++)
+    {
+        cb_parse_fen(&board, benchmark_fen);
+    }
+
+    sink = board.castling_rights;
+}
+
+static void benchmark_generate_fen(size_t iterations)
+{
+    chess_board board;
+    char fen[CB_FEN_NOTATION_LENGTH];
+    uchar accumulator = 0;
+
+    cb_parse_fen(&board, benchmark_fen);
+    for(size_t i = 0; i < iterations; i++)
+    {
+        cb_generate_fen(&board, fen, CB_FEN_NOTATION_LENGTH);
+        accumulator ^= (uchar)fen[i % 16];
+    }
+
+    sink = accumulator;
+}
+
+static void benchmark_encode_position(size_t iterations)
+{
+    chess_board board;
+    uchar data[CB_POSITION_MAX_SIZE];
+    uchar accumulator = 0;
+
+    cb_parse_fen(&board, benchmark_fen);
+    for(size_t i = 0; i < iterations; i++)
+    {
+        accumulator ^= cb_encode_position(&board, data);
+    }
+
+    sink = accumulator ^ data[8];
+}
+
+static void benchmark_decode_position(size_t iterations)
+{
+    chess_board board;
+    uchar data[CB_POSITION_MAX_SIZE];
+    uchar length;
+
+    cb_parse_fen(&board, benchmark_fen);
+    length = cb_encode_position(&board, data);
+    for(size_t i = 0; i < iterations; i++)
+    {
+        cb_decode_position(&board, data, length);
+    }
+
+    sink = board.castling_rights;
+}
+
+/*
+ * The naive way of telling whether a square is attacked: go through every
+ * square of the board, and for each piece of the attacking color, check
+ * its move pattern and walk the squares in between. The reference the
+ * attack queries are measured against.
+ */
+static int naive_is_square_attacked(chess_board *board, uchar square_index, uchar color)
+{
+    int target_file = square_index % 8;
+    int target_rank = square_index / 8;
+
+    for(uchar from = 0; from < 64; from++)
+    {
+        uchar piece = cb_get_board_value_at_square_index(board, from);
+        int file_difference = target_file - from % 8;
+        int rank_difference = target_rank - from / 8;
+        int distance = abs(file_difference) > abs(rank_difference) ? abs(file_difference) : abs(rank_difference);
+        int is_straight = file_difference == 0 || rank_difference == 0;
+        int is_diagonal = abs(file_difference) == abs(rank_difference);
+
+        if(piece == EMPTY_SQUARE || (piece & BLACK) != color || from == square_index)
+        {
+            continue;
+        }
+
+        switch(piece & COLOR_MASK)
+        {
+            case PAWN:
+                if(abs(file_difference) == 1 && rank_difference == (color == WHITE ? 1 : -1)) return 1;
+                continue;
+            case KNIGHT:
+                if(abs(file_difference * rank_difference) == 2) return 1;
+                continue;
+            case KING:
+                if(distance == 1) return 1;
+                continue;
+            case BISHOP:
+                if(!is_diagonal) continue;
+                break;
+            case ROOK:
+                if(!is_straight) continue;
+                break;
+            default:
+                if(!is_diagonal && !is_straight) continue;
+                break;
+        }
+
+        int file_step = (file_difference > 0) - (file_difference < 0);
+        int rank_step = (rank_difference > 0) - (rank_difference < 0);
+        int is_blocked = 0;
+
+        for(int step = 1; step < distance && !is_blocked; step++)
+        {
+            uchar between = (uchar)((from / 8 + rank_step * step) * 8 + from % 8 + file_step * step);
+            is_blocked = cb_get_board_value_at_square_index(board, between) != EMPTY_SQUARE;
+        }
+
+        if(!is_blocked) return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * The attack benchmarks ask about every square of the board, for both
+ * colors, 128 questions per iteration.
+ */
+static void benchmark_attacked_squares_naive(size_t iterations)
+{
+    chess_board board;
+    uchar accumulator = 0;
+
+    cb_parse_fen(&board, benchmark_fen);
+    for(size_t i = 0; i < iterations; i++)
+    {
+        for(uchar square_index = 0; square_index < 64; square_index++)
+        {
+            accumulator += naive_is_square_attacked(&board, square_index, WHITE);
+            accumulator += naive_is_square_attacked(&board, square_index, BLACK);
+        }
+    }
+
+    sink = accumulator;
+}
+
+static void benchmark_attacked_squares(size_t iterations)
+{
+    chess_board board;
+    uchar accumulator = 0;
+
+    cb_parse_fen(&board, benchmark_fen);
+    for(size_t i = 0; i < iterations; i++)
+    {
+        for(uchar square_index = 0; square_index < 64; square_index++)
+        {
+            accumulator += cb_is_square_attacked(&board, square_index, WHITE);
+            accumulator += cb_is_square_attacked(&board, square_index, BLACK);
+        }
+    }
+
+    sink = accumulator;
+}
+
+static void benchmark_attacked_squares_map(size_t iterations)
+{
+    chess_board board;
+    cb_attack_map map;
+    uchar accumulator = 0;
+
+    cb_parse_fen(&board, benchmark_fen);
+    for(size_t i = 0; i < iterations; i++)
+    {
+        cb_load_attack_map(&board, &map);
+        for(uchar square_index = 0; square_index < 64; square_index++)
+        {
+            accumulator += cb_attack_map_is_square_attacked(&map, square_index, WHITE);
+            accumulator += cb_attack_map_is_square_attacked(&map, square_index, BLACK);
+        }
+    }
+
+    sink = accumulator;
+}
+
+static void benchmark_is_in_check(size_t iterations)
+{
+    chess_board board;
+    uchar accumulator = 0;
+
+    cb_parse_fen(&board, benchmark_fen);
+    for(size_t i = 0; i < iterations; i++)
+    {
+        accumulator += cb_is_in_check(&board);
+        board.move_counter ^= 1;
+    }
+
+    sink = accumulator;
+}
+
+static void benchmark_load_attack_map(size_t iterations)
+{
+    chess_board board;
+    cb_attack_map map;
+    uchar accumulator = 0;
+
+    cb_parse_fen(&board, benchmark_fen);
+    for(size_t i = 0; i < iterations; i++)
+    {
+        cb_load_attack_map(&board, &map);
+        accumulator ^= (uchar)map.attacked[i & 1];
+        board.move_counter ^= 1;
+    }
+
+    sink = accumulator;
+}
+
+static void benchmark_generate_legal_moves(size_t iterations)
+{
+    chess_board board;
+    cb_move_list list;
+    uchar accumulator = 0;
+
+    cb_parse_fen(&board, benchmark_fen);
+    for(size_t i = 0; i < iterations; i++)
+    {
+        accumulator ^= cb_generate_legal_moves(&board, &list);
+        board.move_counter ^= 1;
+    }
+
+    sink = accumulator;
+}
+
+/*
+ * The legality benchmarks check one move per iteration, going round the
+ * legal moves of the position: from the board alone, and then from an
+ * attack map loaded once for the position, as when several moves of the
+ * same position are checked.
+ */
+static void benchmark_is_move_legal(size_t iterations)
+{
+    chess_board board;
+    cb_move_list list;
+    uchar accumulator = 0;
+
+    cb_parse_fen(&board, benchmark_fen);
+    cb_generate_legal_moves(&board, &list);
+    for(size_t i = 0; i < iterations; i++)
+    {
+        accumulator += cb_is_move_legal(&board, &list.moves[i % list.count]);
+    }
+
+    sink = accumulator;
+}
+
+static void benchmark_is_move_legal_map(size_t iterations)
+{
+    chess_board board;
+    cb_attack_map map;
+    cb_move_list list;
+    uchar accumulator = 0;
+
+    cb_parse_fen(&board, benchmark_fen);
+    cb_generate_legal_moves(&board, &list);
+    cb_load_attack_map(&board, &map);
+    for(size_t i = 0; i < iterations; i++)
+    {
+        accumulator += cb_is_move_legal_from_map(&board, &map, &list.moves[i % list.count]);
+    }
+
+    sink = accumulator;
+}
+
+/*
+ * A search of a fixed number of nodes from a cleared table, the same tree
+ * every iteration. Also measures the cost of SEARCH_TRACE, between builds
+ * with and without it.
+ */
+static void benchmark_search(size_t iterations)
+{
+    static cb_searcher searcher;
+    cb_transposition_table table;
+    cb_search_limits limits = {.nodes = 4096, .multi_pv = 1};
+    cb_search_result result;
+    chess_board board;
+
+    cb_parse_fen(&board, benchmark_fen);
+    cb_initialize_transposition_table(&table, 1 << 18);
+    cb_initialize_searcher(&searcher, &table);
+
+    for(size_t i = 0; i < iterations; i++)
+    {
+        cb_clear_transposition_table(&table);
+        cb_search(&searcher, &board, NULL, &limits, &result);
+    }
+
+    cb_free_transposition_table(&table);
+    sink = result.depth;
+}
+#endif
+
+#ifdef IMPORT_EXPORT_EXTENSIONS
+static void benchmark_export(size_t iterations)
+{
+    chess_board board;
+
+    cb_initialize_game(&board);
+    for(size_t i = 0; i < iterations; i++)
+    {
+        cb_write_board_to_file(&board, BENCHMARK_FILE_PATH);
+    }
+}
+
+static void benchmark_import(size_t iterations)
+{
+    chess_board board;
+
+    cb_initialize_game(&board);
+    cb_write_board_to_file(&board, BENCHMARK_FILE_PATH);
+    for(size_t i = 0; i < iterations; i++)
+    {
+        cb_read_board_state_from_file(&board, BENCHMARK_FILE_PATH);
+    }
+
+    sink = board.castling_rights;
+}
+#endif
+
+static const benchmark benchmarks[] = {
+        {"get_square", benchmark_get_square},
+        {"set_square", benchmark_set_square},
+        {"point_evaluation", benchmark_point_evaluation},
+        {"perform_movement", benchmark_perform_movement},
+#ifdef FEN_EXTENSIONS
+        {"parse_fen", benchmark_parse_fen},
+        {"generate_fen", benchmark_generate_fen},
+        {"encode_position", benchmark_encode_position},
+        {"decode_position", benchmark_decode_position},
+        {"attacked_squares_naive", benchmark_attacked_squares_naive},
+        {"attacked_squares", benchmark_attacked_squares},
+        {"attacked_squares_map", benchmark_attacked_squares_map},
+        {"is_in_check", benchmark_is_in_check},
+        {"load_attack_map", benchmark_load_attack_map},
+        {"generate_legal_moves", benchmark_generate_legal_moves},
+        {"is_move_legal", benchmark_is_move_legal},
+        {"is_move_legal_map", benchmark_is_move_legal_map},
+        {"search", benchmark_search},
+#endif
+#ifdef IMPORT_EXPORT_EXTENSIONS
+        {"export", benchmark_export},
+        {"import", benchmark_import},
+#endif
+};
+
+static int compare_doubles(const void *first, const void *second)
+{
+    double difference = *(const double*)first - *(const double*)second;
+    return (difference > 0) - (difference < 0);
+}
+
+static double percentile(const double *sorted_samples, unsigned int count, double fraction)
+{
+    return sorted_samples[(unsigned int)(fraction * (count - 1) + 0.5)];
+}
+
+static void run_benchmark(const benchmark *bench, unsigned int repetitions, benchmark_result *result)
+{
+    static double samples[MAX_REPETITIONS];
+    size_t iterations = 1;
+
+    // Calibrate, so that timer resolution is negligible.
+    for(;;)
+    {
+        double start = now_ns();
+        bench->run(iterations);
+        if(now_ns() - start >= CALIBRATION_NS || iterations >= ((size_t)1 << 40))
+        {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    for(unsigned int i = 0; i < WARMUP_REPETITIONS; i++)
+    {
+        bench->run(iterations);
+    }
+
+    for(unsigned int i = 0; i < repetitions; i++)
+    {
+        double start = now_ns();
+        bench->run(iterations);
+        samples[i] = (now_ns() - start) / (double)iterations;
+    }
+
+    qsort(samples, repetitions, sizeof(double), compare_doubles);
+
+    snprintf(result->name, NAME_LENGTH, "%s", bench->name);
+    result->iterations = iterations;
+    result->median_ns = percentile(samples, repetitions, 0.5);
+    result->p10_ns = percentile(samples, repetitions, 0.1);
+    result->p90_ns = percentile(samples, repetitions, 0.9);
+    result->min_ns = samples[0];
+}
+
+static int write_results(const char *path, const benchmark_result *results, unsigned int count, unsigned int repetitions)
+{
+    FILE *file = fopen(path, "w");
+    if(file == NULL)
+    {
+        return 0;
+    }
+
+    fprintf(file, "{\n  \"repetitions\": %u,\n  \"benchmarks\": [\n", repetitions);
+    for(unsigned int i = 0; i < count; i++)
+    {
+        fprintf(file, "    {\"name\": \"%s\", \"iterations\": %zu, \"median_ns\": %.3f, \"p10_ns\": %.3f, \"p90_ns\": %.3f, \"min_ns\": %.3f, \"ops_per_second\": %.0f}%s\n",
+                results[i].name, results[i].iterations, results[i].median_ns, results[i].p10_ns, results[i].p90_ns, results[i].min_ns,
+                1e9 / results[i].median_ns, i + 1 < count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+
+    return 1;
+}
+
+/*
+ * Read the names and medians back from a file written by write_results.
+ * Only that layout needs to be understood, one benchmark per line.
+ */
+static unsigned int read_baseline(const char *path, benchmark_result *results)
+{
+    FILE *file = fopen(path, "r");
+    char line[512];
+    unsigned int count = 0;
+
+    if(file == NULL)
+    {
+        return 0;
+    }
+
+    while(fgets(line, sizeof(line), file) != NULL && count < MAX_BENCHMARKS)
+    {
+        char *name = strstr(line, "\"name\": \"");
+        char *median = strstr(line, "\"median_ns\": ");
+
+        if(name == NULL || median == NULL)
+        {
+            continue;
+        }
+
+        name += strlen("\"name\": \"");
+        char *name_end = strchr(name, '"');
+        if(name_end == NULL || name_end - name >= NAME_LENGTH)
+        {
+            continue;
+        }
+
+        memset(results[count].name, 0, NAME_LENGTH);
+        memcpy(results[count].name, name, (size_t)(name_end - name));
+        results[count].median_ns = strtod(median + strlen("\"median_ns\": "), NULL);
+        count++;
+    }
+
+    fclose(file);
+    return count;
+}
+
+static int compare_to_baseline(const char *path, const benchmark_result *results, unsigned int count, double threshold)
+{
+    benchmark_result baseline[MAX_BENCHMARKS];
+    unsigned int baseline_count = read_baseline(path, baseline);
+    int regressed = 0;
+
+    if(baseline_count == 0)
+    {
+        fprintf(stderr, "Could not read any benchmark from %s.\n", path);
+        return 0;
+    }
+
+    printf("\n%-20s %14s %14s %9s\n", "benchmark", "baseline ns", "current ns", "change");
+    for(unsigned int i = 0; i < count; i++)
+    {
+        for(unsigned int j = 0; j < baseline_count; j++)
+        {
+            if(strcmp(results[i].name, baseline[j].name) != 0 || baseline[j].median_ns <= 0)
+            {
+                continue;
+            }
+
+            double change = (results[i].median_ns / baseline[j].median_ns - 1.0) * 100.0;
+            int is_regression = change > threshold;
+
+            printf("%-20s %14.3f %14.3f %+8.1f%%%s\n", results[i].name, baseline[j].median_ns, results[i].median_ns, change, is_regression ? "  REGRESSION" : "");
+            regressed |= is_regression;
+        }
+    }
+
+    return !regressed;
+}
+
+int main(int argc, char **argv)
+{
+    const char *output_path = NULL;
+    const char *baseline_path = NULL;
+    const char *filter = NULL;
+    double threshold = 10.0;
+    unsigned int repetitions = 21;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            output_path = argv[++i];
+        }
+        else if(strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+        {
+            baseline_path = argv[++i];
+        }
+        else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            threshold = atof(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+        {
+            repetitions = (unsigned int)atoi(argv[++i]);
+        }
+        else if(argv[i][0] != '-')
+        {
+            filter = argv[i];
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [-o results.json] [-c baseline.json] [-t threshold] [-r repetitions] [filter]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(repetitions < 1 || repetitions > MAX_REPETITIONS)
+    {
+        repetitions = repetitions < 1 ? 1 : MAX_REPETITIONS;
+    }
+
+    benchmark_result results[MAX_BENCHMARKS];
+    unsigned int count = 0;
+
+    printf("%-20s %12s %12s %12s %14s\n", "benchmark", "median ns", "p10 ns", "p90 ns", "ops/s");
+    for(unsigned int i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++)
+    {
+        if(filter != NULL && strstr(benchmarks[i].name, filter) == NULL)
+        {
+            continue;
+        }
+
+        run_benchmark(&benchmarks[i], repetitions, &results[count]);
+        printf("%-20s %12.3f %12.3f %12.3f %14.0f\n", results[count].name, results[count].median_ns, results[count].p10_ns, results[count].p90_ns, 1e9 / results[count].median_ns);
+        count++;
+    }
+
+#ifdef IMPORT_EXPORT_EXTENSIONS
+    remove(BENCHMARK_FILE_PATH);
+#endif
+
+    if(output_path != NULL && !write_results(output_path, results, count, repetitions))
+    {
+        fprintf(stderr, "Could not write %s.\n", output_path);
+        return 1;
+    }
+
+    if(baseline_path != NULL && !compare_to_baseline(baseline_path, results, count, threshold))
+    {
+        return 1;
+    }
+
+    return 0;
+}
@@ -8,6 +8,8 @@
 #ifndef PROTON_CHESS_BASE_TYPES_H
 #define PROTON_CHESS_BASE_TYPES_H
 
+#include <stdint.h>
+
 /**
  * Used extensively as a container to store various values.
  * This is because we try to store everything in the smallest
@@ -16,4 +18,17 @@
  */
 typedef unsigned char uchar;
 
+/**
+ * Used for the few values that do not fit in a uchar, such as the move
+ * counters of long games.
+ */
+typedef unsigned short ushort;
+
+/**
+ * Zobrist hash keys are always 64 bits wide, whatever the platform.
+ * They are used to identify positions (or parts of positions) in
+ * hash tables.
+ */
+typedef uint64_t cb_hash_key;
+
 #endif //PROTON_CHESS_BASE_TYPES_H
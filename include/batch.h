@@ -0,0 +1,36 @@
+/**
+ * @file batch.h
+ * @author Nathan Seymour
+ * @brief Tools for applying moves to many chess boards at once.
+ */
+
+#ifndef PROTON_CHESS_BATCH_H
+#define PROTON_CHESS_BATCH_H
+
+#include <stddef.h>
+#include "pool.h"
+
+/**
+ * Flags of a batch. By default, moves are applied like cb_perform_movement:
+ * the piece is moved and whatever stood on the target square is removed.
+ *
+ * CB_BATCH_LEGAL_MOVES_ONLY checks every move with cb_is_move_legal, and
+ * plays the legal ones with cb_make_move, following all of the rules.
+ */
+#define CB_BATCH_DEFAULT            0x0
+#define CB_BATCH_LEGAL_MOVES_ONLY   0x1
+
+/**
+ * Result of each move of a batch. Boards are left untouched by moves that
+ * are not applied.
+ */
+#define CB_BATCH_MOVE_APPLIED       0   /// The move was applied.
+#define CB_BATCH_INVALID_SQUARE     1   /// A square index is off the board, or both are the same.
+#define CB_BATCH_EMPTY_SQUARE       2   /// There is no piece to move on the source square.
+#define CB_BATCH_ILLEGAL_MOVE       3   /// The move is not legal (CB_BATCH_LEGAL_MOVES_ONLY).
+#define CB_BATCH_INVALID_GAME       4   /// The game handle is invalid or stale.
+
+size_t cb_perform_movements(chess_board *boards, cb_move *moves, size_t count, uchar flags, uchar *results);
+size_t cb_pool_perform_movements(cb_game_pool *pool, const cb_game_handle *handles, cb_move *moves, size_t count, uchar flags, uchar *results);
+
+#endif //PROTON_CHESS_BATCH_H
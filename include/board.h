@@ -0,0 +1,171 @@
+/**
+ * @file board.h
+ * @author Nathan Seymour
+ * @brief Storage of the squares of a chess board, and inline
+ * accessors to them.
+ *
+ * The squares can be stored in one of three ways, selected with the
+ * BOARD_BACKEND CMake option:
+ *
+ * NIBBLE   - Each square is four bits, so a byte holds a pair of squares and
+ *            the whole board fits into 32 bytes. Even squares are stored in
+ *            the high nibble of their byte. This is the default, and the
+ *            layout written to .pcgpf files.
+ * MAILBOX  - Each square is a byte, 64 bytes in total. Reading or writing
+ *            a square is a single load or store.
+ * BITBOARD - The four bits of each square are spread over four 64 bit
+ *            planes, one bit per square. Plane 3 is the bitboard of the
+ *            black pieces. 32 bytes in total.
+ *
+ * Whichever is chosen, squares are read and written with cb_board_get and
+ * cb_board_set, and converted to the nibble layout with cb_pack_board.
+ */
+
+#ifndef PROTON_CHESS_BOARD_H
+#define PROTON_CHESS_BOARD_H
+
+#include "base_types.h"
+#include "extensions.h"
+
+#if CB_BOARD_BACKEND == CB_BOARD_BACKEND_MAILBOX
+
+typedef uchar cb_board_squares[64];
+
+static inline uchar cb_squares_get(const uchar *squares, uchar square_index)
+{
+    return squares[square_index];
+}
+
+static inline void cb_squares_set(uchar *squares, uchar square_index, uchar piece_value)
+{
+    squares[square_index] = piece_value;
+}
+
+static inline void cb_squares_planes(const uchar *squares, uint64_t planes[4])
+{
+    planes[0] = planes[1] = planes[2] = planes[3] = 0;
+
+    for(uchar square_index = 0; square_index < 64; square_index++)
+    {
+        for(uchar plane = 0; plane < 4; plane++)
+        {
+            planes[plane] |= (uint64_t)((squares[square_index] >> plane) & 1) << square_index;
+        }
+    }
+}
+
+#elif CB_BOARD_BACKEND == CB_BOARD_BACKEND_BITBOARD
+
+typedef uint64_t cb_board_squares[4];
+
+static inline uchar cb_squares_get(const uint64_t *squares, uchar square_index)
+{
+    return (uchar)(((squares[0] >> square_index) & 1)
+                | ((squares[1] >> square_index) & 1) << 1
+                | ((squares[2] >> square_index) & 1) << 2
+                | ((squares[3] >> square_index) & 1) << 3);
+}
+
+static inline void cb_squares_set(uint64_t *squares, uchar square_index, uchar piece_value)
+{
+    uint64_t square = (uint64_t)1 << square_index;
+
+    for(uchar plane = 0; plane < 4; plane++)
+    {
+        squares[plane] = (squares[plane] & ~square) | (-(uint64_t)((piece_value >> plane) & 1) & square);
+    }
+}
+
+static inline void cb_squares_planes(const uint64_t *squares, uint64_t planes[4])
+{
+    for(uchar plane = 0; plane < 4; plane++)
+    {
+        planes[plane] = squares[plane];
+    }
+}
+
+#else
+
+typedef uchar cb_board_squares[32];
+
+/*
+ * Shift of the nibble of a square in its byte: 4 for even squares, 0 for
+ * odd squares. Computed rather than branched on.
+ */
+#define cb_nibble_shift(square_index) ((~(square_index) & 1) << 2)
+
+static inline uchar cb_squares_get(const uchar *squares, uchar square_index)
+{
+    return (squares[square_index >> 1] >> cb_nibble_shift(square_index)) & 0xF;
+}
+
+static inline void cb_squares_set(uchar *squares, uchar square_index, uchar piece_value)
+{
+    uchar shift = cb_nibble_shift(square_index);
+
+    squares[square_index >> 1] = (uchar)((squares[square_index >> 1] & ~(0xF << shift)) | ((piece_value & 0xF) << shift));
+}
+
+/*
+ * Sixteen squares at a time: the nibbles of each pair are swapped so that
+ * square n is nibble n, then bit p of every nibble is gathered into 16
+ * contiguous bits, halving the gaps between them at every step.
+ */
+static inline void cb_squares_planes(const uchar *squares, uint64_t planes[4])
+{
+    planes[0] = planes[1] = planes[2] = planes[3] = 0;
+
+    for(uchar word_index = 0; word_index < 4; word_index++)
+    {
+        uint64_t word = 0;
+
+        for(uchar byte_index = 0; byte_index < 8; byte_index++)
+        {
+            word |= (uint64_t)squares[word_index * 8 + byte_index] << (byte_index * 8);
+        }
+
+        word = ((word >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((word & 0x0F0F0F0F0F0F0F0FULL) << 4);
+
+        for(uchar plane = 0; plane < 4; plane++)
+        {
+            uint64_t bits = (word >> plane) & 0x1111111111111111ULL;
+
+            bits = (bits | (bits >> 3)) & 0x0303030303030303ULL;
+            bits = (bits | (bits >> 6)) & 0x000F000F000F000FULL;
+            bits = (bits | (bits >> 12)) & 0x000000FF000000FFULL;
+            bits = (bits | (bits >> 24)) & 0xFFFFULL;
+
+            planes[plane] |= bits << (word_index * 16);
+        }
+    }
+}
+
+#endif
+
+/**
+ * Read the piece value of a square of a chess board. Inline counterpart
+ * of cb_get_board_value_at_square_index.
+ * @param chess_board Pointer to the board.
+ * @param square_index Square index to read.
+ */
+#define cb_board_get(chess_board, square_index) cb_squares_get((chess_board)->board, (square_index))
+
+/**
+ * Write the piece value of a square of a chess board. Inline counterpart
+ * of cb_set_board_value_at_square_index.
+ * @param chess_board Pointer to the board.
+ * @param square_index Square index to write to.
+ * @param piece_value Value to set the square to.
+ */
+#define cb_board_set(chess_board, square_index, piece_value) cb_squares_set((chess_board)->board, (square_index), (piece_value))
+
+/**
+ * Read every square of a chess board as four bitboards, bit p of the piece
+ * value of square n being bit n of planes[p]: the layout of the BITBOARD
+ * backend, whatever the backend.
+ * @param chess_board Pointer to the board.
+ * @param planes Receives the four bitboards.
+ */
+#define cb_board_planes(chess_board, planes) cb_squares_planes((chess_board)->board, (planes))
+
+#endif //PROTON_CHESS_BOARD_H
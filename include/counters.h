@@ -0,0 +1,104 @@
+/**
+ * @file counters.h
+ * @author Nathan Seymour
+ * @brief Per-thread counters of the hot paths, compiled in with
+ * the HOT_PATH_COUNTERS CMake option.
+ *
+ * Every thread counting something gets its own block of counters, on its
+ * own cache lines, so that counting never makes threads share a line. Only
+ * the owning thread writes its block; other threads can read the blocks at
+ * any time with cb_counters_snapshot or cb_counters_aggregate, without
+ * stopping the workload. Counters are never reset: take a snapshot before
+ * and after the work of interest, and subtract.
+ *
+ * Without HOT_PATH_COUNTERS the CB_COUNT macros expand to nothing, and the
+ * snapshots are all zeros.
+ */
+
+#ifndef PROTON_CHESS_COUNTERS_H
+#define PROTON_CHESS_COUNTERS_H
+
+#include <stddef.h>
+#include "base_types.h"
+#include "extensions.h"
+
+/**
+ * Maximum number of threads with their own counters. Threads beyond that
+ * share the last block, and may lose counts. Can be overridden at compile
+ * time.
+ */
+#ifndef CB_COUNTERS_MAX_THREADS
+#define CB_COUNTERS_MAX_THREADS 64
+#endif
+
+/**
+ * Beta cutoffs are counted by the index of the move causing them, the last
+ * slot counting all moves from that index onwards.
+ */
+#define CB_COUNTERS_CUTOFF_SLOTS 8
+
+typedef struct {
+    uint64_t nodes;
+    uint64_t quiescence_nodes;
+    uint64_t tt_probes;
+    uint64_t tt_hits;
+
+    /**
+     * Probes finding an entry of another position in the slot of the key.
+     */
+    uint64_t tt_collisions;
+
+    uint64_t beta_cutoffs[CB_COUNTERS_CUTOFF_SLOTS];
+    uint64_t movegen_calls;
+    uint64_t parse_errors;
+} cb_counters;
+
+#ifdef HOT_PATH_COUNTERS
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define CB_THREAD_LOCAL _Thread_local
+#else
+#define CB_THREAD_LOCAL __thread
+#endif
+
+extern CB_THREAD_LOCAL cb_counters *cb_thread_counters;
+cb_counters *cb_claim_thread_counters();
+
+/*
+ * Single writer, so a relaxed load and store is enough: no locked
+ * instruction, yet readers never see a torn value.
+ */
+static inline void cb_counter_add(uint64_t *counter, uint64_t amount)
+{
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + amount, __ATOMIC_RELAXED);
+}
+
+#define cb_current_counters() (cb_thread_counters != NULL ? cb_thread_counters : cb_claim_thread_counters())
+
+/**
+ * Add to a counter of the calling thread, Ex: CB_COUNT_ADD(nodes, 4).
+ */
+#define CB_COUNT_ADD(counter, amount) cb_counter_add(&cb_current_counters()->counter, (amount))
+
+/**
+ * Count a beta cutoff caused by the move at move_index in the move list.
+ */
+#define CB_COUNT_CUTOFF(move_index) CB_COUNT_ADD(beta_cutoffs[(move_index) < CB_COUNTERS_CUTOFF_SLOTS - 1 ? (move_index) : CB_COUNTERS_CUTOFF_SLOTS - 1], 1)
+
+#else
+
+#define CB_COUNT_ADD(counter, amount) ((void)0)
+#define CB_COUNT_CUTOFF(move_index) ((void)0)
+
+#endif
+
+/**
+ * Count one event of the calling thread, Ex: CB_COUNT(tt_probes).
+ */
+#define CB_COUNT(counter) CB_COUNT_ADD(counter, 1)
+
+unsigned int cb_counters_thread_count();
+void cb_counters_snapshot(unsigned int thread_index, cb_counters *snapshot);
+void cb_counters_aggregate(cb_counters *total);
+
+#endif //PROTON_CHESS_COUNTERS_H
@@ -7,6 +7,109 @@
 #ifndef PROTON_CHESS_EVALUATION_H
 #define PROTON_CHESS_EVALUATION_H
 
+#ifdef NNUE_EVALUATION
+#include "nnue.h"
+#endif
+
+/**
+ * Number of entries in a pawn hash table. Must be a power of two. Can be
+ * overridden at compile time to trade RAM for hit rate.
+ */
+#ifndef CB_PAWN_HASH_ENTRIES
+#define CB_PAWN_HASH_ENTRIES 1024
+#endif
+
+/**
+ * @defgroup evaluation-parameters Evaluation Parameters
+ * Indices of the tunable weights of the material evaluator, as used by
+ * cb_evaluation_parameters and cb_evaluation_coefficients.
+ */
+///@{
+#define CB_EVAL_PIECE_VALUES        0       /* 5 weights, pawn to queen */
+#define CB_EVAL_PASSED_PAWN         5       /* 8 weights, by relative rank */
+#define CB_EVAL_ISOLATED_PAWN       13
+#define CB_EVAL_DOUBLED_PAWN        14
+#define CB_EVAL_BACKWARD_PAWN       15
+#define CB_EVAL_PAWN_SHIELD         16      /* 2 weights, by distance to the king */
+#define CB_EVAL_PARAMETER_COUNT     18
+///@}
+
+/**
+ * Pawn structure scores in centipawns, one per side. Higher is better for
+ * that side.
+ */
+typedef struct {
+    short white_score;
+    short black_score;
+} cb_pawn_evaluation;
+
+/**
+ * A cached pawn structure evaluation. Besides the scores, the rearmost pawn
+ * of each side on every file is kept, so that king shelter can be computed
+ * cheaply without rescanning the board.
+ */
+typedef struct {
+    cb_hash_key key;
+    short white_score;
+    short black_score;
+    /**
+     * Rank id of the rearmost pawn on each file, seen from the side owning
+     * it (0 is that side's back rank). 0xF when the file has no pawn.
+     */
+    uchar white_rearmost_rank[8];
+    uchar black_rearmost_rank[8];
+} cb_pawn_hash_entry;
+
+/**
+ * Pawn hash table. It is not shared: each thread evaluating positions should
+ * own one. Statistics are kept to check that the table is large enough.
+ */
+typedef struct {
+    cb_pawn_hash_entry entries[CB_PAWN_HASH_ENTRIES];
+    unsigned long probes;
+    unsigned long hits;
+} cb_pawn_hash_table;
+
+/**
+ * @defgroup evaluators Evaluators
+ * Evaluation functions that cb_evaluate can be switched between at runtime.
+ */
+///@{
+#define CB_EVALUATOR_MATERIAL   0x0     /* Material and pawn structure */
+#define CB_EVALUATOR_NNUE       0x1     /* Neural network, requires NNUE_EVALUATION */
+///@}
+
+/**
+ * Selects and holds the state of the evaluation function used by
+ * cb_evaluate. Each thread evaluating positions needs its own.
+ */
+typedef struct {
+    /**
+     * One of the evaluators, Ex: CB_EVALUATOR_MATERIAL.
+     */
+    uchar type;
+
+    /**
+     * Optional pawn hash table for the material evaluator.
+     */
+    cb_pawn_hash_table *pawn_table;
+
+#ifdef NNUE_EVALUATION
+    /**
+     * Network and accumulator for the NNUE evaluator. The accumulator must
+     * be kept in sync with the evaluated board by the caller.
+     */
+    const cb_nnue_network *network;
+    cb_nnue_accumulator *accumulator;
+#endif
+} cb_evaluator;
+
 void cb_board_point_evaluation(chess_board *board, cb_board_evaluation *evaluation);
+void cb_clear_pawn_hash_table(cb_pawn_hash_table *table);
+void cb_pawn_structure_evaluation(chess_board *board, cb_pawn_hash_table *table, cb_hash_key pawn_key, cb_pawn_evaluation *evaluation);
+void cb_initialize_evaluator(cb_evaluator *evaluator, uchar type);
+int cb_evaluate(chess_board *board, cb_evaluator *evaluator);
+void cb_evaluation_parameters(short parameters[CB_EVAL_PARAMETER_COUNT]);
+void cb_evaluation_coefficients(chess_board *board, signed char coefficients[CB_EVAL_PARAMETER_COUNT]);
 
 #endif //PROTON_CHESS_EVALUATION_H
@@ -0,0 +1,55 @@
+/**
+ * @file explorer.h
+ * @author Nathan Seymour
+ * @brief Opening explorer: the moves played from a position in a set of
+ * games, with their results.
+ */
+
+#ifndef PROTON_CHESS_EXPLORER_H
+#define PROTON_CHESS_EXPLORER_H
+
+#include <stddef.h>
+#include "pcmem.h"
+
+/**
+ * Statistics of a move played from a position. Index files are a header
+ * followed by these entries, sorted by key, then by decreasing number of
+ * games, so that they can be searched right where they are mapped.
+ */
+typedef struct {
+    cb_hash_key key;
+    uint64_t rating_sum;
+    uint32_t white_wins;
+    uint32_t draws;
+    uint32_t black_wins;
+
+    /**
+     * Games the rating sum is made of, those where the players had ratings.
+     */
+    uint32_t rated_games;
+
+    uchar from_square_index;
+    uchar to_square_index;
+    uchar promotion_piece;
+    uchar padding[5];
+} cb_explorer_entry;
+
+#define cb_explorer_entry_games(entry) ((entry)->white_wins + (entry)->draws + (entry)->black_wins)
+#define cb_explorer_entry_average_rating(entry) ((entry)->rated_games == 0 ? 0 : (uint32_t)((entry)->rating_sum / (entry)->rated_games))
+
+/**
+ * An opened index. It is only read once opened, so any number of threads
+ * can query it at once.
+ */
+typedef struct {
+    pcmem_file_mapping mapping;
+    const cb_explorer_entry *entries;
+    size_t count;
+} cb_explorer;
+
+int cb_write_explorer_index(const char *path, const cb_explorer_entry *entries, size_t count);
+int cb_open_explorer(cb_explorer *explorer, const char *path);
+void cb_close_explorer(cb_explorer *explorer);
+size_t cb_explorer_query(const cb_explorer *explorer, chess_board *board, const cb_explorer_entry **entries);
+
+#endif //PROTON_CHESS_EXPLORER_H
@@ -0,0 +1,104 @@
+/**
+ * @file game_encoding.h
+ * @author Nathan Seymour
+ * @brief Compact game archives: each move is stored as its index among the
+ * legal moves of its position.
+ */
+
+#ifndef PROTON_CHESS_GAME_ENCODING_H
+#define PROTON_CHESS_GAME_ENCODING_H
+
+#include <stdio.h>
+#include "pcmem.h"
+
+/**
+ * @defgroup game-encodings Game Encodings
+ * How the move indices of the games of an archive are stored.
+ */
+///@{
+#define CB_GAME_ENCODING_RAW    0x0     /* One byte per move */
+#define CB_GAME_ENCODING_RANGE  0x1     /* Range coded, log2 of the number of legal moves bits per move */
+///@}
+
+/**
+ * @defgroup game-results Game Results
+ */
+///@{
+#define CB_GAME_RESULT_UNKNOWN      0x0
+#define CB_GAME_RESULT_WHITE_WINS   0x1
+#define CB_GAME_RESULT_BLACK_WINS   0x2
+#define CB_GAME_RESULT_DRAW         0x3
+///@}
+
+/**
+ * Largest record of a game of a number of moves: a header, a starting
+ * position and a byte per move. A range coded move never takes more than a
+ * byte, plus 5 bytes to flush.
+ */
+#define CB_GAME_RECORD_MAX_SIZE(move_count) (4 + 38 + (size_t)(move_count) + 16)
+
+/**
+ * Writes games to an archive, one after the other. The offset table of the
+ * games is written when the writer is closed.
+ */
+typedef struct {
+    FILE *file;
+    uchar encoding;
+    uint64_t position;
+
+    uint64_t *offsets;
+    size_t count;
+    size_t capacity;
+
+    uchar *buffer;
+    size_t buffer_capacity;
+
+    /**
+     * Whether the offsets and buffer were allocated by the writer, and can
+     * be grown, rather than given with cb_use_game_writer_memory.
+     */
+    uchar owns_memory;
+} cb_game_writer;
+
+/**
+ * An opened archive. It is only read once opened, so any number of
+ * threads can decode its games at once, each with its own cursor.
+ */
+typedef struct {
+    pcmem_file_mapping mapping;
+    uchar encoding;
+    const uchar *offsets;
+    size_t count;
+} cb_game_reader;
+
+/**
+ * Replays a game of an archive. The board holds the position reached by
+ * the moves decoded so far.
+ */
+typedef struct {
+    chess_board board;
+    uchar result;
+    ushort move_count;
+    ushort moves_decoded;
+
+    uchar encoding;
+    const uchar *data;
+    const uchar *end;
+    uint32_t range;
+    uint32_t code;
+} cb_game_cursor;
+
+uchar cb_move_to_index(chess_board *board, cb_move *move, uchar *move_count);
+int cb_move_from_index(chess_board *board, uchar index, cb_move *move);
+
+int cb_open_game_writer(cb_game_writer *writer, const char *path, uchar encoding);
+int cb_use_game_writer_memory(cb_game_writer *writer, uint64_t *offsets, size_t offsets_capacity, uchar *buffer, size_t buffer_capacity);
+int cb_write_game(cb_game_writer *writer, chess_board *start, cb_move *moves, ushort move_count, uchar result);
+int cb_close_game_writer(cb_game_writer *writer);
+
+int cb_open_game_reader(cb_game_reader *reader, const char *path);
+void cb_close_game_reader(cb_game_reader *reader);
+int cb_seek_game(cb_game_reader *reader, size_t index, cb_game_cursor *cursor);
+int cb_next_game_move(cb_game_cursor *cursor, cb_move *move);
+
+#endif //PROTON_CHESS_GAME_ENCODING_H
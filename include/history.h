@@ -0,0 +1,54 @@
+/**
+ * @file history.h
+ * @author Nathan Seymour
+ * @brief History of the positions of a game, used to detect
+ * repetitions.
+ */
+
+#ifndef PROTON_CHESS_HISTORY_H
+#define PROTON_CHESS_HISTORY_H
+
+/**
+ * Number of positions kept in the history ring. Must be a power of two,
+ * and larger than the longest run of reversible moves that needs to be
+ * checked for repetitions. Can be overridden at compile time.
+ */
+#ifndef CB_HISTORY_SIZE
+#define CB_HISTORY_SIZE 256
+#endif
+
+/**
+ * Number of counters in the repetition filter. Must be a power of two.
+ */
+#ifndef CB_HISTORY_FILTER_SIZE
+#define CB_HISTORY_FILTER_SIZE 1024
+#endif
+
+/**
+ * Ring of the Zobrist keys of the positions of a game, the current position
+ * last. cb_make_move pushes the key of the new position and cb_unmake_move
+ * pops it.
+ *
+ * The filter counts how many positions in the ring share the low bits of
+ * each key. When the current key's counter is 1, the position cannot be a
+ * repetition and the ring does not need to be scanned at all.
+ */
+typedef struct {
+    cb_hash_key keys[CB_HISTORY_SIZE];
+    uchar filter[CB_HISTORY_FILTER_SIZE];
+
+    /**
+     * Number of positions pushed since the history was initialized,
+     * including the initial position.
+     */
+    unsigned int count;
+} cb_position_history;
+
+void cb_initialize_history(cb_position_history *history, chess_board *board);
+void cb_push_history(cb_position_history *history, cb_hash_key key);
+void cb_pop_history(cb_position_history *history);
+cb_hash_key cb_history_current_key(cb_position_history *history);
+uchar cb_count_repetitions(cb_position_history *history, chess_board *board);
+int cb_is_draw(cb_position_history *history, chess_board *board);
+
+#endif //PROTON_CHESS_HISTORY_H
@@ -0,0 +1,73 @@
+/**
+ * @file legality.h
+ * @author Nathan Seymour
+ * @brief Tools for checking the legality of moves.
+ */
+
+#ifndef PROTON_CHESS_LEGALITY_H
+#define PROTON_CHESS_LEGALITY_H
+
+/**
+ * Upper bound of the number of legal moves in any position (218 is the
+ * most known), with promotions counted once per piece.
+ */
+#define CB_MAX_MOVES 256
+
+typedef struct {
+    cb_move moves[CB_MAX_MOVES];
+    uchar count;
+} cb_move_list;
+
+/**
+ * Bitboards of a position and of the squares each side attacks, computed
+ * once with cb_load_attack_map and then shared by every question asked
+ * about the same position: checks, attacked squares, move generation. It
+ * is only valid until the board changes.
+ */
+typedef struct {
+    /**
+     * Squares of each piece value (Ex: pieces[BLACK | ROOK]), of each
+     * color (colors[color >> 3]), and of every piece.
+     */
+    uint64_t pieces[16];
+    uint64_t colors[2];
+    uint64_t occupied;
+
+    /**
+     * Squares attacked by each color, indexed by color >> 3. The attacks of
+     * the side not to move go through the king of the side to move, so that
+     * the squares behind it on a checking line count as attacked.
+     */
+    uint64_t attacked[2];
+
+    /**
+     * Pieces giving check to the side to move, and pieces of the side to
+     * move pinned to their king.
+     */
+    uint64_t checkers;
+    uint64_t pinned;
+
+    /**
+     * Side to move.
+     */
+    uchar color;
+
+    /**
+     * Square of the king of the side to move, 64 if it has none.
+     */
+    uchar king_square_index;
+} cb_attack_map;
+
+int cb_is_move_legal(chess_board *board, cb_move *move);
+int cb_is_move_legal_from_map(chess_board *board, const cb_attack_map *map, cb_move *move);
+unsigned int cb_validate_move_sequence(chess_board *board, cb_move *moves, unsigned int move_count);
+uchar cb_generate_legal_moves(chess_board *board, cb_move_list *list);
+uchar cb_generate_legal_moves_from_map(chess_board *board, const cb_attack_map *map, cb_move_list *list);
+int cb_is_in_check(chess_board *board);
+uint64_t cb_attackers_to(chess_board *board, uchar square_index, uchar color);
+int cb_is_square_attacked(chess_board *board, uchar square_index, uchar color);
+void cb_load_attack_map(chess_board *board, cb_attack_map *map);
+uint64_t cb_attack_map_attackers_to(const cb_attack_map *map, uchar square_index, uchar color);
+int cb_attack_map_is_square_attacked(const cb_attack_map *map, uchar square_index, uchar color);
+
+#endif //PROTON_CHESS_LEGALITY_H
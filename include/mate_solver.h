@@ -0,0 +1,129 @@
+/**
+ * @file mate_solver.h
+ * @author Nathan Seymour
+ * @brief Mate solver: proves or refutes forced mates with depth-first
+ * proof-number search, Ex: to validate "mate in n" puzzles.
+ */
+
+#ifndef PROTON_CHESS_MATE_SOLVER_H
+#define PROTON_CHESS_MATE_SOLVER_H
+
+#include <stddef.h>
+#include "history.h"
+#include "legality.h"
+
+/**
+ * Longest mate the solver can look for, in moves of the mating side. The
+ * memory of a solver grows linearly with it.
+ */
+#ifndef CB_MATE_MAX_MOVES
+#define CB_MATE_MAX_MOVES 16
+#endif
+
+#define CB_MATE_MAX_PLIES (2 * CB_MATE_MAX_MOVES)
+
+/**
+ * @defgroup mate-statuses Mate Statuses
+ * Outcome of cb_solve_mate.
+ */
+///@{
+#define CB_MATE_UNKNOWN     0x0     /* A limit was reached first */
+#define CB_MATE_PROVEN      0x1     /* The side to move mates, the line is the mate */
+#define CB_MATE_DISPROVEN   0x2     /* No mate within the moves, the line refutes the best try */
+///@}
+
+/**
+ * Proof and disproof numbers of a node, from the side to move: phi is the
+ * proof number of a win of the side to move, delta that of its loss.
+ */
+typedef struct {
+    cb_hash_key key;
+    uint32_t phi;
+    uint32_t delta;
+
+    /**
+     * Nodes expanded below the entry, 0 for empty entries. Entries of the
+     * most work are kept, and lines follow the longest defence.
+     */
+    uint32_t work;
+} cb_mate_entry;
+
+typedef struct {
+    cb_mate_entry *entries;
+
+    /**
+     * Number of entries, a power of two, looked up in buckets of four.
+     */
+    size_t size;
+} cb_mate_table;
+
+typedef struct {
+    /**
+     * Most moves of the mating side, at most CB_MATE_MAX_MOVES. Shorter
+     * mates are tried first, so a proven mate is always a shortest one.
+     */
+    uchar moves;
+
+    /**
+     * Nodes and milliseconds after which the solver gives up, 0 for no
+     * limit.
+     */
+    unsigned long nodes;
+    unsigned long time_ms;
+} cb_mate_limits;
+
+typedef struct {
+    uchar status;
+
+    /**
+     * Moves of the mating side in the proven mate.
+     */
+    uchar mate_in;
+
+    /**
+     * For a proven mate, the mating line, the defence resisting longest.
+     * For a disproven one, the try of the most work and a defence refuting
+     * it. The line stops short when the table lost a node of it.
+     */
+    cb_move line[CB_MATE_MAX_PLIES];
+    uchar length;
+
+    unsigned long nodes;
+    unsigned long time_ms;
+} cb_mate_result;
+
+/**
+ * Moves of a ply of the solver, and the table keys of the positions they
+ * lead to.
+ */
+typedef struct {
+    cb_move_list moves;
+    cb_hash_key child_keys[CB_MAX_MOVES];
+} cb_mate_frame;
+
+/**
+ * Everything a solve needs besides the position. Each thread solving needs
+ * its own solver and its own table.
+ */
+typedef struct {
+    cb_mate_table *table;
+    cb_position_history history;
+    cb_mate_frame stack[CB_MATE_MAX_PLIES + 1];
+    cb_attack_map attacks;
+
+    cb_mate_limits limits;
+    unsigned long nodes;
+    unsigned long start_ms;
+    int stopped;
+} cb_mate_solver;
+
+int cb_attach_mate_table(cb_mate_table *table, void *memory, size_t size_in_bytes);
+#ifdef DYNAMIC_MEMORY_ALLOCATION
+int cb_initialize_mate_table(cb_mate_table *table, size_t size_in_bytes);
+void cb_free_mate_table(cb_mate_table *table);
+#endif
+void cb_clear_mate_table(cb_mate_table *table);
+void cb_initialize_mate_solver(cb_mate_solver *solver, cb_mate_table *table);
+void cb_solve_mate(cb_mate_solver *solver, chess_board *board, const cb_mate_limits *limits, cb_mate_result *result);
+
+#endif //PROTON_CHESS_MATE_SOLVER_H
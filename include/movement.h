@@ -7,6 +7,22 @@
 #ifndef PROTON_CHESS_MOVEMENT_H
 #define PROTON_CHESS_MOVEMENT_H
 
+#include "history.h"
+
+/**
+ * Everything cb_make_move overwrites that cannot be recovered from the move
+ * itself. Filled by cb_make_move and read back by cb_unmake_move.
+ */
+typedef struct {
+    uchar moved_piece;
+    uchar captured_piece;
+    uchar castling_rights;
+    uchar ep_target_square_index;
+    ushort halfmove_clock;
+} cb_move_undo;
+
 void cb_perform_movement(chess_board *board, cb_move *move);
+void cb_make_move(chess_board *board, cb_move *move, cb_move_undo *undo, cb_position_history *history);
+void cb_unmake_move(chess_board *board, cb_move *move, cb_move_undo *undo, cb_position_history *history);
 
 #endif //PROTON_CHESS_MOVEMENT_H
@@ -0,0 +1,76 @@
+/**
+ * @file nnue.h
+ * @author Nathan Seymour
+ * @brief Efficiently updatable neural network (NNUE) evaluation.
+ */
+
+#ifndef PROTON_CHESS_NNUE_H
+#define PROTON_CHESS_NNUE_H
+
+#include "pcmem.h"
+
+/**
+ * Number of neurons in the first layer, for each perspective. Network files
+ * must have been trained with the same size.
+ */
+#ifndef CB_NNUE_HIDDEN_SIZE
+#define CB_NNUE_HIDDEN_SIZE 256
+#endif
+
+/**
+ * Number of input features per perspective: one per colored piece per square.
+ */
+#define CB_NNUE_FEATURE_COUNT 768
+
+/**
+ * Activations of the first layer are clipped to [0, CB_NNUE_ACTIVATION_MAX]
+ * so that they fit in a signed byte.
+ */
+#define CB_NNUE_ACTIVATION_MAX 127
+
+/**
+ * Magic number and version found at the start of every network file.
+ * Ex: "PCNN" followed by a little-endian version number.
+ */
+#define CB_NNUE_MAGIC   0x4E4E4350  /* "PCNN" */
+#define CB_NNUE_VERSION 1
+
+/**
+ * Size of a network file header. The header is followed by the feature
+ * biases (int16[hidden]), the feature weights (int16[768][hidden]) and the
+ * output weights (int8[2 * hidden]). All values are little-endian.
+ */
+#define CB_NNUE_HEADER_SIZE 32
+
+/**
+ * A loaded network. The weights point directly into the memory-mapped
+ * network file, so loading costs nothing more than the mapping itself.
+ */
+typedef struct {
+    const int16_t *feature_biases;
+    const int16_t *feature_weights;
+    const int8_t *output_weights;
+    int32_t output_bias;
+    int32_t output_scale;
+    pcmem_file_mapping mapping;
+} cb_nnue_network;
+
+/**
+ * First layer values of a position, for each perspective (WHITE, then BLACK).
+ * Kept up to date move by move by adding and subtracting the weight columns of
+ * the features that change.
+ */
+typedef struct {
+    int16_t values[2][CB_NNUE_HIDDEN_SIZE];
+} cb_nnue_accumulator;
+
+int cb_nnue_load_network(cb_nnue_network *network, const char *path);
+int cb_nnue_init_network(cb_nnue_network *network, const void *data, size_t size);
+void cb_nnue_free_network(cb_nnue_network *network);
+void cb_nnue_refresh_accumulator(const cb_nnue_network *network, cb_nnue_accumulator *accumulator, chess_board *board);
+void cb_nnue_add_piece(const cb_nnue_network *network, cb_nnue_accumulator *accumulator, uchar piece_value, uchar square_index);
+void cb_nnue_remove_piece(const cb_nnue_network *network, cb_nnue_accumulator *accumulator, uchar piece_value, uchar square_index);
+void cb_nnue_update_accumulator(const cb_nnue_network *network, cb_nnue_accumulator *accumulator, chess_board *board, cb_move *move);
+int cb_nnue_evaluate(const cb_nnue_network *network, const cb_nnue_accumulator *accumulator, uchar side_to_move);
+
+#endif //PROTON_CHESS_NNUE_H
@@ -5,6 +5,7 @@
 #ifndef PROTON_CHESS_NOTATION_H
 #define PROTON_CHESS_NOTATION_H
 
-
+int cb_parse_notation(chess_board *board, const char *notation, cb_move *move);
+char *cb_move_to_uci(const cb_move *move, char notation[6]);
 
 #endif //PROTON_CHESS_NOTATION_H
@@ -0,0 +1,99 @@
+/**
+ * @file pool.h
+ * @author Nathan Seymour
+ * @brief Pools of many concurrent games, stored as contiguous
+ * arrays and addressed by handles.
+ */
+
+#ifndef PROTON_CHESS_POOL_H
+#define PROTON_CHESS_POOL_H
+
+#include <stddef.h>
+
+/**
+ * Games are addressed by handles rather than pointers. A handle holds the
+ * shard of the game (8 bits), its slot in the shard (12 bits) and the
+ * generation of the slot (12 bits), so that handles to destroyed games are
+ * detected instead of silently addressing the game reusing their slot.
+ * A slot is retired once its generation is exhausted, after 2048 games,
+ * rather than let the generation wrap and stale handles become valid again.
+ */
+typedef uint32_t cb_game_handle;
+
+#define CB_INVALID_GAME_HANDLE      0xFFFFFFFF
+#define CB_POOL_MAX_SHARDS          255
+#define CB_POOL_MAX_SHARD_CAPACITY  0xFFF
+#define CB_POOL_MAX_GENERATION      0xFFF
+
+#define cb_game_handle_shard(handle)        ((uchar)((handle) >> 24))
+#define cb_game_handle_slot(handle)         ((uint32_t)(((handle) >> 12) & 0xFFF))
+#define cb_game_handle_generation(handle)   ((ushort)((handle) & 0xFFF))
+
+/**
+ * The games of one shard, as a structure of arrays: the boards of all
+ * games are contiguous, then all move counters, and so on. A shard is only
+ * ever used by one thread at a time; shards are allocated on separate cache
+ * lines so that threads working on different shards never share one.
+ */
+typedef struct {
+    cb_board_squares *boards;
+    ushort *move_counters;
+    ushort *halfmove_clocks;
+    uchar *castling_rights;
+    uchar *ep_target_square_indices;
+
+    /**
+     * Zobrist key of the current position of each game.
+     */
+    cb_hash_key *keys;
+
+    /**
+     * Generation of each slot, bumped every time its game is destroyed.
+     * Odd while the slot holds a game, even while it is free, and above
+     * CB_POOL_MAX_GENERATION once the slot is retired.
+     */
+    ushort *generations;
+
+    /**
+     * Free slots form a singly linked list through this array.
+     */
+    uint32_t *next_free_slots;
+
+    /**
+     * Single block holding every array above.
+     */
+    void *memory;
+    size_t memory_size;
+
+    uint32_t capacity;
+    uint32_t active_count;
+    uint32_t free_head;
+
+    /**
+     * Pads the shard to two cache lines, so that shards written by different
+     * threads never share one.
+     */
+    uchar padding[128 - 9 * sizeof(void*) - sizeof(size_t) - 3 * sizeof(uint32_t)];
+} cb_game_shard;
+
+typedef struct {
+    cb_game_shard *shards;
+    uchar shard_count;
+} cb_game_pool;
+
+size_t cb_game_pool_memory_size(unsigned int shard_count, uint32_t shard_capacity);
+int cb_attach_game_pool(cb_game_pool *pool, void *memory, size_t size, unsigned int shard_count, uint32_t shard_capacity);
+#ifdef DYNAMIC_MEMORY_ALLOCATION
+int cb_initialize_game_pool(cb_game_pool *pool, unsigned int shard_count, uint32_t shard_capacity);
+void cb_free_game_pool(cb_game_pool *pool);
+#endif
+cb_game_handle cb_pool_create_game(cb_game_pool *pool, uchar shard_index);
+void cb_pool_destroy_game(cb_game_pool *pool, cb_game_handle handle);
+int cb_pool_is_valid_game(cb_game_pool *pool, cb_game_handle handle);
+void cb_pool_load_board(cb_game_pool *pool, cb_game_handle handle, chess_board *board);
+void cb_pool_store_board(cb_game_pool *pool, cb_game_handle handle, chess_board *board);
+size_t cb_pool_snapshot_size(cb_game_pool *pool, uchar shard_index);
+void cb_pool_snapshot(cb_game_pool *pool, uchar shard_index, void *buffer);
+void cb_pool_restore(cb_game_pool *pool, uchar shard_index, const void *buffer);
+
+#endif //PROTON_CHESS_POOL_H
@@ -0,0 +1,30 @@
+/**
+ * @file position_encoding.h
+ * @author Nathan Seymour
+ * @brief Dense position encoding: an occupancy bitmap and a four bit code
+ * per piece, 24 bytes at most for the board, with the castling rights, en
+ * passant square and side to move folded into the piece codes.
+ */
+
+#ifndef PROTON_CHESS_POSITION_ENCODING_H
+#define PROTON_CHESS_POSITION_ENCODING_H
+
+#include <stddef.h>
+
+/**
+ * Most pieces an encoded position can hold, those of a legal game.
+ */
+#define CB_POSITION_MAX_PIECES 32
+
+/**
+ * Largest encoded position: 8 bytes of occupancy, 16 of piece codes, up to
+ * 6 bytes of counters and 2 bytes of state that could not be folded.
+ */
+#define CB_POSITION_MAX_SIZE 32
+
+uchar cb_encode_position(chess_board *board, uchar data[CB_POSITION_MAX_SIZE]);
+uchar cb_decode_position(chess_board *board, const uchar *data, size_t size);
+size_t cb_encode_positions(chess_board *boards, size_t count, uchar *data);
+size_t cb_decode_positions(chess_board *boards, size_t count, const uchar *data, size_t size);
+
+#endif //PROTON_CHESS_POSITION_ENCODING_H
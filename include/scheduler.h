@@ -0,0 +1,142 @@
+/**
+ * @file scheduler.h
+ * @author Nathan Seymour
+ * @brief Analysis scheduler: a bounded queue of search jobs served by a
+ * pool of worker threads sharing one transposition table.
+ */
+
+#ifndef PROTON_CHESS_SCHEDULER_H
+#define PROTON_CHESS_SCHEDULER_H
+
+#include "search.h"
+#include "pcthreads.h"
+
+/**
+ * Most workers a scheduler can run, and so most threads a job can use.
+ */
+#define CB_SCHEDULER_MAX_WORKERS 64
+
+/**
+ * @defgroup analysis-statuses Analysis Statuses
+ * How an analysis job ended, as given to the analysis callback.
+ */
+///@{
+#define CB_ANALYSIS_DONE        0x0     /* The limits of the job were reached */
+#define CB_ANALYSIS_EXPIRED     0x1     /* The deadline passed before the job could start */
+#define CB_ANALYSIS_CANCELLED   0x2     /* Cancelled, the result holds what was searched */
+///@}
+
+/**
+ * An analysis job. The search limits apply as in cb_search, except that
+ * infinite and ponder searches are not allowed: nothing would stop them.
+ */
+typedef struct {
+    chess_board board;
+    cb_search_limits limits;
+
+    /**
+     * Milliseconds from submission by which the result is needed, 0 for
+     * none. A job not started by then is dropped; a running job is given
+     * at most the time left, after its first depth.
+     */
+    unsigned long deadline_ms;
+
+    /**
+     * Jobs of higher priority are started first. Among jobs of the same
+     * priority, the earliest deadline is started first, then the oldest.
+     */
+    uchar priority;
+
+    /**
+     * Most workers searching the job together, 1 if 0. Helpers are only
+     * given to a job when no queued job is waiting for a worker.
+     */
+    uchar threads;
+
+    /**
+     * Given back to the analysis callback.
+     */
+    void *user_data;
+} cb_analysis_request;
+
+/**
+ * Called once per job when the job ends, from a worker thread (or from the
+ * thread cancelling or submitting, for jobs that never started). The result
+ * is only valid during the call, and is empty for jobs that never started.
+ */
+typedef void (*cb_analysis_callback)(const cb_analysis_request *request, uchar status, const cb_search_result *result);
+
+typedef struct {
+    cb_analysis_request request;
+    unsigned long id;
+
+    /**
+     * Absolute deadline, on the clock of the scheduler. ULONG_MAX for none.
+     */
+    unsigned long deadline;
+
+    /**
+     * Workers searching the job, the first one being its main worker.
+     */
+    uchar worker_count;
+    uchar finished;
+    uchar cancelled;
+    cb_searcher *main_searcher;
+    cb_search_result result;
+} cb_analysis_job;
+
+struct cb_scheduler;
+
+typedef struct {
+    struct cb_scheduler *scheduler;
+    pcthread thread;
+    cb_searcher *searcher;
+
+    /**
+     * Job being searched, NULL while idle.
+     */
+    cb_analysis_job *job;
+} cb_analysis_worker;
+
+/**
+ * All the fields are protected by the mutex.
+ */
+typedef struct cb_scheduler {
+    cb_transposition_table *table;
+    cb_analysis_callback callback;
+
+    pcthread_mutex mutex;
+    pcthread_condition work_available;
+    pcthread_condition job_changed;
+
+    cb_analysis_worker workers[CB_SCHEDULER_MAX_WORKERS];
+    uchar worker_count;
+
+    /**
+     * Jobs, queued or running. Free ones are listed in free_jobs.
+     */
+    cb_analysis_job *jobs;
+    cb_analysis_job **free_jobs;
+    size_t free_job_count;
+
+    /**
+     * Binary heap of the queued jobs, the next one to start first.
+     */
+    cb_analysis_job **queue;
+    size_t queue_count;
+    size_t queue_capacity;
+
+    size_t job_capacity;
+    unsigned long next_id;
+    int shutting_down;
+} cb_scheduler;
+
+#ifdef DYNAMIC_MEMORY_ALLOCATION
+int cb_initialize_scheduler(cb_scheduler *scheduler, cb_transposition_table *table, uchar worker_count, size_t queue_capacity, cb_analysis_callback callback);
+void cb_free_scheduler(cb_scheduler *scheduler);
+unsigned long cb_submit_analysis(cb_scheduler *scheduler, const cb_analysis_request *request);
+int cb_cancel_analysis(cb_scheduler *scheduler, unsigned long id);
+void cb_wait_for_analyses(cb_scheduler *scheduler);
+#endif
+
+#endif //PROTON_CHESS_SCHEDULER_H
@@ -0,0 +1,235 @@
+/**
+ * @file search.h
+ * @author Nathan Seymour
+ * @brief Alpha-beta search of the best moves of a position.
+ */
+
+#ifndef PROTON_CHESS_SEARCH_H
+#define PROTON_CHESS_SEARCH_H
+
+#include "history.h"
+#include "legality.h"
+#include "evaluation.h"
+#include "transposition.h"
+
+#ifdef NNUE_EVALUATION
+#include "nnue.h"
+#endif
+
+/**
+ * Deepest ply the search can reach, quiescence included. The memory of a
+ * searcher grows linearly with it; it can be lowered for small targets, as
+ * long as the whole build agrees on its value.
+ */
+#ifndef CB_MAX_PLY
+#define CB_MAX_PLY 64
+#endif
+
+/**
+ * Most principal variations a MultiPV search can return.
+ */
+#define CB_MAX_MULTI_PV 16
+
+#define CB_INFINITE_SCORE 32000
+
+/**
+ * Score of a mate at the root. Mate in n plies scores CB_MATE_SCORE - n for
+ * the mating side, and the opposite for the mated side.
+ */
+#define CB_MATE_SCORE 31000
+
+#define cb_is_mate_score(score) ((score) >= CB_MATE_SCORE - CB_MAX_PLY || (score) <= -(CB_MATE_SCORE - CB_MAX_PLY))
+
+/**
+ * When the search should stop. Zero means no limit, except for the depth,
+ * which is then limited by CB_MAX_PLY.
+ */
+typedef struct {
+    uchar depth;
+    unsigned long nodes;
+    unsigned long time_ms;
+
+    /**
+     * Number of best root moves to return, each with its own principal
+     * variation. 0 and 1 both return the best move only.
+     */
+    uchar multi_pv;
+
+    /**
+     * Search until cb_stop_search is called, ignoring every other limit.
+     * The result is only returned once stopped, even if the deepest
+     * depth was reached.
+     */
+    uchar infinite;
+
+    /**
+     * Search as if infinite until cb_ponder_hit is called, from when the
+     * other limits apply, the time limit counting from the ponder hit.
+     */
+    uchar ponder;
+} cb_search_limits;
+
+typedef struct {
+    cb_move moves[CB_MAX_PLY];
+    uchar length;
+
+    /**
+     * Centipawns from the point of view of the side to move at the root.
+     */
+    int score;
+} cb_principal_variation;
+
+typedef struct {
+    /**
+     * Best lines, best first. lines[0].moves[0] is the move to play.
+     */
+    cb_principal_variation lines[CB_MAX_MULTI_PV];
+    uchar line_count;
+
+    /**
+     * Depth of the last iteration that was completed.
+     */
+    uchar depth;
+
+    unsigned long nodes;
+    unsigned long time_ms;
+
+    /**
+     * 1 if the search returned because of cb_stop_search rather than its
+     * limits, which is always the case for infinite and ponder searches.
+     */
+    uchar stopped;
+} cb_search_result;
+
+/**
+ * @defgroup search-events Search Events
+ * Why a search callback is called.
+ */
+///@{
+#define CB_SEARCH_EVENT_DEPTH       0x0     /* A depth was completed, called once per line */
+#define CB_SEARCH_EVENT_PV_CHANGE   0x1     /* A new best root move was found within a depth */
+///@}
+
+/**
+ * Progress of a running search, as given to the search callback. The
+ * principal variation is only valid during the call.
+ */
+typedef struct {
+    uchar event;
+    uchar depth;
+
+    /**
+     * Index of the line, 0 for the best one.
+     */
+    uchar line;
+
+    int score;
+    const cb_move *pv;
+    uchar pv_length;
+
+    unsigned long nodes;
+    unsigned long nodes_per_second;
+    unsigned long time_ms;
+
+    /**
+     * Per mille of the transposition table used by this search.
+     */
+    ushort hashfull;
+} cb_search_info;
+
+/**
+ * Called by the search thread while searching. It should return quickly,
+ * the search waits for it.
+ */
+typedef void (*cb_search_callback)(const cb_search_info *info, void *user_data);
+
+/**
+ * Moves of a ply being searched, their ordering scores, and the attack map
+ * of the position, computed once for the check test and the moves.
+ */
+typedef struct {
+    cb_move_list moves;
+    int scores[CB_MAX_MOVES];
+    cb_attack_map attacks;
+} cb_search_frame;
+
+/**
+ * Everything a search needs besides the position. Each thread searching
+ * needs its own searcher; they can share a transposition table. The
+ * structure is large (about 280KB with the default CB_MAX_PLY, see the
+ * memory report of the build), allocate it accordingly.
+ */
+typedef struct {
+    cb_transposition_table *table;
+
+    /**
+     * Evaluator used at the leaves. Material by default, using the pawn
+     * table below. Can be switched to the NNUE evaluator by setting its
+     * type and network; the accumulator is then managed by the search.
+     */
+    cb_evaluator evaluator;
+    cb_pawn_hash_table pawn_table;
+#ifdef NNUE_EVALUATION
+    /**
+     * Accumulator of the position at each ply of the current line, each one
+     * computed from the one before it as the moves are made.
+     */
+    cb_nnue_accumulator accumulators[CB_MAX_PLY + 1];
+#endif
+
+    /**
+     * Positions of the game followed by the positions of the current line.
+     */
+    cb_position_history history;
+
+    cb_move killers[CB_MAX_PLY][2];
+    unsigned int history_scores[2][64][64];
+    cb_principal_variation pv[CB_MAX_PLY + 1];
+
+    /**
+     * Kept here rather than on the call stack, so that the recursion only
+     * uses a few bytes of stack per ply and the whole search fits in this
+     * structure.
+     */
+    cb_search_frame stack[CB_MAX_PLY + 1];
+    cb_move_list root_moves;
+    int root_scores[CB_MAX_MOVES];
+
+    /**
+     * Root moves already returned as a line of the current iteration.
+     */
+    cb_move excluded_root_moves[CB_MAX_MULTI_PV];
+    uchar excluded_root_move_count;
+
+    /**
+     * Optional progress reporting, NULL by default.
+     */
+    cb_search_callback callback;
+    void *callback_data;
+
+    cb_search_limits limits;
+    unsigned long nodes;
+    unsigned long start_ms;
+    uchar completed_depth;
+
+    /**
+     * Set once the search unwinds, to why it does.
+     */
+    int stopped;
+
+    /**
+     * Set from other threads by cb_stop_search and cb_ponder_hit.
+     */
+    int stop_requested;
+    int ponder_hit;
+    unsigned long ponder_hit_ms;
+} cb_searcher;
+
+void cb_initialize_searcher(cb_searcher *searcher, cb_transposition_table *table);
+void cb_set_search_callback(cb_searcher *searcher, cb_search_callback callback, void *user_data);
+void cb_search(cb_searcher *searcher, chess_board *board, cb_position_history *history, cb_search_limits *limits, cb_search_result *result);
+void cb_stop_search(cb_searcher *searcher);
+void cb_ponder_hit(cb_searcher *searcher);
+void cb_reset_search(cb_searcher *searcher);
+
+#endif //PROTON_CHESS_SEARCH_H
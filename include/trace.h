@@ -0,0 +1,204 @@
+/**
+ * @file trace.h
+ * @author Nathan Seymour
+ * @brief Search trace: a per-thread record of the last events of the
+ * search, compiled in with the SEARCH_TRACE CMake option.
+ *
+ * Every thread tracing gets its own ring buffer of fixed size, overwriting
+ * its oldest events once full (a buffer of n events holds the last n - 1).
+ * Only the owning thread writes its buffer, without any lock; other threads
+ * can copy the buffers at any time with cb_trace_snapshot or cb_trace_dump,
+ * without stopping the search. Events overwritten during the copy are left
+ * out of it.
+ *
+ * Reading the clock costs more than the rest of an event, so only the
+ * events entering a search, an iteration or a node read it. The other
+ * events carry the time of the last of those, node times having the
+ * resolution of a node.
+ *
+ * Nodes are recorded with their window on entry and their score on exit,
+ * in between the moves searched, the cutoffs and the transposition table
+ * hits and stores of the node, so that the tree can be rebuilt from the
+ * events (see tools/trace-export.c).
+ *
+ * Without SEARCH_TRACE the CB_TRACE macros expand to nothing, and no event
+ * is ever recorded.
+ */
+
+#ifndef PROTON_CHESS_TRACE_H
+#define PROTON_CHESS_TRACE_H
+
+#include <stddef.h>
+#include "base_types.h"
+#include "extensions.h"
+
+/**
+ * Maximum number of threads with their own buffer. Threads beyond that
+ * record nothing. Can be overridden at compile time.
+ */
+#ifndef CB_TRACE_MAX_THREADS
+#define CB_TRACE_MAX_THREADS 64
+#endif
+
+/**
+ * Events of the buffer given to each thread on its first event, a power of
+ * two. Can be overridden at compile time, or replaced with
+ * cb_trace_attach_thread.
+ */
+#ifndef CB_TRACE_EVENTS
+#define CB_TRACE_EVENTS (1 << 16)
+#endif
+
+/**
+ * Size of an event in a dump, see cb_trace_dump.
+ */
+#define CB_TRACE_EVENT_SIZE 16
+
+/**
+ * @defgroup trace-events Trace Events
+ * Types of the events, and the meaning of their argument and values.
+ */
+///@{
+#define CB_TRACE_SEARCH         0x1     /* Start of cb_search */
+#define CB_TRACE_ITERATION      0x2     /* Root search, argument depth, values line index */
+#define CB_TRACE_NODE           0x3     /* Node entry, argument depth, values alpha and beta */
+#define CB_TRACE_QUIESCENCE     0x4     /* Quiescence node entry, values alpha and beta */
+#define CB_TRACE_MOVE           0x5     /* Move searched, argument move, values alpha and beta */
+#define CB_TRACE_CUTOFF         0x6     /* Beta cutoff, argument move, values score and move index */
+#define CB_TRACE_EXIT           0x7     /* Node or root search exit, values score */
+#define CB_TRACE_TT_HIT         0x8     /* Table hit, argument move, values score and depth << 2 | bound */
+#define CB_TRACE_TT_STORE       0x9     /* Table store, argument move, values score and depth << 2 | bound */
+///@}
+
+/**
+ * An event, in 16 bytes. Moves are packed in the argument as the from
+ * square, the to square << 6 and the promotion piece type << 12.
+ *
+ * Events are copied in and out of the buffers as two 64-bit words, with
+ * atomic loads and stores, so that readers never see one torn.
+ */
+typedef struct {
+    uint64_t time_ns;
+    uchar type;
+    uchar ply;
+    uint16_t argument;
+    int16_t values[2];
+} cb_trace_event;
+
+typedef struct {
+    cb_trace_event *events;
+
+    /**
+     * Number of events minus one, the number of events being a power of
+     * two.
+     */
+    uint64_t mask;
+
+    /**
+     * Number of events ever recorded, the next one going to
+     * events[head & mask].
+     */
+    uint64_t head;
+
+    /**
+     * Time of the last event that read the clock, only used by the owning
+     * thread.
+     */
+    uint64_t time_ns;
+} cb_trace_buffer;
+
+#ifdef SEARCH_TRACE
+
+#include <string.h>
+#include <time.h>
+
+#ifndef CB_THREAD_LOCAL
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define CB_THREAD_LOCAL _Thread_local
+#else
+#define CB_THREAD_LOCAL __thread
+#endif
+#endif
+
+extern CB_THREAD_LOCAL cb_trace_buffer *cb_thread_trace;
+cb_trace_buffer *cb_claim_thread_trace(void);
+
+static inline uint64_t cb_trace_clock_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/*
+ * Single writer: the event is written, then published by moving the head
+ * on. The release fence orders the publication of the previous event
+ * before the new one overwrites its slot, for readers checking the head
+ * after their copy.
+ */
+static inline void cb_trace_record(uchar type, uchar ply, uint16_t argument, int value0, int value1)
+{
+    cb_trace_buffer *buffer = cb_thread_trace != NULL ? cb_thread_trace : cb_claim_thread_trace();
+    cb_trace_event event;
+    uint64_t words[2];
+    uint64_t head;
+
+    if(buffer->events == NULL)
+    {
+        return;
+    }
+
+    if(type <= CB_TRACE_QUIESCENCE)
+    {
+        buffer->time_ns = cb_trace_clock_ns();
+    }
+
+    event.time_ns = buffer->time_ns;
+    event.type = type;
+    event.ply = ply;
+    event.argument = argument;
+    event.values[0] = (int16_t)value0;
+    event.values[1] = (int16_t)value1;
+    memcpy(words, &event, sizeof(words));
+
+    head = __atomic_load_n(&buffer->head, __ATOMIC_RELAXED);
+    uint64_t *slot = (uint64_t*)&buffer->events[head & buffer->mask];
+
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&slot[0], words[0], __ATOMIC_RELAXED);
+    __atomic_store_n(&slot[1], words[1], __ATOMIC_RELAXED);
+    __atomic_store_n(&buffer->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Record an event of the calling thread, Ex: CB_TRACE(CB_TRACE_NODE, ply,
+ * depth, alpha, beta).
+ */
+#define CB_TRACE(type, ply, argument, value0, value1) cb_trace_record((type), (uchar)(ply), (uint16_t)(argument), (value0), (value1))
+
+/**
+ * Pack a move, Ex: CB_TRACE(CB_TRACE_MOVE, ply, CB_TRACE_PACK_MOVE(move), alpha, beta).
+ */
+#define CB_TRACE_PACK_MOVE(move) ((move)->from_square_index | (move)->to_square_index << 6 | ((move)->promotion_piece & 0x7) << 12)
+
+/**
+ * Return the score of a node, recording its exit, Ex:
+ * CB_TRACE_RETURN(ply, best_score).
+ */
+#define CB_TRACE_RETURN(ply, score) do { int cb_traced_score = (score); CB_TRACE(CB_TRACE_EXIT, ply, 0, cb_traced_score, 0); return cb_traced_score; } while(0)
+
+#else
+
+#define CB_TRACE(type, ply, argument, value0, value1) ((void)0)
+#define CB_TRACE_PACK_MOVE(move) 0
+#define CB_TRACE_RETURN(ply, score) return (score)
+
+#endif
+
+int cb_trace_attach_thread(void *memory, size_t size_in_bytes);
+unsigned int cb_trace_thread_count(void);
+size_t cb_trace_snapshot(unsigned int thread_index, cb_trace_event *events, size_t capacity);
+int cb_trace_dump(const char *path);
+
+#endif //PROTON_CHESS_TRACE_H
@@ -0,0 +1,71 @@
+/**
+ * @file transposition.h
+ * @author Nathan Seymour
+ * @brief Transposition table of the search, shared between threads.
+ */
+
+#ifndef PROTON_CHESS_TRANSPOSITION_H
+#define PROTON_CHESS_TRANSPOSITION_H
+
+#include <stddef.h>
+
+/**
+ * @defgroup bounds Bounds
+ * What the score of an entry means, depending on how the search of its
+ * position ended.
+ */
+///@{
+#define CB_BOUND_NONE   0x0
+#define CB_BOUND_UPPER  0x1     /* Every move failed low, the score is at most this */
+#define CB_BOUND_LOWER  0x2     /* A move failed high, the score is at least this */
+#define CB_BOUND_EXACT  0x3
+///@}
+
+/**
+ * Entries are two 64 bit words: the key XOR'd with the data, and the data.
+ * A thread reading an entry while another writes it sees a key that does
+ * not match, rather than the data of another position, so the table can be
+ * shared between threads without locks.
+ */
+typedef struct {
+    uint64_t key_check;
+    uint64_t data;
+} cb_tt_entry;
+
+typedef struct {
+    cb_tt_entry *entries;
+
+    /**
+     * Number of entries, a power of two.
+     */
+    size_t size;
+
+    /**
+     * Bumped at each new search, so that entries of older searches are
+     * replaced first.
+     */
+    uchar age;
+} cb_transposition_table;
+
+/**
+ * Contents of an entry, as returned by cb_tt_probe.
+ */
+typedef struct {
+    cb_move move;
+    short score;
+    uchar depth;
+    uchar bound;
+} cb_tt_data;
+
+int cb_attach_transposition_table(cb_transposition_table *table, void *memory, size_t size_in_bytes);
+#ifdef DYNAMIC_MEMORY_ALLOCATION
+int cb_initialize_transposition_table(cb_transposition_table *table, size_t size_in_bytes);
+void cb_free_transposition_table(cb_transposition_table *table);
+#endif
+void cb_clear_transposition_table(cb_transposition_table *table);
+void cb_tt_new_search(cb_transposition_table *table);
+int cb_tt_probe(cb_transposition_table *table, cb_hash_key key, cb_tt_data *data);
+void cb_tt_store(cb_transposition_table *table, cb_hash_key key, cb_move *move, short score, uchar depth, uchar bound);
+ushort cb_tt_hashfull(cb_transposition_table *table);
+
+#endif //PROTON_CHESS_TRANSPOSITION_H
@@ -0,0 +1,17 @@
+/**
+ * @file zobrist.h
+ * @author Nathan Seymour
+ * @brief Zobrist hashing of chess positions.
+ */
+
+#ifndef PROTON_CHESS_ZOBRIST_H
+#define PROTON_CHESS_ZOBRIST_H
+
+cb_hash_key cb_zobrist_piece_key(uchar piece_value, uchar square_index);
+cb_hash_key cb_zobrist_castling_key(uchar castling_rights);
+cb_hash_key cb_zobrist_ep_key(uchar ep_target_square_index);
+cb_hash_key cb_zobrist_side_key();
+cb_hash_key cb_zobrist_key(chess_board *board);
+cb_hash_key cb_zobrist_pawn_key(chess_board *board);
+
+#endif //PROTON_CHESS_ZOBRIST_H
@@ -1,8 +1,42 @@
-//
-// Created by Nathan Seymour on 30/12/20.
-//
+/**
+ * @file pcmem.h
+ * @author Nathan Seymour
+ * @brief Portable, cross-platform memory utilities for
+ * proton-chess.
+ */
 
 #ifndef PROTON_CHESS_PCMEM_H
 #define PROTON_CHESS_PCMEM_H
 
+#include <stddef.h>
+
+/**
+ * Size of a cache line on every platform we care about. Data written by
+ * different threads is kept at least this far apart to avoid false sharing.
+ */
+#define PCMEM_CACHE_LINE_SIZE 64
+
+/**
+ * Round a size up to a whole number of cache lines.
+ */
+#define pcmem_cache_line_round(size) (((size) + PCMEM_CACHE_LINE_SIZE - 1) & ~(size_t)(PCMEM_CACHE_LINE_SIZE - 1))
+
+/**
+ * A read-only view of a whole file. Depending on the platform, the file is
+ * either memory-mapped or read into an allocated buffer. With PCMEM_NO_HEAP
+ * defined, nothing is ever allocated: files can only be memory-mapped.
+ */
+typedef struct {
+    const void *data;
+    size_t size;
+    int is_mapped;
+} pcmem_file_mapping;
+
+#ifndef PCMEM_NO_HEAP
+void *pcmem_aligned_alloc(size_t size, size_t alignment);
+void pcmem_aligned_free(void *pointer);
+#endif
+int pcmem_map_file(pcmem_file_mapping *mapping, const char *path);
+void pcmem_unmap_file(pcmem_file_mapping *mapping);
+
 #endif //PROTON_CHESS_PCMEM_H
@@ -0,0 +1,165 @@
+/**
+ * @file pcmem.c
+ * @author Nathan Seymour
+ * @brief Portable utilities for working with memory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "pcmem.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define PCMEM_HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifndef PCMEM_NO_HEAP
+/**
+ * Allocate memory aligned on a power of two boundary. The pointer returned
+ * by malloc is stored right before the aligned block, so that this works
+ * wherever malloc does.
+ * @param size Number of bytes to allocate.
+ * @param alignment Alignment in bytes, a power of two.
+ * @return Aligned memory to release with pcmem_aligned_free, or NULL.
+ */
+void *pcmem_aligned_alloc(size_t size, size_t alignment)
+{
+    if(alignment < sizeof(void*))
+    {
+        alignment = sizeof(void*);
+    }
+
+    unsigned char *block = malloc(size + alignment + sizeof(void*));
+    if(block == NULL)
+    {
+        return NULL;
+    }
+
+    size_t address = (size_t)(block + sizeof(void*));
+    unsigned char *aligned = (unsigned char*)((address + alignment - 1) & ~(alignment - 1));
+    ((void**)aligned)[-1] = block;
+
+    return aligned;
+}
+
+/**
+ * Release memory allocated with pcmem_aligned_alloc.
+ * @param pointer Aligned pointer, may be NULL.
+ */
+void pcmem_aligned_free(void *pointer)
+{
+    if(pointer != NULL)
+    {
+        free(((void**)pointer)[-1]);
+    }
+}
+
+/**
+ * Read the whole file into a newly allocated buffer. Used where there is no
+ * mmap, and as a fallback when mapping fails.
+ */
+static int pcmem_read_file(pcmem_file_mapping *mapping, const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if(file == NULL)
+    {
+        return 0;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    void *buffer = size > 0 ? malloc((size_t)size) : NULL;
+    if(buffer == NULL || fread(buffer, 1, (size_t)size, file) != (size_t)size)
+    {
+        free(buffer);
+        fclose(file);
+        return 0;
+    }
+
+    fclose(file);
+
+    mapping->data = buffer;
+    mapping->size = (size_t)size;
+    mapping->is_mapped = 0;
+
+    return 1;
+}
+#endif
+
+/**
+ * Map a whole file read-only into memory.
+ * @param mapping Mapping object to fill.
+ * @param path Path of the file to map.
+ * @return 1 on success, 0 if the file could not be opened or read.
+ */
+int pcmem_map_file(pcmem_file_mapping *mapping, const char *path)
+{
+    mapping->data = NULL;
+    mapping->size = 0;
+    mapping->is_mapped = 0;
+
+#ifdef PCMEM_HAS_MMAP
+    int descriptor = open(path, O_RDONLY);
+    if(descriptor < 0)
+    {
+        return 0;
+    }
+
+    struct stat file_status;
+    if(fstat(descriptor, &file_status) == 0 && file_status.st_size > 0)
+    {
+        void *data = mmap(NULL, (size_t)file_status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if(data != MAP_FAILED)
+        {
+            close(descriptor);
+
+            mapping->data = data;
+            mapping->size = (size_t)file_status.st_size;
+            mapping->is_mapped = 1;
+
+            return 1;
+        }
+    }
+
+    close(descriptor);
+#endif
+
+#ifdef PCMEM_NO_HEAP
+    return 0;
+#else
+    return pcmem_read_file(mapping, path);
+#endif
+}
+
+/**
+ * Release a file mapping created by pcmem_map_file.
+ * @param mapping Mapping to release.
+ */
+void pcmem_unmap_file(pcmem_file_mapping *mapping)
+{
+    if(mapping->data == NULL)
+    {
+        return;
+    }
+
+#ifdef PCMEM_HAS_MMAP
+    if(mapping->is_mapped)
+    {
+        munmap((void*)mapping->data, mapping->size);
+    }
+#endif
+#ifndef PCMEM_NO_HEAP
+    if(!mapping->is_mapped)
+    {
+        free((void*)mapping->data);
+    }
+#endif
+
+    mapping->data = NULL;
+    mapping->size = 0;
+}
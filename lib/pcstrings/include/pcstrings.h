@@ -35,5 +35,7 @@
 
 uchar cb_read_uchar_from_string(const char *string, uchar start_index);
 uchar cb_uchar_to_string(uchar value, char *buffer, uchar buffer_size);
+ushort cb_read_ushort_from_string(const char *string, uchar start_index);
+uchar cb_ushort_to_string(ushort value, char *buffer, uchar buffer_size);
 
 #endif //PROTON_CHESS_PCSTRINGS_H
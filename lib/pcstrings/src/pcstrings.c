@@ -65,4 +65,54 @@ uchar cb_uchar_to_string(uchar value, char *buffer, uchar buffer_size)
     chars_used++;
 
     return chars_used;
-}
\ No newline at end of file
+}
+
+/**
+ * Read in a ushort number from a string, starting at a specific
+ * index, and return it.
+ * @param string String to scan the number from.
+ * @param start_index Index at which to start looking.
+ * @return Number found in the string. Zero is returned if no number is
+ * found.
+ */
+ushort cb_read_ushort_from_string(const char *string, uchar start_index)
+{
+    ushort number = 0;
+
+    for(uchar i = start_index; string[i] >= '0' && string[i] <= '9'; i++)
+    {
+        number = (ushort)(number * 10 + cb_single_char_to_int(string[i]));
+    }
+
+    return number;
+}
+
+/**
+ * Write a ushort as a null-terminated decimal string.
+ * @param value Value to write.
+ * @param buffer Buffer to write the string into.
+ * @param buffer_size Size of the buffer. 6 is always enough.
+ * @return Number of characters used, null terminator included.
+ */
+uchar cb_ushort_to_string(ushort value, char *buffer, uchar buffer_size)
+{
+    char digits[5];
+    uchar digit_count = 0;
+    uchar chars_used = 0;
+
+    do
+    {
+        digits[digit_count++] = (char)cb_single_int_to_char(value % 10);
+        value /= 10;
+    } while(value != 0);
+
+    while(digit_count > 0 && chars_used + 1 < buffer_size)
+    {
+        buffer[chars_used++] = digits[--digit_count];
+    }
+
+    buffer[chars_used] = '\0';
+    chars_used++;
+
+    return chars_used;
+}
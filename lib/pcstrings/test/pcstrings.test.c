@@ -39,6 +39,22 @@ TEST(cb_uchar_to_string)
         ASSERT_STR_EQ_MSG(string_buffer, "28", "Value should be 28.");
 }
 
+TEST(cb_ushort_to_string)
+{
+        char string_buffer[6];
+
+        ASSERT_EQ_MSG(cb_ushort_to_string(65535, string_buffer, 6), 6, "Five digits and a null terminator should be used.");
+        ASSERT_STR_EQ_MSG(string_buffer, "65535", "Value should be 65535.");
+
+        cb_ushort_to_string(0, string_buffer, 6);
+        ASSERT_STR_EQ_MSG(string_buffer, "0", "Value should be 0.");
+
+        cb_ushort_to_string(300, string_buffer, 6);
+        ASSERT_STR_EQ_MSG(string_buffer, "300", "Value should be 300.");
+
+        ASSERT_EQ_MSG(cb_read_ushort_from_string("move 1024", 5), 1024, "Value should be 1024.");
+}
+
 TEST(is_char_uppercase)
 {
     ASSERT_TRUE_MSG(is_char_uppercase('A'), "'A' is an uppercase letter.");
@@ -82,6 +98,7 @@ TEST_SUITE(PCStrings)
 {
         ADD_TEST(cb_read_uchar_from_string);
         ADD_TEST(cb_uchar_to_string);
+        ADD_TEST(cb_ushort_to_string);
         ADD_TEST(is_char_uppercase);
         ADD_TEST(is_char_lowercase);
         ADD_TEST(is_char_digit);
@@ -0,0 +1,65 @@
+/**
+ * @file pcthreads.h
+ * @author Nathan Seymour
+ * @brief Portable, cross-platform threading for proton-chess
+ * tools.
+ *
+ * Where threads are not available, threads are run to completion as soon
+ * as they are created, so that code written against this header still
+ * works, just sequentially.
+ */
+
+#ifndef PROTON_CHESS_PCTHREADS_H
+#define PROTON_CHESS_PCTHREADS_H
+
+#ifdef PCTHREADS_HAS_PTHREADS
+#include <pthread.h>
+#endif
+
+typedef void *(*pcthread_function)(void *argument);
+
+typedef struct {
+#ifdef PCTHREADS_HAS_PTHREADS
+    pthread_t handle;
+#endif
+    int started;
+} pcthread;
+
+/**
+ * Mutual exclusion lock. Without threads, locking does nothing.
+ */
+typedef struct {
+#ifdef PCTHREADS_HAS_PTHREADS
+    pthread_mutex_t handle;
+#endif
+    int initialized;
+} pcthread_mutex;
+
+/**
+ * Condition variable, always used with a mutex. Without threads, waiting
+ * returns at once: callers must wait in a loop checking their condition, as
+ * they should anyway because of spurious wake-ups.
+ */
+typedef struct {
+#ifdef PCTHREADS_HAS_PTHREADS
+    pthread_cond_t handle;
+#endif
+    int initialized;
+} pcthread_condition;
+
+int pcthread_create(pcthread *thread, pcthread_function function, void *argument);
+void pcthread_join(pcthread *thread);
+unsigned int pcthread_hardware_concurrency();
+
+int pcthread_mutex_init(pcthread_mutex *mutex);
+void pcthread_mutex_destroy(pcthread_mutex *mutex);
+void pcthread_mutex_lock(pcthread_mutex *mutex);
+void pcthread_mutex_unlock(pcthread_mutex *mutex);
+
+int pcthread_condition_init(pcthread_condition *condition);
+void pcthread_condition_destroy(pcthread_condition *condition);
+void pcthread_condition_wait(pcthread_condition *condition, pcthread_mutex *mutex);
+void pcthread_condition_signal(pcthread_condition *condition);
+void pcthread_condition_broadcast(pcthread_condition *condition);
+
+#endif //PROTON_CHESS_PCTHREADS_H
@@ -0,0 +1,160 @@
+/**
+ * @file pcthreads.c
+ * @author Nathan Seymour
+ * @brief Portable threading utilities.
+ */
+
+#include "pcthreads.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+/**
+ * Start a new thread.
+ * @param thread Thread object to initialize.
+ * @param function Function run by the thread.
+ * @param argument Argument passed to the function.
+ * @return 1 on success, 0 if the thread could not be created.
+ */
+int pcthread_create(pcthread *thread, pcthread_function function, void *argument)
+{
+#ifdef PCTHREADS_HAS_PTHREADS
+    thread->started = pthread_create(&thread->handle, NULL, function, argument) == 0;
+    return thread->started;
+#else
+    function(argument);
+    thread->started = 0;
+    return 1;
+#endif
+}
+
+/**
+ * Wait for a thread to finish.
+ * @param thread Thread to wait for.
+ */
+void pcthread_join(pcthread *thread)
+{
+#ifdef PCTHREADS_HAS_PTHREADS
+    if(thread->started)
+    {
+        pthread_join(thread->handle, NULL);
+        thread->started = 0;
+    }
+#endif
+}
+
+/**
+ * Get the number of hardware threads available.
+ * @return Number of online processors, at least 1.
+ */
+unsigned int pcthread_hardware_concurrency()
+{
+#if defined(_SC_NPROCESSORS_ONLN) && defined(PCTHREADS_HAS_PTHREADS)
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (unsigned int)count : 1;
+#else
+    return 1;
+#endif
+}
+
+/**
+ * Create a mutex.
+ * @param mutex Mutex to initialize.
+ * @return 1 on success, 0 if the mutex could not be created.
+ */
+int pcthread_mutex_init(pcthread_mutex *mutex)
+{
+#ifdef PCTHREADS_HAS_PTHREADS
+    mutex->initialized = pthread_mutex_init(&mutex->handle, NULL) == 0;
+#else
+    mutex->initialized = 1;
+#endif
+    return mutex->initialized;
+}
+
+/**
+ * Destroy a mutex, which must be unlocked.
+ * @param mutex Mutex created with pcthread_mutex_init.
+ */
+void pcthread_mutex_destroy(pcthread_mutex *mutex)
+{
+#ifdef PCTHREADS_HAS_PTHREADS
+    if(mutex->initialized)
+    {
+        pthread_mutex_destroy(&mutex->handle);
+    }
+#endif
+    mutex->initialized = 0;
+}
+
+void pcthread_mutex_lock(pcthread_mutex *mutex)
+{
+#ifdef PCTHREADS_HAS_PTHREADS
+    pthread_mutex_lock(&mutex->handle);
+#endif
+}
+
+void pcthread_mutex_unlock(pcthread_mutex *mutex)
+{
+#ifdef PCTHREADS_HAS_PTHREADS
+    pthread_mutex_unlock(&mutex->handle);
+#endif
+}
+
+/**
+ * Create a condition variable.
+ * @param condition Condition variable to initialize.
+ * @return 1 on success, 0 if it could not be created.
+ */
+int pcthread_condition_init(pcthread_condition *condition)
+{
+#ifdef PCTHREADS_HAS_PTHREADS
+    condition->initialized = pthread_cond_init(&condition->handle, NULL) == 0;
+#else
+    condition->initialized = 1;
+#endif
+    return condition->initialized;
+}
+
+/**
+ * Destroy a condition variable no thread is waiting on.
+ * @param condition Condition variable created with pcthread_condition_init.
+ */
+void pcthread_condition_destroy(pcthread_condition *condition)
+{
+#ifdef PCTHREADS_HAS_PTHREADS
+    if(condition->initialized)
+    {
+        pthread_cond_destroy(&condition->handle);
+    }
+#endif
+    condition->initialized = 0;
+}
+
+/**
+ * Release a locked mutex and wait to be woken up, locking it again before
+ * returning.
+ * @param condition Condition variable to wait on.
+ * @param mutex Mutex locked by the calling thread.
+ */
+void pcthread_condition_wait(pcthread_condition *condition, pcthread_mutex *mutex)
+{
+#ifdef PCTHREADS_HAS_PTHREADS
+    pthread_cond_wait(&condition->handle, &mutex->handle);
+#endif
+}
+
+void pcthread_condition_signal(pcthread_condition *condition)
+{
+#ifdef PCTHREADS_HAS_PTHREADS
+    pthread_cond_signal(&condition->handle);
+#endif
+}
+
+void pcthread_condition_broadcast(pcthread_condition *condition)
+{
+#ifdef PCTHREADS_HAS_PTHREADS
+    pthread_cond_broadcast(&condition->handle);
+#endif
+}
@@ -25,13 +25,19 @@
 #define PRINT(...) printf(__VA_ARGS__)
 #endif
 
-static char _has_error = 0;
-
 typedef struct {
     int result;
     int passed_assertions;
 } test_results;
 
+/**
+ * State of a test run, owned by the caller of RUN_SUITE so that the library
+ * keeps no state of its own and runs can happen on several threads.
+ */
+typedef struct {
+    int failed_tests;
+} test_runner;
+
 typedef void (*scpunitc_test)(test_results*);
 
 typedef struct {
@@ -50,7 +56,7 @@ typedef struct {
 #define ADD_TEST(test_name) \
     { \
         suite->tests_count++; \
-        if(suite->tests_allocated_size > suite->tests_count) \
+        if(suite->tests_count > suite->tests_allocated_size) \
         { \
             suite->tests_allocated_size += 5; \
             suite->tests = realloc(suite->tests, suite->tests_allocated_size * sizeof(scpunitc_test)); \
@@ -60,7 +66,7 @@ typedef struct {
         suite->test_names[suite->tests_count - 1] = #test_name; \
     }
 
-#define RUN_TEST(test_function, test_name) \
+#define RUN_TEST(runner, test_function, test_name) \
     {                       \
         test_results results;              \
         results.result = 0;                \
@@ -73,12 +79,12 @@ typedef struct {
         }                   \
         else                \
         {                   \
-            _has_error = 1; \
+            (runner)->failed_tests++; \
             PRINT("\t Test %s FAILED with code %i\n", test_name, results.result);\
         }\
     }
 
-#define RUN_SUITE(suite_name) \
+#define RUN_SUITE(runner, suite_name) \
     {                         \
         test_suite suite;     \
         suite.tests = malloc(5 * sizeof(scpunitc_test)); \
@@ -89,7 +95,7 @@ typedef struct {
         scpunitc_suite_##suite_name(&suite);   \
         for(int i = 0; i < suite.tests_count; i++) \
         {                     \
-            RUN_TEST(suite.tests[i], suite.test_names[i]); \
+            RUN_TEST(runner, suite.tests[i], suite.test_names[i]); \
         }                     \
         free(suite.tests);    \
         free(suite.test_names);\
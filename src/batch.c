@@ -0,0 +1,173 @@
+/**
+ * @file batch.c
+ * @author Nathan Seymour
+ * @brief Tools for applying moves to many chess boards at once.
+ *
+ * Replaying or validating thousands of games means applying one move to
+ * each of thousands of boards. Here the squares are updated through the
+ * inline accessors of board.h, which do not branch on the side of the byte
+ * with the nibble backend, and the boards of a pool are updated in place in
+ * their shard rather than copied out and back.
+ */
+
+#include <stddef.h>
+#include "chess.h"
+#include "zobrist.h"
+#include "legality.h"
+#include "movement.h"
+#include "pool.h"
+#include "batch.h"
+
+/*
+ * Move a piece on the squares of a board, straight through the inline
+ * accessors of the board backend. Sets the moved and captured pieces for
+ * the callers keeping keys.
+ */
+static uchar cb_batch_move_piece(cb_board_squares squares, cb_move *move, uchar *moved_piece, uchar *captured_piece)
+{
+    uchar from = move->from_square_index;
+    uchar to = move->to_square_index;
+
+    if(((from | to) & 0xC0) || from == to)
+    {
+        return CB_BATCH_INVALID_SQUARE;
+    }
+
+    uchar piece = cb_squares_get(squares, from);
+
+    if(piece == EMPTY_SQUARE)
+    {
+        return CB_BATCH_EMPTY_SQUARE;
+    }
+
+    *moved_piece = piece;
+    *captured_piece = cb_squares_get(squares, to);
+
+    cb_squares_set(squares, from, EMPTY_SQUARE);
+    cb_squares_set(squares, to, piece);
+
+    return CB_BATCH_MOVE_APPLIED;
+}
+
+static uchar cb_batch_make_legal_move(chess_board *board, cb_move *move)
+{
+    cb_move_undo undo;
+
+    if(((move->from_square_index | move->to_square_index) & 0xC0) || move->from_square_index == move->to_square_index)
+    {
+        return CB_BATCH_INVALID_SQUARE;
+    }
+
+    if(cb_board_get(board, move->from_square_index) == EMPTY_SQUARE)
+    {
+        return CB_BATCH_EMPTY_SQUARE;
+    }
+
+    if(!cb_is_move_legal(board, move))
+    {
+        return CB_BATCH_ILLEGAL_MOVE;
+    }
+
+    cb_make_move(board, move, &undo, NULL);
+    return CB_BATCH_MOVE_APPLIED;
+}
+
+/**
+ * Apply moves[i] to boards[i] for every board.
+ * @param boards Boards on which to apply the moves.
+ * @param moves One move per board.
+ * @param count Number of boards.
+ * @param flags CB_BATCH_DEFAULT or CB_BATCH_LEGAL_MOVES_ONLY.
+ * @param results If not NULL, receives the result of each move (Ex: CB_BATCH_MOVE_APPLIED).
+ * @return Number of moves that were applied.
+ */
+size_t cb_perform_movements(chess_board *boards, cb_move *moves, size_t count, uchar flags, uchar *results)
+{
+    size_t applied_count = 0;
+
+    for(size_t i = 0; i < count; i++)
+    {
+        uchar result;
+
+        if(flags & CB_BATCH_LEGAL_MOVES_ONLY)
+        {
+            result = cb_batch_make_legal_move(&boards[i], &moves[i]);
+        }
+        else
+        {
+            uchar moved_piece, captured_piece;
+            result = cb_batch_move_piece(boards[i].board, &moves[i], &moved_piece, &captured_piece);
+        }
+
+        applied_count += result == CB_BATCH_MOVE_APPLIED;
+
+        if(results != NULL)
+        {
+            results[i] = result;
+        }
+    }
+
+    return applied_count;
+}
+
+/**
+ * Apply moves[i] to the game of handles[i] for every handle. The Zobrist
+ * keys of the games are kept up to date.
+ * @param pool Pool the games belong to.
+ * @param handles Handles of the games on which to apply the moves.
+ * @param moves One move per game.
+ * @param count Number of games.
+ * @param flags CB_BATCH_DEFAULT or CB_BATCH_LEGAL_MOVES_ONLY.
+ * @param results If not NULL, receives the result of each move (Ex: CB_BATCH_INVALID_GAME).
+ * @return Number of moves that were applied.
+ */
+size_t cb_pool_perform_movements(cb_game_pool *pool, const cb_game_handle *handles, cb_move *moves, size_t count, uchar flags, uchar *results)
+{
+    size_t applied_count = 0;
+
+    for(size_t i = 0; i < count; i++)
+    {
+        uchar result;
+
+        if(!cb_pool_is_valid_game(pool, handles[i]))
+        {
+            result = CB_BATCH_INVALID_GAME;
+        }
+        else if(flags & CB_BATCH_LEGAL_MOVES_ONLY)
+        {
+            chess_board board;
+
+            cb_pool_load_board(pool, handles[i], &board);
+            result = cb_batch_make_legal_move(&board, &moves[i]);
+
+            if(result == CB_BATCH_MOVE_APPLIED)
+            {
+                cb_pool_store_board(pool, handles[i], &board);
+            }
+        }
+        else
+        {
+            cb_game_shard *shard = &pool->shards[cb_game_handle_shard(handles[i])];
+            uint32_t slot = cb_game_handle_slot(handles[i]);
+            uchar moved_piece, captured_piece;
+
+            result = cb_batch_move_piece(shard->boards[slot], &moves[i], &moved_piece, &captured_piece);
+
+            if(result == CB_BATCH_MOVE_APPLIED)
+            {
+                shard->keys[slot] ^= cb_zobrist_piece_key(moved_piece, moves[i].from_square_index)
+                                   ^ cb_zobrist_piece_key(moved_piece, moves[i].to_square_index)
+                                   ^ cb_zobrist_piece_key(captured_piece, moves[i].to_square_index);
+            }
+        }
+
+        applied_count += result == CB_BATCH_MOVE_APPLIED;
+
+        if(results != NULL)
+        {
+            results[i] = result;
+        }
+    }
+
+    return applied_count;
+}
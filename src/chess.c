@@ -10,7 +10,9 @@
 
 /**
  * Takes a coordinate index position and returns the notation
- * for the particular square.
+ * for the particular square. Not thread-safe: the notation is kept in a
+ * static buffer, overwritten by every call. Use
+ * cb_coordinate_index_to_notation_r where threads format squares.
  * @param coordinate_index Index of position to get notation of.
  * @return Null-terminated length 3 string of chess notation
  * for the particular square. Ex. "e2", "b8", etc.
@@ -19,6 +21,18 @@ char *cb_coordinate_index_to_notation(uchar coordinate_index)
 {
     static char notation[3];
 
+    return cb_coordinate_index_to_notation_r(coordinate_index, notation);
+}
+
+/**
+ * Reentrant cb_coordinate_index_to_notation, writing the notation of a
+ * square to a buffer owned by the caller.
+ * @param coordinate_index Index of position to get notation of.
+ * @param notation Buffer of at least 3 characters.
+ * @return The buffer, holding the null-terminated notation. Ex. "e2".
+ */
+char *cb_coordinate_index_to_notation_r(uchar coordinate_index, char notation[3])
+{
     uchar rank_id = coordinate_index / 8;
     uchar file_id = coordinate_index % 8;
 
@@ -37,38 +51,7 @@ char *cb_coordinate_index_to_notation(uchar coordinate_index)
  */
 uchar cb_get_board_value_at_square_index(chess_board* board, uchar square_index)
 {
-    /*
-     * The board is an array of bytes,
-     * which in our case is then a 1D array of the chess board
-     * as pairs of squares. This will allow us to select and replace
-     * the concerned square.
-     */
-    uchar concerned_byte = board->board[cb_square_index_to_container_index(square_index)];
-
-    /*
-     * The piece values are stored in four bits on either side of a
-     * single byte. So we are determining if we need to put the new
-     * piece value into the left or the right side of that byte. We
-     * do this by taking mod 2 of the square. 0 is left, and 1 is right.
-     *
-     * Left side
-     */
-    if(square_index % 2 == 0)
-    {
-        /*
-         * Then we can return the left side by shifting it into the right.
-         */
-        return concerned_byte >> 4;
-    }
-    // Right side
-    else
-    {
-        /*
-         * Then we can return the right side by applying the mask 0xF,
-         * which is equivalent to 0b0000 1111.
-         */
-        return concerned_byte & 0xF;
-    }
+    return cb_board_get(board, square_index);
 }
 
 /**
@@ -94,58 +77,7 @@ uchar cb_get_board_value_at(chess_board *board, uchar file, uchar rank)
  */
 void cb_set_board_value_at_square_index(chess_board *board, uchar square_index, uchar piece_value)
 {
-    /*
-     * The board is an array of bytes,
-     * which in our case is then a 1D array of the chess board
-     * as pairs of squares. This will allow us to select and replace
-     * the concerned square.
-     */
-    uchar concerned_byte = board->board[cb_square_index_to_container_index(square_index)];
-
-    /*
-     * The piece values are stored in four bits on either side of a
-     * single byte. So we are determining if we need to put the new
-     * piece value into the left or the right side of that byte. We
-     * do this by taking mod 2 of the square index. 0 is left, and 1 is right.
-     *
-     * Left side
-     */
-    if(square_index % 2 == 0)
-    {
-        /*
-         * First we bitshift out the side that we don't want.
-         * In this case that is the right side.
-         */
-        concerned_byte <<= 4;
-        concerned_byte >>= 4;
-
-        /*
-         * Now we can shift the new value to the left and bitwise-OR
-         * the two values together.
-         */
-        concerned_byte |= (piece_value << 4);
-    }
-    // Right side
-    else
-    {
-        /*
-         * First we bitshift out the side that we don't want.
-         * In this case that is the left side.
-         */
-        concerned_byte >>= 4;
-        concerned_byte <<= 4;
-
-        /*
-         * Now we can bitwise-OR the two values together. No need to
-         * shift, because the value is already on the right side.
-         */
-        concerned_byte |= piece_value;
-    }
-
-    /*
-     * Now we can set the new calculated square-pair value
-     */
-    board->board[cb_square_index_to_container_index(square_index)] = concerned_byte;
+    cb_board_set(board, square_index, piece_value);
 }
 
 /**
@@ -163,6 +95,42 @@ void cb_set_board_value_at(chess_board *board, uchar file, uchar rank, uchar pie
     cb_set_board_value_at_square_index(board, cb_square_index(file_id, rank_id), piece_value);
 }
 
+/**
+ * Write the squares of a board in the nibble layout (see board.h), as used
+ * by cb_initial_chess_position and .pcgpf files, whatever the backend.
+ * @param board Pointer to the board.
+ * @param packed_board Receives the 32 bytes of the board.
+ */
+void cb_pack_board(chess_board *board, uchar packed_board[32])
+{
+#if CB_BOARD_BACKEND == CB_BOARD_BACKEND_NIBBLE
+    memcpy(packed_board, board->board, 32);
+#else
+    for(uchar square_index = 0; square_index < 64; square_index += 2)
+    {
+        packed_board[square_index / 2] = (uchar)(cb_board_get(board, square_index) << 4 | cb_board_get(board, square_index + 1));
+    }
+#endif
+}
+
+/**
+ * Set the squares of a board from the nibble layout (see board.h).
+ * @param board Pointer to the board.
+ * @param packed_board 32 bytes of the board, Ex: cb_initial_chess_position.
+ */
+void cb_unpack_board(chess_board *board, const uchar packed_board[32])
+{
+#if CB_BOARD_BACKEND == CB_BOARD_BACKEND_NIBBLE
+    memcpy(board->board, packed_board, 32);
+#else
+    for(uchar square_index = 0; square_index < 64; square_index += 2)
+    {
+        cb_board_set(board, square_index, packed_board[square_index / 2] >> 4);
+        cb_board_set(board, square_index + 1, packed_board[square_index / 2] & 0xF);
+    }
+#endif
+}
+
 /**
  * Initialize a chess board to a standard game on turn 1. White to move.
  * Equivalent of FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1".
@@ -176,7 +144,7 @@ void cb_initialize_game(chess_board *board)
      * and I would like to keep the FEN extensions optional to reduce
      * binary size for certain embedded applications.
      */
-    memcpy(board->board, cb_initial_chess_position, 32);
+    cb_unpack_board(board, cb_initial_chess_position);
 
     // Set other standard values.
     board->move_counter = 0;
@@ -185,6 +153,7 @@ void cb_initialize_game(chess_board *board)
     board->ep_target_square_index = -1;
 }
 
+#ifdef DYNAMIC_MEMORY_ALLOCATION
 /**
  * Allocate and initialize a new chess board. IMPORTANT: Memory is allocated in this function...
  * you MUST call cb_free_chess_board when you are done with it to avoid memory leaks.
@@ -210,4 +179,5 @@ chess_board *cb_new_chess_board()
 void cb_free_chess_board(chess_board *board)
 {
     free(board);
-}
\ No newline at end of file
+}
+#endif
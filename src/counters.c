@@ -0,0 +1,107 @@
+/**
+ * @file counters.c
+ * @author Nathan Seymour
+ * @brief Per-thread counters of the hot paths.
+ */
+
+#include <string.h>
+#include "counters.h"
+#include "pcmem.h"
+
+#ifdef HOT_PATH_COUNTERS
+
+/*
+ * Each block of counters is padded to a whole number of cache lines, and
+ * the array aligned on one, so that two blocks never share a line.
+ */
+typedef union {
+    cb_counters counters;
+    uchar padding[pcmem_cache_line_round(sizeof(cb_counters))];
+} cb_counter_block;
+
+static cb_counter_block cb_counter_blocks[CB_COUNTERS_MAX_THREADS] __attribute__((aligned(PCMEM_CACHE_LINE_SIZE)));
+static unsigned int cb_claimed_blocks = 0;
+
+CB_THREAD_LOCAL cb_counters *cb_thread_counters = NULL;
+
+/**
+ * Give the calling thread its block of counters. Called on the first count
+ * of every thread, through the CB_COUNT macros.
+ * @return Counters of the calling thread.
+ */
+cb_counters *cb_claim_thread_counters()
+{
+    unsigned int index = __atomic_fetch_add(&cb_claimed_blocks, 1, __ATOMIC_RELAXED);
+
+    if(index >= CB_COUNTERS_MAX_THREADS)
+    {
+        index = CB_COUNTERS_MAX_THREADS - 1;
+    }
+
+    cb_thread_counters = &cb_counter_blocks[index].counters;
+    return cb_thread_counters;
+}
+
+/**
+ * Number of threads that have counted something so far.
+ * @return Number of blocks of counters in use.
+ */
+unsigned int cb_counters_thread_count()
+{
+    unsigned int count = __atomic_load_n(&cb_claimed_blocks, __ATOMIC_RELAXED);
+    return count < CB_COUNTERS_MAX_THREADS ? count : CB_COUNTERS_MAX_THREADS;
+}
+
+/**
+ * Read the counters of one thread while it keeps running.
+ * @param thread_index Index of the thread, below cb_counters_thread_count.
+ * @param snapshot Receives the counters of the thread.
+ */
+void cb_counters_snapshot(unsigned int thread_index, cb_counters *snapshot)
+{
+    const uint64_t *counters = (const uint64_t*)&cb_counter_blocks[thread_index].counters;
+    uint64_t *values = (uint64_t*)snapshot;
+
+    for(size_t i = 0; i < sizeof(cb_counters) / sizeof(uint64_t); i++)
+    {
+        values[i] = __atomic_load_n(&counters[i], __ATOMIC_RELAXED);
+    }
+}
+
+#else
+
+unsigned int cb_counters_thread_count()
+{
+    return 0;
+}
+
+void cb_counters_snapshot(unsigned int thread_index, cb_counters *snapshot)
+{
+    (void)thread_index;
+    memset(snapshot, 0, sizeof(cb_counters));
+}
+
+#endif
+
+/**
+ * Sum the counters of every thread while they keep running.
+ * @param total Receives the sum of the counters.
+ */
+void cb_counters_aggregate(cb_counters *total)
+{
+    cb_counters snapshot;
+    uint64_t *totals = (uint64_t*)total;
+    const uint64_t *values = (const uint64_t*)&snapshot;
+
+    memset(total, 0, sizeof(cb_counters));
+
+    for(unsigned int thread_index = 0; thread_index < cb_counters_thread_count(); thread_index++)
+    {
+        cb_counters_snapshot(thread_index, &snapshot);
+
+        for(size_t i = 0; i < sizeof(cb_counters) / sizeof(uint64_t); i++)
+        {
+            totals[i] += values[i];
+        }
+    }
+}
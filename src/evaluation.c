@@ -4,17 +4,22 @@
  * @brief Tools for evaluating advantage in chess positions.
  */
 
+#include <string.h>
 #include "chess.h"
 #include "evaluation.h"
+#include "zobrist.h"
 
 /**
  * Calculate the piece point value of white and black in a chess
  * position.
  * @param board Board to evaluation.
- * @param evaluation Pointer to evaluation object to modify.
+ * @param evaluation Pointer to evaluation object to fill.
  */
 void cb_board_point_evaluation(chess_board *board, cb_board_evaluation *evaluation)
 {
+    evaluation->black_points = 0;
+    evaluation->white_points = 0;
+
     for(uchar rank = 1; rank <= 8; rank++)
     {
         for(uchar file = 'A'; file <= 'H'; file++)
@@ -32,4 +37,373 @@ void cb_board_point_evaluation(chess_board *board, cb_board_evaluation *evaluati
             }
         }
     }
-}
\ No newline at end of file
+}
+
+/*
+ * Weights of the material evaluator, in centipawns. Passed pawn bonuses are
+ * indexed by the rank of the pawn as seen from its own side (0 is its back
+ * rank), pawn shield bonuses by the distance of the pawn to its king.
+ *
+ * These tables are tuned with the texel-tuner tool, which prints them in
+ * this exact form.
+ */
+static const short cb_piece_centipawn_values[7] = {0, 100, 300, 300, 500, 900, 0};
+static const short cb_passed_pawn_bonus[8] = {0, 5, 10, 20, 35, 60, 100, 0};
+static const short cb_isolated_pawn_penalty = 15;
+static const short cb_doubled_pawn_penalty = 12;
+static const short cb_backward_pawn_penalty = 10;
+static const short cb_pawn_shield_bonus[2] = {12, 6};
+
+#define NO_PAWN_ON_FILE 0xF
+
+/**
+ * Mirror a bitmask of ranks, so that the ranks of a black pawn file can be
+ * treated as if it was a white one.
+ */
+static uchar cb_mirror_ranks(uchar ranks)
+{
+    ranks = (uchar)((ranks & 0xF0) >> 4 | (ranks & 0x0F) << 4);
+    ranks = (uchar)((ranks & 0xCC) >> 2 | (ranks & 0x33) << 2);
+    return (uchar)((ranks & 0xAA) >> 1 | (ranks & 0x55) << 1);
+}
+
+static uchar cb_count_ranks(uchar ranks)
+{
+    uchar count = 0;
+    for(; ranks; ranks &= ranks - 1)
+    {
+        count++;
+    }
+    return count;
+}
+
+/**
+ * Score the pawns of one side. Both file arrays hold a bitmask of the ranks
+ * occupied by pawns, seen from the side being scored (bit 0 is its back rank).
+ * @param own Pawns of the side being scored.
+ * @param enemy Pawns of the opponent.
+ * @param rearmost_rank Filled with the rank of the rearmost own pawn on each file.
+ * @param coefficients If not NULL, the number of times each term applies is
+ * added to it, multiplied by sign.
+ * @param sign 1 for white, -1 for black.
+ * @return Pawn structure score of the side.
+ */
+static short cb_score_pawn_files(const uchar own[8], const uchar enemy[8], uchar rearmost_rank[8], signed char *coefficients, signed char sign)
+{
+    short score = 0;
+
+    for(uchar file = 0; file < 8; file++)
+    {
+        uchar adjacent_own = (uchar)((file > 0 ? own[file - 1] : 0) | (file < 7 ? own[file + 1] : 0));
+        uchar adjacent_enemy = (uchar)((file > 0 ? enemy[file - 1] : 0) | (file < 7 ? enemy[file + 1] : 0));
+        uchar pawns = own[file];
+
+        rearmost_rank[file] = NO_PAWN_ON_FILE;
+        if(pawns == 0)
+        {
+            continue;
+        }
+
+        uchar count = cb_count_ranks(pawns);
+        score -= (short)((count - 1) * cb_doubled_pawn_penalty);
+        if(coefficients != NULL)
+        {
+            coefficients[CB_EVAL_DOUBLED_PAWN] -= (signed char)(sign * (count - 1));
+        }
+
+        for(uchar rank = 0; rank < 8; rank++)
+        {
+            if(!(pawns & (1 << rank)))
+            {
+                continue;
+            }
+
+            if(rearmost_rank[file] == NO_PAWN_ON_FILE)
+            {
+                rearmost_rank[file] = rank;
+            }
+
+            uchar ranks_ahead = (uchar)(0xFF << (rank + 1));
+
+            if(((adjacent_enemy | enemy[file]) & ranks_ahead) == 0)
+            {
+                score += cb_passed_pawn_bonus[rank];
+                if(coefficients != NULL)
+                {
+                    coefficients[CB_EVAL_PASSED_PAWN + rank] += sign;
+                }
+            }
+
+            if(adjacent_own == 0)
+            {
+                score -= cb_isolated_pawn_penalty;
+                if(coefficients != NULL)
+                {
+                    coefficients[CB_EVAL_ISOLATED_PAWN] -= sign;
+                }
+            }
+            /*
+             * Backward: every friendly pawn on the neighbouring files is
+             * further advanced, and the square in front is held by an enemy pawn.
+             */
+            else if((adjacent_own & (uchar)~ranks_ahead) == 0 && rank < 6 && (adjacent_enemy & (1 << (rank + 2))))
+            {
+                score -= cb_backward_pawn_penalty;
+                if(coefficients != NULL)
+                {
+                    coefficients[CB_EVAL_BACKWARD_PAWN] -= sign;
+                }
+            }
+        }
+    }
+
+    return score;
+}
+
+/**
+ * Compute the pawn structure terms that do not depend on anything else than
+ * the pawns themselves.
+ */
+static void cb_compute_pawn_hash_entry(chess_board *board, cb_pawn_hash_entry *entry, signed char *coefficients)
+{
+    uchar white_files[8] = {0};
+    uchar black_files[8] = {0};
+
+    for(uchar square_index = 0; square_index < 64; square_index++)
+    {
+        uchar piece = cb_board_get(board, square_index);
+
+        if(piece == (WHITE | PAWN))
+        {
+            white_files[square_index % 8] |= (uchar)(1 << (square_index / 8));
+        }
+        else if(piece == (BLACK | PAWN))
+        {
+            black_files[square_index % 8] |= (uchar)(1 << (square_index / 8));
+        }
+    }
+
+    entry->white_score = cb_score_pawn_files(white_files, black_files, entry->white_rearmost_rank, coefficients, 1);
+
+    for(uchar file = 0; file < 8; file++)
+    {
+        white_files[file] = cb_mirror_ranks(white_files[file]);
+        black_files[file] = cb_mirror_ranks(black_files[file]);
+    }
+
+    entry->black_score = cb_score_pawn_files(black_files, white_files, entry->black_rearmost_rank, coefficients, -1);
+}
+
+/**
+ * Bonus for the pawns sheltering a king, as long as the king is still on
+ * one of its two back ranks.
+ */
+static short cb_king_shield_score(const uchar rearmost_rank[8], uchar king_file, uchar king_rank, signed char *coefficients, signed char sign)
+{
+    short score = 0;
+
+    if(king_rank > 1)
+    {
+        return 0;
+    }
+
+    for(char file = (char)(king_file - 1); file <= king_file + 1; file++)
+    {
+        if(file < 0 || file > 7 || rearmost_rank[(uchar)file] == NO_PAWN_ON_FILE)
+        {
+            continue;
+        }
+
+        uchar distance = (uchar)(rearmost_rank[(uchar)file] - king_rank);
+        if(rearmost_rank[(uchar)file] > king_rank && distance <= 2)
+        {
+            score += cb_pawn_shield_bonus[distance - 1];
+            if(coefficients != NULL)
+            {
+                coefficients[CB_EVAL_PAWN_SHIELD + distance - 1] += sign;
+            }
+        }
+    }
+
+    return score;
+}
+
+/**
+ * Empty a pawn hash table. Must be called before the table is first used.
+ * @param table Table to clear.
+ */
+void cb_clear_pawn_hash_table(cb_pawn_hash_table *table)
+{
+    memset(table, 0, sizeof(cb_pawn_hash_table));
+}
+
+/**
+ * Evaluate the pawn structure of a position: passed, isolated, doubled and
+ * backward pawns, and the pawn shield in front of each king.
+ *
+ * Everything but the king shelter only depends on the pawns, so it is looked
+ * up in the pawn hash table first and only computed on a miss.
+ * @param board Board to evaluate.
+ * @param table Pawn hash table owned by the calling thread, or NULL to
+ * always compute the evaluation.
+ * @param pawn_key Pawn key of the position, as given by cb_zobrist_pawn_key.
+ * @param evaluation Pointer to evaluation object to fill.
+ */
+void cb_pawn_structure_evaluation(chess_board *board, cb_pawn_hash_table *table, cb_hash_key pawn_key, cb_pawn_evaluation *evaluation)
+{
+    cb_pawn_hash_entry local_entry;
+    cb_pawn_hash_entry *entry = &local_entry;
+
+    if(table != NULL)
+    {
+        entry = &table->entries[pawn_key & (CB_PAWN_HASH_ENTRIES - 1)];
+        table->probes++;
+
+        /*
+         * A zeroed entry is only valid for the key 0, which is the key of a
+         * position without pawns. Its scores are indeed all zero.
+         */
+        if(entry->key == pawn_key && (pawn_key != 0 || entry->white_rearmost_rank[0] == NO_PAWN_ON_FILE))
+        {
+            table->hits++;
+        }
+        else
+        {
+            cb_compute_pawn_hash_entry(board, entry, NULL);
+            entry->key = pawn_key;
+        }
+    }
+    else
+    {
+        cb_compute_pawn_hash_entry(board, entry, NULL);
+    }
+
+    evaluation->white_score = entry->white_score;
+    evaluation->black_score = entry->black_score;
+
+    // King shelter depends on the kings, which are not part of the pawn key.
+    for(uchar square_index = 0; square_index < 64; square_index++)
+    {
+        uchar piece = cb_board_get(board, square_index);
+
+        if(piece == (WHITE | KING))
+        {
+            evaluation->white_score += cb_king_shield_score(entry->white_rearmost_rank, square_index % 8, square_index / 8, NULL, 1);
+        }
+        else if(piece == (BLACK | KING))
+        {
+            evaluation->black_score += cb_king_shield_score(entry->black_rearmost_rank, square_index % 8, 7 - square_index / 8, NULL, -1);
+        }
+    }
+}
+
+
+/**
+ * Initialize an evaluator with no pawn hash table and no network attached.
+ * @param evaluator Evaluator to initialize.
+ * @param type One of the evaluators, Ex: CB_EVALUATOR_MATERIAL.
+ */
+void cb_initialize_evaluator(cb_evaluator *evaluator, uchar type)
+{
+    evaluator->type = type;
+    evaluator->pawn_table = NULL;
+
+#ifdef NNUE_EVALUATION
+    evaluator->network = NULL;
+    evaluator->accumulator = NULL;
+#endif
+}
+
+/**
+ * Evaluate a position with the evaluator selected at runtime. When the NNUE
+ * evaluator is selected but no network is attached (or NNUE_EVALUATION is
+ * disabled), the material evaluator is used instead.
+ * @param board Board to evaluate.
+ * @param evaluator Evaluator to use.
+ * @return Evaluation in centipawns, from the point of view of the side to move.
+ */
+int cb_evaluate(chess_board *board, cb_evaluator *evaluator)
+{
+    uchar side_to_move = board->move_counter % 2 == 0 ? WHITE : BLACK;
+
+#ifdef NNUE_EVALUATION
+    if(evaluator->type == CB_EVALUATOR_NNUE && evaluator->network != NULL && evaluator->accumulator != NULL)
+    {
+        return cb_nnue_evaluate(evaluator->network, evaluator->accumulator, side_to_move);
+    }
+#endif
+
+    cb_pawn_evaluation pawns;
+    cb_pawn_structure_evaluation(board, evaluator->pawn_table, cb_zobrist_pawn_key(board), &pawns);
+
+    int score = pawns.white_score - pawns.black_score;
+    for(uchar square_index = 0; square_index < 64; square_index++)
+    {
+        uchar piece = cb_board_get(board, square_index);
+        short piece_value = cb_piece_centipawn_values[piece & COLOR_MASK];
+
+        score += (piece & BLACK) ? -piece_value : piece_value;
+    }
+
+    return side_to_move == WHITE ? score : -score;
+}
+
+
+/**
+ * Get the current weights of the material evaluator, in the order of the
+ * evaluation parameter indices (Ex: CB_EVAL_PASSED_PAWN).
+ * @param parameters Array to fill with the weights.
+ */
+void cb_evaluation_parameters(short parameters[CB_EVAL_PARAMETER_COUNT])
+{
+    for(uchar i = 0; i < 5; i++)
+    {
+        parameters[CB_EVAL_PIECE_VALUES + i] = cb_piece_centipawn_values[PAWN + i];
+    }
+
+    for(uchar i = 0; i < 8; i++)
+    {
+        parameters[CB_EVAL_PASSED_PAWN + i] = cb_passed_pawn_bonus[i];
+    }
+
+    parameters[CB_EVAL_ISOLATED_PAWN] = cb_isolated_pawn_penalty;
+    parameters[CB_EVAL_DOUBLED_PAWN] = cb_doubled_pawn_penalty;
+    parameters[CB_EVAL_BACKWARD_PAWN] = cb_backward_pawn_penalty;
+    parameters[CB_EVAL_PAWN_SHIELD] = cb_pawn_shield_bonus[0];
+    parameters[CB_EVAL_PAWN_SHIELD + 1] = cb_pawn_shield_bonus[1];
+}
+
+/**
+ * Decompose the material evaluation of a position into the number of times
+ * each weight applies, white minus black. Penalties count negatively. The
+ * white-relative evaluation is then the dot product of the coefficients with
+ * the parameters given by cb_evaluation_parameters.
+ * @param board Board to decompose.
+ * @param coefficients Array to fill with the coefficients.
+ */
+void cb_evaluation_coefficients(chess_board *board, signed char coefficients[CB_EVAL_PARAMETER_COUNT])
+{
+    cb_pawn_hash_entry entry;
+
+    memset(coefficients, 0, CB_EVAL_PARAMETER_COUNT);
+    cb_compute_pawn_hash_entry(board, &entry, coefficients);
+
+    for(uchar square_index = 0; square_index < 64; square_index++)
+    {
+        uchar piece = cb_board_get(board, square_index);
+        uchar piece_type = piece & COLOR_MASK;
+
+        if(piece_type >= PAWN && piece_type <= QUEEN)
+        {
+            coefficients[CB_EVAL_PIECE_VALUES + piece_type - PAWN] += (piece & BLACK) ? -1 : 1;
+        }
+        else if(piece == (WHITE | KING))
+        {
+            cb_king_shield_score(entry.white_rearmost_rank, square_index % 8, square_index / 8, coefficients, 1);
+        }
+        else if(piece == (BLACK | KING))
+        {
+            cb_king_shield_score(entry.black_rearmost_rank, square_index % 8, 7 - square_index / 8, coefficients, -1);
+        }
+    }
+}
@@ -0,0 +1,145 @@
+/**
+ * @file explorer.c
+ * @author Nathan Seymour
+ * @brief Opening explorer index files, memory-mapped and searched in place.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "chess.h"
+#include "zobrist.h"
+#include "explorer.h"
+
+/*
+ * Index header: the magic, a byte order mark and the number of entries.
+ * Entries are written as they are laid out in memory, files can only be
+ * read on machines of the same byte order, which the mark checks.
+ */
+#define EXPLORER_MAGIC "PCEXPLR1"
+#define EXPLORER_BYTE_ORDER_MARK 0x01020304
+#define EXPLORER_HEADER_SIZE 24
+
+typedef struct {
+    char magic[8];
+    uint32_t byte_order_mark;
+    uint32_t entry_size;
+    uint64_t count;
+} cb_explorer_header;
+
+/**
+ * Write an index file.
+ * @param path Path of the index to write.
+ * @param entries Entries of the index, sorted by key, then by decreasing
+ * number of games.
+ * @param count Number of entries.
+ * @return 1 on success, 0 if the file could not be written.
+ */
+int cb_write_explorer_index(const char *path, const cb_explorer_entry *entries, size_t count)
+{
+    cb_explorer_header header;
+    FILE *file = fopen(path, "wb");
+    int written;
+
+    if(file == NULL)
+    {
+        return 0;
+    }
+
+    memcpy(header.magic, EXPLORER_MAGIC, 8);
+    header.byte_order_mark = EXPLORER_BYTE_ORDER_MARK;
+    header.entry_size = sizeof(cb_explorer_entry);
+    header.count = count;
+
+    written = fwrite(&header, 1, EXPLORER_HEADER_SIZE, file) == EXPLORER_HEADER_SIZE
+              && fwrite(entries, sizeof(cb_explorer_entry), count, file) == count;
+
+    return fclose(file) == 0 && written;
+}
+
+/**
+ * Open an index file, memory-mapping it where possible.
+ * cb_close_explorer must be called when done.
+ * @param explorer Explorer to open.
+ * @param path Path of the index written by cb_write_explorer_index.
+ * @return 1 on success, 0 if the file is missing or not a valid index.
+ */
+int cb_open_explorer(cb_explorer *explorer, const char *path)
+{
+    cb_explorer_header header;
+
+    memset(explorer, 0, sizeof(cb_explorer));
+
+    if(!pcmem_map_file(&explorer->mapping, path))
+    {
+        return 0;
+    }
+
+    if(explorer->mapping.size >= EXPLORER_HEADER_SIZE)
+    {
+        memcpy(&header, explorer->mapping.data, EXPLORER_HEADER_SIZE);
+
+        if(memcmp(header.magic, EXPLORER_MAGIC, 8) == 0 && header.byte_order_mark == EXPLORER_BYTE_ORDER_MARK
+           && header.entry_size == sizeof(cb_explorer_entry)
+           && header.count <= (explorer->mapping.size - EXPLORER_HEADER_SIZE) / sizeof(cb_explorer_entry))
+        {
+            explorer->entries = (const cb_explorer_entry *)((const uchar *)explorer->mapping.data + EXPLORER_HEADER_SIZE);
+            explorer->count = (size_t)header.count;
+
+            return 1;
+        }
+    }
+
+    pcmem_unmap_file(&explorer->mapping);
+
+    return 0;
+}
+
+/**
+ * Close an index opened with cb_open_explorer. No query may be running.
+ * @param explorer Explorer to close.
+ */
+void cb_close_explorer(cb_explorer *explorer)
+{
+    pcmem_unmap_file(&explorer->mapping);
+    explorer->entries = NULL;
+    explorer->count = 0;
+}
+
+/**
+ * Find the moves played from a position, with a binary search of the
+ * index. Nothing is allocated or copied: the entries are read from the
+ * mapped file.
+ * @param explorer Opened explorer.
+ * @param board Position to look up.
+ * @param entries Receives the first entry of the position, most played move
+ * first, valid until the explorer is closed.
+ * @return Number of moves played from the position.
+ */
+size_t cb_explorer_query(const cb_explorer *explorer, chess_board *board, const cb_explorer_entry **entries)
+{
+    cb_hash_key key = cb_zobrist_key(board);
+    size_t low = 0;
+    size_t high = explorer->count;
+    size_t end;
+
+    // First entry whose key is not below the position's.
+    while(low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+
+        if(explorer->entries[middle].key < key)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    for(end = low; end < explorer->count && explorer->entries[end].key == key; end++);
+
+    *entries = explorer->entries + low;
+
+    return end - low;
+}
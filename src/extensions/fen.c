@@ -8,6 +8,7 @@
 #include <string.h>
 #include "chess.h"
 #include "pcstrings.h"
+#include "counters.h"
 
 /**
  * Parse Forsyth-Edwards notation into an initialized chess board.
@@ -38,13 +39,18 @@ void cb_parse_fen(chess_board *board, const char *fen)
             uchar empty_squares = cb_single_char_to_int(fen[fen_index]);
             for(uchar i = 0; i < empty_squares; i++)
             {
-                cb_set_board_value_at(board, file, rank, EMPTY_SQUARE);
+                cb_board_set(board, cb_square_index(cb_file_id(file), cb_rank_id(rank)), EMPTY_SQUARE);
                 file++;
             }
         }
+        else if((uchar)fen[fen_index] >= sizeof(cb_lookup_table) || cb_lookup_table[(uchar)fen[fen_index]] == 0)
+        {
+            CB_COUNT(parse_errors);
+            file++;
+        }
         else
         {
-            cb_set_board_value_at(board, file, rank, cb_lookup_table[fen[fen_index]]);
+            cb_board_set(board, cb_square_index(cb_file_id(file), cb_rank_id(rank)), cb_lookup_table[(uchar)fen[fen_index]]);
             file++;
         }
     }
@@ -99,12 +105,12 @@ void cb_parse_fen(chess_board *board, const char *fen)
 
     // Halfmove clock
     fen_index += 2;
-    board->halfmove_clock = cb_read_uchar_from_string(fen, fen_index);
+    board->halfmove_clock = cb_read_ushort_from_string(fen, fen_index);
 
     // Move counter
     for(; fen[fen_index] != ' '; fen_index++); // scan to move counter
     fen_index++;
-    board->move_counter += cb_read_uchar_from_string(fen, fen_index) * 2;
+    board->move_counter += cb_read_ushort_from_string(fen, fen_index) * 2;
 }
 
 /**
@@ -124,7 +130,7 @@ void cb_generate_fen(chess_board *board, char *buffer, int buffer_size)
     {
         for(uchar file = 'A'; file <= 'H'; file++)
         {
-            uchar piece_value = cb_get_board_value_at(board, file, rank);
+            uchar piece_value = cb_board_get(board, cb_square_index(cb_file_id(file), cb_rank_id(rank)));
 
             if(piece_value == 0)
             {
@@ -214,7 +220,9 @@ void cb_generate_fen(chess_board *board, char *buffer, int buffer_size)
     // En passant square
     if(board->ep_target_square_index != (uchar)-1)
     {
-        memcpy(buffer + fen_index, cb_coordinate_index_to_notation(board->ep_target_square_index), 2);
+        char notation[3];
+
+        memcpy(buffer + fen_index, cb_coordinate_index_to_notation_r(board->ep_target_square_index, notation), 2);
         fen_index += 2;
     }
     else
@@ -226,8 +234,8 @@ void cb_generate_fen(chess_board *board, char *buffer, int buffer_size)
     fen_index++;
 
     // Halfmove clock
-    char move_buffer[4];
-    uchar chars_used = cb_uchar_to_string(board->halfmove_clock, move_buffer, 4);
+    char move_buffer[6];
+    uchar chars_used = cb_ushort_to_string(board->halfmove_clock, move_buffer, 6);
     memcpy(buffer + fen_index, move_buffer, chars_used);
     fen_index += chars_used - 1;
 
@@ -235,7 +243,7 @@ void cb_generate_fen(chess_board *board, char *buffer, int buffer_size)
     fen_index++;
 
     // Move counter
-    chars_used = cb_uchar_to_string( board->move_counter / 2, move_buffer, 4);
+    chars_used = cb_ushort_to_string(board->move_counter / 2, move_buffer, 6);
     memcpy(buffer + fen_index, move_buffer, chars_used);
     fen_index += chars_used - 1;
 }
\ No newline at end of file
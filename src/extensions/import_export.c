@@ -6,7 +6,39 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include "chess.h"
+#include "counters.h"
+
+/*
+ * '.pcgpf' record layout. The first 36 bytes are the original format, in
+ * which every counter was a single byte: move counter, castling rights, en
+ * passant square, halfmove clock and the 32 board bytes. The high bytes of
+ * the two counters follow, so that older files still load (with their
+ * counters' high bytes set to zero).
+ */
+#define PCGPF_LEGACY_RECORD_SIZE 36
+#define PCGPF_RECORD_SIZE 38
+
+static void cb_serialize_board(chess_board *board, uchar record[PCGPF_RECORD_SIZE])
+{
+    record[0] = (uchar)(board->move_counter & 0xFF);
+    record[1] = board->castling_rights;
+    record[2] = board->ep_target_square_index;
+    record[3] = (uchar)(board->halfmove_clock & 0xFF);
+    cb_pack_board(board, record + 4);
+    record[36] = (uchar)(board->move_counter >> 8);
+    record[37] = (uchar)(board->halfmove_clock >> 8);
+}
+
+static void cb_deserialize_board(chess_board *board, const uchar record[PCGPF_RECORD_SIZE])
+{
+    board->move_counter = (ushort)(record[0] | record[36] << 8);
+    board->castling_rights = record[1];
+    board->ep_target_square_index = record[2];
+    board->halfmove_clock = (ushort)(record[3] | record[37] << 8);
+    cb_unpack_board(board, record + 4);
+}
 
 /**
  * Write the binary contents of a chess board to the file at the provided
@@ -16,15 +48,18 @@
  * '.pcgpf' - DOT PROTON CHESS GAME POSITION FILE is the preferred extension.
  *
  * If you would like to save the contents of a chess board not to a file, but
- * somewhere else, you must simply copy the structure from memory.
+ * somewhere else, you must simply copy the structure from memory. Note that
+ * the file format does not depend on the layout of the structure.
  * @param board Pointer to the board to save.
  * @param path Path to save the chess position to.
  */
 void cb_write_board_to_file(chess_board *board, const char *path)
 {
     FILE *file = fopen(path, "wb");
+    uchar record[PCGPF_RECORD_SIZE];
 
-    fwrite(board, sizeof(chess_board), 1, file);
+    cb_serialize_board(board, record);
+    fwrite(record, 1, PCGPF_RECORD_SIZE, file);
 
     fclose(file);
 }
@@ -47,12 +82,27 @@ void cb_write_board_to_file(chess_board *board, const char *path)
 void cb_read_board_state_from_file(chess_board *board, const char *path)
 {
     FILE *file = fopen(path, "rb");
+    uchar record[PCGPF_RECORD_SIZE] = {0};
+
+    if(file == NULL)
+    {
+        CB_COUNT(parse_errors);
+        return;
+    }
 
-    fread(board, sizeof(chess_board), 1, file);
+    if(fread(record, 1, PCGPF_RECORD_SIZE, file) >= PCGPF_LEGACY_RECORD_SIZE)
+    {
+        cb_deserialize_board(board, record);
+    }
+    else
+    {
+        CB_COUNT(parse_errors);
+    }
 
     fclose(file);
 }
 
+#ifdef DYNAMIC_MEMORY_ALLOCATION
 /**
  * Import a chess board from a '.pcgpf' file, creating a new chess board
  * object.
@@ -73,4 +123,122 @@ chess_board *cb_import_board_from_file(const char *path)
     cb_read_board_state_from_file(board, path);
 
     return board;
-}
\ No newline at end of file
+}
+#endif
+
+/**
+ * Write a board as a '.pcgpf' record to an open file. A file can hold any
+ * number of records, one after the other, to be read back in order with
+ * cb_read_board_record.
+ * @param file File opened for binary writing.
+ * @param board Board to write.
+ * @return 1 on success, 0 if the record could not be written.
+ */
+int cb_write_board_record(FILE *file, chess_board *board)
+{
+    uchar record[PCGPF_RECORD_SIZE];
+
+    cb_serialize_board(board, record);
+
+    return fwrite(record, 1, PCGPF_RECORD_SIZE, file) == PCGPF_RECORD_SIZE;
+}
+
+/**
+ * Read the next '.pcgpf' record of an open file.
+ * @param file File opened for binary reading.
+ * @param board Board to load the record into.
+ * @return 1 if a record was read, 0 at the end of the file.
+ */
+int cb_read_board_record(FILE *file, chess_board *board)
+{
+    uchar record[PCGPF_RECORD_SIZE];
+    size_t size = fread(record, 1, PCGPF_RECORD_SIZE, file);
+
+    if(size != PCGPF_RECORD_SIZE)
+    {
+        if(size != 0)
+        {
+            CB_COUNT(parse_errors);
+        }
+        return 0;
+    }
+
+    cb_deserialize_board(board, record);
+
+    return 1;
+}
+
+/*
+ * '.pcpdb' (proton chess position database) entry layout: the Zobrist key
+ * of the position (8 bytes, little endian), its '.pcgpf' record, and the
+ * number of times the position occurs (4 bytes, little endian). Databases
+ * are sorted by key, with a single entry per key.
+ */
+#define PCPDB_ENTRY_SIZE (8 + PCGPF_RECORD_SIZE + 4)
+
+/**
+ * Write a position database entry to an open file. Entries must be written
+ * in increasing key order.
+ * @param file File opened for binary writing.
+ * @param key Zobrist key of the position.
+ * @param board Position.
+ * @param count Number of occurrences of the position.
+ * @return 1 on success, 0 if the entry could not be written.
+ */
+int cb_write_position_entry(FILE *file, cb_hash_key key, chess_board *board, uint32_t count)
+{
+    uchar entry[PCPDB_ENTRY_SIZE];
+
+    for(uchar i = 0; i < 8; i++)
+    {
+        entry[i] = (uchar)(key >> (8 * i));
+    }
+
+    cb_serialize_board(board, entry + 8);
+
+    for(uchar i = 0; i < 4; i++)
+    {
+        entry[8 + PCGPF_RECORD_SIZE + i] = (uchar)(count >> (8 * i));
+    }
+
+    return fwrite(entry, 1, PCPDB_ENTRY_SIZE, file) == PCPDB_ENTRY_SIZE;
+}
+
+/**
+ * Read the next position database entry of an open file.
+ * @param file File opened for binary reading.
+ * @param key Receives the Zobrist key of the position.
+ * @param board Receives the position.
+ * @param count Receives the number of occurrences of the position.
+ * @return 1 if an entry was read, 0 at the end of the file.
+ */
+int cb_read_position_entry(FILE *file, cb_hash_key *key, chess_board *board, uint32_t *count)
+{
+    uchar entry[PCPDB_ENTRY_SIZE];
+    size_t size = fread(entry, 1, PCPDB_ENTRY_SIZE, file);
+
+    if(size != PCPDB_ENTRY_SIZE)
+    {
+        if(size != 0)
+        {
+            CB_COUNT(parse_errors);
+        }
+        return 0;
+    }
+
+    *key = 0;
+    for(uchar i = 0; i < 8; i++)
+    {
+        *key |= (cb_hash_key)entry[i] << (8 * i);
+    }
+
+    cb_deserialize_board(board, entry + 8);
+
+    *count = 0;
+    for(uchar i = 0; i < 4; i++)
+    {
+        *count |= (uint32_t)entry[8 + PCGPF_RECORD_SIZE + i] << (8 * i);
+    }
+
+    return 1;
+}
@@ -0,0 +1,651 @@
+/**
+ * @file game_encoding.c
+ * @author Nathan Seymour
+ * @brief Compact game archives. A move is stored as its index among the
+ * legal moves of its position, sorted by from square, to square and
+ * promotion piece, so that the order does not depend on the move generator.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "chess.h"
+#include "counters.h"
+#include "legality.h"
+#include "movement.h"
+#include "game_encoding.h"
+
+/*
+ * Archive layout (every number little endian):
+ *
+ *  header   "PCGAMES1", the encoding, 7 reserved bytes
+ *  games    one record per game, see below
+ *  offsets  8 bytes per game, the offset of its record in the file
+ *  footer   the offset of the offset table (8 bytes), the number of games
+ *           (8 bytes), "PCGINDEX"
+ *
+ * Game record: flags (bit 0 set when the game does not start from the
+ * initial position), result, number of moves (2 bytes), the start position
+ * as a '.pcgpf' record when flagged, then the moves.
+ */
+#define GAMES_MAGIC "PCGAMES1"
+#define GAMES_INDEX_MAGIC "PCGINDEX"
+#define GAMES_HEADER_SIZE 16
+#define GAMES_FOOTER_SIZE 24
+#define GAME_RECORD_HEADER_SIZE 4
+#define GAME_START_RECORD_SIZE 38
+
+#define GAME_FLAG_CUSTOM_START 0x1
+
+// Range coder normalization threshold, a byte is shifted out below it.
+#define RANGE_TOP (1u << 24)
+
+/**
+ * Key of a move in the canonical order: from square, to square, then
+ * promotion piece. Also enough to rebuild the move.
+ */
+#define cb_move_key(move) ((ushort)((move)->from_square_index << 10 | (move)->to_square_index << 4 | ((move)->promotion_piece & COLOR_MASK)))
+
+typedef struct {
+    uint64_t low;
+    uint32_t range;
+    uchar cache;
+    size_t cache_size;
+    uchar *out;
+    size_t length;
+} cb_range_encoder;
+
+static void cb_write_le(uchar *bytes, uint64_t value, uchar size)
+{
+    for(uchar i = 0; i < size; i++)
+    {
+        bytes[i] = (uchar)(value >> (8 * i));
+    }
+}
+
+static uint64_t cb_read_le(const uchar *bytes, uchar size)
+{
+    uint64_t value = 0;
+
+    for(uchar i = 0; i < size; i++)
+    {
+        value |= (uint64_t)bytes[i] << (8 * i);
+    }
+
+    return value;
+}
+
+/*
+ * Sort the keys of the legal moves of a position, the canonical order.
+ * Lists are short, insertion sort does it.
+ */
+static uchar cb_sorted_move_keys(chess_board *board, ushort keys[CB_MAX_MOVES])
+{
+    cb_move_list moves;
+    uchar count = cb_generate_legal_moves(board, &moves);
+
+    for(uchar i = 0; i < count; i++)
+    {
+        ushort key = cb_move_key(&moves.moves[i]);
+        uchar j = i;
+
+        for(; j > 0 && keys[j - 1] > key; j--)
+        {
+            keys[j] = keys[j - 1];
+        }
+
+        keys[j] = key;
+    }
+
+    return count;
+}
+
+/*
+ * Range coder, with the carry propagation of LZMA. Every move index is
+ * coded with the same probability among the legal moves, which costs
+ * log2 of their number bits.
+ */
+static void cb_range_shift_low(cb_range_encoder *encoder)
+{
+    if((uint32_t)encoder->low < 0xFF000000u || (encoder->low >> 32) != 0)
+    {
+        uchar carry = (uchar)(encoder->low >> 32);
+        uchar byte = encoder->cache;
+
+        do
+        {
+            encoder->out[encoder->length++] = (uchar)(byte + carry);
+            byte = 0xFF;
+        } while(--encoder->cache_size != 0);
+
+        encoder->cache = (uchar)(encoder->low >> 24);
+    }
+
+    encoder->cache_size++;
+    encoder->low = (encoder->low & 0x00FFFFFFu) << 8;
+}
+
+static void cb_range_encode(cb_range_encoder *encoder, uint32_t index, uint32_t total)
+{
+    encoder->range /= total;
+    encoder->low += (uint64_t)index * encoder->range;
+
+    while(encoder->range < RANGE_TOP)
+    {
+        encoder->range <<= 8;
+        cb_range_shift_low(encoder);
+    }
+}
+
+static void cb_move_from_key(ushort key, cb_move *move)
+{
+    move->from_square_index = (uchar)(key >> 10);
+    move->to_square_index = (uchar)(key >> 4 & 0x3F);
+    move->promotion_piece = (uchar)(key & 0xF);
+}
+
+static uchar cb_cursor_byte(cb_game_cursor *cursor)
+{
+    return cursor->data < cursor->end ? *cursor->data++ : 0;
+}
+
+/**
+ * Find the index of a move among the legal moves of a position, in the
+ * canonical order.
+ * @param board Position the move is played from.
+ * @param move Move to find. A promotion without a piece is a queen promotion.
+ * @param move_count If not NULL, receives the number of legal moves.
+ * @return Index of the move, 0xFF if it is not legal.
+ */
+uchar cb_move_to_index(chess_board *board, cb_move *move, uchar *move_count)
+{
+    ushort keys[CB_MAX_MOVES];
+    uchar count = cb_sorted_move_keys(board, keys);
+    ushort key = cb_move_key(move);
+    uchar index = 0xFF;
+
+    for(uchar i = 0; i < count; i++)
+    {
+        if(keys[i] == key || ((move->promotion_piece & COLOR_MASK) == EMPTY_SQUARE && keys[i] == (key | QUEEN)))
+        {
+            index = i;
+        }
+    }
+
+    if(move_count != NULL)
+    {
+        *move_count = count;
+    }
+
+    return index;
+}
+
+/**
+ * Find the move at an index among the legal moves of a position, in the
+ * canonical order.
+ * @param board Position the move is played from.
+ * @param index Index given by cb_move_to_index.
+ * @param move Receives the move.
+ * @return 1 on success, 0 if the position has fewer legal moves.
+ */
+int cb_move_from_index(chess_board *board, uchar index, cb_move *move)
+{
+    ushort keys[CB_MAX_MOVES];
+
+    if(index >= cb_sorted_move_keys(board, keys))
+    {
+        return 0;
+    }
+
+    cb_move_from_key(keys[index], move);
+
+    return 1;
+}
+
+/*
+ * Make room for one more game offset and a record of a given size. Memory
+ * given with cb_use_game_writer_memory is never grown.
+ */
+static int cb_reserve_writer_memory(cb_game_writer *writer, size_t record_size)
+{
+    if(writer->count < writer->capacity && record_size <= writer->buffer_capacity)
+    {
+        return 1;
+    }
+
+#ifdef DYNAMIC_MEMORY_ALLOCATION
+    if(!writer->owns_memory)
+    {
+        return 0;
+    }
+
+    if(writer->count == writer->capacity)
+    {
+        size_t offsets_capacity = writer->capacity == 0 ? 1024 : writer->capacity * 2;
+        uint64_t *offsets = realloc(writer->offsets, offsets_capacity * sizeof(uint64_t));
+
+        if(offsets == NULL)
+        {
+            return 0;
+        }
+
+        writer->offsets = offsets;
+        writer->capacity = offsets_capacity;
+    }
+
+    if(writer->buffer_capacity < record_size)
+    {
+        uchar *buffer = realloc(writer->buffer, record_size);
+
+        if(buffer == NULL)
+        {
+            return 0;
+        }
+
+        writer->buffer = buffer;
+        writer->buffer_capacity = record_size;
+    }
+
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Create an archive. cb_close_game_writer must be called when done, the
+ * archive cannot be read before.
+ * @param writer Writer to open.
+ * @param path Path of the archive, '.pcgames' is the preferred extension.
+ * @param encoding CB_GAME_ENCODING_RAW or CB_GAME_ENCODING_RANGE.
+ * @return 1 on success, 0 if the file could not be created.
+ */
+int cb_open_game_writer(cb_game_writer *writer, const char *path, uchar encoding)
+{
+    uchar header[GAMES_HEADER_SIZE] = {0};
+
+    memset(writer, 0, sizeof(cb_game_writer));
+    writer->encoding = encoding;
+#ifdef DYNAMIC_MEMORY_ALLOCATION
+    writer->owns_memory = 1;
+#endif
+    writer->file = fopen(path, "wb");
+
+    if(writer->file == NULL)
+    {
+        return 0;
+    }
+
+    memcpy(header, GAMES_MAGIC, 8);
+    header[8] = encoding;
+
+    if(fwrite(header, 1, GAMES_HEADER_SIZE, writer->file) != GAMES_HEADER_SIZE)
+    {
+        fclose(writer->file);
+        writer->file = NULL;
+        return 0;
+    }
+
+    writer->position = GAMES_HEADER_SIZE;
+
+    return 1;
+}
+
+/**
+ * Make a writer use memory provided by the caller instead of allocating
+ * its own, as it must in builds without dynamic memory allocation. The
+ * memory must outlive the writer.
+ * @param writer Writer just opened, before any game is written.
+ * @param offsets Room for the offset of each game.
+ * @param offsets_capacity Most games the archive can hold.
+ * @param buffer Room for the record of a game.
+ * @param buffer_capacity Size of the buffer, CB_GAME_RECORD_MAX_SIZE(n)
+ * for games of up to n moves.
+ * @return 1 on success, 0 if games were already written.
+ */
+int cb_use_game_writer_memory(cb_game_writer *writer, uint64_t *offsets, size_t offsets_capacity, uchar *buffer, size_t buffer_capacity)
+{
+    if(writer->count > 0)
+    {
+        return 0;
+    }
+
+#ifdef DYNAMIC_MEMORY_ALLOCATION
+    if(writer->owns_memory)
+    {
+        free(writer->offsets);
+        free(writer->buffer);
+    }
+#endif
+
+    writer->owns_memory = 0;
+    writer->offsets = offsets;
+    writer->capacity = offsets_capacity;
+    writer->buffer = buffer;
+    writer->buffer_capacity = buffer_capacity;
+
+    return 1;
+}
+
+/**
+ * Append a game to an archive. Nothing is written if a move is illegal.
+ * @param writer Opened writer.
+ * @param start Position the game starts from.
+ * @param moves Moves of the game.
+ * @param move_count Number of moves.
+ * @param result One of the game results.
+ * @return 1 on success, 0 if a move is illegal or the game could not be written.
+ */
+int cb_write_game(cb_game_writer *writer, chess_board *start, cb_move *moves, ushort move_count, uchar result)
+{
+    chess_board board = *start;
+    chess_board initial;
+    uchar packed[32];
+    cb_range_encoder encoder;
+    size_t capacity = CB_GAME_RECORD_MAX_SIZE(move_count);
+    uchar *record;
+    size_t length = GAME_RECORD_HEADER_SIZE;
+
+    if(writer->file == NULL)
+    {
+        return 0;
+    }
+
+    if(!cb_reserve_writer_memory(writer, capacity))
+    {
+        return 0;
+    }
+
+    record = writer->buffer;
+    record[0] = 0;
+    record[1] = result;
+    cb_write_le(record + 2, move_count, 2);
+
+    cb_initialize_game(&initial);
+    cb_pack_board(start, packed);
+
+    if(memcmp(packed, cb_initial_chess_position, 32) != 0 || start->move_counter != initial.move_counter
+       || start->castling_rights != initial.castling_rights || start->ep_target_square_index != initial.ep_target_square_index
+       || start->halfmove_clock != initial.halfmove_clock)
+    {
+        record[0] |= GAME_FLAG_CUSTOM_START;
+        record[length++] = (uchar)(start->move_counter & 0xFF);
+        record[length++] = start->castling_rights;
+        record[length++] = start->ep_target_square_index;
+        record[length++] = (uchar)(start->halfmove_clock & 0xFF);
+        memcpy(record + length, packed, 32);
+        length += 32;
+        record[length++] = (uchar)(start->move_counter >> 8);
+        record[length++] = (uchar)(start->halfmove_clock >> 8);
+    }
+
+    encoder = (cb_range_encoder){0, 0xFFFFFFFFu, 0, 1, record + length, 0};
+
+    for(ushort i = 0; i < move_count; i++)
+    {
+        cb_move_undo undo;
+        uchar count;
+        uchar index = cb_move_to_index(&board, &moves[i], &count);
+
+        if(index == 0xFF)
+        {
+            return 0;
+        }
+
+        if(writer->encoding == CB_GAME_ENCODING_RANGE)
+        {
+            cb_range_encode(&encoder, index, count);
+        }
+        else
+        {
+            encoder.out[encoder.length++] = index;
+        }
+
+        cb_make_move(&board, &moves[i], &undo, NULL);
+    }
+
+    if(writer->encoding == CB_GAME_ENCODING_RANGE)
+    {
+        for(uchar i = 0; i < 5; i++)
+        {
+            cb_range_shift_low(&encoder);
+        }
+    }
+
+    length += encoder.length;
+
+    if(fwrite(record, 1, length, writer->file) != length)
+    {
+        return 0;
+    }
+
+    writer->offsets[writer->count++] = writer->position;
+    writer->position += length;
+
+    return 1;
+}
+
+/**
+ * Write the offset table of an archive and close it.
+ * @param writer Writer opened with cb_open_game_writer.
+ * @return 1 on success, 0 if the archive could not be completed.
+ */
+int cb_close_game_writer(cb_game_writer *writer)
+{
+    uchar bytes[GAMES_FOOTER_SIZE];
+    int written = writer->file != NULL;
+
+    for(size_t i = 0; written && i < writer->count; i++)
+    {
+        cb_write_le(bytes, writer->offsets[i], 8);
+        written = fwrite(bytes, 1, 8, writer->file) == 8;
+    }
+
+    cb_write_le(bytes, writer->position, 8);
+    cb_write_le(bytes + 8, writer->count, 8);
+    memcpy(bytes + 16, GAMES_INDEX_MAGIC, 8);
+
+    if(writer->file != NULL)
+    {
+        written = written && fwrite(bytes, 1, GAMES_FOOTER_SIZE, writer->file) == GAMES_FOOTER_SIZE;
+        written = fclose(writer->file) == 0 && written;
+    }
+
+#ifdef DYNAMIC_MEMORY_ALLOCATION
+    if(writer->owns_memory)
+    {
+        free(writer->offsets);
+        free(writer->buffer);
+    }
+#endif
+    memset(writer, 0, sizeof(cb_game_writer));
+
+    return written;
+}
+
+/**
+ * Open an archive, memory-mapping it where possible.
+ * cb_close_game_reader must be called when done.
+ * @param reader Reader to open.
+ * @param path Path of an archive written by a cb_game_writer.
+ * @return 1 on success, 0 if the file is missing or not a valid archive.
+ */
+int cb_open_game_reader(cb_game_reader *reader, const char *path)
+{
+    memset(reader, 0, sizeof(cb_game_reader));
+
+    if(!pcmem_map_file(&reader->mapping, path))
+    {
+        return 0;
+    }
+
+    if(reader->mapping.size >= GAMES_HEADER_SIZE + GAMES_FOOTER_SIZE)
+    {
+        const uchar *data = reader->mapping.data;
+        const uchar *footer = data + reader->mapping.size - GAMES_FOOTER_SIZE;
+        uint64_t table = cb_read_le(footer, 8);
+        uint64_t count = cb_read_le(footer + 8, 8);
+
+        if(memcmp(data, GAMES_MAGIC, 8) == 0 && memcmp(footer + 16, GAMES_INDEX_MAGIC, 8) == 0
+           && data[8] <= CB_GAME_ENCODING_RANGE && table >= GAMES_HEADER_SIZE
+           && count <= (reader->mapping.size - GAMES_FOOTER_SIZE) / 8
+           && table + count * 8 == reader->mapping.size - GAMES_FOOTER_SIZE)
+        {
+            reader->encoding = data[8];
+            reader->offsets = data + table;
+            reader->count = (size_t)count;
+
+            return 1;
+        }
+    }
+
+    CB_COUNT(parse_errors);
+    pcmem_unmap_file(&reader->mapping);
+
+    return 0;
+}
+
+/**
+ * Close an archive opened with cb_open_game_reader. Its cursors may not be
+ * used anymore.
+ * @param reader Reader to close.
+ */
+void cb_close_game_reader(cb_game_reader *reader)
+{
+    pcmem_unmap_file(&reader->mapping);
+    reader->offsets = NULL;
+    reader->count = 0;
+}
+
+/**
+ * Point a cursor at the start of a game of an archive. Seeking is a lookup
+ * in the offset table, whatever the number of games.
+ * @param reader Opened archive.
+ * @param index Index of the game, in writing order.
+ * @param cursor Receives the start position, result and number of moves of
+ * the game. Its moves are then read with cb_next_game_move.
+ * @return 1 on success, 0 if there is no such game or its record is invalid.
+ */
+int cb_seek_game(cb_game_reader *reader, size_t index, cb_game_cursor *cursor)
+{
+    const uchar *data = reader->mapping.data;
+    uint64_t offset;
+    uint64_t end;
+
+    if(index >= reader->count)
+    {
+        return 0;
+    }
+
+    offset = cb_read_le(reader->offsets + index * 8, 8);
+    end = index + 1 < reader->count ? cb_read_le(reader->offsets + (index + 1) * 8, 8) : (uint64_t)(reader->offsets - data);
+
+    if(offset < GAMES_HEADER_SIZE || end > (uint64_t)(reader->offsets - data) || offset + GAME_RECORD_HEADER_SIZE > end)
+    {
+        CB_COUNT(parse_errors);
+        return 0;
+    }
+
+    cursor->data = data + offset;
+    cursor->end = data + end;
+    cursor->encoding = reader->encoding;
+    cursor->result = cursor->data[1];
+    cursor->move_count = (ushort)cb_read_le(cursor->data + 2, 2);
+    cursor->moves_decoded = 0;
+    cursor->data += GAME_RECORD_HEADER_SIZE;
+
+    if(cursor->data[-GAME_RECORD_HEADER_SIZE] & GAME_FLAG_CUSTOM_START)
+    {
+        const uchar *start = cursor->data;
+
+        if(cursor->end - start < GAME_START_RECORD_SIZE)
+        {
+            CB_COUNT(parse_errors);
+            return 0;
+        }
+
+        cursor->board.move_counter = (ushort)(start[0] | start[36] << 8);
+        cursor->board.castling_rights = start[1];
+        cursor->board.ep_target_square_index = start[2];
+        cursor->board.halfmove_clock = (ushort)(start[3] | start[37] << 8);
+        cb_unpack_board(&cursor->board, start + 4);
+        cursor->data += GAME_START_RECORD_SIZE;
+    }
+    else
+    {
+        cb_initialize_game(&cursor->board);
+    }
+
+    if(cursor->encoding == CB_GAME_ENCODING_RANGE)
+    {
+        cursor->range = 0xFFFFFFFFu;
+        cursor->code = 0;
+
+        for(uchar i = 0; i < 5; i++)
+        {
+            cursor->code = cursor->code << 8 | cb_cursor_byte(cursor);
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * Decode the next move of a game and play it on the cursor's board. Every
+ * move costs a single legal move generation.
+ * @param cursor Cursor set by cb_seek_game.
+ * @param move Receives the move.
+ * @return 1 if a move was decoded, 0 at the end of the game or if the
+ * record is invalid.
+ */
+int cb_next_game_move(cb_game_cursor *cursor, cb_move *move)
+{
+    ushort keys[CB_MAX_MOVES];
+    cb_move_undo undo;
+    uchar count;
+    uint32_t index;
+
+    if(cursor->moves_decoded >= cursor->move_count)
+    {
+        return 0;
+    }
+
+    count = cb_sorted_move_keys(&cursor->board, keys);
+
+    if(cursor->encoding == CB_GAME_ENCODING_RANGE)
+    {
+        if(count == 0)
+        {
+            index = count;
+        }
+        else
+        {
+            cursor->range /= count;
+            index = cursor->code / cursor->range;
+            cursor->code -= (index < count ? index : 0) * cursor->range;
+
+            while(cursor->range < RANGE_TOP)
+            {
+                cursor->code = cursor->code << 8 | cb_cursor_byte(cursor);
+                cursor->range <<= 8;
+            }
+        }
+    }
+    else
+    {
+        index = cursor->data < cursor->end ? *cursor->data++ : count;
+    }
+
+    if(index >= count)
+    {
+        CB_COUNT(parse_errors);
+        cursor->moves_decoded = cursor->move_count;
+        return 0;
+    }
+
+    cb_move_from_key(keys[index], move);
+
+    cb_make_move(&cursor->board, move, &undo, NULL);
+    cursor->moves_decoded++;
+
+    return 1;
+}
@@ -0,0 +1,122 @@
+/**
+ * @file history.c
+ * @author Nathan Seymour
+ * @brief History of the positions of a game, used to detect
+ * repetitions.
+ */
+
+#include <string.h>
+#include "chess.h"
+#include "zobrist.h"
+#include "history.h"
+
+#define cb_history_slot(index) ((index) & (CB_HISTORY_SIZE - 1))
+#define cb_filter_slot(key) ((key) & (CB_HISTORY_FILTER_SIZE - 1))
+
+/**
+ * Start a new history from a position.
+ * @param history History to initialize.
+ * @param board Current position of the game.
+ */
+void cb_initialize_history(cb_position_history *history, chess_board *board)
+{
+    memset(history->filter, 0, sizeof(history->filter));
+    history->count = 0;
+
+    cb_push_history(history, cb_zobrist_key(board));
+}
+
+/**
+ * Add a position to the history. When the ring is full, the oldest
+ * position is forgotten.
+ * @param history History to add to.
+ * @param key Zobrist key of the new current position.
+ */
+void cb_push_history(cb_position_history *history, cb_hash_key key)
+{
+    if(history->count >= CB_HISTORY_SIZE)
+    {
+        history->filter[cb_filter_slot(history->keys[cb_history_slot(history->count)])]--;
+    }
+
+    history->keys[cb_history_slot(history->count)] = key;
+    history->filter[cb_filter_slot(key)]++;
+    history->count++;
+}
+
+/**
+ * Remove the current position from the history.
+ * @param history History to remove from.
+ */
+void cb_pop_history(cb_position_history *history)
+{
+    if(history->count == 0)
+    {
+        return;
+    }
+
+    history->count--;
+    history->filter[cb_filter_slot(history->keys[cb_history_slot(history->count)])]--;
+}
+
+/**
+ * Get the key of the current position.
+ * @param history History of the game.
+ * @return Zobrist key of the last position pushed.
+ */
+cb_hash_key cb_history_current_key(cb_position_history *history)
+{
+    return history->keys[cb_history_slot(history->count - 1)];
+}
+
+/**
+ * Count how many times the current position occurred before. Only the
+ * positions since the last irreversible move (capture, pawn move) are
+ * compared, and only those with the same side to move.
+ * @param history History of the game, current position last.
+ * @param board Current position, for its halfmove clock.
+ * @return Number of earlier occurrences of the current position.
+ */
+uchar cb_count_repetitions(cb_position_history *history, chess_board *board)
+{
+    cb_hash_key key = cb_history_current_key(history);
+    uchar repetitions = 0;
+
+    if(history->filter[cb_filter_slot(key)] < 2)
+    {
+        return 0;
+    }
+
+    unsigned int distance = board->halfmove_clock;
+    if(distance > history->count - 1)
+    {
+        distance = history->count - 1;
+    }
+    if(distance > CB_HISTORY_SIZE - 1)
+    {
+        distance = CB_HISTORY_SIZE - 1;
+    }
+
+    for(unsigned int back = 4; back <= distance; back += 2)
+    {
+        if(history->keys[cb_history_slot(history->count - 1 - back)] == key)
+        {
+            repetitions++;
+        }
+    }
+
+    return repetitions;
+}
+
+/**
+ * Check whether the current position is drawn by the fifty-move rule or by
+ * repetition. Any repetition counts, as is usual inside a search: a position
+ * that can be repeated once can be repeated three times.
+ * @param history History of the game, current position last.
+ * @param board Current position.
+ * @return 1 if the position is a draw, 0 otherwise.
+ */
+int cb_is_draw(cb_position_history *history, chess_board *board)
+{
+    return board->halfmove_clock >= 100 || cb_count_repetitions(history, board) > 0;
+}
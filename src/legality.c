@@ -0,0 +1,968 @@
+/**
+ * @file legality.c
+ * @author Nathan Seymour
+ * @brief Tools for checking the legality of single moves without
+ * generating every legal move of the position, and for generating
+ * them all when they are needed.
+ */
+
+#include "chess.h"
+#include "movement.h"
+#include "legality.h"
+#include "counters.h"
+
+#define FILE_A_MASK 0x0101010101010101ULL
+#define FILE_H_MASK 0x8080808080808080ULL
+#define RANK_1_MASK 0x00000000000000FFULL
+#define DIAGONAL_MASK 0x8040201008040201ULL
+#define ANTI_DIAGONAL_MASK 0x0102040810204080ULL
+
+#define square_mask(square_index) (1ULL << (square_index))
+
+/*
+ * The eight ray directions, as (file, rank) steps. The first four are
+ * straight (rook) directions, the last four diagonal (bishop) ones.
+ */
+static const signed char cb_ray_file_steps[8] = {1, -1, 0, 0, 1, 1, -1, -1};
+static const signed char cb_ray_rank_steps[8] = {0, 0, 1, -1, 1, -1, 1, -1};
+
+/*
+ * The eight knight jumps, as (file, rank) steps.
+ */
+static const signed char cb_knight_file_jumps[8] = {1, 2, 2, 1, -1, -2, -2, -1};
+static const signed char cb_knight_rank_jumps[8] = {2, 1, -1, -2, -2, -1, 1, 2};
+
+/*
+ * Fill in the pieces of an attack map, for the checks that need no more.
+ * The bitboard of each piece value is put together from the bit planes of
+ * the board, without going through the squares one by one.
+ */
+static void cb_load_pieces(chess_board *board, cb_attack_map *map)
+{
+    uint64_t planes[4];
+    uint64_t types[8];
+
+    cb_board_planes(board, planes);
+
+    for(uchar type = 0; type < 8; type++)
+    {
+        types[type] = (type & 1 ? planes[0] : ~planes[0])
+                    & (type & 2 ? planes[1] : ~planes[1])
+                    & (type & 4 ? planes[2] : ~planes[2]);
+    }
+
+    for(uchar type = 0; type < 8; type++)
+    {
+        map->pieces[WHITE | type] = types[type] & ~planes[3];
+        map->pieces[BLACK | type] = types[type] & planes[3];
+    }
+
+    map->pieces[WHITE | EMPTY_SQUARE] = 0;
+    map->pieces[BLACK | EMPTY_SQUARE] = 0;
+    map->colors[1] = planes[3];
+    map->occupied = planes[0] | planes[1] | planes[2];
+    map->colors[0] = map->occupied & ~planes[3];
+}
+
+/*
+ * Index of the lowest set bit of a bitboard, by De Bruijn multiplication:
+ * the isolated bit times the constant leaves a unique 6 bit pattern in the
+ * top bits, which this table maps back to the square.
+ */
+static const uchar cb_de_bruijn_squares[64] = {
+         0,  1, 48,  2, 57, 49, 28,  3,
+        61, 58, 50, 42, 38, 29, 17,  4,
+        62, 55, 59, 36, 53, 51, 43, 22,
+        45, 39, 33, 30, 24, 18, 12,  5,
+        63, 47, 56, 27, 60, 41, 37, 16,
+        54, 35, 52, 21, 44, 32, 23, 11,
+        46, 26, 40, 15, 34, 20, 31, 10,
+        25, 14, 19,  9, 13,  8,  7,  6,
+};
+
+static uchar cb_lowest_square(uint64_t bitboard)
+{
+    return cb_de_bruijn_squares[((bitboard & (~bitboard + 1)) * 0x03F79D71B4CB0A89ULL) >> 58];
+}
+
+/**
+ * Squares attacked by a set of knights, all of them at once.
+ */
+static uint64_t cb_knights_attacks(uint64_t square)
+{
+    uint64_t not_a = ~FILE_A_MASK;
+    uint64_t not_h = ~FILE_H_MASK;
+    uint64_t not_ab = ~(FILE_A_MASK | (FILE_A_MASK << 1));
+    uint64_t not_gh = ~(FILE_H_MASK | (FILE_H_MASK >> 1));
+
+    return ((square << 17) & not_a) | ((square << 15) & not_h)
+         | ((square << 10) & not_ab) | ((square << 6) & not_gh)
+         | ((square >> 17) & not_h) | ((square >> 15) & not_a)
+         | ((square >> 10) & not_gh) | ((square >> 6) & not_ab);
+}
+
+#define cb_knight_attacks(square_index) cb_knights_attacks(square_mask(square_index))
+
+static uint64_t cb_king_attacks(uchar square_index)
+{
+    uint64_t square = square_mask(square_index);
+    uint64_t sides = ((square << 1) & ~FILE_A_MASK) | ((square >> 1) & ~FILE_H_MASK);
+    uint64_t row = square | sides;
+
+    return sides | (row << 8) | (row >> 8);
+}
+
+/**
+ * Squares attacked by a pawn of the given color standing on a square.
+ */
+static uint64_t cb_pawn_attacks(uchar color, uchar square_index)
+{
+    uint64_t square = square_mask(square_index);
+
+    if(color == WHITE)
+    {
+        return ((square << 9) & ~FILE_A_MASK) | ((square << 7) & ~FILE_H_MASK);
+    }
+
+    return ((square >> 7) & ~FILE_A_MASK) | ((square >> 9) & ~FILE_H_MASK);
+}
+
+/*
+ * Shift every square of a bitboard one step in a ray direction, dropping
+ * the squares that would wrap around the board.
+ */
+static uint64_t cb_shift(uint64_t bitboard, uchar direction)
+{
+    switch(direction)
+    {
+        case 0: return (bitboard << 1) & ~FILE_A_MASK;
+        case 1: return (bitboard >> 1) & ~FILE_H_MASK;
+        case 2: return bitboard << 8;
+        case 3: return bitboard >> 8;
+        case 4: return (bitboard << 9) & ~FILE_A_MASK;
+        case 5: return (bitboard >> 7) & ~FILE_A_MASK;
+        case 6: return (bitboard << 7) & ~FILE_H_MASK;
+        default: return (bitboard >> 9) & ~FILE_H_MASK;
+    }
+}
+
+/*
+ * Squares attacked by a set of sliders along the rays [first_direction,
+ * last_direction), all of them at once: each ray is flooded over the empty
+ * squares, at most six steps, then pushed one more step onto its blocker.
+ */
+static uint64_t cb_slider_attacks(uint64_t sliders, uint64_t occupied, uchar first_direction, uchar last_direction)
+{
+    uint64_t attacks = 0;
+
+    for(uchar direction = first_direction; direction < last_direction; direction++)
+    {
+        uint64_t flood = sliders;
+        uint64_t ray = sliders;
+
+        for(uchar step = 0; step < 6 && ray; step++)
+        {
+            ray = cb_shift(ray, direction) & ~occupied;
+            flood |= ray;
+        }
+
+        attacks |= cb_shift(flood, direction);
+    }
+
+    return attacks;
+}
+
+#define cb_rook_attacks(square_index, occupied) cb_slider_attacks(square_mask(square_index), occupied, 0, 4)
+#define cb_bishop_attacks(square_index, occupied) cb_slider_attacks(square_mask(square_index), occupied, 4, 8)
+
+/**
+ * Squares on the rank and file of a square, as on an empty board, the
+ * square itself left out.
+ */
+static uint64_t cb_straight_lines(uchar square_index)
+{
+    return (FILE_A_MASK << (square_index & 7)) ^ (RANK_1_MASK << (square_index & 56));
+}
+
+/**
+ * Squares on the diagonals of a square, as on an empty board, the square
+ * itself left out. Each diagonal is the long one shifted by ranks.
+ */
+static uint64_t cb_diagonal_lines(uchar square_index)
+{
+    int diagonal = (square_index & 7) - (square_index >> 3);
+    int anti_diagonal = 7 - (square_index & 7) - (square_index >> 3);
+    uint64_t lines;
+
+    lines = diagonal >= 0 ? DIAGONAL_MASK >> (diagonal * 8) : DIAGONAL_MASK << (-diagonal * 8);
+    lines ^= anti_diagonal >= 0 ? ANTI_DIAGONAL_MASK >> (anti_diagonal * 8) : ANTI_DIAGONAL_MASK << (-anti_diagonal * 8);
+
+    return lines;
+}
+
+/**
+ * Squares strictly between two squares on a common line, or 0 if the
+ * squares are not aligned.
+ */
+static uint64_t cb_squares_between(uchar from, uchar to)
+{
+    signed char file_difference = (signed char)(to % 8 - from % 8);
+    signed char rank_difference = (signed char)(to / 8 - from / 8);
+    signed char file_step = (signed char)((file_difference > 0) - (file_difference < 0));
+    signed char rank_step = (signed char)((rank_difference > 0) - (rank_difference < 0));
+    uint64_t between = 0;
+
+    if(file_difference != 0 && rank_difference != 0 && file_difference != rank_difference && file_difference != -rank_difference)
+    {
+        return 0;
+    }
+
+    for(uchar square_index = (uchar)(from + file_step + rank_step * 8); square_index != to; square_index = (uchar)(square_index + file_step + rank_step * 8))
+    {
+        between |= square_mask(square_index);
+    }
+
+    return between;
+}
+
+/**
+ * Whether three squares stand on a common line (rank, file or diagonal).
+ */
+static int cb_squares_aligned(uchar first, uchar second, uchar third)
+{
+    int first_file = first % 8, first_rank = first / 8;
+    int second_file = second % 8 - first_file, second_rank = second / 8 - first_rank;
+    int third_file = third % 8 - first_file, third_rank = third / 8 - first_rank;
+
+    if(second_file * third_rank != second_rank * third_file)
+    {
+        return 0;
+    }
+
+    // Only straight lines and diagonals count.
+    return second_file == 0 || second_rank == 0 || second_file == second_rank || second_file == -second_rank;
+}
+
+/**
+ * Pieces of a color attacking a square, given the occupancy of the board.
+ */
+static uint64_t cb_colored_attackers_to(const cb_attack_map *position, uchar color, uchar square_index, uint64_t occupied)
+{
+    const uint64_t *pieces = position->pieces + color;
+    uint64_t queens = pieces[QUEEN];
+    uint64_t diagonal_sliders = (pieces[BISHOP] | queens) & cb_diagonal_lines(square_index);
+    uint64_t straight_sliders = (pieces[ROOK] | queens) & cb_straight_lines(square_index);
+    uint64_t attackers = (cb_pawn_attacks(color ^ BLACK, square_index) & pieces[PAWN])
+                       | (cb_knight_attacks(square_index) & pieces[KNIGHT])
+                       | (cb_king_attacks(square_index) & pieces[KING]);
+
+    // Rays are only followed towards sliders that stand on them.
+    if(diagonal_sliders)
+    {
+        attackers |= cb_bishop_attacks(square_index, occupied) & diagonal_sliders;
+    }
+
+    if(straight_sliders)
+    {
+        attackers |= cb_rook_attacks(square_index, occupied) & straight_sliders;
+    }
+
+    return attackers;
+}
+
+/**
+ * Pieces of the moving side that may not leave the line between their king
+ * and an enemy slider.
+ */
+static uint64_t cb_pinned_pieces(const cb_attack_map *position, uchar color, uchar king_square_index)
+{
+    const uint64_t *enemy = position->pieces + (color ^ BLACK);
+    uint64_t pinned = 0;
+    uint64_t snipers = (cb_straight_lines(king_square_index) & (enemy[ROOK] | enemy[QUEEN]))
+                     | (cb_diagonal_lines(king_square_index) & (enemy[BISHOP] | enemy[QUEEN]));
+
+    while(snipers)
+    {
+        uchar sniper_square_index = cb_lowest_square(snipers);
+        uint64_t blockers = cb_squares_between(king_square_index, sniper_square_index) & position->occupied;
+
+        // Exactly one piece in between, and it is ours.
+        if(blockers && !(blockers & (blockers - 1)) && (blockers & position->colors[color >> 3]))
+        {
+            pinned |= blockers;
+        }
+
+        snipers &= snipers - 1;
+    }
+
+    return pinned;
+}
+
+/**
+ * Whether the piece on the from square can reach the to square, ignoring
+ * whether its own king is left in check. Castling is handled separately.
+ */
+static int cb_is_move_pattern_valid(chess_board *board, const cb_attack_map *position, cb_move *move, uchar piece)
+{
+    uchar from = move->from_square_index;
+    uchar to = move->to_square_index;
+    uchar color = piece & BLACK;
+    uint64_t target = square_mask(to);
+
+    switch(piece & COLOR_MASK)
+    {
+        case PAWN:
+        {
+            signed char forward = color == WHITE ? 8 : -8;
+            uchar start_rank = color == WHITE ? 1 : 6;
+            uchar last_rank = color == WHITE ? 7 : 0;
+            int is_valid;
+
+            if(cb_pawn_attacks(color, from) & target)
+            {
+                is_valid = (position->colors[(color ^ BLACK) >> 3] & target) || to == board->ep_target_square_index;
+            }
+            else if(to == from + forward)
+            {
+                is_valid = !(position->occupied & target);
+            }
+            else if(to == from + 2 * forward && from / 8 == start_rank)
+            {
+                is_valid = !(position->occupied & (target | square_mask(from + forward)));
+            }
+            else
+            {
+                is_valid = 0;
+            }
+
+            if(is_valid && to / 8 == last_rank)
+            {
+                uchar promotion_piece = move->promotion_piece & COLOR_MASK;
+                is_valid = promotion_piece == EMPTY_SQUARE || (promotion_piece >= KNIGHT && promotion_piece <= QUEEN);
+            }
+
+            return is_valid;
+        }
+        case KNIGHT:
+            return (cb_knight_attacks(from) & target) != 0;
+        case BISHOP:
+            return (cb_diagonal_lines(from) & target) && !(cb_squares_between(from, to) & position->occupied);
+        case ROOK:
+            return (cb_straight_lines(from) & target) && !(cb_squares_between(from, to) & position->occupied);
+        case QUEEN:
+            return ((cb_diagonal_lines(from) | cb_straight_lines(from)) & target) && !(cb_squares_between(from, to) & position->occupied);
+        case KING:
+            return (cb_king_attacks(from) & target) != 0;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Castling is legal when the right is still held, the rook is home, the
+ * squares between king and rook are empty, and the king is not in check
+ * and does not cross or land on an attacked square.
+ */
+static int cb_is_castling_legal(chess_board *board, const cb_attack_map *position, uchar color, uchar from, uchar to)
+{
+    uchar home = color == WHITE ? 4 : 60;
+    int is_kingside = to == from + 2;
+    uchar right;
+    uchar rook_square_index;
+
+    if(from != home)
+    {
+        return 0;
+    }
+
+    if(color == WHITE)
+    {
+        right = is_kingside ? CASTLE_RIGHTS_KINGSIDE_WHITE : CASTLE_RIGHTS_QUEENSIDE_WHITE;
+    }
+    else
+    {
+        right = is_kingside ? CASTLE_RIGHTS_KINGSIDE_BLACK : CASTLE_RIGHTS_QUEENSIDE_BLACK;
+    }
+    rook_square_index = is_kingside ? home + 3 : home - 4;
+
+    if(!(board->castling_rights & right)
+        || !(position->pieces[color | ROOK] & square_mask(rook_square_index))
+        || (cb_squares_between(home, rook_square_index) & position->occupied))
+    {
+        return 0;
+    }
+
+    for(uchar square_index = home; square_index != to; square_index = is_kingside ? square_index + 1 : square_index - 1)
+    {
+        if(cb_colored_attackers_to(position, color ^ BLACK, square_index, position->occupied))
+        {
+            return 0;
+        }
+    }
+
+    return cb_colored_attackers_to(position, color ^ BLACK, to, position->occupied) == 0;
+}
+
+/*
+ * Fill in the pieces of an attack map, with the checkers and pinned pieces
+ * of the side to move: all that cb_is_move_legal_from_map needs, without
+ * the attacked squares.
+ */
+static void cb_load_pins_and_checks(chess_board *board, cb_attack_map *map)
+{
+    cb_load_pieces(board, map);
+
+    map->color = board->move_counter % 2 == 0 ? WHITE : BLACK;
+    map->king_square_index = 64;
+    map->checkers = 0;
+    map->pinned = 0;
+
+    uint64_t king = map->pieces[map->color | KING];
+
+    if(king)
+    {
+        map->king_square_index = cb_lowest_square(king);
+        map->pinned = cb_pinned_pieces(map, map->color, map->king_square_index);
+        map->checkers = cb_colored_attackers_to(map, map->color ^ BLACK, map->king_square_index, map->occupied);
+    }
+}
+
+/**
+ * Decide whether a move is legal in a position: the moving piece belongs to
+ * the side to move, it can reach the target square, and its king is not left
+ * in check. Castling and en passant are fully handled.
+ *
+ * The checkers and pinned pieces are computed for the position on every
+ * call. To check several moves of the same position, compute them once
+ * with cb_load_attack_map and use cb_is_move_legal_from_map.
+ * @param board Board the move would be performed on.
+ * @param move Move to check.
+ * @return 1 if the move is legal, 0 otherwise.
+ */
+int cb_is_move_legal(chess_board *board, cb_move *move)
+{
+    cb_attack_map position;
+
+    cb_load_pins_and_checks(board, &position);
+
+    return cb_is_move_legal_from_map(board, &position, move);
+}
+
+/**
+ * Decide whether a move is legal, as cb_is_move_legal, from an attack map
+ * already computed for the position. Pins and checks are resolved with the
+ * masks of the map, so that only king moves and en passant (which removes
+ * two pieces from a rank) look at the attacks on a square again.
+ * @param board Board the move would be performed on.
+ * @param map Attack map of the position.
+ * @param move Move to check.
+ * @return 1 if the move is legal, 0 otherwise.
+ */
+int cb_is_move_legal_from_map(chess_board *board, const cb_attack_map *map, cb_move *move)
+{
+    uchar from = move->from_square_index;
+    uchar to = move->to_square_index;
+    uchar color = map->color;
+    uchar king_square_index = map->king_square_index;
+
+    if(from >= 64 || to >= 64 || from == to || king_square_index >= 64)
+    {
+        return 0;
+    }
+
+    uchar piece = cb_board_get(board, from);
+    uchar target_piece = cb_board_get(board, to);
+
+    if(piece == EMPTY_SQUARE || (piece & BLACK) != color)
+    {
+        return 0;
+    }
+
+    if(target_piece != EMPTY_SQUARE && ((target_piece & BLACK) == color || (target_piece & COLOR_MASK) == KING))
+    {
+        return 0;
+    }
+
+    if((piece & COLOR_MASK) == KING)
+    {
+        if(to == from + 2 || from == to + 2)
+        {
+            return cb_is_castling_legal(board, map, color, from, to);
+        }
+
+        if(!(cb_king_attacks(from) & square_mask(to)))
+        {
+            return 0;
+        }
+
+        // The king must not hide behind itself from a slider.
+        return cb_colored_attackers_to(map, color ^ BLACK, to, map->occupied ^ square_mask(from)) == 0;
+    }
+
+    if(!cb_is_move_pattern_valid(board, map, move, piece))
+    {
+        return 0;
+    }
+
+    /*
+     * En passant removes the captured pawn as well, which may uncover a
+     * check along the rank. Play the move on the occupancy and look again.
+     */
+    if((piece & COLOR_MASK) == PAWN && to == board->ep_target_square_index)
+    {
+        uchar captured_square_index = color == WHITE ? to - 8 : to + 8;
+        uint64_t occupied = (map->occupied ^ square_mask(from) ^ square_mask(captured_square_index)) | square_mask(to);
+        cb_attack_map after;
+
+        if(!(map->pieces[(color ^ BLACK) | PAWN] & square_mask(captured_square_index)))
+        {
+            return 0;
+        }
+
+        after = *map;
+        after.pieces[(color ^ BLACK) | PAWN] &= ~square_mask(captured_square_index);
+
+        return cb_colored_attackers_to(&after, color ^ BLACK, king_square_index, occupied) == 0;
+    }
+
+    if(map->checkers)
+    {
+        // Double check, only the king can move.
+        if(map->checkers & (map->checkers - 1))
+        {
+            return 0;
+        }
+
+        uint64_t check_mask = map->checkers | cb_squares_between(king_square_index, cb_lowest_square(map->checkers));
+
+        if(!(check_mask & square_mask(to)))
+        {
+            return 0;
+        }
+    }
+
+    if(map->pinned & square_mask(from))
+    {
+        return cb_squares_aligned(king_square_index, from, to);
+    }
+
+    return 1;
+}
+
+/**
+ * Validate a sequence of moves played one after the other from a position,
+ * Ex: the moves of a game. The board is left untouched.
+ * @param board Position the sequence starts from.
+ * @param moves Moves to validate, in order.
+ * @param move_count Number of moves in the sequence.
+ * @return The number of leading moves that are legal. Equal to move_count
+ * when the whole sequence is legal, otherwise the index of the first
+ * illegal move.
+ */
+unsigned int cb_validate_move_sequence(chess_board *board, cb_move *moves, unsigned int move_count)
+{
+    chess_board position = *board;
+    cb_move_undo undo;
+
+    for(unsigned int i = 0; i < move_count; i++)
+    {
+        if(!cb_is_move_legal(&position, &moves[i]))
+        {
+            return i;
+        }
+
+        cb_make_move(&position, &moves[i], &undo, NULL);
+    }
+
+    return move_count;
+}
+
+static void cb_add_move(cb_move_list *list, uchar from, uchar to, uchar promotion_piece)
+{
+    list->moves[list->count].from_square_index = from;
+    list->moves[list->count].to_square_index = to;
+    list->moves[list->count].promotion_piece = promotion_piece;
+    list->count++;
+}
+
+/*
+ * Targets of a non-king piece of the side to move, before pins and checks
+ * are taken into account.
+ */
+static uint64_t cb_piece_targets(chess_board *board, const cb_attack_map *position, uchar piece, uchar from)
+{
+    uchar color = piece & BLACK;
+    uint64_t own = position->colors[color >> 3];
+    uint64_t enemy = position->colors[(color ^ BLACK) >> 3];
+
+    switch(piece & COLOR_MASK)
+    {
+        case PAWN:
+        {
+            signed char forward = color == WHITE ? 8 : -8;
+            uchar start_rank = color == WHITE ? 1 : 6;
+            uint64_t targets = cb_pawn_attacks(color, from) & enemy;
+            uchar single_push = (uchar)(from + forward);
+
+            if(board->ep_target_square_index < 64 && (cb_pawn_attacks(color, from) & square_mask(board->ep_target_square_index)))
+            {
+                targets |= square_mask(board->ep_target_square_index);
+            }
+
+            if(!(position->occupied & square_mask(single_push)))
+            {
+                targets |= square_mask(single_push);
+
+                if(from / 8 == start_rank && !(position->occupied & square_mask(single_push + forward)))
+                {
+                    targets |= square_mask(single_push + forward);
+                }
+            }
+
+            return targets;
+        }
+        case KNIGHT:
+            return cb_knight_attacks(from) & ~own;
+        case BISHOP:
+            return cb_bishop_attacks(from, position->occupied) & ~own;
+        case ROOK:
+            return cb_rook_attacks(from, position->occupied) & ~own;
+        case QUEEN:
+            return (cb_bishop_attacks(from, position->occupied) | cb_rook_attacks(from, position->occupied)) & ~own;
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Squares attacked by every piece of a color, given the occupancy of the
+ * board.
+ */
+static uint64_t cb_colored_attacks(const cb_attack_map *map, uchar color, uint64_t occupied)
+{
+    const uint64_t *pieces = map->pieces + color;
+    uint64_t pawns = pieces[PAWN];
+    uint64_t attacks;
+
+    if(color == WHITE)
+    {
+        attacks = ((pawns << 9) & ~FILE_A_MASK) | ((pawns << 7) & ~FILE_H_MASK);
+    }
+    else
+    {
+        attacks = ((pawns >> 7) & ~FILE_A_MASK) | ((pawns >> 9) & ~FILE_H_MASK);
+    }
+
+    attacks |= cb_knights_attacks(pieces[KNIGHT]);
+    attacks |= cb_slider_attacks(pieces[ROOK] | pieces[QUEEN], occupied, 0, 4);
+    attacks |= cb_slider_attacks(pieces[BISHOP] | pieces[QUEEN], occupied, 4, 8);
+
+    if(pieces[KING])
+    {
+        attacks |= cb_king_attacks(cb_lowest_square(pieces[KING]));
+    }
+
+    return attacks;
+}
+
+/**
+ * Compute the attack map of a position: the bitboards of its pieces, the
+ * squares attacked by each side, and the checkers and pinned pieces of the
+ * side to move. Meant to be computed once per position, and then passed to
+ * every function asking about it.
+ * @param board Position to map.
+ * @param map Receives the attack map.
+ */
+void cb_load_attack_map(chess_board *board, cb_attack_map *map)
+{
+    cb_load_pieces(board, map);
+
+    map->color = board->move_counter % 2 == 0 ? WHITE : BLACK;
+    map->king_square_index = 64;
+    map->checkers = 0;
+    map->pinned = 0;
+
+    uint64_t king = map->pieces[map->color | KING];
+
+    if(king)
+    {
+        map->king_square_index = cb_lowest_square(king);
+        map->pinned = cb_pinned_pieces(map, map->color, map->king_square_index);
+    }
+
+    // The king is taken off for the enemy attacks, so that it cannot hide behind itself.
+    map->attacked[map->color >> 3] = cb_colored_attacks(map, map->color, map->occupied);
+    map->attacked[(map->color ^ BLACK) >> 3] = cb_colored_attacks(map, map->color ^ BLACK, map->occupied & ~king);
+
+    // Only look for the checkers when there are some.
+    if(map->attacked[(map->color ^ BLACK) >> 3] & king)
+    {
+        map->checkers = cb_colored_attackers_to(map, map->color ^ BLACK, map->king_square_index, map->occupied);
+    }
+}
+
+/**
+ * Pieces of a color attacking a square of a mapped position.
+ * @param map Attack map of the position.
+ * @param square_index Square attacked.
+ * @param color Color of the attackers, WHITE or BLACK.
+ * @return Bitboard of the attackers, bit n standing for square n.
+ */
+uint64_t cb_attack_map_attackers_to(const cb_attack_map *map, uchar square_index, uchar color)
+{
+    if(square_index >= 64)
+    {
+        return 0;
+    }
+
+    return cb_colored_attackers_to(map, color & BLACK, square_index, map->occupied);
+}
+
+/**
+ * Whether a color attacks a square of a mapped position, a single lookup.
+ * Squares behind the king of the side to move on a line attacked by the
+ * other side count as attacked.
+ * @param map Attack map of the position.
+ * @param square_index Square attacked.
+ * @param color Color of the attackers, WHITE or BLACK.
+ * @return 1 if the square is attacked, 0 otherwise.
+ */
+int cb_attack_map_is_square_attacked(const cb_attack_map *map, uchar square_index, uchar color)
+{
+    return square_index < 64 && (map->attacked[(color & BLACK) >> 3] & square_mask(square_index)) != 0;
+}
+
+/**
+ * Generate every legal move of the side to move. Promotions are generated
+ * once per piece, queen first. The position is only scanned once, and pins
+ * and checks are resolved with the same masks as cb_is_move_legal.
+ * @param board Position to generate the moves of.
+ * @param list Receives the moves.
+ * @return Number of legal moves, 0 when the side to move is mated or stalemated.
+ */
+uchar cb_generate_legal_moves(chess_board *board, cb_move_list *list)
+{
+    cb_attack_map map;
+
+    cb_load_attack_map(board, &map);
+
+    return cb_generate_legal_moves_from_map(board, &map, list);
+}
+
+/**
+ * Generate every legal move of the side to move, as cb_generate_legal_moves,
+ * from an attack map already computed for the position.
+ * @param board Position to generate the moves of.
+ * @param map Attack map of the position.
+ * @param list Receives the moves.
+ * @return Number of legal moves, 0 when the side to move is mated or stalemated.
+ */
+uchar cb_generate_legal_moves_from_map(chess_board *board, const cb_attack_map *map, cb_move_list *list)
+{
+    uchar color = map->color;
+    uchar enemy_color = color ^ BLACK;
+    uchar king_square_index = map->king_square_index;
+
+    CB_COUNT(movegen_calls);
+
+    list->count = 0;
+
+    if(king_square_index >= 64)
+    {
+        return 0;
+    }
+
+    uint64_t own = map->colors[color >> 3];
+    uint64_t capturable = ~own & ~map->pieces[enemy_color | KING];
+    uint64_t checkers = map->checkers;
+    uint64_t check_mask = ~0ULL;
+    uint64_t pinned = map->pinned;
+
+    uint64_t king_targets = cb_king_attacks(king_square_index) & capturable & ~map->attacked[enemy_color >> 3];
+    while(king_targets)
+    {
+        cb_add_move(list, king_square_index, cb_lowest_square(king_targets), EMPTY_SQUARE);
+        king_targets &= king_targets - 1;
+    }
+
+    // Double check, only the king can move.
+    if(checkers & (checkers - 1))
+    {
+        return list->count;
+    }
+
+    if(checkers)
+    {
+        check_mask = checkers | cb_squares_between(king_square_index, cb_lowest_square(checkers));
+    }
+    else
+    {
+        if(cb_is_castling_legal(board, map, color, king_square_index, king_square_index + 2))
+        {
+            cb_add_move(list, king_square_index, king_square_index + 2, EMPTY_SQUARE);
+        }
+        if(king_square_index >= 2 && cb_is_castling_legal(board, map, color, king_square_index, king_square_index - 2))
+        {
+            cb_add_move(list, king_square_index, king_square_index - 2, EMPTY_SQUARE);
+        }
+    }
+
+    uint64_t pieces = own & ~square_mask(king_square_index);
+    while(pieces)
+    {
+        uchar from = cb_lowest_square(pieces);
+        uchar piece = cb_board_get(board, from);
+        uint64_t targets = cb_piece_targets(board, map, piece, from) & capturable;
+
+        pieces &= pieces - 1;
+
+        while(targets)
+        {
+            uchar to = cb_lowest_square(targets);
+            targets &= targets - 1;
+
+            if((piece & COLOR_MASK) == PAWN && to == board->ep_target_square_index)
+            {
+                uchar captured_square_index = color == WHITE ? to - 8 : to + 8;
+                uint64_t occupied = (map->occupied ^ square_mask(from) ^ square_mask(captured_square_index)) | square_mask(to);
+                cb_attack_map after = *map;
+
+                if(!(map->pieces[enemy_color | PAWN] & square_mask(captured_square_index)))
+                {
+                    continue;
+                }
+
+                // Also covers checks given by the captured pawn, and pins.
+                after.pieces[enemy_color | PAWN] &= ~square_mask(captured_square_index);
+                if(!cb_colored_attackers_to(&after, enemy_color, king_square_index, occupied))
+                {
+                    cb_add_move(list, from, to, EMPTY_SQUARE);
+                }
+                continue;
+            }
+
+            if(!(check_mask & square_mask(to)) || ((pinned & square_mask(from)) && !cb_squares_aligned(king_square_index, from, to)))
+            {
+                continue;
+            }
+
+            if((piece & COLOR_MASK) == PAWN && (to / 8 == 7 || to / 8 == 0))
+            {
+                cb_add_move(list, from, to, QUEEN);
+                cb_add_move(list, from, to, KNIGHT);
+                cb_add_move(list, from, to, ROOK);
+                cb_add_move(list, from, to, BISHOP);
+            }
+            else
+            {
+                cb_add_move(list, from, to, EMPTY_SQUARE);
+            }
+        }
+    }
+
+    return list->count;
+}
+
+/**
+ * Pieces of a color attacking a square. Rather than going through every
+ * piece of the board, looks out from the square: along each of the eight
+ * rays up to its first piece, which may be a slider, or a king or pawn
+ * when next to the square, then on the eight squares a knight could
+ * attack it from. For many questions about the same position, an attack
+ * map is faster.
+ * @param board Position to look at.
+ * @param square_index Square attacked.
+ * @param color Color of the attackers, WHITE or BLACK.
+ * @return Bitboard of the attackers, bit n standing for square n.
+ */
+uint64_t cb_attackers_to(chess_board *board, uchar square_index, uchar color)
+{
+    uint64_t attackers = 0;
+    signed char pawn_rank_step;
+
+    if(square_index >= 64)
+    {
+        return 0;
+    }
+
+    color &= BLACK;
+    pawn_rank_step = color == WHITE ? -1 : 1;
+
+    for(uchar direction = 0; direction < 8; direction++)
+    {
+        uchar slider = direction < 4 ? ROOK : BISHOP;
+        signed char file = (signed char)(square_index % 8);
+        signed char rank = (signed char)(square_index / 8);
+
+        for(uchar distance = 1;; distance++)
+        {
+            file += cb_ray_file_steps[direction];
+            rank += cb_ray_rank_steps[direction];
+
+            if(file < 0 || file > 7 || rank < 0 || rank > 7)
+            {
+                break;
+            }
+
+            uchar piece = cb_board_get(board, (uchar)(rank * 8 + file));
+
+            if(piece == EMPTY_SQUARE)
+            {
+                continue;
+            }
+
+            if(piece == (color | slider) || piece == (color | QUEEN)
+               || (distance == 1 && (piece == (color | KING)
+                                     || (piece == (color | PAWN) && slider == BISHOP && cb_ray_rank_steps[direction] == pawn_rank_step))))
+            {
+                attackers |= square_mask(rank * 8 + file);
+            }
+            break;
+        }
+    }
+
+    for(uchar jump = 0; jump < 8; jump++)
+    {
+        signed char file = (signed char)(square_index % 8 + cb_knight_file_jumps[jump]);
+        signed char rank = (signed char)(square_index / 8 + cb_knight_rank_jumps[jump]);
+
+        if(file >= 0 && file <= 7 && rank >= 0 && rank <= 7 && cb_board_get(board, (uchar)(rank * 8 + file)) == (color | KNIGHT))
+        {
+            attackers |= square_mask(rank * 8 + file);
+        }
+    }
+
+    return attackers;
+}
+
+/**
+ * Whether any piece of a color attacks a square.
+ * @param board Position to look at.
+ * @param square_index Square attacked.
+ * @param color Color of the attackers, WHITE or BLACK.
+ * @return 1 if the square is attacked, 0 otherwise.
+ */
+int cb_is_square_attacked(chess_board *board, uchar square_index, uchar color)
+{
+    return cb_attackers_to(board, square_index, color) != 0;
+}
+
+/**
+ * Whether the king of the side to move is attacked.
+ * @param board Position to look at.
+ * @return 1 if the side to move is in check, 0 otherwise.
+ */
+int cb_is_in_check(chess_board *board)
+{
+    uchar color = board->move_counter % 2 == 0 ? WHITE : BLACK;
+
+    for(uchar square_index = 0; square_index < 64; square_index++)
+    {
+        if(cb_board_get(board, square_index) == (color | KING))
+        {
+            return cb_is_square_attacked(board, square_index, color ^ BLACK);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,485 @@
+/**
+ * @file mate_solver.c
+ * @author Nathan Seymour
+ * @brief Mate solver, by depth-first proof-number search (df-pn).
+ *
+ * Every node carries two numbers from the side to move: phi, the least
+ * number of leaves to expand to prove it wins, and delta, to prove it
+ * loses. A node wins when any child loses and loses when every child wins,
+ * so phi is the least delta of its children and delta the sum of their
+ * phi. The search always goes down to the child of least delta, with
+ * thresholds telling when another child becomes more promising, and keeps
+ * the numbers of every node in a table so that it can come back to them.
+ *
+ * The moves left to the mating side are part of the key of a node, so that
+ * the tree of a mate in n cannot loop, and the results of shorter mates do
+ * not mix with those of longer ones.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "chess.h"
+#include "movement.h"
+#include "legality.h"
+#include "history.h"
+#include "mate_solver.h"
+
+#define CB_MATE_INFINITE 0x7FFFFFFFu
+
+/*
+ * How many nodes are expanded between two checks of the time limit.
+ */
+#define CB_MATE_CHECK_INTERVAL 1024
+
+#define cb_mate_node_key(position_key, moves_left) ((position_key) ^ (0x9E3779B97F4A7C15ULL * ((uint64_t)(moves_left) + 1)))
+
+static unsigned long cb_mate_clock_ms(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (unsigned long)now.tv_sec * 1000 + (unsigned long)(now.tv_nsec / 1000000);
+#else
+    return (unsigned long)(clock() / (CLOCKS_PER_SEC / 1000));
+#endif
+}
+
+/*
+ * Largest power of two number of entries that fits in a size.
+ */
+static size_t cb_mate_entry_count(size_t size_in_bytes)
+{
+    size_t size = 1;
+
+    while(size * 2 * sizeof(cb_mate_entry) <= size_in_bytes)
+    {
+        size *= 2;
+    }
+
+    return size;
+}
+
+/**
+ * Set up a mate table in memory provided by the caller, which must outlive
+ * the table. Nothing is allocated, and cb_free_mate_table must not be
+ * called on the table.
+ * @param table Table to initialize.
+ * @param memory Memory of the entries.
+ * @param size_in_bytes Size of the memory, rounded down to a power of two
+ * number of entries once the memory is aligned.
+ * @return 1 on success, 0 if the memory cannot hold a bucket of entries.
+ */
+int cb_attach_mate_table(cb_mate_table *table, void *memory, size_t size_in_bytes)
+{
+    size_t address = (size_t)memory;
+    size_t padding = (sizeof(uint64_t) - address % sizeof(uint64_t)) % sizeof(uint64_t);
+
+    table->entries = NULL;
+    table->size = 0;
+
+    if(memory == NULL || size_in_bytes < padding + 4 * sizeof(cb_mate_entry))
+    {
+        return 0;
+    }
+
+    table->entries = (cb_mate_entry*)((uchar*)memory + padding);
+    table->size = cb_mate_entry_count(size_in_bytes - padding);
+
+    cb_clear_mate_table(table);
+
+    return 1;
+}
+
+#ifdef DYNAMIC_MEMORY_ALLOCATION
+/**
+ * Allocate a mate table. cb_free_mate_table must be called when done.
+ * @param table Table to initialize.
+ * @param size_in_bytes Memory to use, rounded down to a power of two number of entries.
+ * @return 1 on success, 0 if the memory could not be allocated.
+ */
+int cb_initialize_mate_table(cb_mate_table *table, size_t size_in_bytes)
+{
+    size_t size = cb_mate_entry_count(size_in_bytes);
+
+    if(size < 4)
+    {
+        size = 4;
+    }
+
+    table->entries = malloc(size * sizeof(cb_mate_entry));
+    table->size = table->entries != NULL ? size : 0;
+
+    cb_clear_mate_table(table);
+
+    return table->entries != NULL;
+}
+
+/**
+ * Release the memory of a mate table.
+ * @param table Table to free.
+ */
+void cb_free_mate_table(cb_mate_table *table)
+{
+    free(table->entries);
+    table->entries = NULL;
+    table->size = 0;
+}
+#endif
+
+/**
+ * Forget every entry, Ex: between two unrelated positions, so that their
+ * nodes do not compete for the table.
+ * @param table Table to clear.
+ */
+void cb_clear_mate_table(cb_mate_table *table)
+{
+    if(table->entries != NULL)
+    {
+        memset(table->entries, 0, table->size * sizeof(cb_mate_entry));
+    }
+}
+
+/*
+ * Look up a node. Unknown nodes are worth one expansion either way.
+ */
+static int cb_mate_probe(cb_mate_table *table, cb_hash_key key, uint32_t *phi, uint32_t *delta, uint32_t *work)
+{
+    cb_mate_entry *bucket = &table->entries[key & (table->size - 1) & ~(size_t)3];
+
+    for(uchar i = 0; i < 4; i++)
+    {
+        if(bucket[i].work != 0 && bucket[i].key == key)
+        {
+            *phi = bucket[i].phi;
+            *delta = bucket[i].delta;
+            *work = bucket[i].work;
+            return 1;
+        }
+    }
+
+    *phi = 1;
+    *delta = 1;
+    *work = 0;
+    return 0;
+}
+
+/*
+ * Store a node over its older entry, or else over the entry of least work
+ * of its bucket.
+ */
+static void cb_mate_store(cb_mate_table *table, cb_hash_key key, uint32_t phi, uint32_t delta, unsigned long work)
+{
+    cb_mate_entry *bucket = &table->entries[key & (table->size - 1) & ~(size_t)3];
+    cb_mate_entry *replaced = &bucket[0];
+
+    for(uchar i = 0; i < 4; i++)
+    {
+        if(bucket[i].work != 0 && bucket[i].key == key)
+        {
+            replaced = &bucket[i];
+            break;
+        }
+
+        if(bucket[i].work < replaced->work)
+        {
+            replaced = &bucket[i];
+        }
+    }
+
+    replaced->key = key;
+    replaced->phi = phi;
+    replaced->delta = delta;
+    replaced->work = work == 0 ? 1 : (work > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)work);
+}
+
+static uint32_t cb_mate_add(uint32_t a, uint32_t b)
+{
+    return a >= CB_MATE_INFINITE - b ? CB_MATE_INFINITE : a + b;
+}
+
+/*
+ * Count a node, and stop on the node limit, or every so often on the time
+ * limit.
+ */
+static void cb_mate_count_node(cb_mate_solver *solver)
+{
+    solver->nodes++;
+
+    if((solver->limits.nodes != 0 && solver->nodes >= solver->limits.nodes)
+       || (solver->limits.time_ms != 0 && solver->nodes % CB_MATE_CHECK_INTERVAL == 0
+           && cb_mate_clock_ms() - solver->start_ms >= solver->limits.time_ms))
+    {
+        solver->stopped = 1;
+    }
+}
+
+/*
+ * Generate the moves of a position, telling whether its side to move is
+ * in check.
+ */
+static uchar cb_mate_generate(cb_mate_solver *solver, chess_board *board, cb_move_list *moves, int *in_check)
+{
+    cb_load_attack_map(board, &solver->attacks);
+    *in_check = solver->attacks.checkers != 0;
+
+    return cb_generate_legal_moves_from_map(board, &solver->attacks, moves);
+}
+
+/*
+ * Search a node until its phi or delta reaches its threshold. The mating
+ * side is attacking with moves_left moves to go including this one, or
+ * defending with moves_left moves to go after this one.
+ */
+static void cb_mate_search(cb_mate_solver *solver, chess_board *board, cb_hash_key key, uchar ply, uchar moves_left, int attacking,
+                           uint32_t phi_threshold, uint32_t delta_threshold)
+{
+    cb_mate_frame *frame = &solver->stack[ply];
+    unsigned long first_node = solver->nodes;
+    uchar child_moves_left = attacking ? moves_left - 1 : moves_left;
+    uint32_t phi, delta, work;
+    cb_move_undo undo;
+    int in_check;
+
+    if(cb_mate_probe(solver->table, key, &phi, &delta, &work) && (phi >= phi_threshold || delta >= delta_threshold))
+    {
+        return;
+    }
+
+    cb_mate_count_node(solver);
+
+    if(solver->stopped)
+    {
+        return;
+    }
+
+    // Mated or stalemated, the side to move loses unless it is the defender stalemated.
+    if(cb_mate_generate(solver, board, &frame->moves, &in_check) == 0)
+    {
+        int wins = !attacking && !in_check;
+        cb_mate_store(solver->table, key, wins ? 0 : CB_MATE_INFINITE, wins ? CB_MATE_INFINITE : 0, 1);
+        return;
+    }
+
+    // The defender was not mated in time.
+    if(!attacking && moves_left == 0)
+    {
+        cb_mate_store(solver->table, key, 0, CB_MATE_INFINITE, 1);
+        return;
+    }
+
+    for(uchar i = 0; i < frame->moves.count; i++)
+    {
+        cb_move *move = &frame->moves.moves[i];
+
+        cb_make_move(board, move, &undo, &solver->history);
+        frame->child_keys[i] = cb_mate_node_key(cb_history_current_key(&solver->history), child_moves_left);
+
+        // The last move of the mating side either mates or fails, no need to go down.
+        if(attacking && child_moves_left == 0)
+        {
+            int mated = cb_mate_generate(solver, board, &solver->stack[ply + 1].moves, &in_check) == 0 && in_check;
+            cb_mate_store(solver->table, frame->child_keys[i], mated ? CB_MATE_INFINITE : 0, mated ? 0 : CB_MATE_INFINITE, 1);
+        }
+
+        cb_unmake_move(board, move, &undo, &solver->history);
+    }
+
+    for(;;)
+    {
+        uint32_t best_phi = 0;
+        uint32_t best_delta = CB_MATE_INFINITE;
+        uint32_t second_delta = CB_MATE_INFINITE;
+        uchar best = 0;
+
+        phi = CB_MATE_INFINITE;
+        delta = 0;
+
+        for(uchar i = 0; i < frame->moves.count; i++)
+        {
+            uint32_t child_phi, child_delta, child_work;
+
+            cb_mate_probe(solver->table, frame->child_keys[i], &child_phi, &child_delta, &child_work);
+
+            if(child_delta < phi) phi = child_delta;
+            delta = cb_mate_add(delta, child_phi);
+
+            if(child_delta < best_delta)
+            {
+                second_delta = best_delta;
+                best_delta = child_delta;
+                best_phi = child_phi;
+                best = i;
+            }
+            else if(child_delta < second_delta)
+            {
+                second_delta = child_delta;
+            }
+        }
+
+        if(phi >= phi_threshold || delta >= delta_threshold || solver->stopped)
+        {
+            break;
+        }
+
+        // Go down until the child is no longer the most promising one.
+        uint32_t child_phi_threshold = delta_threshold == CB_MATE_INFINITE ? CB_MATE_INFINITE : cb_mate_add(delta_threshold - delta, best_phi);
+        uint32_t child_delta_threshold = cb_mate_add(second_delta, 1) < phi_threshold ? cb_mate_add(second_delta, 1) : phi_threshold;
+        cb_move *move = &frame->moves.moves[best];
+
+        cb_make_move(board, move, &undo, &solver->history);
+        cb_mate_search(solver, board, frame->child_keys[best], ply + 1, child_moves_left, !attacking, child_phi_threshold, child_delta_threshold);
+        cb_unmake_move(board, move, &undo, &solver->history);
+    }
+
+    cb_mate_store(solver->table, key, phi, delta, solver->nodes - first_node);
+}
+
+/*
+ * Follow the table from the root: the winning side plays its quickest win,
+ * the losing side the defence of the most work. A disproven root stops
+ * after the refutation of its best try.
+ */
+static void cb_mate_line(cb_mate_solver *solver, chess_board *board, uchar moves_left, cb_mate_result *result)
+{
+    chess_board position = *board;
+    cb_move_list *moves = &solver->stack[0].moves;
+    cb_position_history *history = &solver->history;
+    cb_move_undo undo;
+    int attacking = 1;
+    int in_check;
+
+    cb_initialize_history(history, &position);
+
+    while(result->length < CB_MATE_MAX_PLIES)
+    {
+        cb_hash_key key = cb_mate_node_key(cb_history_current_key(history), moves_left);
+        uchar child_moves_left = attacking ? moves_left - 1 : moves_left;
+        uint32_t phi, delta, work;
+        int chosen = -1;
+        uint32_t chosen_work = 0;
+
+        if(!cb_mate_probe(solver->table, key, &phi, &delta, &work) || (phi != 0 && delta != 0)
+           || cb_mate_generate(solver, &position, moves, &in_check) == 0)
+        {
+            break;
+        }
+
+        // Out of moves to mate with, any defence refutes the try.
+        if(!attacking && moves_left == 0)
+        {
+            if(result->status == CB_MATE_DISPROVEN)
+            {
+                result->line[result->length++] = moves->moves[0];
+            }
+            break;
+        }
+
+        for(uchar i = 0; i < moves->count; i++)
+        {
+            uint32_t child_phi, child_delta, child_work;
+
+            cb_make_move(&position, &moves->moves[i], &undo, history);
+            cb_mate_probe(solver->table, cb_mate_node_key(cb_history_current_key(history), child_moves_left), &child_phi, &child_delta, &child_work);
+            cb_unmake_move(&position, &moves->moves[i], &undo, history);
+
+            // A winning side looks for a losing child, a losing side for the hardest one.
+            if(phi == 0 ? (child_delta == 0 && (chosen < 0 || child_work < chosen_work))
+                        : (child_phi == 0 && child_work > 0 && (chosen < 0 || child_work > chosen_work)))
+            {
+                chosen = i;
+                chosen_work = child_work;
+            }
+        }
+
+        if(chosen < 0)
+        {
+            break;
+        }
+
+        result->line[result->length++] = moves->moves[chosen];
+        cb_make_move(&position, &moves->moves[chosen], &undo, history);
+
+        // A refutation is the try and the answer to it.
+        if(result->status == CB_MATE_DISPROVEN && result->length == 2)
+        {
+            break;
+        }
+
+        moves_left = child_moves_left;
+        attacking = !attacking;
+    }
+}
+
+/**
+ * Initialize a solver. It is large, mostly its stack of move lists; see
+ * the memory report.
+ * @param solver Solver to initialize.
+ * @param table Table of the solver, initialized with cb_initialize_mate_table
+ * or cb_attach_mate_table.
+ */
+void cb_initialize_mate_solver(cb_mate_solver *solver, cb_mate_table *table)
+{
+    memset(solver, 0, sizeof(cb_mate_solver));
+    solver->table = table;
+}
+
+/**
+ * Look for a forced mate by the side to move. Mates of one move, then two
+ * and so on are tried up to the limit, so the mate proven is a shortest
+ * one. The table is not cleared: solving the same position again, or with
+ * more moves, reuses the work done.
+ * @param solver Solver initialized with cb_initialize_mate_solver.
+ * @param board Position to solve. It is left unchanged.
+ * @param limits Most moves of the mate, and when to give up.
+ * @param result Filled with the status and the line proving it.
+ */
+void cb_solve_mate(cb_mate_solver *solver, chess_board *board, const cb_mate_limits *limits, cb_mate_result *result)
+{
+    chess_board position = *board;
+    uchar max_moves = limits->moves == 0 || limits->moves > CB_MATE_MAX_MOVES ? CB_MATE_MAX_MOVES : limits->moves;
+    uchar moves = 1;
+
+    memset(result, 0, sizeof(cb_mate_result));
+    solver->limits = *limits;
+    solver->nodes = 0;
+    solver->stopped = 0;
+    solver->start_ms = cb_mate_clock_ms();
+
+    cb_initialize_history(&solver->history, &position);
+
+    for(; moves <= max_moves; moves++)
+    {
+        cb_hash_key key = cb_mate_node_key(cb_history_current_key(&solver->history), moves);
+        uint32_t phi, delta, work;
+
+        cb_mate_search(solver, &position, key, 0, moves, 1, CB_MATE_INFINITE, CB_MATE_INFINITE);
+
+        if(solver->stopped || !cb_mate_probe(solver->table, key, &phi, &delta, &work))
+        {
+            break;
+        }
+
+        if(phi == 0)
+        {
+            result->status = CB_MATE_PROVEN;
+            result->mate_in = moves;
+            break;
+        }
+    }
+
+    if(!solver->stopped && result->status != CB_MATE_PROVEN && moves > max_moves)
+    {
+        result->status = CB_MATE_DISPROVEN;
+        moves = max_moves;
+    }
+
+    if(result->status != CB_MATE_UNKNOWN)
+    {
+        cb_mate_line(solver, board, moves, result);
+    }
+
+    result->nodes = solver->nodes;
+    result->time_ms = cb_mate_clock_ms() - solver->start_ms;
+}
@@ -4,7 +4,10 @@
  * @brief Tools for moving pieces on a chess board
  */
 
+#include <stddef.h>
 #include "chess.h"
+#include "zobrist.h"
+#include "history.h"
 #include "movement.h"
 
 /**
@@ -16,19 +19,178 @@
 void cb_perform_movement(chess_board *board, cb_move *move)
 {
     // Get piece value that is being moved
-    uchar moved_piece_value = cb_get_board_value_at_square_index(board, move->from_square_index);
+    uchar moved_piece_value = cb_board_get(board, move->from_square_index);
 
     // Set the old square to empty
-    cb_set_board_value_at_square_index(board, move->from_square_index, EMPTY_SQUARE);
+    cb_board_set(board, move->from_square_index, EMPTY_SQUARE);
 
     /* Put the piece on the new square
      * If there was already a piece there, it's effectively removed from the board
      * as if it was taken in the game.
      */
-    cb_set_board_value_at_square_index(board, move->to_square_index, moved_piece_value);
+    cb_board_set(board, move->to_square_index, moved_piece_value);
 }
 
 uchar cb_find_movement_source_square_index(cb_move *move, uchar piece_value)
 {
 
+}
+
+/**
+ * Castling rights that remain after a piece leaves or arrives on a square.
+ * Moving the king or a rook, or capturing a rook, loses the matching rights.
+ */
+static uchar cb_castling_rights_after(uchar castling_rights, uchar square_index)
+{
+    switch(square_index)
+    {
+        case 0:  return castling_rights & ~CASTLE_RIGHTS_QUEENSIDE_WHITE;
+        case 4:  return castling_rights & ~(CASTLE_RIGHTS_KINGSIDE_WHITE | CASTLE_RIGHTS_QUEENSIDE_WHITE);
+        case 7:  return castling_rights & ~CASTLE_RIGHTS_KINGSIDE_WHITE;
+        case 56: return castling_rights & ~CASTLE_RIGHTS_QUEENSIDE_BLACK;
+        case 60: return castling_rights & ~(CASTLE_RIGHTS_KINGSIDE_BLACK | CASTLE_RIGHTS_QUEENSIDE_BLACK);
+        case 63: return castling_rights & ~CASTLE_RIGHTS_KINGSIDE_BLACK;
+        default: return castling_rights;
+    }
+}
+
+/**
+ * Play a move on the board following all of the rules of chess: castling
+ * moves the rook, en passant removes the captured pawn, pawns are promoted,
+ * and the castling rights, en passant square and counters are updated.
+ *
+ * Like cb_perform_movement, the legality of the move is NOT checked. Use
+ * cb_is_move_legal first for moves coming from untrusted sources.
+ * @param board Board on which to play the move.
+ * @param move Move to play.
+ * @param undo Filled with what is needed to take the move back with cb_unmake_move.
+ * @param history If not NULL, the Zobrist key of the new position is computed
+ * incrementally from the current one and pushed onto it.
+ */
+void cb_make_move(chess_board *board, cb_move *move, cb_move_undo *undo, cb_position_history *history)
+{
+    uchar from = move->from_square_index;
+    uchar to = move->to_square_index;
+    uchar piece = cb_board_get(board, from);
+    uchar color = piece & BLACK;
+    uchar captured_square_index = to;
+    uchar rook_from = 0;
+    uchar rook_to = 0;
+
+    undo->moved_piece = piece;
+    undo->captured_piece = cb_board_get(board, to);
+    undo->castling_rights = board->castling_rights;
+    undo->ep_target_square_index = board->ep_target_square_index;
+    undo->halfmove_clock = board->halfmove_clock;
+
+    cb_board_set(board, from, EMPTY_SQUARE);
+    board->ep_target_square_index = -1;
+    board->halfmove_clock++;
+
+    if((piece & COLOR_MASK) == PAWN)
+    {
+        board->halfmove_clock = 0;
+
+        // En passant, the captured pawn is behind the target square.
+        if(to == undo->ep_target_square_index)
+        {
+            captured_square_index = color == WHITE ? to - 8 : to + 8;
+            undo->captured_piece = cb_board_get(board, captured_square_index);
+            cb_board_set(board, captured_square_index, EMPTY_SQUARE);
+        }
+        // Double push, the square that was skipped becomes the en passant target.
+        else if(to == from + 16 || from == to + 16)
+        {
+            board->ep_target_square_index = (from + to) / 2;
+        }
+        // Promotion
+        else if(to / 8 == 7 || to / 8 == 0)
+        {
+            uchar promotion_piece = move->promotion_piece & COLOR_MASK;
+            piece = color | (promotion_piece == EMPTY_SQUARE ? QUEEN : promotion_piece);
+        }
+    }
+    // Castling, the rook jumps over the king.
+    else if((piece & COLOR_MASK) == KING && (to == from + 2 || from == to + 2))
+    {
+        rook_from = to > from ? from + 3 : from - 4;
+        rook_to = to > from ? from + 1 : from - 1;
+
+        cb_board_set(board, rook_to, cb_board_get(board, rook_from));
+        cb_board_set(board, rook_from, EMPTY_SQUARE);
+    }
+
+    if(undo->captured_piece != EMPTY_SQUARE)
+    {
+        board->halfmove_clock = 0;
+    }
+
+    cb_board_set(board, to, piece);
+
+    board->castling_rights = cb_castling_rights_after(cb_castling_rights_after(board->castling_rights, from), to);
+    board->move_counter++;
+
+    if(history != NULL)
+    {
+        cb_hash_key key = cb_history_current_key(history);
+
+        key ^= cb_zobrist_piece_key(undo->moved_piece, from) ^ cb_zobrist_piece_key(piece, to);
+        key ^= cb_zobrist_piece_key(undo->captured_piece, captured_square_index);
+        key ^= cb_zobrist_castling_key(undo->castling_rights) ^ cb_zobrist_castling_key(board->castling_rights);
+        key ^= cb_zobrist_ep_key(undo->ep_target_square_index) ^ cb_zobrist_ep_key(board->ep_target_square_index);
+        key ^= cb_zobrist_side_key();
+
+        if(rook_from != rook_to)
+        {
+            key ^= cb_zobrist_piece_key(color | ROOK, rook_from) ^ cb_zobrist_piece_key(color | ROOK, rook_to);
+        }
+
+        cb_push_history(history, key);
+    }
+}
+
+/**
+ * Take back a move played with cb_make_move.
+ * @param board Board on which the move was played.
+ * @param move Move that was played.
+ * @param undo Undo information filled by cb_make_move.
+ * @param history History given to cb_make_move, if any. Its current position
+ * is popped.
+ */
+void cb_unmake_move(chess_board *board, cb_move *move, cb_move_undo *undo, cb_position_history *history)
+{
+    uchar from = move->from_square_index;
+    uchar to = move->to_square_index;
+    uchar piece_type = undo->moved_piece & COLOR_MASK;
+
+    cb_board_set(board, from, undo->moved_piece);
+
+    if(piece_type == PAWN && to == undo->ep_target_square_index)
+    {
+        cb_board_set(board, to, EMPTY_SQUARE);
+        cb_board_set(board, (undo->moved_piece & BLACK) == WHITE ? to - 8 : to + 8, undo->captured_piece);
+    }
+    else
+    {
+        cb_board_set(board, to, undo->captured_piece);
+    }
+
+    if(piece_type == KING && (to == from + 2 || from == to + 2))
+    {
+        uchar rook_from = to > from ? from + 3 : from - 4;
+        uchar rook_to = to > from ? from + 1 : from - 1;
+
+        cb_board_set(board, rook_from, cb_board_get(board, rook_to));
+        cb_board_set(board, rook_to, EMPTY_SQUARE);
+    }
+
+    board->castling_rights = undo->castling_rights;
+    board->ep_target_square_index = undo->ep_target_square_index;
+    board->halfmove_clock = undo->halfmove_clock;
+    board->move_counter--;
+
+    if(history != NULL)
+    {
+        cb_pop_history(history);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,408 @@
+/**
+ * @file nnue.c
+ * @author Nathan Seymour
+ * @brief Efficiently updatable neural network (NNUE) evaluation.
+ *
+ * The network has a single hidden layer. Its input is the set of pieces on
+ * the board, seen from both sides, so that a move only turns on or off a
+ * handful of features: the first layer (the accumulator) is updated by adding
+ * and subtracting weight columns instead of being recomputed.
+ *
+ * Kernels are selected at compile time from the instruction sets enabled for
+ * this file: AVX2, SSE4.1 or WASM SIMD128, with a portable scalar fallback
+ * (forced with CB_NNUE_SCALAR).
+ */
+
+#include <string.h>
+#include "chess.h"
+#include "nnue.h"
+
+#if defined(CB_NNUE_SCALAR)
+// Portable kernels only.
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define NNUE_AVX2
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#define NNUE_SSE41
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define NNUE_WASM_SIMD128
+#endif
+
+#if CB_NNUE_HIDDEN_SIZE % 32 != 0
+#error "CB_NNUE_HIDDEN_SIZE must be a multiple of 32."
+#endif
+
+/**
+ * Index of the feature for a piece on a square, from the point of view of
+ * one side. Black's point of view is the board flipped vertically with the
+ * colors swapped, so that both perspectives share the same weights.
+ */
+static unsigned int cb_nnue_feature_index(uchar perspective, uchar piece_value, uchar square_index)
+{
+    uchar color = (piece_value & BLACK) ? 1 : 0;
+    uchar piece_type = (uchar)((piece_value & COLOR_MASK) - 1);
+
+    if(perspective == 1)
+    {
+        color ^= 1;
+        square_index ^= 56;
+    }
+
+    return (unsigned int)((color * 6 + piece_type) * 64 + square_index);
+}
+
+/*
+ * Accumulator kernels
+ */
+
+static void cb_nnue_add_column(int16_t *values, const int16_t *column)
+{
+#if defined(NNUE_AVX2)
+    for(int i = 0; i < CB_NNUE_HIDDEN_SIZE; i += 16)
+    {
+        __m256i sum = _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(values + i)), _mm256_loadu_si256((const __m256i*)(column + i)));
+        _mm256_storeu_si256((__m256i*)(values + i), sum);
+    }
+#elif defined(NNUE_SSE41)
+    for(int i = 0; i < CB_NNUE_HIDDEN_SIZE; i += 8)
+    {
+        __m128i sum = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(values + i)), _mm_loadu_si128((const __m128i*)(column + i)));
+        _mm_storeu_si128((__m128i*)(values + i), sum);
+    }
+#elif defined(NNUE_WASM_SIMD128)
+    for(int i = 0; i < CB_NNUE_HIDDEN_SIZE; i += 8)
+    {
+        wasm_v128_store(values + i, wasm_i16x8_add(wasm_v128_load(values + i), wasm_v128_load(column + i)));
+    }
+#else
+    for(int i = 0; i < CB_NNUE_HIDDEN_SIZE; i++)
+    {
+        values[i] = (int16_t)(values[i] + column[i]);
+    }
+#endif
+}
+
+static void cb_nnue_sub_column(int16_t *values, const int16_t *column)
+{
+#if defined(NNUE_AVX2)
+    for(int i = 0; i < CB_NNUE_HIDDEN_SIZE; i += 16)
+    {
+        __m256i difference = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i*)(values + i)), _mm256_loadu_si256((const __m256i*)(column + i)));
+        _mm256_storeu_si256((__m256i*)(values + i), difference);
+    }
+#elif defined(NNUE_SSE41)
+    for(int i = 0; i < CB_NNUE_HIDDEN_SIZE; i += 8)
+    {
+        __m128i difference = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(values + i)), _mm_loadu_si128((const __m128i*)(column + i)));
+        _mm_storeu_si128((__m128i*)(values + i), difference);
+    }
+#elif defined(NNUE_WASM_SIMD128)
+    for(int i = 0; i < CB_NNUE_HIDDEN_SIZE; i += 8)
+    {
+        wasm_v128_store(values + i, wasm_i16x8_sub(wasm_v128_load(values + i), wasm_v128_load(column + i)));
+    }
+#else
+    for(int i = 0; i < CB_NNUE_HIDDEN_SIZE; i++)
+    {
+        values[i] = (int16_t)(values[i] - column[i]);
+    }
+#endif
+}
+
+/*
+ * Output kernel: dot product of the clipped activations (uint8) with the
+ * output weights (int8), accumulated in 32 bits.
+ */
+
+static int32_t cb_nnue_output_dot(const int16_t *values, const int8_t *weights)
+{
+#if defined(NNUE_AVX2)
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i activation_max = _mm256_set1_epi16(CB_NNUE_ACTIVATION_MAX);
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i sum = _mm256_setzero_si256();
+
+    for(int i = 0; i < CB_NNUE_HIDDEN_SIZE; i += 32)
+    {
+        __m256i low = _mm256_min_epi16(_mm256_max_epi16(_mm256_loadu_si256((const __m256i*)(values + i)), zero), activation_max);
+        __m256i high = _mm256_min_epi16(_mm256_max_epi16(_mm256_loadu_si256((const __m256i*)(values + i + 16)), zero), activation_max);
+
+        // Packing works within 128 bit lanes, so the quarters need reordering.
+        __m256i activations = _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), 0xD8);
+        __m256i products = _mm256_maddubs_epi16(activations, _mm256_loadu_si256((const __m256i*)(weights + i)));
+
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(products, ones));
+    }
+
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4E));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xB1));
+
+    return _mm_cvtsi128_si32(half);
+#elif defined(NNUE_SSE41)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i activation_max = _mm_set1_epi16(CB_NNUE_ACTIVATION_MAX);
+    const __m128i ones = _mm_set1_epi16(1);
+    __m128i sum = _mm_setzero_si128();
+
+    for(int i = 0; i < CB_NNUE_HIDDEN_SIZE; i += 16)
+    {
+        __m128i low = _mm_min_epi16(_mm_max_epi16(_mm_loadu_si128((const __m128i*)(values + i)), zero), activation_max);
+        __m128i high = _mm_min_epi16(_mm_max_epi16(_mm_loadu_si128((const __m128i*)(values + i + 8)), zero), activation_max);
+
+        __m128i activations = _mm_packus_epi16(low, high);
+        __m128i products = _mm_maddubs_epi16(activations, _mm_loadu_si128((const __m128i*)(weights + i)));
+
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(products, ones));
+    }
+
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+
+    return _mm_cvtsi128_si32(sum);
+#elif defined(NNUE_WASM_SIMD128)
+    const v128_t zero = wasm_i16x8_splat(0);
+    const v128_t activation_max = wasm_i16x8_splat(CB_NNUE_ACTIVATION_MAX);
+    v128_t sum = wasm_i32x4_splat(0);
+
+    for(int i = 0; i < CB_NNUE_HIDDEN_SIZE; i += 8)
+    {
+        v128_t activations = wasm_i16x8_min(wasm_i16x8_max(wasm_v128_load(values + i), zero), activation_max);
+        v128_t widened_weights = wasm_i16x8_load8x8(weights + i);
+
+        sum = wasm_i32x4_add(sum, wasm_i32x4_dot_i16x8(activations, widened_weights));
+    }
+
+    return wasm_i32x4_extract_lane(sum, 0) + wasm_i32x4_extract_lane(sum, 1)
+        + wasm_i32x4_extract_lane(sum, 2) + wasm_i32x4_extract_lane(sum, 3);
+#else
+    int32_t sum = 0;
+
+    for(int i = 0; i < CB_NNUE_HIDDEN_SIZE; i++)
+    {
+        int16_t activation = values[i];
+        if(activation < 0)
+        {
+            activation = 0;
+        }
+        else if(activation > CB_NNUE_ACTIVATION_MAX)
+        {
+            activation = CB_NNUE_ACTIVATION_MAX;
+        }
+
+        sum += activation * weights[i];
+    }
+
+    return sum;
+#endif
+}
+
+static uint32_t cb_nnue_read_u32(const uchar *data)
+{
+    return (uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+/**
+ * Initialize a network from a network file already in memory. The buffer is
+ * not copied and must outlive the network.
+ * @param network Network to initialize.
+ * @param data Contents of a network file.
+ * @param size Size of the buffer in bytes.
+ * @return 1 if the network is valid, 0 otherwise.
+ */
+int cb_nnue_init_network(cb_nnue_network *network, const void *data, size_t size)
+{
+    const uchar *bytes = data;
+    size_t expected_size = CB_NNUE_HEADER_SIZE
+            + CB_NNUE_HIDDEN_SIZE * sizeof(int16_t)
+            + CB_NNUE_FEATURE_COUNT * CB_NNUE_HIDDEN_SIZE * sizeof(int16_t)
+            + 2 * CB_NNUE_HIDDEN_SIZE * sizeof(int8_t);
+
+    if(size < expected_size
+        || cb_nnue_read_u32(bytes) != CB_NNUE_MAGIC
+        || cb_nnue_read_u32(bytes + 4) != CB_NNUE_VERSION
+        || cb_nnue_read_u32(bytes + 8) != CB_NNUE_HIDDEN_SIZE)
+    {
+        return 0;
+    }
+
+    network->output_scale = (int32_t)cb_nnue_read_u32(bytes + 12);
+    network->output_bias = (int32_t)cb_nnue_read_u32(bytes + 16);
+
+    if(network->output_scale <= 0)
+    {
+        return 0;
+    }
+
+    bytes += CB_NNUE_HEADER_SIZE;
+    network->feature_biases = (const int16_t*)bytes;
+
+    bytes += CB_NNUE_HIDDEN_SIZE * sizeof(int16_t);
+    network->feature_weights = (const int16_t*)bytes;
+
+    bytes += CB_NNUE_FEATURE_COUNT * CB_NNUE_HIDDEN_SIZE * sizeof(int16_t);
+    network->output_weights = (const int8_t*)bytes;
+
+    return 1;
+}
+
+/**
+ * Load a network from a file. The file is memory-mapped where the platform
+ * allows it, so that many processes evaluating with the same network share
+ * its pages. cb_nnue_free_network must be called when done.
+ * @param network Network to load into.
+ * @param path Path of the network file.
+ * @return 1 on success, 0 if the file is missing or not a valid network.
+ */
+int cb_nnue_load_network(cb_nnue_network *network, const char *path)
+{
+    if(!pcmem_map_file(&network->mapping, path))
+    {
+        return 0;
+    }
+
+    if(!cb_nnue_init_network(network, network->mapping.data, network->mapping.size))
+    {
+        pcmem_unmap_file(&network->mapping);
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Release a network loaded with cb_nnue_load_network.
+ * @param network Network to free.
+ */
+void cb_nnue_free_network(cb_nnue_network *network)
+{
+    pcmem_unmap_file(&network->mapping);
+}
+
+/**
+ * Turn on the features of a piece placed on a square.
+ * @param network Network the accumulator belongs to.
+ * @param accumulator Accumulator to update.
+ * @param piece_value Bitwise-OR'd piece and color value. Ex: BLACK | ROOK.
+ * @param square_index Square the piece is placed on.
+ */
+void cb_nnue_add_piece(const cb_nnue_network *network, cb_nnue_accumulator *accumulator, uchar piece_value, uchar square_index)
+{
+    for(uchar perspective = 0; perspective < 2; perspective++)
+    {
+        unsigned int feature = cb_nnue_feature_index(perspective, piece_value, square_index);
+        cb_nnue_add_column(accumulator->values[perspective], network->feature_weights + feature * CB_NNUE_HIDDEN_SIZE);
+    }
+}
+
+/**
+ * Turn off the features of a piece removed from a square.
+ * @param network Network the accumulator belongs to.
+ * @param accumulator Accumulator to update.
+ * @param piece_value Bitwise-OR'd piece and color value. Ex: BLACK | ROOK.
+ * @param square_index Square the piece is removed from.
+ */
+void cb_nnue_remove_piece(const cb_nnue_network *network, cb_nnue_accumulator *accumulator, uchar piece_value, uchar square_index)
+{
+    for(uchar perspective = 0; perspective < 2; perspective++)
+    {
+        unsigned int feature = cb_nnue_feature_index(perspective, piece_value, square_index);
+        cb_nnue_sub_column(accumulator->values[perspective], network->feature_weights + feature * CB_NNUE_HIDDEN_SIZE);
+    }
+}
+
+/**
+ * Compute the accumulator of a position from scratch. Only needed for the
+ * root position, later positions are reached with cb_nnue_update_accumulator.
+ * @param network Network to evaluate with.
+ * @param accumulator Accumulator to fill.
+ * @param board Position to compute the accumulator of.
+ */
+void cb_nnue_refresh_accumulator(const cb_nnue_network *network, cb_nnue_accumulator *accumulator, chess_board *board)
+{
+    memcpy(accumulator->values[0], network->feature_biases, sizeof(accumulator->values[0]));
+    memcpy(accumulator->values[1], network->feature_biases, sizeof(accumulator->values[1]));
+
+    for(uchar square_index = 0; square_index < 64; square_index++)
+    {
+        uchar piece = cb_board_get(board, square_index);
+
+        if(piece != EMPTY_SQUARE)
+        {
+            cb_nnue_add_piece(network, accumulator, piece, square_index);
+        }
+    }
+}
+
+/**
+ * Update an accumulator for a move, following the rules of cb_make_move:
+ * castling also moves the rook, en passant removes the pawn behind the
+ * target square and promotions place the promoted piece. Must be called
+ * BEFORE the move is performed on the board, as the moved and captured
+ * pieces are read from it.
+ * @param network Network the accumulator belongs to.
+ * @param accumulator Accumulator of the position before the move.
+ * @param board Board the move is about to be performed on.
+ * @param move Move about to be performed.
+ */
+void cb_nnue_update_accumulator(const cb_nnue_network *network, cb_nnue_accumulator *accumulator, chess_board *board, cb_move *move)
+{
+    uchar from = move->from_square_index;
+    uchar to = move->to_square_index;
+    uchar moved_piece = cb_board_get(board, from);
+    uchar placed_piece = moved_piece;
+    uchar color = moved_piece & BLACK;
+    uchar captured_square_index = to;
+
+    if((moved_piece & COLOR_MASK) == PAWN)
+    {
+        if(to == board->ep_target_square_index)
+        {
+            captured_square_index = color == WHITE ? to - 8 : to + 8;
+        }
+        else if(to / 8 == 7 || to / 8 == 0)
+        {
+            uchar promotion_piece = move->promotion_piece & COLOR_MASK;
+            placed_piece = color | (promotion_piece == EMPTY_SQUARE ? QUEEN : promotion_piece);
+        }
+    }
+    else if((moved_piece & COLOR_MASK) == KING && (to == from + 2 || from == to + 2))
+    {
+        uchar rook_from = to > from ? from + 3 : from - 4;
+        uchar rook_to = to > from ? from + 1 : from - 1;
+
+        cb_nnue_remove_piece(network, accumulator, color | ROOK, rook_from);
+        cb_nnue_add_piece(network, accumulator, color | ROOK, rook_to);
+    }
+
+    uchar captured_piece = cb_board_get(board, captured_square_index);
+
+    cb_nnue_remove_piece(network, accumulator, moved_piece, from);
+
+    if(captured_piece != EMPTY_SQUARE)
+    {
+        cb_nnue_remove_piece(network, accumulator, captured_piece, captured_square_index);
+    }
+
+    cb_nnue_add_piece(network, accumulator, placed_piece, to);
+}
+
+/**
+ * Evaluate a position from its accumulator.
+ * @param network Network to evaluate with.
+ * @param accumulator Accumulator of the position.
+ * @param side_to_move WHITE or BLACK.
+ * @return Evaluation in centipawns, from the point of view of the side to move.
+ */
+int cb_nnue_evaluate(const cb_nnue_network *network, const cb_nnue_accumulator *accumulator, uchar side_to_move)
+{
+    uchar us = side_to_move == BLACK ? 1 : 0;
+
+    int32_t output = network->output_bias;
+    output += cb_nnue_output_dot(accumulator->values[us], network->output_weights);
+    output += cb_nnue_output_dot(accumulator->values[us ^ 1], network->output_weights + CB_NNUE_HIDDEN_SIZE);
+
+    return (int)(output / network->output_scale);
+}
@@ -1,33 +1,41 @@
 /**
  * @file notation.c
  * @author Nathan Seymour
- * @brief Tools for parsing chess algebraic notation.
+ * @brief Tools for reading and writing chess move notation.
  */
 
+#include <string.h>
 #include "chess.h"
+#include "legality.h"
 #include "notation.h"
 #include "pcstrings.h"
 
 /**
- * Parse chess algebraic notation for a certain board and returns the
- * move object.
+ * Parse chess algebraic notation (SAN) for a certain board and find the
+ * move it describes among the legal moves of the board.
  *
  * NOTE: This function ignores all annotations.
+ *
+ * Castling is written "O-O" or "O-O-O" (zeros are accepted too). Captures
+ * ('x') do not need to be marked. A pawn reaching the last rank without a
+ * promotion piece ("e8" instead of "e8=Q") is promoted to a queen.
  * @param board Board to calculate notation moves from.
  * @param notation The chess algebraic notation to calculate. One move at a time.
  * Annotations will be ignored. Move number will be ignored.
- * @return Move object to be used with proton-chess movement tools.
+ * @param move Receives the move, to be used with proton-chess movement tools.
+ * @return 1 if a single legal move matches the notation, 0 otherwise.
  */
-cb_move cb_parse_notation(chess_board *board, const char *notation) {
-    // Move that will be returned
-    cb_move move;
+int cb_parse_notation(chess_board *board, const char *notation, cb_move *move)
+{
+    cb_move_list moves;
+    uchar matches = 0;
 
     /*
      * In the case of ambiguity (for example two bishops can move to the same
      * square), the file of the piece is noted that is being moved to the selected
-     * square. This is the file that is stored here, if needed.
+     * square. This is the file that is stored here, if needed. 0xFF when not given.
      */
-    uchar from_file = '\0';
+    uchar from_file = 0xFF;
 
     /*
      * In rare cases, two pieces can be on the same file and be able to move to the same
@@ -38,75 +46,125 @@ cb_move cb_parse_notation(chess_board *board, const char *notation) {
      *
      * In this case, the rank of the moved piece is noted. That is stored here.
      */
-    uchar from_rank = 0;
+    uchar from_rank = 0xFF;
 
     /*
      * Default to PAWN because if a piece is not specifically mentioned in the notation,
      * it must be a pawn. This saves us code while parsing.
      */
     uchar moved_piece = PAWN;
+    uchar promotion_piece = EMPTY_SQUARE;
+    uchar to_square_index = 0xFF;
 
-    uchar to_file;
-    uchar to_rank;
+    // Move numbers ("12." or "12...") are skipped.
+    size_t digits = strspn(notation, "0123456789");
+    if(digits > 0 && notation[digits] == '.')
+    {
+        notation += digits + strspn(notation + digits, ".");
+    }
 
-    // Loop over the notation until the null terminator
-    for (uchar i = 0; notation[i] != '\0'; i++)
+    // Castling, the king moves two squares.
+    if(notation[0] == 'O' || notation[0] == '0')
     {
-        // If the character is uppercase, then it must be the piece that is being moved.
-        if(is_char_uppercase(notation[i]))
+        uchar king_square_index = board->move_counter % 2 == 0 ? 4 : 60;
+        size_t length = strspn(notation, "O0-");
+
+        moved_piece = KING;
+        from_file = king_square_index % 8;
+        to_square_index = length >= 5 ? king_square_index - 2 : king_square_index + 2;
+    }
+    else
+    {
+        // The destination is the last square named, disambiguation comes before it.
+        uchar length = (uchar)strcspn(notation, "+#!? \t\r\n");
+        uchar destination = 0xFF;
+
+        for(uchar i = 0; i + 1 < length; i++)
         {
-            moved_piece = cb_lookup_table[notation[i]];
+            if(notation[i] >= 'a' && notation[i] <= 'h' && notation[i + 1] >= '1' && notation[i + 1] <= '8')
+            {
+                destination = i;
+            }
         }
-        // Check to see if character is lowercase. If so, it must be a file.
-        else if(is_char_lowercase(notation[i]))
+
+        if(destination == 0xFF)
+        {
+            return 0;
+        }
+
+        to_square_index = (notation[destination] - 'a') + (notation[destination + 1] - '1') * 8;
+
+        for(uchar i = 0; i < destination; i++)
         {
-            /*
-             * For our intents and purposes, we really don't care whether a move
-             * takes a piece or not.
-             */
-            if(notation[i] == 'x')
+            // If the character is uppercase, then it must be the piece that is being moved.
+            if(is_char_uppercase(notation[i]))
             {
-                continue;
+                moved_piece = cb_lookup_table[(uchar)notation[i]] & COLOR_MASK;
             }
-
-            /*
-             * If the previous character was uppercase, then it was a piece definition, and
-             * the following number is specifying the rank that it was on.
-             */
-            if(is_char_uppercase(notation[i - 1]) && i > 0)
+            // For our intents and purposes, we really don't care whether a move takes a piece or not.
+            else if(notation[i] >= 'a' && notation[i] <= 'h')
             {
-                from_file = notation[i];
+                from_file = notation[i] - 'a';
             }
-            /*
-             * Otherwise it must be part of the algebraic notation that notes the square that
-             * the piece moved to.
-             */
-            else
+            else if(notation[i] >= '1' && notation[i] <= '8')
             {
-                to_file = notation[i];
+                from_rank = notation[i] - '1';
             }
         }
-        // Check to see if the character is a number. If so, it must be a rank.
-        else if(is_char_digit(notation[i]))
+
+        // Promotion, "e8=Q" or "e8Q".
+        for(uchar i = destination + 2; i < length; i++)
         {
-            /*
-             * If the previous character was uppercase, then it was a piece definition, and
-             * the following number is specifying the rank that it was on.
-             */
-            if(is_char_uppercase(notation[i - 1]) && i > 0)
-            {
-                from_rank = cb_single_char_to_int(notation[i]);
-            }
-            /*
-             * Otherwise it must be part of the algebraic notation that notes the square that
-             * the piece moved to.
-             */
-            else
+            if(is_char_uppercase(notation[i]))
             {
-                to_rank = cb_single_char_to_int(notation[i]);
+                promotion_piece = cb_lookup_table[(uchar)notation[i]] & COLOR_MASK;
             }
         }
     }
 
-    return move;
-}
\ No newline at end of file
+    if(moved_piece == EMPTY_SQUARE)
+    {
+        return 0;
+    }
+
+    cb_generate_legal_moves(board, &moves);
+
+    for(uchar i = 0; i < moves.count; i++)
+    {
+        cb_move *candidate = &moves.moves[i];
+        uchar candidate_promotion = candidate->promotion_piece & COLOR_MASK;
+
+        if(candidate->to_square_index != to_square_index
+           || (cb_board_get(board, candidate->from_square_index) & COLOR_MASK) != moved_piece
+           || (from_file != 0xFF && candidate->from_square_index % 8 != from_file)
+           || (from_rank != 0xFF && candidate->from_square_index / 8 != from_rank)
+           || (candidate_promotion != EMPTY_SQUARE && candidate_promotion != (promotion_piece == EMPTY_SQUARE ? QUEEN : promotion_piece)))
+        {
+            continue;
+        }
+
+        *move = *candidate;
+        matches++;
+    }
+
+    return matches == 1;
+}
+
+/**
+ * Write a move in the coordinate notation of UCI, Ex: "e2e4" or "e7e8q".
+ * @param move Move to write.
+ * @param notation Receives the notation, null terminated.
+ * @return notation.
+ */
+char *cb_move_to_uci(const cb_move *move, char notation[6])
+{
+    char square[3];
+    uchar promotion_piece = move->promotion_piece & COLOR_MASK;
+
+    memcpy(notation, cb_coordinate_index_to_notation_r(move->from_square_index, square), 2);
+    memcpy(notation + 2, cb_coordinate_index_to_notation_r(move->to_square_index, square), 2);
+    notation[4] = promotion_piece != EMPTY_SQUARE ? " pnbrqk"[promotion_piece] : '\0';
+    notation[5] = '\0';
+
+    return notation;
+}
@@ -0,0 +1,396 @@
+/**
+ * @file pool.c
+ * @author Nathan Seymour
+ * @brief Pools of many concurrent games, stored as contiguous
+ * arrays and addressed by handles.
+ *
+ * Servers hosting thousands of games would otherwise allocate each board
+ * separately with cb_new_chess_board, scattering them over the heap. In a
+ * pool, all the games of a shard live in one block, each field in its own
+ * array, so that passes over many games touch as few cache lines as possible.
+ */
+
+#include <string.h>
+#include "chess.h"
+#include "zobrist.h"
+#include "pool.h"
+#include "pcmem.h"
+
+#define NO_FREE_SLOT 0xFFFFFFFF
+
+/*
+ * Each array of a shard starts on its own cache line.
+ */
+static uchar *cb_carve_array(uchar **cursor, size_t size)
+{
+    uchar *array = *cursor;
+    *cursor += pcmem_cache_line_round(size);
+    return array;
+}
+
+static size_t cb_shard_memory_size(uint32_t capacity)
+{
+    return pcmem_cache_line_round(capacity * sizeof(cb_board_squares))
+         + pcmem_cache_line_round(capacity * sizeof(ushort)) * 3
+         + pcmem_cache_line_round(capacity) * 2
+         + pcmem_cache_line_round(capacity * sizeof(cb_hash_key))
+         + pcmem_cache_line_round(capacity * sizeof(uint32_t));
+}
+
+/*
+ * Lay the arrays of a shard out in a zeroed, cache line aligned block of
+ * cb_shard_memory_size(capacity) bytes.
+ */
+static void cb_initialize_shard(cb_game_shard *shard, uint32_t capacity, void *memory)
+{
+    memset(shard, 0, sizeof(cb_game_shard));
+
+    shard->memory = memory;
+    shard->memory_size = cb_shard_memory_size(capacity);
+    memset(shard->memory, 0, shard->memory_size);
+
+    uchar *cursor = shard->memory;
+    shard->boards = (cb_board_squares*)cb_carve_array(&cursor, capacity * sizeof(cb_board_squares));
+    shard->move_counters = (ushort*)cb_carve_array(&cursor, capacity * sizeof(ushort));
+    shard->halfmove_clocks = (ushort*)cb_carve_array(&cursor, capacity * sizeof(ushort));
+    shard->castling_rights = cb_carve_array(&cursor, capacity);
+    shard->ep_target_square_indices = cb_carve_array(&cursor, capacity);
+    shard->generations = (ushort*)cb_carve_array(&cursor, capacity * sizeof(ushort));
+    shard->keys = (cb_hash_key*)cb_carve_array(&cursor, capacity * sizeof(cb_hash_key));
+    shard->next_free_slots = (uint32_t*)cb_carve_array(&cursor, capacity * sizeof(uint32_t));
+
+    shard->capacity = capacity;
+    shard->free_head = capacity > 0 ? 0 : NO_FREE_SLOT;
+    for(uint32_t slot = 0; slot < capacity; slot++)
+    {
+        shard->next_free_slots[slot] = slot + 1 < capacity ? slot + 1 : NO_FREE_SLOT;
+    }
+}
+
+static cb_game_shard *cb_handle_shard(cb_game_pool *pool, cb_game_handle handle, uint32_t *slot)
+{
+    uchar shard_index = cb_game_handle_shard(handle);
+
+    if(handle == CB_INVALID_GAME_HANDLE || shard_index >= pool->shard_count)
+    {
+        return NULL;
+    }
+
+    cb_game_shard *shard = &pool->shards[shard_index];
+    *slot = cb_game_handle_slot(handle);
+
+    // Free slots have an even generation, which handles of live games never have.
+    if(*slot >= shard->capacity || shard->generations[*slot] != cb_game_handle_generation(handle)
+       || shard->generations[*slot] % 2 == 0)
+    {
+        return NULL;
+    }
+
+    return shard;
+}
+
+/**
+ * Memory needed by cb_attach_game_pool for a pool, alignment included.
+ * @param shard_count Number of shards.
+ * @param shard_capacity Maximum number of games in each shard.
+ * @return Size in bytes.
+ */
+size_t cb_game_pool_memory_size(unsigned int shard_count, uint32_t shard_capacity)
+{
+    return PCMEM_CACHE_LINE_SIZE
+         + pcmem_cache_line_round(sizeof(cb_game_shard) * shard_count)
+         + cb_shard_memory_size(shard_capacity) * shard_count;
+}
+
+/**
+ * Set up a pool of games in memory provided by the caller, which must
+ * outlive the pool. Nothing is allocated, and cb_free_game_pool must not
+ * be called on the pool.
+ * @param pool Pool to initialize.
+ * @param memory Memory of the pool.
+ * @param size Size of the memory, at least
+ * cb_game_pool_memory_size(shard_count, shard_capacity).
+ * @param shard_count Number of shards, usually the number of threads, at
+ * most CB_POOL_MAX_SHARDS.
+ * @param shard_capacity Maximum number of games in each shard.
+ * @return 1 on success, 0 if the arguments are out of range or the memory
+ * is too small.
+ */
+int cb_attach_game_pool(cb_game_pool *pool, void *memory, size_t size, unsigned int shard_count, uint32_t shard_capacity)
+{
+    pool->shard_count = 0;
+    pool->shards = NULL;
+
+    if(shard_count == 0 || shard_count > CB_POOL_MAX_SHARDS || shard_capacity > CB_POOL_MAX_SHARD_CAPACITY
+       || memory == NULL || size < cb_game_pool_memory_size(shard_count, shard_capacity))
+    {
+        return 0;
+    }
+
+    uchar *cursor = (uchar*)memory + (PCMEM_CACHE_LINE_SIZE - (size_t)memory % PCMEM_CACHE_LINE_SIZE) % PCMEM_CACHE_LINE_SIZE;
+    pool->shards = (cb_game_shard*)cb_carve_array(&cursor, sizeof(cb_game_shard) * shard_count);
+
+    for(uchar i = 0; i < shard_count; i++)
+    {
+        cb_initialize_shard(&pool->shards[i], shard_capacity, cb_carve_array(&cursor, cb_shard_memory_size(shard_capacity)));
+    }
+
+    pool->shard_count = (uchar)shard_count;
+    return 1;
+}
+
+#ifdef DYNAMIC_MEMORY_ALLOCATION
+/**
+ * Allocate a pool of games. Each thread hosting games should create them in
+ * its own shard. cb_free_game_pool must be called when done.
+ * @param pool Pool to initialize.
+ * @param shard_count Number of shards, usually the number of threads, at
+ * most CB_POOL_MAX_SHARDS.
+ * @param shard_capacity Maximum number of games in each shard.
+ * @return 1 on success, 0 if the arguments are out of range or the memory
+ * could not be allocated.
+ */
+int cb_initialize_game_pool(cb_game_pool *pool, unsigned int shard_count, uint32_t shard_capacity)
+{
+    pool->shard_count = 0;
+    pool->shards = NULL;
+
+    if(shard_count == 0 || shard_count > CB_POOL_MAX_SHARDS || shard_capacity > CB_POOL_MAX_SHARD_CAPACITY)
+    {
+        return 0;
+    }
+
+    pool->shards = pcmem_aligned_alloc(sizeof(cb_game_shard) * shard_count, PCMEM_CACHE_LINE_SIZE);
+    if(pool->shards == NULL)
+    {
+        return 0;
+    }
+
+    for(uchar i = 0; i < shard_count; i++)
+    {
+        void *memory = pcmem_aligned_alloc(cb_shard_memory_size(shard_capacity), PCMEM_CACHE_LINE_SIZE);
+
+        if(memory == NULL)
+        {
+            pool->shard_count = i;
+            cb_free_game_pool(pool);
+            return 0;
+        }
+
+        cb_initialize_shard(&pool->shards[i], shard_capacity, memory);
+    }
+
+    pool->shard_count = (uchar)shard_count;
+    return 1;
+}
+
+/**
+ * Release a pool and every game in it.
+ * @param pool Pool to free.
+ */
+void cb_free_game_pool(cb_game_pool *pool)
+{
+    for(uchar i = 0; i < pool->shard_count; i++)
+    {
+        pcmem_aligned_free(pool->shards[i].memory);
+    }
+
+    pcmem_aligned_free(pool->shards);
+    pool->shards = NULL;
+    pool->shard_count = 0;
+}
+#endif
+
+/**
+ * Create a new game, set up with the standard initial position.
+ * @param pool Pool to create the game in.
+ * @param shard_index Shard of the calling thread.
+ * @return Handle of the new game, or CB_INVALID_GAME_HANDLE if the shard is full.
+ */
+cb_game_handle cb_pool_create_game(cb_game_pool *pool, uchar shard_index)
+{
+    if(shard_index >= pool->shard_count)
+    {
+        return CB_INVALID_GAME_HANDLE;
+    }
+
+    cb_game_shard *shard = &pool->shards[shard_index];
+    uint32_t slot = shard->free_head;
+
+    if(slot == NO_FREE_SLOT)
+    {
+        return CB_INVALID_GAME_HANDLE;
+    }
+
+    shard->free_head = shard->next_free_slots[slot];
+    shard->active_count++;
+    shard->generations[slot]++;
+
+    chess_board board;
+    cb_initialize_game(&board);
+    memcpy(shard->boards[slot], board.board, sizeof(cb_board_squares));
+    shard->move_counters[slot] = board.move_counter;
+    shard->halfmove_clocks[slot] = board.halfmove_clock;
+    shard->castling_rights[slot] = board.castling_rights;
+    shard->ep_target_square_indices[slot] = board.ep_target_square_index;
+    shard->keys[slot] = cb_zobrist_key(&board);
+
+    return (cb_game_handle)shard_index << 24 | slot << 12 | shard->generations[slot];
+}
+
+/**
+ * Destroy a game, making its slot available to new games unless its
+ * generation is exhausted. Stale or invalid handles are ignored.
+ * @param pool Pool the game belongs to.
+ * @param handle Handle of the game.
+ */
+void cb_pool_destroy_game(cb_game_pool *pool, cb_game_handle handle)
+{
+    uint32_t slot;
+    cb_game_shard *shard = cb_handle_shard(pool, handle, &slot);
+
+    if(shard == NULL)
+    {
+        return;
+    }
+
+    shard->generations[slot]++;
+    shard->active_count--;
+
+    // Another game would wrap the generation, the slot stays out of the free list.
+    if(shard->generations[slot] > CB_POOL_MAX_GENERATION)
+    {
+        return;
+    }
+
+    shard->next_free_slots[slot] = shard->free_head;
+    shard->free_head = slot;
+}
+
+/**
+ * Check whether a handle refers to a live game.
+ * @param pool Pool the game belongs to.
+ * @param handle Handle to check.
+ * @return 1 if the game exists, 0 if it was destroyed or never existed.
+ */
+int cb_pool_is_valid_game(cb_game_pool *pool, cb_game_handle handle)
+{
+    uint32_t slot;
+    return cb_handle_shard(pool, handle, &slot) != NULL;
+}
+
+/**
+ * Copy a game out of the pool into a regular chess board, Ex: to use the
+ * functions working on single boards.
+ * @param pool Pool the game belongs to.
+ * @param handle Handle of the game.
+ * @param board Board to copy the game into.
+ */
+void cb_pool_load_board(cb_game_pool *pool, cb_game_handle handle, chess_board *board)
+{
+    uint32_t slot;
+    cb_game_shard *shard = cb_handle_shard(pool, handle, &slot);
+
+    if(shard == NULL)
+    {
+        return;
+    }
+
+    memcpy(board->board, shard->boards[slot], sizeof(cb_board_squares));
+    board->move_counter = shard->move_counters[slot];
+    board->halfmove_clock = shard->halfmove_clocks[slot];
+    board->castling_rights = shard->castling_rights[slot];
+    board->ep_target_square_index = shard->ep_target_square_indices[slot];
+}
+
+/**
+ * Copy a chess board into a game of the pool. The Zobrist key of the game
+ * is updated.
+ * @param pool Pool the game belongs to.
+ * @param handle Handle of the game.
+ * @param board Board to copy into the game.
+ */
+void cb_pool_store_board(cb_game_pool *pool, cb_game_handle handle, chess_board *board)
+{
+    uint32_t slot;
+    cb_game_shard *shard = cb_handle_shard(pool, handle, &slot);
+
+    if(shard == NULL)
+    {
+        return;
+    }
+
+    memcpy(shard->boards[slot], board->board, sizeof(cb_board_squares));
+    shard->move_counters[slot] = board->move_counter;
+    shard->halfmove_clocks[slot] = board->halfmove_clock;
+    shard->castling_rights[slot] = board->castling_rights;
+    shard->ep_target_square_indices[slot] = board->ep_target_square_index;
+    shard->keys[slot] = cb_zobrist_key(board);
+}
+
+/**
+ * Size of the buffer needed to snapshot a shard.
+ * @param pool Pool the shard belongs to.
+ * @param shard_index Shard to snapshot.
+ * @return Size of a snapshot in bytes, or 0 if the shard does not exist.
+ */
+size_t cb_pool_snapshot_size(cb_game_pool *pool, uchar shard_index)
+{
+    if(shard_index >= pool->shard_count)
+    {
+        return 0;
+    }
+
+    return sizeof(uint32_t) * 3 + pool->shards[shard_index].memory_size;
+}
+
+/**
+ * Copy every game of a shard, free slots included, into a buffer. As the
+ * games are already contiguous, this is a single copy. Missing shards are
+ * ignored.
+ * @param pool Pool the shard belongs to.
+ * @param shard_index Shard to snapshot.
+ * @param buffer Buffer of at least cb_pool_snapshot_size bytes.
+ */
+void cb_pool_snapshot(cb_game_pool *pool, uchar shard_index, void *buffer)
+{
+    if(shard_index >= pool->shard_count)
+    {
+        return;
+    }
+
+    cb_game_shard *shard = &pool->shards[shard_index];
+    uint32_t header[3] = {shard->capacity, shard->active_count, shard->free_head};
+
+    memcpy(buffer, header, sizeof(header));
+    memcpy((uchar*)buffer + sizeof(header), shard->memory, shard->memory_size);
+}
+
+/**
+ * Restore a shard from a snapshot taken with cb_pool_snapshot. Handles that
+ * were valid when the snapshot was taken become valid again. Snapshots of
+ * shards of a different capacity, and missing shards, are ignored.
+ * @param pool Pool the shard belongs to.
+ * @param shard_index Shard to restore.
+ * @param buffer Snapshot to restore from.
+ */
+void cb_pool_restore(cb_game_pool *pool, uchar shard_index, const void *buffer)
+{
+    if(shard_index >= pool->shard_count)
+    {
+        return;
+    }
+
+    cb_game_shard *shard = &pool->shards[shard_index];
+    uint32_t header[3];
+
+    memcpy(header, buffer, sizeof(header));
+    if(header[0] != shard->capacity)
+    {
+        return;
+    }
+
+    shard->active_count = header[1];
+    shard->free_head = header[2];
+    memcpy(shard->memory, (const uchar*)buffer + sizeof(header), shard->memory_size);
+}
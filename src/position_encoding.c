@@ -0,0 +1,594 @@
+/**
+ * @file position_encoding.c
+ * @author Nathan Seymour
+ * @brief Dense position encoding.
+ *
+ * Layout (every number little endian):
+ *
+ *  occupancy  8 bytes, bit i set when square i holds a piece
+ *  pieces     a four bit code per occupied square, in square order, two per
+ *             byte, the first in the low nibble
+ *  counters   varint of the move counter with a flag (see below), then
+ *             varint of the halfmove clock
+ *  state      castling rights and en passant square, only when flagged
+ *
+ * A piece code is the piece value (Ex: BLACK | ROOK), which leaves 0, 7, 8
+ * and 15 free to fold the rest of the position in:
+ *
+ *  0   pawn that has just moved two squares, the en passant square is
+ *      behind it (a white pawn on the fourth rank, a black one on the fifth)
+ *  7   white rook that can castle, on a1 or h1
+ *  8   black rook that can castle, on a8 or h8
+ *  15  black king, black to move
+ *
+ * The move counter is then stored without its lowest bit. Positions whose
+ * state cannot be folded (Ex: a castling right without its rook) set the
+ * flag, store the whole move counter and add the castling rights and en
+ * passant square as two bytes.
+ *
+ * Piece codes are gathered with PEXT and scattered back with PDEP, 16
+ * squares at a time, when the file is built for BMI2 (see the
+ * POSITION_ENCODING_ISA CMake option), with a portable fallback otherwise.
+ * Special codes are found with SWAR tests on the same 64 bit words.
+ */
+
+#include <string.h>
+#include "chess.h"
+#include "position_encoding.h"
+
+#if !defined(CB_POSITION_ENCODING_SCALAR) && defined(__BMI2__)
+#include <immintrin.h>
+#define POSITION_ENCODING_BMI2
+#endif
+
+#define NIBBLE_LOW_BITS 0x1111111111111111ull
+
+#define CODE_EP_PAWN                0x0
+#define CODE_WHITE_CASTLING_ROOK    0x7
+#define CODE_BLACK_CASTLING_ROOK    0x8
+#define CODE_BLACK_KING_TO_MOVE     0xF
+
+#define COUNTER_FLAG_UNFOLDED 0x1
+
+/*
+ * Bit gathering and scattering
+ */
+
+static inline uint64_t cb_pext(uint64_t value, uint64_t mask)
+{
+#if defined(POSITION_ENCODING_BMI2)
+    return _pext_u64(value, mask);
+#else
+    uint64_t result = 0;
+
+    for(uint64_t bit = 1; mask != 0; bit <<= 1)
+    {
+        if(value & mask & -mask)
+        {
+            result |= bit;
+        }
+        mask &= mask - 1;
+    }
+
+    return result;
+#endif
+}
+
+static inline uint64_t cb_pdep(uint64_t value, uint64_t mask)
+{
+#if defined(POSITION_ENCODING_BMI2)
+    return _pdep_u64(value, mask);
+#else
+    uint64_t result = 0;
+
+    for(uint64_t bit = 1; mask != 0; bit <<= 1)
+    {
+        if(value & bit)
+        {
+            result |= mask & -mask;
+        }
+        mask &= mask - 1;
+    }
+
+    return result;
+#endif
+}
+
+static inline uchar cb_popcount(uint64_t value)
+{
+    value = value - ((value >> 1) & 0x5555555555555555ull);
+    value = (value & 0x3333333333333333ull) + ((value >> 2) & 0x3333333333333333ull);
+    value = (value + (value >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+
+    return (uchar)((value * 0x0101010101010101ull) >> 56);
+}
+
+static inline uchar cb_lowest_bit(uint64_t value)
+{
+    return cb_popcount((value & -value) - 1);
+}
+
+/*
+ * Nibble words: squares 16w to 16w + 15 of the board in word w, square 16w
+ * in the lowest four bits.
+ */
+
+static void cb_board_to_words(chess_board *board, uint64_t words[4])
+{
+    uchar packed[32];
+
+    cb_pack_board(board, packed);
+
+    for(uchar w = 0; w < 4; w++)
+    {
+        uint64_t word = 0;
+
+        for(uchar i = 0; i < 8; i++)
+        {
+            word |= (uint64_t)packed[w * 8 + i] << (8 * i);
+        }
+
+        // The packed layout stores even squares in the high nibble.
+        words[w] = ((word >> 4) & 0x0F0F0F0F0F0F0F0Full) | ((word & 0x0F0F0F0F0F0F0F0Full) << 4);
+    }
+}
+
+static void cb_words_to_board(const uint64_t words[4], chess_board *board)
+{
+    uchar packed[32];
+
+    for(uchar w = 0; w < 4; w++)
+    {
+        uint64_t word = ((words[w] >> 4) & 0x0F0F0F0F0F0F0F0Full) | ((words[w] & 0x0F0F0F0F0F0F0F0Full) << 4);
+
+        for(uchar i = 0; i < 8; i++)
+        {
+            packed[w * 8 + i] = (uchar)(word >> (8 * i));
+        }
+    }
+
+    cb_unpack_board(board, packed);
+}
+
+// Lowest bit of every nibble that is not zero.
+static inline uint64_t cb_nonzero_nibbles(uint64_t word)
+{
+    return (word | word >> 1 | word >> 2 | word >> 3) & NIBBLE_LOW_BITS;
+}
+
+// Lowest bit of every nibble whose three low bits are equal: 0, 7, 8 or 15.
+static inline uint64_t cb_special_nibbles(uint64_t word)
+{
+    uint64_t differences = word ^ (word >> 1);
+
+    return ~(differences | differences >> 1) & NIBBLE_LOW_BITS;
+}
+
+static inline uchar cb_word_code(const uint64_t words[4], uchar square_index)
+{
+    return (uchar)((words[square_index >> 4] >> (4 * (square_index & 15))) & 0xF);
+}
+
+static inline void cb_set_word_code(uint64_t words[4], uchar square_index, uchar code)
+{
+    uchar shift = (uchar)(4 * (square_index & 15));
+
+    words[square_index >> 4] = (words[square_index >> 4] & ~(0xFull << shift)) | (uint64_t)code << shift;
+}
+
+/*
+ * Fold the castling rights, en passant square and side to move into the
+ * piece codes. Returns 0, leaving the codes untouched, if any of them
+ * cannot be folded.
+ */
+static int cb_fold_state(chess_board *board, uint64_t words[4])
+{
+    static const uchar rook_squares[4] = {56, 63, 0, 7};
+    uchar ep = board->ep_target_square_index;
+    uchar ep_pawn_square = 0xFF;
+    uchar black_king_square = 0xFF;
+
+    if(ep != (uchar)-1)
+    {
+        if(ep >= 16 && ep < 24 && cb_word_code(words, ep + 8) == (WHITE | PAWN))
+        {
+            ep_pawn_square = ep + 8;
+        }
+        else if(ep >= 40 && ep < 48 && cb_word_code(words, ep - 8) == (BLACK | PAWN))
+        {
+            ep_pawn_square = ep - 8;
+        }
+        else
+        {
+            return 0;
+        }
+    }
+
+    // Bits of the castling rights, from the lowest: a8, h8, a1, h1.
+    for(uchar i = 0; i < 4; i++)
+    {
+        if((board->castling_rights >> i & 1) && cb_word_code(words, rook_squares[i]) != ((i < 2 ? BLACK : WHITE) | ROOK))
+        {
+            return 0;
+        }
+    }
+
+    if(board->castling_rights > CASTLE_RIGHTS_ALL)
+    {
+        return 0;
+    }
+
+    if(board->move_counter % 2 == 1)
+    {
+        for(uchar w = 0; w < 4 && black_king_square == 0xFF; w++)
+        {
+            // Nibbles equal to BLACK | KING (0b1110): zero after the XOR.
+            uint64_t kings = ~cb_nonzero_nibbles(words[w] ^ ((BLACK | KING) * NIBBLE_LOW_BITS)) & NIBBLE_LOW_BITS;
+
+            if(kings != 0)
+            {
+                black_king_square = (uchar)(w * 16 + cb_lowest_bit(kings) / 4);
+            }
+        }
+
+        if(black_king_square == 0xFF)
+        {
+            return 0;
+        }
+
+        cb_set_word_code(words, black_king_square, CODE_BLACK_KING_TO_MOVE);
+    }
+
+    if(ep_pawn_square != 0xFF)
+    {
+        cb_set_word_code(words, ep_pawn_square, CODE_EP_PAWN);
+    }
+
+    for(uchar i = 0; i < 4; i++)
+    {
+        if(board->castling_rights >> i & 1)
+        {
+            cb_set_word_code(words, rook_squares[i], i < 2 ? CODE_BLACK_CASTLING_ROOK : CODE_WHITE_CASTLING_ROOK);
+        }
+    }
+
+    return 1;
+}
+
+static inline uchar cb_write_varint(uchar *data, uint32_t value)
+{
+    uchar length = 0;
+
+    while(value >= 0x80)
+    {
+        data[length++] = (uchar)(value | 0x80);
+        value >>= 7;
+    }
+
+    data[length++] = (uchar)value;
+
+    return length;
+}
+
+// Counters take at most three bytes each.
+static inline uchar cb_read_varint(const uchar *data, size_t size, uint32_t *value)
+{
+    *value = 0;
+
+    for(uchar i = 0; i < 3 && i < size; i++)
+    {
+        *value |= (uint32_t)(data[i] & 0x7F) << (7 * i);
+
+        if(!(data[i] & 0x80))
+        {
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Encode a position. Every field of the board is kept.
+ * @param board Position to encode.
+ * @param data Receives the encoded position.
+ * @return Number of bytes written, 0 if a square holds an invalid piece value
+ * or the board holds more than 32 pieces, which would not fit.
+ */
+uchar cb_encode_position(chess_board *board, uchar data[CB_POSITION_MAX_SIZE])
+{
+    uint64_t words[4];
+    uint64_t occupancy = 0;
+    uint64_t masks[4];
+    unsigned int nibbles = 0;
+    uchar length;
+    int folded;
+
+    cb_board_to_words(board, words);
+
+    for(uchar w = 0; w < 4; w++)
+    {
+        uint64_t occupied = cb_nonzero_nibbles(words[w]);
+
+        // 7, 8 and 15 are not pieces.
+        if(cb_special_nibbles(words[w]) & occupied)
+        {
+            return 0;
+        }
+
+        occupancy |= cb_pext(occupied, NIBBLE_LOW_BITS) << (16 * w);
+        masks[w] = occupied * 0xF;
+    }
+
+    if(cb_popcount(occupancy) > CB_POSITION_MAX_PIECES)
+    {
+        return 0;
+    }
+
+    folded = cb_fold_state(board, words);
+
+    for(uchar i = 0; i < 8; i++)
+    {
+        data[i] = (uchar)(occupancy >> (8 * i));
+    }
+
+    // Codes of each word appended to the nibble stream.
+    memset(data + 8, 0, 16);
+
+    for(uchar w = 0; w < 4; w++)
+    {
+        uint64_t codes = cb_pext(words[w], masks[w]);
+        uchar count = cb_popcount(masks[w]) / 4;
+        uchar *out = data + 8 + nibbles / 2;
+
+        nibbles += count;
+
+        // Complete the half-written byte of the previous word first.
+        if(count > 0 && (nibbles - count) % 2 == 1)
+        {
+            *out++ |= (uchar)((codes & 0xF) << 4);
+            codes >>= 4;
+            count--;
+        }
+
+        for(uchar i = 0; i < count; i += 2)
+        {
+            *out++ = (uchar)(codes >> (4 * i));
+        }
+    }
+
+    length = (uchar)(8 + (nibbles + 1) / 2);
+
+    if(folded)
+    {
+        length += cb_write_varint(data + length, board->move_counter & ~1u);
+    }
+    else
+    {
+        length += cb_write_varint(data + length, (uint32_t)board->move_counter << 1 | COUNTER_FLAG_UNFOLDED);
+    }
+
+    length += cb_write_varint(data + length, board->halfmove_clock);
+
+    if(!folded)
+    {
+        data[length++] = board->castling_rights;
+        data[length++] = board->ep_target_square_index;
+    }
+
+    return length;
+}
+
+/**
+ * Decode a position written by cb_encode_position.
+ * @param board Receives the position.
+ * @param data Encoded position.
+ * @param size Number of bytes available.
+ * @return Number of bytes read, 0 if the data is truncated or invalid.
+ */
+uchar cb_decode_position(chess_board *board, const uchar *data, size_t size)
+{
+    uint64_t words[4];
+    uint64_t occupancy = 0;
+    uint64_t specials = 0;
+    unsigned int nibbles = 0;
+    uint32_t counter;
+    uint32_t halfmove_clock;
+    uchar castling_rights = CASTLE_RIGHTS_NONE;
+    uchar ep = (uchar)-1;
+    uchar move_counter_low = 0;
+    uchar length;
+    uchar read;
+
+    if(size < 8)
+    {
+        return 0;
+    }
+
+    for(uchar i = 0; i < 8; i++)
+    {
+        occupancy |= (uint64_t)data[i] << (8 * i);
+    }
+
+    if(cb_popcount(occupancy) > CB_POSITION_MAX_PIECES)
+    {
+        return 0;
+    }
+
+    length = (uchar)(8 + (cb_popcount(occupancy) + 1) / 2);
+
+    if(size < length)
+    {
+        return 0;
+    }
+
+    for(uchar w = 0; w < 4; w++)
+    {
+        uint64_t mask = cb_pdep(occupancy >> (16 * w), NIBBLE_LOW_BITS) * 0xF;
+        uchar count = cb_popcount(mask) / 4;
+        const uchar *in = data + 8 + nibbles / 2;
+        uint64_t codes = 0;
+        uchar first = 0;
+        uchar shift = 0;
+
+        nibbles += count;
+
+        // The first code may share its byte with the previous word.
+        if(count > 0 && (nibbles - count) % 2 == 1)
+        {
+            first = *in++ >> 4;
+            shift = 4;
+            count--;
+        }
+
+        for(uchar i = 0; i < count; i += 2)
+        {
+            codes |= (uint64_t)*in++ << (4 * i);
+        }
+
+        // PDEP ignores the bits past the number of codes.
+        codes = codes << shift | first;
+        words[w] = cb_pdep(codes, mask);
+        specials |= cb_pext(cb_special_nibbles(words[w]) & mask, NIBBLE_LOW_BITS) << (16 * w);
+    }
+
+    if(!(read = cb_read_varint(data + length, size - length, &counter)))
+    {
+        return 0;
+    }
+    length += read;
+
+    if(!(read = cb_read_varint(data + length, size - length, &halfmove_clock)))
+    {
+        return 0;
+    }
+    length += read;
+
+    if(counter & COUNTER_FLAG_UNFOLDED)
+    {
+        if(size < (size_t)length + 2 || specials != 0)
+        {
+            return 0;
+        }
+
+        castling_rights = data[length++];
+        ep = data[length++];
+        counter >>= 1;
+    }
+
+    // Unfold the state, special codes are rare.
+    while(specials != 0)
+    {
+        uchar square_index = cb_lowest_bit(specials);
+        uchar code = cb_word_code(words, square_index);
+
+        specials &= specials - 1;
+
+        switch(code)
+        {
+            case CODE_EP_PAWN:
+                if(ep != (uchar)-1 || square_index < 24 || square_index >= 40)
+                {
+                    return 0;
+                }
+                ep = square_index < 32 ? square_index - 8 : square_index + 8;
+                code = (square_index < 32 ? WHITE : BLACK) | PAWN;
+                break;
+            case CODE_WHITE_CASTLING_ROOK:
+                if(square_index != 0 && square_index != 7)
+                {
+                    return 0;
+                }
+                castling_rights |= square_index == 7 ? CASTLE_RIGHTS_KINGSIDE_WHITE : CASTLE_RIGHTS_QUEENSIDE_WHITE;
+                code = WHITE | ROOK;
+                break;
+            case CODE_BLACK_CASTLING_ROOK:
+                if(square_index != 56 && square_index != 63)
+                {
+                    return 0;
+                }
+                castling_rights |= square_index == 63 ? CASTLE_RIGHTS_KINGSIDE_BLACK : CASTLE_RIGHTS_QUEENSIDE_BLACK;
+                code = BLACK | ROOK;
+                break;
+            default:
+                if(move_counter_low)
+                {
+                    return 0;
+                }
+                move_counter_low = 1;
+                code = BLACK | KING;
+                break;
+        }
+
+        cb_set_word_code(words, square_index, code);
+    }
+
+    if(counter > 0xFFFF || halfmove_clock > 0xFFFF)
+    {
+        return 0;
+    }
+
+    cb_words_to_board(words, board);
+    board->move_counter = (ushort)(counter | move_counter_low);
+    board->castling_rights = castling_rights;
+    board->ep_target_square_index = ep;
+    board->halfmove_clock = (ushort)halfmove_clock;
+
+    return length;
+}
+
+/**
+ * Encode positions one after the other. Positions are variable length,
+ * they can only be decoded in order.
+ * @param boards Positions to encode.
+ * @param count Number of positions.
+ * @param data Receives the encoded positions, CB_POSITION_MAX_SIZE bytes
+ * per position at most.
+ * @return Number of bytes written, 0 if a position holds an invalid piece value
+ * or more than 32 pieces.
+ */
+size_t cb_encode_positions(chess_board *boards, size_t count, uchar *data)
+{
+    size_t length = 0;
+
+    for(size_t i = 0; i < count; i++)
+    {
+        uchar written = cb_encode_position(&boards[i], data + length);
+
+        if(written == 0)
+        {
+            return 0;
+        }
+
+        length += written;
+    }
+
+    return length;
+}
+
+/**
+ * Decode positions written by cb_encode_positions.
+ * @param boards Receives the positions.
+ * @param count Number of positions to decode.
+ * @param data Encoded positions.
+ * @param size Number of bytes available.
+ * @return Number of bytes read, 0 if the data is truncated or invalid.
+ */
+size_t cb_decode_positions(chess_board *boards, size_t count, const uchar *data, size_t size)
+{
+    size_t length = 0;
+
+    for(size_t i = 0; i < count; i++)
+    {
+        uchar read = cb_decode_position(&boards[i], data + length, size - length);
+
+        if(read == 0)
+        {
+            return 0;
+        }
+
+        length += read;
+    }
+
+    return length;
+}
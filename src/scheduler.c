@@ -0,0 +1,534 @@
+/**
+ * @file scheduler.c
+ * @author Nathan Seymour
+ * @brief Analysis scheduler: a bounded queue of search jobs served by a
+ * pool of worker threads sharing one transposition table.
+ *
+ * Services receiving analysis requests would otherwise start a thread and
+ * allocate a table per request. Here a fixed set of workers, each with its
+ * own searcher, takes jobs from a priority queue ordered by priority, then
+ * earliest deadline. Workers left idle help the running jobs that asked for
+ * more than one thread, searching the same position on the shared table
+ * until the main worker of the job is done.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include "chess.h"
+#include "search.h"
+#include "scheduler.h"
+
+#ifdef DYNAMIC_MEMORY_ALLOCATION
+
+#define CB_NO_DEADLINE ULONG_MAX
+
+static unsigned long cb_scheduler_clock_ms(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (unsigned long)now.tv_sec * 1000 + (unsigned long)(now.tv_nsec / 1000000);
+#else
+    return (unsigned long)(clock() / (CLOCKS_PER_SEC / 1000));
+#endif
+}
+
+static uchar cb_job_threads(cb_analysis_job *job)
+{
+    return job->request.threads == 0 ? 1 : job->request.threads;
+}
+
+/*
+ * Whether a job should be started before another.
+ */
+static int cb_job_before(cb_analysis_job *first, cb_analysis_job *second)
+{
+    if(first->request.priority != second->request.priority)
+    {
+        return first->request.priority > second->request.priority;
+    }
+
+    if(first->deadline != second->deadline)
+    {
+        return first->deadline < second->deadline;
+    }
+
+    return first->id < second->id;
+}
+
+static void cb_queue_swap(cb_scheduler *scheduler, size_t first, size_t second)
+{
+    cb_analysis_job *job = scheduler->queue[first];
+    scheduler->queue[first] = scheduler->queue[second];
+    scheduler->queue[second] = job;
+}
+
+static void cb_queue_sift_up(cb_scheduler *scheduler, size_t index)
+{
+    while(index > 0 && cb_job_before(scheduler->queue[index], scheduler->queue[(index - 1) / 2]))
+    {
+        cb_queue_swap(scheduler, index, (index - 1) / 2);
+        index = (index - 1) / 2;
+    }
+}
+
+static void cb_queue_sift_down(cb_scheduler *scheduler, size_t index)
+{
+    for(;;)
+    {
+        size_t best = index;
+        size_t left = index * 2 + 1;
+        size_t right = left + 1;
+
+        if(left < scheduler->queue_count && cb_job_before(scheduler->queue[left], scheduler->queue[best])) best = left;
+        if(right < scheduler->queue_count && cb_job_before(scheduler->queue[right], scheduler->queue[best])) best = right;
+        if(best == index) return;
+
+        cb_queue_swap(scheduler, index, best);
+        index = best;
+    }
+}
+
+/*
+ * Take a job out of the queue, wherever it is in the heap.
+ */
+static cb_analysis_job *cb_queue_remove(cb_scheduler *scheduler, size_t index)
+{
+    cb_analysis_job *job = scheduler->queue[index];
+
+    scheduler->queue[index] = scheduler->queue[--scheduler->queue_count];
+
+    if(index < scheduler->queue_count)
+    {
+        cb_queue_sift_up(scheduler, index);
+        cb_queue_sift_down(scheduler, index);
+    }
+
+    return job;
+}
+
+/*
+ * Report the end of a job that never ran, then release it. Called with the
+ * mutex locked, which is released during the callback.
+ */
+static void cb_end_queued_job(cb_scheduler *scheduler, cb_analysis_job *job, uchar status)
+{
+    memset(&job->result, 0, sizeof(cb_search_result));
+
+    pcthread_mutex_unlock(&scheduler->mutex);
+    scheduler->callback(&job->request, status, &job->result);
+    pcthread_mutex_lock(&scheduler->mutex);
+
+    scheduler->free_jobs[scheduler->free_job_count++] = job;
+    pcthread_condition_broadcast(&scheduler->job_changed);
+}
+
+/*
+ * Running job that wants more workers, the first one to be started if
+ * several do.
+ */
+static cb_analysis_job *cb_find_job_to_help(cb_scheduler *scheduler)
+{
+    cb_analysis_job *best = NULL;
+
+    for(uchar i = 0; i < scheduler->worker_count; i++)
+    {
+        cb_analysis_job *job = scheduler->workers[i].job;
+
+        if(job != NULL && !job->finished && job->worker_count < cb_job_threads(job)
+           && (best == NULL || cb_job_before(job, best)))
+        {
+            best = job;
+        }
+    }
+
+    return best;
+}
+
+/*
+ * Search a job as its main worker, then stop its helpers and report it.
+ * Called with the mutex locked, which is released during the search.
+ */
+static void cb_run_main_worker(cb_analysis_worker *worker, cb_analysis_job *job)
+{
+    cb_scheduler *scheduler = worker->scheduler;
+    chess_board board = job->request.board;
+    cb_search_limits limits = job->request.limits;
+    unsigned long now = cb_scheduler_clock_ms();
+
+    limits.infinite = 0;
+    limits.ponder = 0;
+
+    if(job->deadline != CB_NO_DEADLINE)
+    {
+        unsigned long left = job->deadline > now ? job->deadline - now : 1;
+
+        if(limits.time_ms == 0 || left < limits.time_ms)
+        {
+            limits.time_ms = left;
+        }
+    }
+
+    job->worker_count = 1;
+    job->main_searcher = worker->searcher;
+    worker->job = job;
+
+    // Under the mutex, so that a cancel from now on is kept for the search.
+    cb_reset_search(worker->searcher);
+
+    // Idle workers may help this job.
+    if(cb_job_threads(job) > 1)
+    {
+        pcthread_condition_broadcast(&scheduler->work_available);
+    }
+
+    pcthread_mutex_unlock(&scheduler->mutex);
+    cb_search(worker->searcher, &board, NULL, &limits, &job->result);
+    pcthread_mutex_lock(&scheduler->mutex);
+
+    job->finished = 1;
+
+    for(uchar i = 0; i < scheduler->worker_count; i++)
+    {
+        if(scheduler->workers[i].job == job && &scheduler->workers[i] != worker)
+        {
+            cb_stop_search(scheduler->workers[i].searcher);
+        }
+    }
+
+    while(job->worker_count > 1)
+    {
+        pcthread_condition_wait(&scheduler->job_changed, &scheduler->mutex);
+    }
+
+    // A job cancelled once its search had returned was done all the same.
+    pcthread_mutex_unlock(&scheduler->mutex);
+    scheduler->callback(&job->request, job->cancelled && job->result.stopped ? CB_ANALYSIS_CANCELLED : CB_ANALYSIS_DONE,
+                        &job->result);
+    pcthread_mutex_lock(&scheduler->mutex);
+
+    worker->job = NULL;
+    scheduler->free_jobs[scheduler->free_job_count++] = job;
+    pcthread_condition_broadcast(&scheduler->job_changed);
+}
+
+/*
+ * Search the position of a job until its main worker is done, filling the
+ * shared table for it. Called with the mutex locked.
+ */
+static void cb_run_helper_worker(cb_analysis_worker *worker, cb_analysis_job *job)
+{
+    cb_scheduler *scheduler = worker->scheduler;
+    chess_board board = job->request.board;
+    cb_search_limits limits;
+    cb_search_result result;
+
+    memset(&limits, 0, sizeof(cb_search_limits));
+    limits.infinite = 1;
+
+    job->worker_count++;
+    worker->job = job;
+
+    // Under the mutex, so that the stop sent when the job finishes is kept.
+    cb_reset_search(worker->searcher);
+
+    pcthread_mutex_unlock(&scheduler->mutex);
+    cb_search(worker->searcher, &board, NULL, &limits, &result);
+    pcthread_mutex_lock(&scheduler->mutex);
+
+    job->worker_count--;
+    worker->job = NULL;
+    pcthread_condition_broadcast(&scheduler->job_changed);
+}
+
+static void *cb_analysis_worker_main(void *argument)
+{
+    cb_analysis_worker *worker = argument;
+    cb_scheduler *scheduler = worker->scheduler;
+
+    pcthread_mutex_lock(&scheduler->mutex);
+
+    while(!scheduler->shutting_down)
+    {
+        cb_analysis_job *job;
+
+        if(scheduler->queue_count > 0)
+        {
+            job = cb_queue_remove(scheduler, 0);
+
+            if(job->deadline <= cb_scheduler_clock_ms())
+            {
+                cb_end_queued_job(scheduler, job, CB_ANALYSIS_EXPIRED);
+            }
+            else
+            {
+                cb_run_main_worker(worker, job);
+            }
+        }
+        else if((job = cb_find_job_to_help(scheduler)) != NULL)
+        {
+            cb_run_helper_worker(worker, job);
+        }
+        else
+        {
+            pcthread_condition_wait(&scheduler->work_available, &scheduler->mutex);
+        }
+    }
+
+    pcthread_mutex_unlock(&scheduler->mutex);
+
+    return NULL;
+}
+
+static void cb_release_scheduler_memory(cb_scheduler *scheduler)
+{
+    for(uchar i = 0; i < CB_SCHEDULER_MAX_WORKERS; i++)
+    {
+        free(scheduler->workers[i].searcher);
+    }
+
+    free(scheduler->jobs);
+    free(scheduler->free_jobs);
+    free(scheduler->queue);
+}
+
+/**
+ * Start a scheduler and its workers. cb_free_scheduler must be called when
+ * done. Requires threads: fails where pcthreads has none.
+ * @param scheduler Scheduler to initialize.
+ * @param table Transposition table shared by every job, initialized by the
+ * caller. It is not cleared between jobs.
+ * @param worker_count Number of worker threads, usually one per core.
+ * @param queue_capacity Most jobs waiting to start; more are rejected.
+ * @param callback Called when each job ends.
+ * @return 1 on success, 0 if the arguments are out of range or the workers
+ * could not be started.
+ */
+int cb_initialize_scheduler(cb_scheduler *scheduler, cb_transposition_table *table, uchar worker_count, size_t queue_capacity, cb_analysis_callback callback)
+{
+    size_t job_capacity = queue_capacity + worker_count;
+
+    memset(scheduler, 0, sizeof(cb_scheduler));
+
+#ifndef PCTHREADS_HAS_PTHREADS
+    // Without threads, a worker would wait for jobs as soon as created.
+    return 0;
+#endif
+
+    if(worker_count == 0 || worker_count > CB_SCHEDULER_MAX_WORKERS || queue_capacity == 0 || callback == NULL)
+    {
+        return 0;
+    }
+
+    scheduler->table = table;
+    scheduler->callback = callback;
+    scheduler->queue_capacity = queue_capacity;
+    scheduler->job_capacity = job_capacity;
+    scheduler->next_id = 1;
+
+    scheduler->jobs = malloc(job_capacity * sizeof(cb_analysis_job));
+    scheduler->free_jobs = malloc(job_capacity * sizeof(cb_analysis_job*));
+    scheduler->queue = malloc(queue_capacity * sizeof(cb_analysis_job*));
+
+    for(uchar i = 0; i < worker_count; i++)
+    {
+        scheduler->workers[i].scheduler = scheduler;
+        scheduler->workers[i].searcher = malloc(sizeof(cb_searcher));
+
+        if(scheduler->workers[i].searcher == NULL)
+        {
+            break;
+        }
+
+        cb_initialize_searcher(scheduler->workers[i].searcher, table);
+    }
+
+    if(scheduler->jobs == NULL || scheduler->free_jobs == NULL || scheduler->queue == NULL
+       || scheduler->workers[worker_count - 1].searcher == NULL)
+    {
+        cb_release_scheduler_memory(scheduler);
+        return 0;
+    }
+
+    for(size_t i = 0; i < job_capacity; i++)
+    {
+        scheduler->free_jobs[i] = &scheduler->jobs[job_capacity - 1 - i];
+    }
+    scheduler->free_job_count = job_capacity;
+
+    if(!pcthread_mutex_init(&scheduler->mutex))
+    {
+        cb_release_scheduler_memory(scheduler);
+        return 0;
+    }
+
+    pcthread_condition_init(&scheduler->work_available);
+    pcthread_condition_init(&scheduler->job_changed);
+
+    for(uchar i = 0; i < worker_count; i++)
+    {
+        if(!pcthread_create(&scheduler->workers[i].thread, cb_analysis_worker_main, &scheduler->workers[i]))
+        {
+            break;
+        }
+
+        // Read by the workers already started.
+        pcthread_mutex_lock(&scheduler->mutex);
+        scheduler->worker_count++;
+        pcthread_mutex_unlock(&scheduler->mutex);
+    }
+
+    if(scheduler->worker_count < worker_count)
+    {
+        cb_free_scheduler(scheduler);
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Stop a scheduler. Queued jobs are cancelled, running jobs are stopped
+ * and reported as cancelled, then the workers are joined.
+ * @param scheduler Scheduler to free.
+ */
+void cb_free_scheduler(cb_scheduler *scheduler)
+{
+    pcthread_mutex_lock(&scheduler->mutex);
+    scheduler->shutting_down = 1;
+
+    while(scheduler->queue_count > 0)
+    {
+        cb_end_queued_job(scheduler, cb_queue_remove(scheduler, 0), CB_ANALYSIS_CANCELLED);
+    }
+
+    for(uchar i = 0; i < scheduler->worker_count; i++)
+    {
+        cb_analysis_job *job = scheduler->workers[i].job;
+
+        if(job != NULL && job->main_searcher == scheduler->workers[i].searcher && !job->finished)
+        {
+            job->cancelled = 1;
+            cb_stop_search(job->main_searcher);
+        }
+    }
+
+    pcthread_condition_broadcast(&scheduler->work_available);
+    pcthread_mutex_unlock(&scheduler->mutex);
+
+    for(uchar i = 0; i < scheduler->worker_count; i++)
+    {
+        pcthread_join(&scheduler->workers[i].thread);
+    }
+
+    pcthread_condition_destroy(&scheduler->work_available);
+    pcthread_condition_destroy(&scheduler->job_changed);
+    pcthread_mutex_destroy(&scheduler->mutex);
+    cb_release_scheduler_memory(scheduler);
+    memset(scheduler, 0, sizeof(cb_scheduler));
+}
+
+/**
+ * Queue an analysis job. When the queue is full, the jobs in it whose
+ * deadline has passed are dropped first, their callback being called from
+ * this thread.
+ * @param scheduler Running scheduler.
+ * @param request Job to queue, copied.
+ * @return Identifier of the job for cb_cancel_analysis, or 0 if the queue
+ * is full.
+ */
+unsigned long cb_submit_analysis(cb_scheduler *scheduler, const cb_analysis_request *request)
+{
+    unsigned long now = cb_scheduler_clock_ms();
+    unsigned long id = 0;
+
+    pcthread_mutex_lock(&scheduler->mutex);
+
+    for(size_t i = scheduler->queue_count; i > 0 && scheduler->queue_count == scheduler->queue_capacity; i--)
+    {
+        if(i <= scheduler->queue_count && scheduler->queue[i - 1]->deadline <= now)
+        {
+            cb_end_queued_job(scheduler, cb_queue_remove(scheduler, i - 1), CB_ANALYSIS_EXPIRED);
+        }
+    }
+
+    if(scheduler->queue_count < scheduler->queue_capacity && !scheduler->shutting_down)
+    {
+        cb_analysis_job *job = scheduler->free_jobs[--scheduler->free_job_count];
+
+        memset(job, 0, sizeof(cb_analysis_job));
+        job->request = *request;
+        job->id = id = scheduler->next_id++;
+        job->deadline = request->deadline_ms == 0 ? CB_NO_DEADLINE : now + request->deadline_ms;
+
+        scheduler->queue[scheduler->queue_count++] = job;
+        cb_queue_sift_up(scheduler, scheduler->queue_count - 1);
+        pcthread_condition_signal(&scheduler->work_available);
+    }
+
+    pcthread_mutex_unlock(&scheduler->mutex);
+
+    return id;
+}
+
+/**
+ * Cancel a job. A queued job is dropped, a running one stopped after its
+ * first depth; either way its callback is called with
+ * CB_ANALYSIS_CANCELLED, unless the search of the job reached its limits
+ * before the stop, in which case it is reported as done.
+ * @param scheduler Running scheduler.
+ * @param id Identifier returned by cb_submit_analysis.
+ * @return 1 if the job was found, 0 if it had already ended.
+ */
+int cb_cancel_analysis(cb_scheduler *scheduler, unsigned long id)
+{
+    int found = 0;
+
+    pcthread_mutex_lock(&scheduler->mutex);
+
+    for(size_t i = 0; i < scheduler->queue_count && !found; i++)
+    {
+        if(scheduler->queue[i]->id == id)
+        {
+            cb_end_queued_job(scheduler, cb_queue_remove(scheduler, i), CB_ANALYSIS_CANCELLED);
+            found = 1;
+        }
+    }
+
+    for(uchar i = 0; i < scheduler->worker_count && !found; i++)
+    {
+        cb_analysis_job *job = scheduler->workers[i].job;
+
+        if(job != NULL && job->id == id && !job->finished && !job->cancelled)
+        {
+            job->cancelled = 1;
+            cb_stop_search(job->main_searcher);
+            found = 1;
+        }
+    }
+
+    pcthread_mutex_unlock(&scheduler->mutex);
+
+    return found;
+}
+
+/**
+ * Wait until every job submitted so far has ended and been reported.
+ * @param scheduler Running scheduler.
+ */
+void cb_wait_for_analyses(cb_scheduler *scheduler)
+{
+    pcthread_mutex_lock(&scheduler->mutex);
+
+    while(scheduler->free_job_count < scheduler->job_capacity)
+    {
+        pcthread_condition_wait(&scheduler->job_changed, &scheduler->mutex);
+    }
+
+    pcthread_mutex_unlock(&scheduler->mutex);
+}
+
+#endif
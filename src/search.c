@@ -0,0 +1,834 @@
+/**
+ * @file search.c
+ * @author Nathan Seymour
+ * @brief Iterative deepening alpha-beta search, with a quiescence search at
+ * the leaves and MultiPV at the root.
+ */
+
+#include <string.h>
+#include <time.h>
+#include "chess.h"
+#include "history.h"
+#include "movement.h"
+#include "legality.h"
+#include "evaluation.h"
+#include "transposition.h"
+#include "counters.h"
+#include "trace.h"
+#include "search.h"
+
+/**
+ * How many nodes are searched between two checks of the limits.
+ */
+#define CB_SEARCH_CHECK_INTERVAL 1024
+
+/**
+ * Why the search is unwinding, in searcher->stopped.
+ */
+#define CB_STOPPED_BY_LIMIT     1
+#define CB_STOPPED_BY_REQUEST   2
+
+/**
+ * @defgroup move-ordering Move Ordering
+ * Base scores of the move categories, searched in decreasing order.
+ */
+///@{
+#define CB_ORDER_TT_MOVE        0x40000000
+#define CB_ORDER_PREVIOUS_LINE  0x30000000
+#define CB_ORDER_CAPTURE        0x20000000
+#define CB_ORDER_KILLER         0x10000000
+///@}
+
+static const uchar cb_order_piece_values[7] = {0, 1, 3, 3, 5, 9, 10};
+
+static unsigned long cb_search_clock_ms(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (unsigned long)now.tv_sec * 1000 + (unsigned long)(now.tv_nsec / 1000000);
+#else
+    return (unsigned long)(clock() / (CLOCKS_PER_SEC / 1000));
+#endif
+}
+
+static int cb_same_move(cb_move *a, cb_move *b)
+{
+    return a->from_square_index == b->from_square_index && a->to_square_index == b->to_square_index
+        && (a->promotion_piece & COLOR_MASK) == (b->promotion_piece & COLOR_MASK);
+}
+
+/**
+ * Mate scores are stored relative to the position they were found in, and
+ * returned relative to the root.
+ */
+static short cb_score_to_tt(int score, uchar ply)
+{
+    if(score >= CB_MATE_SCORE - CB_MAX_PLY) return (short)(score + ply);
+    if(score <= -(CB_MATE_SCORE - CB_MAX_PLY)) return (short)(score - ply);
+    return (short)score;
+}
+
+static int cb_score_from_tt(short score, uchar ply)
+{
+    if(score >= CB_MATE_SCORE - CB_MAX_PLY) return score - ply;
+    if(score <= -(CB_MATE_SCORE - CB_MAX_PLY)) return score + ply;
+    return score;
+}
+
+static int cb_is_capture(chess_board *board, cb_move *move)
+{
+    uchar piece = cb_board_get(board, move->from_square_index);
+
+    return cb_board_get(board, move->to_square_index) != EMPTY_SQUARE
+        || ((piece & COLOR_MASK) == PAWN && move->to_square_index == board->ep_target_square_index);
+}
+
+static int cb_is_promotion(chess_board *board, cb_move *move)
+{
+    return (cb_board_get(board, move->from_square_index) & COLOR_MASK) == PAWN
+        && (move->to_square_index / 8 == 7 || move->to_square_index / 8 == 0);
+}
+
+static void cb_search_sleep_ms(unsigned long milliseconds)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec duration = {milliseconds / 1000, (long)(milliseconds % 1000) * 1000000};
+    nanosleep(&duration, NULL);
+#else
+    unsigned long start = cb_search_clock_ms();
+    while(cb_search_clock_ms() - start < milliseconds);
+#endif
+}
+
+static unsigned long cb_search_elapsed_ms(cb_searcher *searcher)
+{
+    return cb_search_clock_ms() - searcher->start_ms;
+}
+
+static int cb_is_pondering(cb_searcher *searcher)
+{
+    return searcher->limits.ponder && !__atomic_load_n(&searcher->ponder_hit, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Check whether the search should stop. Called every CB_SEARCH_CHECK_INTERVAL
+ * nodes, the search unwinds as soon as the stopped flag is set. The first
+ * depth is always completed, so that there is a move to return.
+ */
+static void cb_check_limits(cb_searcher *searcher)
+{
+    if(searcher->completed_depth == 0)
+    {
+        return;
+    }
+
+    if(__atomic_load_n(&searcher->stop_requested, __ATOMIC_RELAXED))
+    {
+        searcher->stopped = CB_STOPPED_BY_REQUEST;
+        return;
+    }
+
+    if(searcher->limits.infinite || cb_is_pondering(searcher))
+    {
+        return;
+    }
+
+    if(searcher->limits.nodes != 0 && searcher->nodes >= searcher->limits.nodes)
+    {
+        searcher->stopped = CB_STOPPED_BY_LIMIT;
+    }
+
+    // After a ponder hit, the time counts from the hit.
+    unsigned long start_ms = searcher->limits.ponder ? __atomic_load_n(&searcher->ponder_hit_ms, __ATOMIC_RELAXED) : searcher->start_ms;
+
+    if(searcher->limits.time_ms != 0 && cb_search_clock_ms() - start_ms >= searcher->limits.time_ms)
+    {
+        searcher->stopped = CB_STOPPED_BY_LIMIT;
+    }
+}
+
+static void cb_report(cb_searcher *searcher, uchar event, uchar depth, uchar line, cb_principal_variation *pv, int score)
+{
+    cb_search_info info;
+
+    if(searcher->callback == NULL)
+    {
+        return;
+    }
+
+    info.event = event;
+    info.depth = depth;
+    info.line = line;
+    info.score = score;
+    info.pv = pv->moves;
+    info.pv_length = pv->length;
+    info.nodes = searcher->nodes;
+    info.time_ms = cb_search_elapsed_ms(searcher);
+    info.nodes_per_second = info.nodes * 1000 / (info.time_ms == 0 ? 1 : info.time_ms);
+    info.hashfull = cb_tt_hashfull(searcher->table);
+
+    searcher->callback(&info, searcher->callback_data);
+}
+
+#ifdef NNUE_EVALUATION
+static int cb_search_uses_nnue(cb_searcher *searcher)
+{
+    return searcher->evaluator.type == CB_EVALUATOR_NNUE && searcher->evaluator.network != NULL;
+}
+#endif
+
+static int cb_search_evaluate(cb_searcher *searcher, chess_board *board, uchar ply)
+{
+#ifdef NNUE_EVALUATION
+    searcher->evaluator.accumulator = &searcher->accumulators[ply];
+#else
+    (void)ply;
+#endif
+
+    return cb_evaluate(board, &searcher->evaluator);
+}
+
+/*
+ * Play a move of the line, the accumulator of the next ply being updated
+ * from the one of this ply when the NNUE evaluator is used. Taking the move
+ * back needs nothing more than cb_unmake_move, the accumulator of this ply
+ * being left untouched.
+ */
+static void cb_search_make_move(cb_searcher *searcher, chess_board *board, cb_move *move, cb_move_undo *undo, uchar ply)
+{
+#ifdef NNUE_EVALUATION
+    if(cb_search_uses_nnue(searcher))
+    {
+        searcher->accumulators[ply + 1] = searcher->accumulators[ply];
+        cb_nnue_update_accumulator(searcher->evaluator.network, &searcher->accumulators[ply + 1], board, move);
+    }
+#else
+    (void)ply;
+#endif
+
+    cb_make_move(board, move, undo, &searcher->history);
+}
+
+/**
+ * Score every move of the list for ordering. Captures are ordered by most
+ * valuable victim, then least valuable attacker.
+ */
+static void cb_score_moves(cb_searcher *searcher, chess_board *board, cb_move_list *moves, cb_move *tt_move, uchar ply, int scores[CB_MAX_MOVES])
+{
+    uchar color = board->move_counter % 2;
+
+    for(uchar i = 0; i < moves->count; i++)
+    {
+        cb_move *move = &moves->moves[i];
+        uchar attacker = cb_board_get(board, move->from_square_index) & COLOR_MASK;
+        uchar victim = cb_board_get(board, move->to_square_index) & COLOR_MASK;
+
+        if(tt_move != NULL && cb_same_move(move, tt_move))
+        {
+            scores[i] = CB_ORDER_TT_MOVE;
+        }
+        else if(cb_is_capture(board, move) || cb_is_promotion(board, move))
+        {
+            if(victim == EMPTY_SQUARE) victim = PAWN;
+            scores[i] = CB_ORDER_CAPTURE + cb_order_piece_values[victim] * 16 - cb_order_piece_values[attacker]
+                      + ((move->promotion_piece & COLOR_MASK) == QUEEN ? 256 : 0);
+        }
+        else if(ply < CB_MAX_PLY && cb_same_move(move, &searcher->killers[ply][0]))
+        {
+            scores[i] = CB_ORDER_KILLER + 1;
+        }
+        else if(ply < CB_MAX_PLY && cb_same_move(move, &searcher->killers[ply][1]))
+        {
+            scores[i] = CB_ORDER_KILLER;
+        }
+        else
+        {
+            scores[i] = (int)searcher->history_scores[color][move->from_square_index][move->to_square_index];
+        }
+    }
+}
+
+/**
+ * Move the best scored move of the remaining ones to the given index.
+ */
+static void cb_pick_move(cb_move_list *moves, int scores[CB_MAX_MOVES], uchar index)
+{
+    uchar best = index;
+
+    for(uchar i = index + 1; i < moves->count; i++)
+    {
+        if(scores[i] > scores[best]) best = i;
+    }
+
+    if(best != index)
+    {
+        cb_move move = moves->moves[index];
+        int score = scores[index];
+
+        moves->moves[index] = moves->moves[best];
+        scores[index] = scores[best];
+        moves->moves[best] = move;
+        scores[best] = score;
+    }
+}
+
+static void cb_update_pv(cb_searcher *searcher, uchar ply, cb_move *move)
+{
+    cb_principal_variation *pv = &searcher->pv[ply];
+    cb_principal_variation *child = &searcher->pv[ply + 1];
+
+    pv->moves[0] = *move;
+    pv->length = 1;
+
+    for(uchar i = 0; i < child->length && pv->length < CB_MAX_PLY; i++)
+    {
+        pv->moves[pv->length++] = child->moves[i];
+    }
+}
+
+/*
+ * Quiescence search. The attack map of the ply may have been computed by
+ * the caller already, as the full search does for its check test.
+ */
+static int cb_quiescence(cb_searcher *searcher, chess_board *board, int alpha, int beta, uchar ply, int mapped)
+{
+    cb_move_list *moves = &searcher->stack[ply].moves;
+    int *scores = searcher->stack[ply].scores;
+    cb_attack_map *attacks = &searcher->stack[ply].attacks;
+    cb_move_undo undo;
+    int in_check;
+    int best_score;
+
+    CB_TRACE(CB_TRACE_QUIESCENCE, ply, 0, alpha, beta);
+
+    searcher->pv[ply].length = 0;
+    searcher->nodes++;
+    CB_COUNT(quiescence_nodes);
+
+    if(searcher->nodes % CB_SEARCH_CHECK_INTERVAL == 0)
+    {
+        cb_check_limits(searcher);
+    }
+
+    if(searcher->stopped || ply >= CB_MAX_PLY)
+    {
+        CB_TRACE_RETURN(ply, cb_search_evaluate(searcher, board, ply));
+    }
+
+    if(!mapped)
+    {
+        cb_load_attack_map(board, attacks);
+    }
+
+    // In check every evasion is searched, standing pat is not an option.
+    in_check = attacks->checkers != 0;
+    best_score = -CB_INFINITE_SCORE;
+
+    if(!in_check)
+    {
+        best_score = cb_search_evaluate(searcher, board, ply);
+
+        if(best_score >= beta) CB_TRACE_RETURN(ply, best_score);
+        if(best_score > alpha) alpha = best_score;
+    }
+
+    cb_generate_legal_moves_from_map(board, attacks, moves);
+
+    if(moves->count == 0)
+    {
+        CB_TRACE_RETURN(ply, in_check ? -(CB_MATE_SCORE - ply) : 0);
+    }
+
+    cb_score_moves(searcher, board, moves, NULL, ply, scores);
+
+    for(uchar i = 0; i < moves->count; i++)
+    {
+        cb_pick_move(moves, scores, i);
+        cb_move *move = &moves->moves[i];
+
+        if(!in_check && scores[i] < CB_ORDER_CAPTURE) break;
+
+        CB_TRACE(CB_TRACE_MOVE, ply, CB_TRACE_PACK_MOVE(move), alpha, beta);
+
+        cb_search_make_move(searcher, board, move, &undo, ply);
+        int score = -cb_quiescence(searcher, board, -beta, -alpha, ply + 1, 0);
+        cb_unmake_move(board, move, &undo, &searcher->history);
+
+        if(searcher->stopped) CB_TRACE_RETURN(ply, 0);
+
+        if(score > best_score)
+        {
+            best_score = score;
+
+            if(score > alpha)
+            {
+                alpha = score;
+                cb_update_pv(searcher, ply, move);
+            }
+
+            if(score >= beta)
+            {
+                CB_COUNT_CUTOFF(i);
+                CB_TRACE(CB_TRACE_CUTOFF, ply, CB_TRACE_PACK_MOVE(move), score, i);
+                break;
+            }
+        }
+    }
+
+    CB_TRACE_RETURN(ply, best_score);
+}
+
+static int cb_alpha_beta(cb_searcher *searcher, chess_board *board, int alpha, int beta, int depth, uchar ply)
+{
+    cb_move_list *moves = &searcher->stack[ply].moves;
+    int *scores = searcher->stack[ply].scores;
+    cb_attack_map *attacks = &searcher->stack[ply].attacks;
+    cb_move_undo undo;
+    cb_tt_data tt_data;
+    cb_move *tt_move = NULL;
+    cb_move best_move = {0, 0, EMPTY_SQUARE};
+    cb_hash_key key = cb_history_current_key(&searcher->history);
+    int original_alpha = alpha;
+    int best_score = -CB_INFINITE_SCORE;
+    int in_check;
+    uchar color = board->move_counter % 2;
+
+    CB_TRACE(CB_TRACE_NODE, ply, depth, alpha, beta);
+
+    if(ply > 0 && cb_is_draw(&searcher->history, board))
+    {
+        searcher->pv[ply].length = 0;
+        CB_TRACE_RETURN(ply, 0);
+    }
+
+    cb_load_attack_map(board, attacks);
+    in_check = attacks->checkers != 0;
+    if(in_check && ply < CB_MAX_PLY / 2) depth++;
+
+    if(depth <= 0 || ply >= CB_MAX_PLY - 1)
+    {
+        CB_TRACE_RETURN(ply, cb_quiescence(searcher, board, alpha, beta, ply, 1));
+    }
+
+    searcher->pv[ply].length = 0;
+    searcher->nodes++;
+    CB_COUNT(nodes);
+
+    if(searcher->nodes % CB_SEARCH_CHECK_INTERVAL == 0)
+    {
+        cb_check_limits(searcher);
+    }
+
+    if(searcher->stopped) CB_TRACE_RETURN(ply, 0);
+
+    if(cb_tt_probe(searcher->table, key, &tt_data))
+    {
+        CB_TRACE(CB_TRACE_TT_HIT, ply, CB_TRACE_PACK_MOVE(&tt_data.move), tt_data.score, tt_data.depth << 2 | tt_data.bound);
+
+        tt_move = tt_data.move.from_square_index != tt_data.move.to_square_index ? &tt_data.move : NULL;
+
+        if(ply > 0 && tt_data.depth >= depth)
+        {
+            int tt_score = cb_score_from_tt(tt_data.score, ply);
+
+            if(tt_data.bound == CB_BOUND_EXACT
+               || (tt_data.bound == CB_BOUND_LOWER && tt_score >= beta)
+               || (tt_data.bound == CB_BOUND_UPPER && tt_score <= alpha))
+            {
+                CB_TRACE_RETURN(ply, tt_score);
+            }
+        }
+    }
+
+    cb_generate_legal_moves_from_map(board, attacks, moves);
+
+    if(moves->count == 0)
+    {
+        CB_TRACE_RETURN(ply, in_check ? -(CB_MATE_SCORE - ply) : 0);
+    }
+
+    cb_score_moves(searcher, board, moves, tt_move, ply, scores);
+
+    for(uchar i = 0; i < moves->count; i++)
+    {
+        cb_pick_move(moves, scores, i);
+        cb_move *move = &moves->moves[i];
+        int quiet = !cb_is_capture(board, move) && !cb_is_promotion(board, move);
+        int score;
+
+        CB_TRACE(CB_TRACE_MOVE, ply, CB_TRACE_PACK_MOVE(move), alpha, beta);
+
+        cb_search_make_move(searcher, board, move, &undo, ply);
+
+        // Principal variation search, the moves after the first are expected to fail low.
+        if(i == 0)
+        {
+            score = -cb_alpha_beta(searcher, board, -beta, -alpha, depth - 1, ply + 1);
+        }
+        else
+        {
+            score = -cb_alpha_beta(searcher, board, -alpha - 1, -alpha, depth - 1, ply + 1);
+
+            if(score > alpha && score < beta)
+            {
+                score = -cb_alpha_beta(searcher, board, -beta, -alpha, depth - 1, ply + 1);
+            }
+        }
+
+        cb_unmake_move(board, move, &undo, &searcher->history);
+
+        if(searcher->stopped) CB_TRACE_RETURN(ply, 0);
+
+        if(score > best_score)
+        {
+            best_score = score;
+            best_move = *move;
+
+            if(score > alpha)
+            {
+                alpha = score;
+                cb_update_pv(searcher, ply, move);
+            }
+
+            if(score >= beta)
+            {
+                CB_COUNT_CUTOFF(i);
+                CB_TRACE(CB_TRACE_CUTOFF, ply, CB_TRACE_PACK_MOVE(move), score, i);
+
+                if(quiet)
+                {
+                    if(!cb_same_move(move, &searcher->killers[ply][0]))
+                    {
+                        searcher->killers[ply][1] = searcher->killers[ply][0];
+                        searcher->killers[ply][0] = *move;
+                    }
+
+                    unsigned int *history_score = &searcher->history_scores[color][move->from_square_index][move->to_square_index];
+                    *history_score += depth * depth;
+
+                    // History scores must stay below the killers.
+                    if(*history_score >= CB_ORDER_KILLER / 2)
+                    {
+                        for(uchar from = 0; from < 64; from++)
+                            for(uchar to = 0; to < 64; to++)
+                                searcher->history_scores[color][from][to] /= 2;
+                    }
+                }
+
+                break;
+            }
+        }
+    }
+
+    uchar bound = best_score >= beta ? CB_BOUND_LOWER : (best_score > original_alpha ? CB_BOUND_EXACT : CB_BOUND_UPPER);
+
+    CB_TRACE(CB_TRACE_TT_STORE, ply, CB_TRACE_PACK_MOVE(&best_move), cb_score_to_tt(best_score, ply), depth << 2 | bound);
+    cb_tt_store(searcher->table, key, &best_move, cb_score_to_tt(best_score, ply), (uchar)depth, bound);
+
+    CB_TRACE_RETURN(ply, best_score);
+}
+
+static int cb_is_excluded_root_move(cb_searcher *searcher, cb_move *move)
+{
+    for(uchar i = 0; i < searcher->excluded_root_move_count; i++)
+    {
+        if(cb_same_move(move, &searcher->excluded_root_moves[i])) return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Search the root with a full window, skipping the root moves that are
+ * already lines of this iteration.
+ * @return 0 if no move was left to search or the search was stopped.
+ */
+static int cb_search_root(cb_searcher *searcher, chess_board *board, cb_move_list *root_moves, int root_scores[CB_MAX_MOVES], int depth, uchar line_index, cb_principal_variation *line)
+{
+    int *scores = searcher->stack[0].scores;
+    cb_move_undo undo;
+    int alpha = -CB_INFINITE_SCORE;
+    int best_score = -CB_INFINITE_SCORE;
+    int searched = 0;
+
+    CB_TRACE(CB_TRACE_ITERATION, 0, depth, line_index, 0);
+
+    memcpy(scores, root_scores, sizeof(int) * root_moves->count);
+    searcher->pv[0].length = 0;
+
+    for(uchar i = 0; i < root_moves->count; i++)
+    {
+        cb_pick_move(root_moves, scores, i);
+        cb_move *move = &root_moves->moves[i];
+        int score;
+
+        if(cb_is_excluded_root_move(searcher, move)) continue;
+
+        searcher->nodes++;
+        CB_COUNT(nodes);
+        CB_TRACE(CB_TRACE_MOVE, 0, CB_TRACE_PACK_MOVE(move), alpha, CB_INFINITE_SCORE);
+
+        cb_search_make_move(searcher, board, move, &undo, 0);
+
+        if(searched == 0)
+        {
+            score = -cb_alpha_beta(searcher, board, -CB_INFINITE_SCORE, -alpha, depth - 1, 1);
+        }
+        else
+        {
+            score = -cb_alpha_beta(searcher, board, -alpha - 1, -alpha, depth - 1, 1);
+
+            if(score > alpha)
+            {
+                score = -cb_alpha_beta(searcher, board, -CB_INFINITE_SCORE, -alpha, depth - 1, 1);
+            }
+        }
+
+        cb_unmake_move(board, move, &undo, &searcher->history);
+        searched++;
+
+        if(searcher->stopped)
+        {
+            CB_TRACE(CB_TRACE_EXIT, 0, 0, best_score, 0);
+            return 0;
+        }
+
+        if(score > best_score)
+        {
+            best_score = score;
+            alpha = score;
+            cb_update_pv(searcher, 0, move);
+
+            // The first move searched is the best line of the previous depth.
+            if(searched > 1)
+            {
+                cb_report(searcher, CB_SEARCH_EVENT_PV_CHANGE, depth, line_index, &searcher->pv[0], score);
+            }
+        }
+    }
+
+    CB_TRACE(CB_TRACE_EXIT, 0, 0, best_score, 0);
+
+    if(searched == 0) return 0;
+
+    *line = searcher->pv[0];
+    line->score = best_score;
+
+    return 1;
+}
+
+/**
+ * Set up a searcher. The material evaluator is selected; the transposition
+ * table is not cleared, so that it can be shared with other searchers.
+ * @param searcher Searcher to initialize.
+ * @param table Transposition table to use, initialized by the caller.
+ */
+void cb_initialize_searcher(cb_searcher *searcher, cb_transposition_table *table)
+{
+    memset(searcher, 0, sizeof(cb_searcher));
+
+    searcher->table = table;
+    searcher->callback = NULL;
+    cb_initialize_evaluator(&searcher->evaluator, CB_EVALUATOR_MATERIAL);
+    cb_clear_pawn_hash_table(&searcher->pawn_table);
+    searcher->evaluator.pawn_table = &searcher->pawn_table;
+}
+
+/**
+ * Search the best moves of a position with iterative deepening. Each depth
+ * runs one full window search of the root per requested line, each one
+ * excluding the root moves of the lines found before it, so that the best
+ * multi_pv moves of the position are returned with their own principal
+ * variation. All the lines share the transposition table and the move
+ * ordering, the best lines of the last depth being searched first.
+ *
+ * When the node or time limit is reached, or cb_stop_search is called, the
+ * lines of the last completed depth are returned. The first depth is always
+ * completed. The search can run in a thread of its own while other threads
+ * stop it and receive its progress through the search callback.
+ * @param searcher Searcher initialized with cb_initialize_searcher.
+ * @param board Position to search. It is left unchanged.
+ * @param history Positions of the game up to the board, for repetitions. If
+ * NULL, only the repetitions within the searched lines are detected.
+ * @param limits When to stop.
+ * @param result Filled with the best lines, best first.
+ */
+void cb_search(cb_searcher *searcher, chess_board *board, cb_position_history *history, cb_search_limits *limits, cb_search_result *result)
+{
+    cb_tt_data tt_data;
+    uchar max_depth = limits->depth == 0 || limits->depth >= CB_MAX_PLY || limits->infinite ? CB_MAX_PLY - 1 : limits->depth;
+    uchar line_count = limits->multi_pv == 0 ? 1 : (limits->multi_pv > CB_MAX_MULTI_PV ? CB_MAX_MULTI_PV : limits->multi_pv);
+
+    if(history != NULL)
+    {
+        searcher->history = *history;
+    }
+    else
+    {
+        cb_initialize_history(&searcher->history, board);
+    }
+
+    memset(searcher->killers, 0, sizeof(searcher->killers));
+    memset(searcher->history_scores, 0, sizeof(searcher->history_scores));
+    searcher->nodes = 0;
+    searcher->limits = *limits;
+    searcher->completed_depth = 0;
+    searcher->stopped = 0;
+    searcher->start_ms = cb_search_clock_ms();
+    CB_TRACE(CB_TRACE_SEARCH, 0, 0, 0, 0);
+
+    cb_tt_new_search(searcher->table);
+    memset(result, 0, sizeof(cb_search_result));
+
+#ifdef NNUE_EVALUATION
+    if(cb_search_uses_nnue(searcher))
+    {
+        cb_nnue_refresh_accumulator(searcher->evaluator.network, &searcher->accumulators[0], board);
+    }
+#endif
+
+    cb_generate_legal_moves(board, &searcher->root_moves);
+    if(line_count > searcher->root_moves.count) line_count = searcher->root_moves.count;
+
+    for(uchar depth = 1; depth <= max_depth && line_count > 0; depth++)
+    {
+        cb_principal_variation lines[CB_MAX_MULTI_PV];
+        cb_move *tt_move = NULL;
+        uchar completed = 0;
+
+        // The lines of the previous depth first, in order, then the usual ordering.
+        if(cb_tt_probe(searcher->table, cb_history_current_key(&searcher->history), &tt_data)
+           && tt_data.move.from_square_index != tt_data.move.to_square_index)
+        {
+            tt_move = &tt_data.move;
+        }
+
+        cb_score_moves(searcher, board, &searcher->root_moves, tt_move, 0, searcher->root_scores);
+
+        for(uchar i = 0; i < searcher->root_moves.count; i++)
+        {
+            for(uchar line = 0; line < result->line_count; line++)
+            {
+                if(cb_same_move(&searcher->root_moves.moves[i], &result->lines[line].moves[0]))
+                {
+                    searcher->root_scores[i] = CB_ORDER_PREVIOUS_LINE + CB_MAX_MULTI_PV - line;
+                }
+            }
+        }
+
+        searcher->excluded_root_move_count = 0;
+
+        cb_check_limits(searcher);
+
+        while(completed < line_count && !searcher->stopped)
+        {
+            if(!cb_search_root(searcher, board, &searcher->root_moves, searcher->root_scores, depth, completed, &lines[completed])) break;
+
+            searcher->excluded_root_moves[searcher->excluded_root_move_count++] = lines[completed].moves[0];
+            completed++;
+        }
+
+        if(searcher->stopped) break;
+
+        // Passes may disagree slightly, keep the lines sorted by score.
+        for(uchar i = 1; i < completed; i++)
+        {
+            cb_principal_variation line = lines[i];
+            uchar j = i;
+
+            for(; j > 0 && lines[j - 1].score < line.score; j--)
+            {
+                lines[j] = lines[j - 1];
+            }
+
+            lines[j] = line;
+        }
+
+        // Only the best line is stored for the root, the others excluded moves.
+        if(completed > 0)
+        {
+            cb_tt_store(searcher->table, cb_history_current_key(&searcher->history), &lines[0].moves[0],
+                        cb_score_to_tt(lines[0].score, 0), depth, CB_BOUND_EXACT);
+        }
+
+        memcpy(result->lines, lines, sizeof(cb_principal_variation) * completed);
+        result->line_count = completed;
+        result->depth = depth;
+        searcher->completed_depth = depth;
+
+        for(uchar i = 0; i < completed; i++)
+        {
+            cb_report(searcher, CB_SEARCH_EVENT_DEPTH, depth, i, &lines[i], lines[i].score);
+        }
+
+        // No need to look deeper once every line is a forced mate.
+        if(cb_is_mate_score(lines[completed - 1].score) && lines[completed - 1].score > 0
+           && CB_MATE_SCORE - lines[completed - 1].score <= depth) break;
+    }
+
+    // Infinite and ponder searches only return once told to.
+    while(!__atomic_load_n(&searcher->stop_requested, __ATOMIC_RELAXED)
+          && (limits->infinite || cb_is_pondering(searcher)))
+    {
+        cb_search_sleep_ms(1);
+    }
+
+    result->nodes = searcher->nodes;
+    result->time_ms = cb_search_elapsed_ms(searcher);
+    result->stopped = searcher->stopped == CB_STOPPED_BY_REQUEST || limits->infinite || cb_is_pondering(searcher);
+
+    cb_reset_search(searcher);
+}
+
+/**
+ * Set the function called with the progress of the searches: after each
+ * completed depth, and whenever a new best root move is found.
+ * @param searcher Searcher to report the progress of.
+ * @param callback Function to call from the search thread, or NULL.
+ * @param user_data Given back to the callback.
+ */
+void cb_set_search_callback(cb_searcher *searcher, cb_search_callback callback, void *user_data)
+{
+    searcher->callback = callback;
+    searcher->callback_data = user_data;
+}
+
+/**
+ * Stop a running search, from any thread. cb_search returns shortly after,
+ * with the lines of the last completed depth. If no search is running, the
+ * next one stops after its first depth, unless cb_reset_search is called
+ * before it.
+ * @param searcher Searcher running the search.
+ */
+void cb_stop_search(cb_searcher *searcher)
+{
+    __atomic_store_n(&searcher->stop_requested, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Turn a ponder search into a regular one, from any thread. The limits of
+ * the search apply from now on. If no search is running, the next ponder
+ * search is a regular one, unless cb_reset_search is called before it.
+ * @param searcher Searcher running the ponder search.
+ */
+void cb_ponder_hit(cb_searcher *searcher)
+{
+    __atomic_store_n(&searcher->ponder_hit_ms, cb_search_clock_ms(), __ATOMIC_RELAXED);
+    __atomic_store_n(&searcher->ponder_hit, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Drop the stop and ponder hit sent while no search was running, Ex: a stop
+ * that arrived once the search had already returned. Both are cleared when
+ * cb_search returns; call this before starting the thread of the next
+ * search, never once it may have started, or a request made for it could
+ * be lost.
+ * @param searcher Searcher about to be started.
+ */
+void cb_reset_search(cb_searcher *searcher)
+{
+    __atomic_store_n(&searcher->stop_requested, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&searcher->ponder_hit, 0, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,301 @@
+/**
+ * @file trace.c
+ * @author Nathan Seymour
+ * @brief Per-thread ring buffers of search events.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+#include "pcmem.h"
+
+/*
+ * Dump header: the magic, a byte order mark and the size of an event. It
+ * is followed by a block per thread: the index of the thread, the number
+ * of events, then the events, oldest first. Everything is written as it is
+ * laid out in memory, dumps can only be read on machines of the same byte
+ * order, which the mark checks.
+ */
+#define TRACE_MAGIC "PCTRACE1"
+#define TRACE_BYTE_ORDER_MARK 0x01020304
+
+#ifdef SEARCH_TRACE
+
+/*
+ * Events copied at once by cb_trace_dump.
+ */
+#define TRACE_DUMP_CHUNK 256
+
+/*
+ * Each buffer is padded to a whole number of cache lines, and the array
+ * aligned on one, so that the heads of two threads never share a line.
+ */
+typedef union {
+    cb_trace_buffer buffer;
+    uchar padding[pcmem_cache_line_round(sizeof(cb_trace_buffer))];
+} cb_trace_block;
+
+static cb_trace_block cb_trace_blocks[CB_TRACE_MAX_THREADS] __attribute__((aligned(PCMEM_CACHE_LINE_SIZE)));
+static unsigned int cb_claimed_traces = 0;
+
+/*
+ * Given to the threads beyond CB_TRACE_MAX_THREADS, never written.
+ */
+static cb_trace_buffer cb_no_trace = {NULL, 0, 0, 0};
+
+CB_THREAD_LOCAL cb_trace_buffer *cb_thread_trace = NULL;
+
+/*
+ * Give the calling thread the next buffer, with its events, or NULL to
+ * keep it from recording.
+ */
+static cb_trace_buffer *cb_claim_trace_buffer(cb_trace_event *events, uint64_t count)
+{
+    unsigned int index = __atomic_fetch_add(&cb_claimed_traces, 1, __ATOMIC_RELAXED);
+
+    if(index >= CB_TRACE_MAX_THREADS)
+    {
+        cb_thread_trace = &cb_no_trace;
+        return NULL;
+    }
+
+    cb_thread_trace = &cb_trace_blocks[index].buffer;
+    cb_thread_trace->mask = count - 1;
+    __atomic_store_n(&cb_thread_trace->events, events, __ATOMIC_RELEASE);
+
+    return cb_thread_trace;
+}
+
+/**
+ * Give the calling thread its buffer. Called on the first event of every
+ * thread, through the CB_TRACE macro. Buffers are allocated when
+ * DYNAMIC_MEMORY_ALLOCATION is enabled, and otherwise the threads must
+ * attach one with cb_trace_attach_thread to record anything.
+ * @return Buffer of the calling thread.
+ */
+cb_trace_buffer *cb_claim_thread_trace(void)
+{
+    cb_trace_event *events = NULL;
+
+#ifdef DYNAMIC_MEMORY_ALLOCATION
+    events = malloc(CB_TRACE_EVENTS * sizeof(cb_trace_event));
+#endif
+
+    if(events == NULL || cb_claim_trace_buffer(events, CB_TRACE_EVENTS) == NULL)
+    {
+#ifdef DYNAMIC_MEMORY_ALLOCATION
+        free(events);
+#endif
+        cb_thread_trace = &cb_no_trace;
+    }
+
+    return cb_thread_trace;
+}
+
+/**
+ * Give the calling thread a buffer in memory provided by the caller,
+ * instead of the one it would get on its first event. The memory must
+ * outlive every snapshot and dump.
+ * @param memory Memory of the buffer.
+ * @param size_in_bytes Size of the memory, of which the largest power of
+ * two of events is used.
+ * @return 1 on success, 0 if the thread already has a buffer, if there are
+ * too many threads or if the memory cannot hold two events.
+ */
+int cb_trace_attach_thread(void *memory, size_t size_in_bytes)
+{
+    uintptr_t address = (uintptr_t)memory;
+    uintptr_t aligned = (address + sizeof(uint64_t) - 1) & ~(uintptr_t)(sizeof(uint64_t) - 1);
+    uint64_t count = 2;
+
+    if(cb_thread_trace != NULL || memory == NULL || size_in_bytes < aligned - address + 2 * sizeof(cb_trace_event))
+    {
+        return 0;
+    }
+
+    while(count * 2 * sizeof(cb_trace_event) <= size_in_bytes - (aligned - address))
+    {
+        count *= 2;
+    }
+
+    return cb_claim_trace_buffer((cb_trace_event*)aligned, count) != NULL;
+}
+
+/**
+ * Number of threads that have a buffer so far.
+ * @return Number of buffers in use.
+ */
+unsigned int cb_trace_thread_count(void)
+{
+    unsigned int count = __atomic_load_n(&cb_claimed_traces, __ATOMIC_RELAXED);
+    return count < CB_TRACE_MAX_THREADS ? count : CB_TRACE_MAX_THREADS;
+}
+
+/*
+ * Copy events first to first + count - 1 of a buffer. The writer may
+ * overwrite events during the copy: the head is read again after it, and
+ * the events the writer may have reached since (the one it may be writing
+ * included) are not valid. The slot of the next event may always be being
+ * written, so only the last events but one of a buffer can be read.
+ * @return Number of events at the start of the copy that are not valid.
+ */
+static size_t cb_trace_copy(const cb_trace_buffer *buffer, const cb_trace_event *events, uint64_t first, size_t count,
+                            cb_trace_event *copy)
+{
+    uint64_t valid;
+
+    for(size_t i = 0; i < count; i++)
+    {
+        const uint64_t *slot = (const uint64_t*)&events[(first + i) & buffer->mask];
+        uint64_t words[2];
+
+        words[0] = __atomic_load_n(&slot[0], __ATOMIC_RELAXED);
+        words[1] = __atomic_load_n(&slot[1], __ATOMIC_RELAXED);
+        memcpy(&copy[i], words, sizeof(words));
+    }
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    valid = __atomic_load_n(&buffer->head, __ATOMIC_RELAXED);
+    valid = valid > buffer->mask ? valid - buffer->mask : 0;
+
+    if(valid <= first)
+    {
+        return 0;
+    }
+
+    return valid - first < count ? (size_t)(valid - first) : count;
+}
+
+/**
+ * Copy the last events of one thread while it keeps running. A buffer of
+ * n events holds the last n - 1.
+ * @param thread_index Index of the thread, below cb_trace_thread_count.
+ * @param events Receives the events, oldest first.
+ * @param capacity Most events to copy.
+ * @return Number of events copied.
+ */
+size_t cb_trace_snapshot(unsigned int thread_index, cb_trace_event *events, size_t capacity)
+{
+    const cb_trace_buffer *buffer = &cb_trace_blocks[thread_index].buffer;
+    const cb_trace_event *buffer_events = __atomic_load_n(&buffer->events, __ATOMIC_ACQUIRE);
+    uint64_t head = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+    size_t count;
+    size_t invalid;
+
+    if(buffer_events == NULL)
+    {
+        return 0;
+    }
+
+    count = head < buffer->mask ? (size_t)head : (size_t)buffer->mask;
+    count = count < capacity ? count : capacity;
+
+    invalid = cb_trace_copy(buffer, buffer_events, head - count, count, events);
+    memmove(events, events + invalid, (count - invalid) * sizeof(cb_trace_event));
+
+    return count - invalid;
+}
+
+/*
+ * Write the events of a thread as a block of a dump, a chunk at a time.
+ * @return 1 on success, 0 if the file could not be written.
+ */
+static int cb_trace_dump_thread(FILE *file, unsigned int thread_index)
+{
+    const cb_trace_buffer *buffer = &cb_trace_blocks[thread_index].buffer;
+    const cb_trace_event *events = __atomic_load_n(&buffer->events, __ATOMIC_ACQUIRE);
+    uint64_t head = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+    uint32_t block[2] = {thread_index, 0};
+    cb_trace_event chunk[TRACE_DUMP_CHUNK];
+    long block_offset = ftell(file);
+    uint64_t first;
+
+    if(events == NULL)
+    {
+        return 1;
+    }
+
+    first = head > buffer->mask ? head - buffer->mask : 0;
+
+    if(fwrite(block, sizeof(uint32_t), 2, file) != 2)
+    {
+        return 0;
+    }
+
+    while(first < head)
+    {
+        size_t count = head - first < TRACE_DUMP_CHUNK ? (size_t)(head - first) : TRACE_DUMP_CHUNK;
+        size_t invalid = cb_trace_copy(buffer, events, first, count, chunk);
+
+        if(fwrite(chunk + invalid, sizeof(cb_trace_event), count - invalid, file) != count - invalid)
+        {
+            return 0;
+        }
+
+        block[1] += (uint32_t)(count - invalid);
+        first += count;
+    }
+
+    // The number of events is only known once they are all copied.
+    return fseek(file, block_offset, SEEK_SET) == 0 && fwrite(block, sizeof(uint32_t), 2, file) == 2
+           && fseek(file, 0, SEEK_END) == 0;
+}
+
+/**
+ * Write the last events of every thread to a file, while they keep
+ * running. The events a thread overwrites during the dump are left out,
+ * so a search being traced should be stopped first for a complete tree.
+ * @param path Path of the file to write.
+ * @return 1 on success, 0 if the file could not be written.
+ */
+int cb_trace_dump(const char *path)
+{
+    uint32_t header[2] = {TRACE_BYTE_ORDER_MARK, sizeof(cb_trace_event)};
+    FILE *file = fopen(path, "wb");
+    int written;
+
+    if(file == NULL)
+    {
+        return 0;
+    }
+
+    written = fwrite(TRACE_MAGIC, 1, 8, file) == 8 && fwrite(header, sizeof(uint32_t), 2, file) == 2;
+
+    for(unsigned int thread_index = 0; written && thread_index < cb_trace_thread_count(); thread_index++)
+    {
+        written = cb_trace_dump_thread(file, thread_index);
+    }
+
+    return fclose(file) == 0 && written;
+}
+
+#else
+
+int cb_trace_attach_thread(void *memory, size_t size_in_bytes)
+{
+    (void)memory;
+    (void)size_in_bytes;
+    return 0;
+}
+
+unsigned int cb_trace_thread_count(void)
+{
+    return 0;
+}
+
+size_t cb_trace_snapshot(unsigned int thread_index, cb_trace_event *events, size_t capacity)
+{
+    (void)thread_index;
+    (void)events;
+    (void)capacity;
+    return 0;
+}
+
+int cb_trace_dump(const char *path)
+{
+    (void)path;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,246 @@
+/**
+ * @file transposition.c
+ * @author Nathan Seymour
+ * @brief Transposition table of the search, shared between threads.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "chess.h"
+#include "counters.h"
+#include "transposition.h"
+
+/*
+ * Layout of the data word:
+ *  bits  0-15  score
+ *  bits 16-23  depth
+ *  bits 24-25  bound
+ *  bits 26-31  from square
+ *  bits 32-37  to square
+ *  bits 38-41  promotion piece
+ *  bits 42-49  age
+ */
+#define pack_data(move, score, depth, bound, age) \
+    ((uint64_t)(ushort)(score) | (uint64_t)(depth) << 16 | (uint64_t)(bound) << 24 \
+    | (uint64_t)((move)->from_square_index & 0x3F) << 26 | (uint64_t)((move)->to_square_index & 0x3F) << 32 \
+    | (uint64_t)((move)->promotion_piece & 0xF) << 38 | (uint64_t)(age) << 42)
+
+#define data_depth(data) ((uchar)((data) >> 16))
+#define data_bound(data) ((uchar)(((data) >> 24) & 0x3))
+#define data_age(data) ((uchar)((data) >> 42))
+
+/*
+ * Entries are read and written with relaxed atomics: no ordering is needed,
+ * the key check catches torn entries, and no data race is left for thread
+ * sanitizers to report.
+ */
+static void cb_read_entry(cb_tt_entry *entry, uint64_t *key_check, uint64_t *data)
+{
+    *key_check = __atomic_load_n(&entry->key_check, __ATOMIC_RELAXED);
+    *data = __atomic_load_n(&entry->data, __ATOMIC_RELAXED);
+}
+
+/*
+ * Largest power of two number of entries that fits in a size.
+ */
+static size_t cb_tt_entry_count(size_t size_in_bytes)
+{
+    size_t size = 1;
+
+    while(size * 2 * sizeof(cb_tt_entry) <= size_in_bytes)
+    {
+        size *= 2;
+    }
+
+    return size;
+}
+
+/**
+ * Set up a transposition table in memory provided by the caller, which
+ * must outlive the table. Nothing is allocated, and
+ * cb_free_transposition_table must not be called on the table.
+ * @param table Table to initialize.
+ * @param memory Memory of the entries.
+ * @param size_in_bytes Size of the memory, rounded down to a power of two
+ * number of entries once the memory is aligned.
+ * @return 1 on success, 0 if the memory cannot hold a single entry.
+ */
+int cb_attach_transposition_table(cb_transposition_table *table, void *memory, size_t size_in_bytes)
+{
+    size_t address = (size_t)memory;
+    size_t padding = (sizeof(cb_tt_entry) - address % sizeof(cb_tt_entry)) % sizeof(cb_tt_entry);
+
+    table->entries = NULL;
+    table->size = 0;
+    table->age = 0;
+
+    if(memory == NULL || size_in_bytes < padding + sizeof(cb_tt_entry))
+    {
+        return 0;
+    }
+
+    table->entries = (cb_tt_entry*)((uchar*)memory + padding);
+    table->size = cb_tt_entry_count(size_in_bytes - padding);
+
+    cb_clear_transposition_table(table);
+
+    return 1;
+}
+
+#ifdef DYNAMIC_MEMORY_ALLOCATION
+/**
+ * Allocate a transposition table. cb_free_transposition_table must be
+ * called when done.
+ * @param table Table to initialize.
+ * @param size_in_bytes Memory to use, rounded down to a power of two number of entries.
+ * @return 1 on success, 0 if the memory could not be allocated.
+ */
+int cb_initialize_transposition_table(cb_transposition_table *table, size_t size_in_bytes)
+{
+    size_t size = cb_tt_entry_count(size_in_bytes);
+
+    table->entries = malloc(size * sizeof(cb_tt_entry));
+    table->size = table->entries != NULL ? size : 0;
+    table->age = 0;
+
+    cb_clear_transposition_table(table);
+
+    return table->entries != NULL;
+}
+
+/**
+ * Release the memory of a transposition table.
+ * @param table Table to free.
+ */
+void cb_free_transposition_table(cb_transposition_table *table)
+{
+    free(table->entries);
+    table->entries = NULL;
+    table->size = 0;
+}
+#endif
+
+/**
+ * Forget every entry. Must not be called while the table is being searched.
+ * @param table Table to clear.
+ */
+void cb_clear_transposition_table(cb_transposition_table *table)
+{
+    if(table->entries != NULL)
+    {
+        memset(table->entries, 0, table->size * sizeof(cb_tt_entry));
+    }
+}
+
+/**
+ * Age the entries of the table, called once before each search. Searches
+ * sharing the table may start at any time, so the age is only accessed
+ * atomically.
+ * @param table Table about to be searched.
+ */
+void cb_tt_new_search(cb_transposition_table *table)
+{
+    __atomic_add_fetch(&table->age, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Look up a position.
+ * @param table Table to look in.
+ * @param key Zobrist key of the position.
+ * @param data Receives the entry of the position, if found.
+ * @return 1 if the position was found, 0 otherwise.
+ */
+int cb_tt_probe(cb_transposition_table *table, cb_hash_key key, cb_tt_data *data)
+{
+    uint64_t key_check, entry_data;
+
+    CB_COUNT(tt_probes);
+
+    cb_read_entry(&table->entries[key & (table->size - 1)], &key_check, &entry_data);
+
+    if((key_check ^ entry_data) != key)
+    {
+        if(entry_data != 0)
+        {
+            CB_COUNT(tt_collisions);
+        }
+        return 0;
+    }
+
+    CB_COUNT(tt_hits);
+
+    data->score = (short)(ushort)(entry_data & 0xFFFF);
+    data->depth = data_depth(entry_data);
+    data->bound = data_bound(entry_data);
+    data->move.from_square_index = (uchar)((entry_data >> 26) & 0x3F);
+    data->move.to_square_index = (uchar)((entry_data >> 32) & 0x3F);
+    data->move.promotion_piece = (uchar)((entry_data >> 38) & 0xF);
+
+    return 1;
+}
+
+/**
+ * Store the result of the search of a position. Entries of the current
+ * search are only replaced by deeper or exact results of other positions.
+ * @param table Table to store into.
+ * @param key Zobrist key of the position.
+ * @param move Best move found, or a move with equal from and to squares if none.
+ * @param score Score of the position.
+ * @param depth Depth the position was searched to.
+ * @param bound Meaning of the score, Ex: CB_BOUND_LOWER.
+ */
+void cb_tt_store(cb_transposition_table *table, cb_hash_key key, cb_move *move, short score, uchar depth, uchar bound)
+{
+    cb_tt_entry *entry = &table->entries[key & (table->size - 1)];
+    uint64_t key_check, entry_data;
+
+    cb_read_entry(entry, &key_check, &entry_data);
+
+    int is_same_position = (key_check ^ entry_data) == key;
+    if(entry_data != 0 && !is_same_position && data_age(entry_data) == __atomic_load_n(&table->age, __ATOMIC_RELAXED)
+        && data_depth(entry_data) > depth && bound != CB_BOUND_EXACT)
+    {
+        return;
+    }
+
+    cb_move no_move = {0, 0, EMPTY_SQUARE};
+    if(is_same_position && move->from_square_index == move->to_square_index)
+    {
+        // Keep the move of an earlier search of the position.
+        no_move.from_square_index = (uchar)((entry_data >> 26) & 0x3F);
+        no_move.to_square_index = (uchar)((entry_data >> 32) & 0x3F);
+        no_move.promotion_piece = (uchar)((entry_data >> 38) & 0xF);
+        move = &no_move;
+    }
+
+    entry_data = pack_data(move, score, depth, bound, __atomic_load_n(&table->age, __ATOMIC_RELAXED));
+
+    __atomic_store_n(&entry->key_check, key ^ entry_data, __ATOMIC_RELAXED);
+    __atomic_store_n(&entry->data, entry_data, __ATOMIC_RELAXED);
+}
+
+/**
+ * Estimate how full the table is with entries of the current search, by
+ * sampling its first thousand entries.
+ * @param table Table to look at.
+ * @return Per mille of the entries used by the current search.
+ */
+ushort cb_tt_hashfull(cb_transposition_table *table)
+{
+    size_t sample = table->size < 1000 ? table->size : 1000;
+    size_t used = 0;
+    uchar age = __atomic_load_n(&table->age, __ATOMIC_RELAXED);
+
+    for(size_t i = 0; i < sample; i++)
+    {
+        uint64_t key_check, data;
+        cb_read_entry(&table->entries[i], &key_check, &data);
+
+        if(data_bound(data) != CB_BOUND_NONE && data_age(data) == age)
+        {
+            used++;
+        }
+    }
+
+    return sample == 0 ? 0 : (ushort)(used * 1000 / sample);
+}
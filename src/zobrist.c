@@ -0,0 +1,131 @@
+/**
+ * @file zobrist.c
+ * @author Nathan Seymour
+ * @brief Zobrist hashing of chess positions.
+ */
+
+#include "chess.h"
+#include "zobrist.h"
+
+/*
+ * Rather than storing a table of 1024 random 64 bit keys (8KB, which is a
+ * lot for some of the microcontrollers we run on), each key is derived from
+ * its table index with the SplitMix64 finalizer. The keys are therefore fixed
+ * across builds and platforms, which matters because hashes end up in files.
+ */
+#define ZOBRIST_SEED            0x9E3779B97F4A7C15ULL
+#define ZOBRIST_PIECE_OFFSET    0x000
+#define ZOBRIST_CASTLING_OFFSET 0x400
+#define ZOBRIST_EP_OFFSET       0x410
+#define ZOBRIST_SIDE_OFFSET     0x418
+
+static cb_hash_key cb_zobrist_mix(cb_hash_key index)
+{
+    cb_hash_key key = (index + 1) * ZOBRIST_SEED;
+
+    key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    key = (key ^ (key >> 27)) * 0x94D049BB133111EBULL;
+
+    return key ^ (key >> 31);
+}
+
+/**
+ * Get the key of a piece standing on a square.
+ * @param piece_value Bitwise-OR'd piece and color value. Ex: BLACK | ROOK.
+ * @param square_index Square index the piece stands on.
+ * @return Zobrist key of the piece on that square. Empty squares hash to 0.
+ */
+cb_hash_key cb_zobrist_piece_key(uchar piece_value, uchar square_index)
+{
+    if(piece_value == EMPTY_SQUARE)
+    {
+        return 0;
+    }
+
+    return cb_zobrist_mix(ZOBRIST_PIECE_OFFSET + (piece_value << 6) + square_index);
+}
+
+/**
+ * Get the key of a set of castling rights.
+ * @param castling_rights Castling rights as stored in chess_board.castling_rights.
+ * @return Zobrist key of the castling rights.
+ */
+cb_hash_key cb_zobrist_castling_key(uchar castling_rights)
+{
+    return cb_zobrist_mix(ZOBRIST_CASTLING_OFFSET + (castling_rights & CASTLE_RIGHTS_ALL));
+}
+
+/**
+ * Get the key of an en passant target square. Only the file is hashed, as
+ * the rank is implied by the player to move.
+ * @param ep_target_square_index En passant target square, or (uchar)-1 if there is none.
+ * @return Zobrist key of the en passant square, 0 if there is none.
+ */
+cb_hash_key cb_zobrist_ep_key(uchar ep_target_square_index)
+{
+    if(ep_target_square_index == (uchar)-1)
+    {
+        return 0;
+    }
+
+    return cb_zobrist_mix(ZOBRIST_EP_OFFSET + (ep_target_square_index % 8));
+}
+
+/**
+ * Get the key XOR'd into the hash when black is to move.
+ * @return Zobrist key of the side to move.
+ */
+cb_hash_key cb_zobrist_side_key()
+{
+    return cb_zobrist_mix(ZOBRIST_SIDE_OFFSET);
+}
+
+/**
+ * Compute the full Zobrist hash of a position: pieces, side to move,
+ * castling rights and en passant square.
+ * @param board Board to hash.
+ * @return Zobrist hash of the position.
+ */
+cb_hash_key cb_zobrist_key(chess_board *board)
+{
+    cb_hash_key key = 0;
+
+    for(uchar square_index = 0; square_index < 64; square_index++)
+    {
+        key ^= cb_zobrist_piece_key(cb_board_get(board, square_index), square_index);
+    }
+
+    if(board->move_counter % 2 == 1)
+    {
+        key ^= cb_zobrist_side_key();
+    }
+
+    key ^= cb_zobrist_castling_key(board->castling_rights);
+    key ^= cb_zobrist_ep_key(board->ep_target_square_index);
+
+    return key;
+}
+
+/**
+ * Compute the Zobrist hash of the pawns only. Two positions with the same
+ * pawn structure have the same pawn key, which makes it suitable for caching
+ * pawn structure evaluations.
+ * @param board Board to hash.
+ * @return Zobrist hash of the pawns on the board.
+ */
+cb_hash_key cb_zobrist_pawn_key(chess_board *board)
+{
+    cb_hash_key key = 0;
+
+    for(uchar square_index = 0; square_index < 64; square_index++)
+    {
+        uchar piece = cb_board_get(board, square_index);
+
+        if((piece & COLOR_MASK) == PAWN)
+        {
+            key ^= cb_zobrist_piece_key(piece, square_index);
+        }
+    }
+
+    return key;
+}
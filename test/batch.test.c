@@ -0,0 +1,123 @@
+/**
+ * @file batch.test.c
+ * @author Nathan Seymour
+ * @brief Tests for proton-chess batched move application.
+ */
+
+#include <string.h>
+#include "chess.h"
+#include "zobrist.h"
+#include "movement.h"
+#include "batch.h"
+#include "scpunitc.h"
+
+#define BATCH_SIZE 5
+
+TEST(cb_perform_movements)
+{
+    chess_board boards[BATCH_SIZE];
+    chess_board expected_board;
+    uchar results[BATCH_SIZE];
+    cb_move moves[BATCH_SIZE] = {
+            {12, 28, EMPTY_SQUARE},     // e2e4
+            {6, 21, EMPTY_SQUARE},      // Ng1f3
+            {20, 28, EMPTY_SQUARE},     // e3 is empty
+            {12, 64, EMPTY_SQUARE},     // Off the board
+            {1, 8, EMPTY_SQUARE}        // Knight takes its own pawn
+    };
+
+    for(uchar i = 0; i < BATCH_SIZE; i++)
+    {
+        cb_initialize_game(&boards[i]);
+    }
+
+    ASSERT_EQ_MSG(cb_perform_movements(boards, moves, BATCH_SIZE, CB_BATCH_DEFAULT, results), 3, "Three moves should be applied.");
+    ASSERT_EQ_MSG(results[0], CB_BATCH_MOVE_APPLIED, "e2e4 should be applied.");
+    ASSERT_EQ_MSG(results[1], CB_BATCH_MOVE_APPLIED, "Ng1f3 should be applied.");
+    ASSERT_EQ_MSG(results[2], CB_BATCH_EMPTY_SQUARE, "Moves from empty squares should be reported.");
+    ASSERT_EQ_MSG(results[3], CB_BATCH_INVALID_SQUARE, "Squares off the board should be reported.");
+    ASSERT_EQ_MSG(results[4], CB_BATCH_MOVE_APPLIED, "Moves should not be checked by default.");
+
+    for(uchar i = 0; i < BATCH_SIZE; i++)
+    {
+        cb_initialize_game(&expected_board);
+        if(results[i] == CB_BATCH_MOVE_APPLIED)
+        {
+            cb_perform_movement(&expected_board, &moves[i]);
+        }
+
+        ASSERT_TRUE_MSG(memcmp(boards[i].board, expected_board.board, sizeof(cb_board_squares)) == 0, "Boards should match cb_perform_movement.");
+    }
+}
+
+TEST(cb_perform_movements_legal_only)
+{
+    chess_board boards[BATCH_SIZE];
+    uchar results[BATCH_SIZE];
+    cb_move moves[BATCH_SIZE] = {
+            {12, 28, EMPTY_SQUARE},     // e2e4
+            {12, 36, EMPTY_SQUARE},     // e2e5
+            {1, 8, EMPTY_SQUARE},       // Knight takes its own pawn
+            {52, 36, EMPTY_SQUARE},     // Black to move, White's turn
+            {30, 38, EMPTY_SQUARE}      // Empty square
+    };
+
+    for(uchar i = 0; i < BATCH_SIZE; i++)
+    {
+        cb_initialize_game(&boards[i]);
+    }
+
+    ASSERT_EQ_MSG(cb_perform_movements(boards, moves, BATCH_SIZE, CB_BATCH_LEGAL_MOVES_ONLY, results), 1, "Only e2e4 should be applied.");
+    ASSERT_EQ_MSG(results[1], CB_BATCH_ILLEGAL_MOVE, "Illegal pawn moves should be reported.");
+    ASSERT_EQ_MSG(results[2], CB_BATCH_ILLEGAL_MOVE, "Capturing an own piece should be reported.");
+    ASSERT_EQ_MSG(results[3], CB_BATCH_ILLEGAL_MOVE, "Moving out of turn should be reported.");
+    ASSERT_EQ_MSG(results[4], CB_BATCH_EMPTY_SQUARE, "Moves from empty squares should be reported.");
+    ASSERT_EQ_MSG(boards[0].ep_target_square_index, 20, "Legal moves should follow all of the rules.");
+    ASSERT_EQ_MSG(boards[0].move_counter, 1, "Legal moves should pass the turn.");
+}
+
+TEST(cb_pool_perform_movements)
+{
+    cb_game_pool pool;
+    chess_board board;
+    uchar results[3];
+    cb_game_handle handles[3];
+    cb_move moves[3] = {
+            {12, 28, EMPTY_SQUARE},
+            {1, 18, EMPTY_SQUARE},
+            {12, 28, EMPTY_SQUARE}
+    };
+
+    cb_initialize_game_pool(&pool, 1, 4);
+    handles[0] = cb_pool_create_game(&pool, 0);
+    handles[1] = cb_pool_create_game(&pool, 0);
+    handles[2] = cb_pool_create_game(&pool, 0);
+    cb_pool_destroy_game(&pool, handles[2]);
+
+    ASSERT_EQ_MSG(cb_pool_perform_movements(&pool, handles, moves, 3, CB_BATCH_DEFAULT, results), 2, "Two moves should be applied.");
+    ASSERT_EQ_MSG(results[2], CB_BATCH_INVALID_GAME, "Destroyed games should be reported.");
+
+    cb_pool_load_board(&pool, handles[1], &board);
+    ASSERT_EQ_MSG(cb_get_board_value_at_square_index(&board, 18), WHITE | KNIGHT, "Knight should be moved in the pool.");
+    ASSERT_TRUE_MSG(pool.shards[0].keys[cb_game_handle_slot(handles[1])] == cb_zobrist_key(&board), "Game key should follow the move.");
+
+    moves[0].from_square_index = 52;
+    moves[0].to_square_index = 36;
+    cb_pool_load_board(&pool, handles[0], &board);
+    board.move_counter = 1;
+    cb_pool_store_board(&pool, handles[0], &board);
+
+    ASSERT_EQ_MSG(cb_pool_perform_movements(&pool, handles, moves, 1, CB_BATCH_LEGAL_MOVES_ONLY, results), 1, "e7e5 should be applied.");
+    cb_pool_load_board(&pool, handles[0], &board);
+    ASSERT_EQ_MSG(board.ep_target_square_index, 44, "Legal moves should follow all of the rules.");
+    ASSERT_TRUE_MSG(pool.shards[0].keys[cb_game_handle_slot(handles[0])] == cb_zobrist_key(&board), "Game key should follow the legal move.");
+
+    cb_free_game_pool(&pool);
+}
+
+TEST_SUITE(Batch)
+{
+    ADD_TEST(cb_perform_movements);
+    ADD_TEST(cb_perform_movements_legal_only);
+    ADD_TEST(cb_pool_perform_movements);
+}
@@ -45,9 +45,11 @@ TEST(cb_set_board_value_at)
 TEST(initialize_game)
 {
     chess_board *board = cb_new_chess_board();
+    uchar packed_board[32];
     cb_initialize_game(board);
+    cb_pack_board(board, packed_board);
 
-    ASSERT_EQ_MSG(memcmp(board->board, cb_initial_chess_position, 32), 0, "Initial chess position should be correctly set.");
+    ASSERT_EQ_MSG(memcmp(packed_board, cb_initial_chess_position, 32), 0, "Initial chess position should be correctly set.");
     ASSERT_EQ_MSG(board->move_counter, 0, "Move counter should be 0.");
     ASSERT_EQ_MSG(board->halfmove_clock, 0, "Halfmove clock should be 0.");
     ASSERT_EQ_MSG(board->castling_rights, CASTLE_RIGHTS_ALL, "Castling rights should be set to all.");
@@ -66,10 +68,36 @@ TEST(cb_coordinate_index_to_notation)
     ASSERT_STR_EQ_MSG(cb_coordinate_index_to_notation(47), "h6", "Coordinate 47 should be h6.");
 }
 
+TEST(cb_pack_board)
+{
+    chess_board board;
+    uchar packed_board[32];
+    uchar unpacked_board[32];
+
+    for(uchar i = 0; i < 32; i++)
+    {
+        packed_board[i] = (uchar)(i * 37 + 11);
+    }
+
+    cb_unpack_board(&board, packed_board);
+    ASSERT_EQ_MSG(cb_board_get(&board, 0), packed_board[0] >> 4, "Even squares should be unpacked from the high nibble.");
+    ASSERT_EQ_MSG(cb_board_get(&board, 63), packed_board[31] & 0xF, "Odd squares should be unpacked from the low nibble.");
+
+    cb_board_set(&board, 20, BLACK | QUEEN);
+    cb_board_set(&board, 21, WHITE | KING);
+    ASSERT_EQ_MSG(cb_board_get(&board, 20), BLACK | QUEEN, "Square 20 should hold the black queen.");
+    ASSERT_EQ_MSG(cb_board_get(&board, 21), WHITE | KING, "Setting square 21 should leave square 20 untouched.");
+
+    packed_board[10] = (BLACK | QUEEN) << 4 | (WHITE | KING);
+    cb_pack_board(&board, unpacked_board);
+    ASSERT_EQ_MSG(memcmp(unpacked_board, packed_board, 32), 0, "Packing should restore the nibble layout.");
+}
+
 TEST_SUITE(ProtonChessMain)
 {
     ADD_TEST(initialize_game);
     ADD_TEST(cb_get_board_value_at);
     ADD_TEST(cb_set_board_value_at);
     ADD_TEST(cb_coordinate_index_to_notation);
+    ADD_TEST(cb_pack_board);
 }
\ No newline at end of file
@@ -0,0 +1,158 @@
+/**
+ * @file concurrency.test.c
+ * @author Nathan Seymour
+ * @brief Stress test of proton-chess used from many threads at once.
+ * Meant to be run under ThreadSanitizer as well (see the README).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "chess.h"
+#include "legality.h"
+#include "movement.h"
+#include "evaluation.h"
+#include "zobrist.h"
+#include "notation.h"
+#include "pcthreads.h"
+#include "scpunitc.h"
+
+#define STRESS_THREADS 4
+#define STRESS_ITERATIONS 40
+
+static const char *stress_fens[] = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+        "rnbqkbnr/ppp1pppp/8/3pP3/8/8/PPPP1PPP/RNBQKBNR w KQkq d6 0 3",
+        "r2q1rk1/pP1p2pp/Q4n2/bbp1p3/Np6/1B3NBn/pPPP1PPP/R3K2R b KQ - 0 1",
+        "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+};
+
+#define STRESS_POSITIONS (sizeof(stress_fens) / sizeof(stress_fens[0]))
+
+typedef struct {
+    unsigned int offset;
+    uint64_t digests[STRESS_POSITIONS];
+    unsigned int mismatches;
+} stress_job;
+
+static uint64_t mix_digest(uint64_t digest, uint64_t value)
+{
+    return (digest ^ value) * 0x100000001B3ULL;
+}
+
+/*
+ * Parse a position and play every legal move and its answers, folding
+ * everything computed along the way into a digest. Only objects owned by
+ * the calling thread are written.
+ */
+static uint64_t position_digest(const char *fen, cb_evaluator *evaluator)
+{
+    chess_board board;
+    cb_move_list moves;
+    cb_move_undo undo;
+    char buffer[128];
+    char notation[3];
+    uint64_t digest = 0xCBF29CE484222325ULL;
+
+    cb_parse_fen(&board, fen);
+    cb_generate_legal_moves(&board, &moves);
+
+    for(uchar i = 0; i < moves.count; i++)
+    {
+        cb_move *move = &moves.moves[i];
+        cb_move_list replies;
+        cb_move parsed;
+
+        // Format the squares of the move and parse them back as notation.
+        cb_coordinate_index_to_notation_r(move->from_square_index, notation);
+        memcpy(buffer, notation, 2);
+        cb_coordinate_index_to_notation_r(move->to_square_index, notation);
+        memcpy(buffer + 2, notation, 3);
+        digest = mix_digest(digest, cb_parse_notation(&board, buffer, &parsed) && parsed.to_square_index == move->to_square_index);
+
+        cb_make_move(&board, move, &undo, NULL);
+
+        digest = mix_digest(digest, cb_zobrist_key(&board));
+        digest = mix_digest(digest, (uint64_t)cb_evaluate(&board, evaluator));
+        digest = mix_digest(digest, cb_generate_legal_moves(&board, &replies));
+        digest = mix_digest(digest, cb_is_in_check(&board));
+
+        cb_generate_fen(&board, buffer, sizeof(buffer));
+        for(char *character = buffer; *character != '\0'; character++)
+        {
+            digest = mix_digest(digest, (uchar)*character);
+        }
+
+        cb_unmake_move(&board, move, &undo, NULL);
+    }
+
+    return mix_digest(digest, cb_zobrist_key(&board));
+}
+
+static void *run_stress_job(void *argument)
+{
+    stress_job *job = argument;
+    cb_evaluator evaluator;
+    cb_pawn_hash_table *pawn_table = malloc(sizeof(cb_pawn_hash_table));
+
+    cb_initialize_evaluator(&evaluator, CB_EVALUATOR_MATERIAL);
+    cb_clear_pawn_hash_table(pawn_table);
+    evaluator.pawn_table = pawn_table;
+
+    // Threads start on different positions, so that all of them are being
+    // worked on at any time.
+    for(unsigned int iteration = 0; iteration < STRESS_ITERATIONS; iteration++)
+    {
+        for(unsigned int i = 0; i < STRESS_POSITIONS; i++)
+        {
+            unsigned int position = (job->offset + iteration + i) % STRESS_POSITIONS;
+
+            if(position_digest(stress_fens[position], &evaluator) != job->digests[position])
+            {
+                job->mismatches++;
+            }
+        }
+    }
+
+    free(pawn_table);
+    return NULL;
+}
+
+TEST(concurrent_stress)
+{
+    stress_job jobs[STRESS_THREADS];
+    pcthread threads[STRESS_THREADS];
+    uint64_t digests[STRESS_POSITIONS];
+    cb_evaluator evaluator;
+
+    // Reference digests, computed by this thread alone without a pawn table.
+    cb_initialize_evaluator(&evaluator, CB_EVALUATOR_MATERIAL);
+    for(unsigned int i = 0; i < STRESS_POSITIONS; i++)
+    {
+        digests[i] = position_digest(stress_fens[i], &evaluator);
+    }
+
+    for(unsigned int i = 0; i < STRESS_THREADS; i++)
+    {
+        jobs[i].offset = i;
+        jobs[i].mismatches = 0;
+        memcpy(jobs[i].digests, digests, sizeof(digests));
+        pcthread_create(&threads[i], run_stress_job, &jobs[i]);
+    }
+
+    for(unsigned int i = 0; i < STRESS_THREADS; i++)
+    {
+        pcthread_join(&threads[i]);
+    }
+
+    for(unsigned int i = 0; i < STRESS_THREADS; i++)
+    {
+        ASSERT_EQ_MSG(jobs[i].mismatches, 0, "Every thread should compute the same results as a single thread.");
+    }
+}
+
+TEST_SUITE(Concurrency)
+{
+    ADD_TEST(concurrent_stress);
+}
@@ -0,0 +1,76 @@
+/**
+ * @file counters.test.c
+ * @author Nathan Seymour
+ * @brief Tests for proton-chess hot path counters.
+ */
+
+#include "chess.h"
+#include "counters.h"
+#include "pcthreads.h"
+#include "scpunitc.h"
+
+#define COUNTED_EVENTS 10000
+
+static void *count_events(void *argument)
+{
+    (void)argument;
+
+    for(unsigned int i = 0; i < COUNTED_EVENTS; i++)
+    {
+        CB_COUNT(nodes);
+        CB_COUNT_CUTOFF(i % 10);
+    }
+
+    return NULL;
+}
+
+TEST(cb_counters_aggregate)
+{
+    cb_counters before, after;
+    pcthread threads[2];
+
+    cb_counters_aggregate(&before);
+
+    pcthread_create(&threads[0], count_events, NULL);
+    pcthread_create(&threads[1], count_events, NULL);
+    pcthread_join(&threads[0]);
+    pcthread_join(&threads[1]);
+
+    cb_counters_aggregate(&after);
+
+#ifdef HOT_PATH_COUNTERS
+    ASSERT_TRUE_MSG(cb_counters_thread_count() >= 2, "Each thread should have its own counters.");
+    ASSERT_TRUE_MSG(after.nodes - before.nodes == 2 * COUNTED_EVENTS, "Nodes of both threads should be counted.");
+    ASSERT_TRUE_MSG(after.beta_cutoffs[0] - before.beta_cutoffs[0] == 2 * COUNTED_EVENTS / 10, "Cutoffs should be counted by move index.");
+    ASSERT_TRUE_MSG(after.beta_cutoffs[CB_COUNTERS_CUTOFF_SLOTS - 1] - before.beta_cutoffs[CB_COUNTERS_CUTOFF_SLOTS - 1] == 2 * COUNTED_EVENTS * 3 / 10,
+                    "Late cutoffs should share the last slot.");
+#else
+    ASSERT_TRUE_MSG(after.nodes == 0 && cb_counters_thread_count() == 0, "Counters should be compiled out.");
+#endif
+}
+
+#ifdef IMPORT_EXPORT_EXTENSIONS
+TEST(parse_errors)
+{
+    cb_counters before, after;
+    chess_board board;
+
+    cb_counters_aggregate(&before);
+    cb_read_board_state_from_file(&board, "missing.pcgpf");
+    cb_counters_aggregate(&after);
+
+#ifdef HOT_PATH_COUNTERS
+    ASSERT_TRUE_MSG(after.parse_errors - before.parse_errors == 1, "Missing files should count as a parse error.");
+#else
+    ASSERT_TRUE_MSG(after.parse_errors == 0, "Counters should be compiled out.");
+#endif
+}
+#endif
+
+TEST_SUITE(Counters)
+{
+    ADD_TEST(cb_counters_aggregate);
+#ifdef IMPORT_EXPORT_EXTENSIONS
+    ADD_TEST(parse_errors);
+#endif
+}
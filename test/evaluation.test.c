@@ -6,6 +6,7 @@
 
 #include "chess.h"
 #include "evaluation.h"
+#include "zobrist.h"
 #include "scpunitc.h"
 
 TEST(cb_board_point_evaluation)
@@ -32,7 +33,88 @@ TEST(cb_board_point_evaluation)
     cb_free_chess_board(board);
 }
 
+TEST(cb_pawn_structure_evaluation)
+{
+    chess_board *board = cb_new_chess_board();
+    cb_initialize_game(board);
+
+    cb_pawn_evaluation evaluation;
+    cb_pawn_structure_evaluation(board, NULL, cb_zobrist_pawn_key(board), &evaluation);
+
+    ASSERT_EQ_MSG(evaluation.white_score, evaluation.black_score, "The initial position should be balanced.");
+    ASSERT_EQ_MSG(evaluation.white_score, 36, "Both kings should be sheltered by three pawns.");
+
+    for(uchar square_index = 0; square_index < 64; square_index++)
+    {
+        cb_set_board_value_at_square_index(board, square_index, EMPTY_SQUARE);
+    }
+    cb_set_board_value_at(board, 'A', 2, WHITE | PAWN);
+    cb_set_board_value_at(board, 'A', 3, WHITE | PAWN);
+
+    cb_pawn_structure_evaluation(board, NULL, cb_zobrist_pawn_key(board), &evaluation);
+
+    ASSERT_EQ_MSG(evaluation.white_score, -27, "Doubled, isolated and passed pawns should all be scored.");
+    ASSERT_EQ_MSG(evaluation.black_score, 0, "Black has no pawns to score.");
+
+    cb_free_chess_board(board);
+}
+
+TEST(cb_pawn_hash_table)
+{
+    chess_board *board = cb_new_chess_board();
+    cb_initialize_game(board);
+
+    cb_pawn_hash_table *table = malloc(sizeof(cb_pawn_hash_table));
+    cb_clear_pawn_hash_table(table);
+
+    cb_pawn_evaluation computed;
+    cb_pawn_evaluation cached;
+    cb_pawn_structure_evaluation(board, table, cb_zobrist_pawn_key(board), &computed);
+    cb_pawn_structure_evaluation(board, table, cb_zobrist_pawn_key(board), &cached);
+
+    ASSERT_EQ_MSG(table->probes, 2, "The table should have been probed twice.");
+    ASSERT_EQ_MSG(table->hits, 1, "The second probe should be a hit.");
+    ASSERT_EQ_MSG(cached.white_score, computed.white_score, "Cached white score should match.");
+    ASSERT_EQ_MSG(cached.black_score, computed.black_score, "Cached black score should match.");
+
+    free(table);
+    cb_free_chess_board(board);
+}
+
+TEST(cb_evaluation_coefficients)
+{
+    chess_board *board = cb_new_chess_board();
+    cb_initialize_game(board);
+
+    // 1. e4 d5 2. exd5, white is a pawn up and to move.
+    cb_set_board_value_at(board, 'E', 2, EMPTY_SQUARE);
+    cb_set_board_value_at(board, 'D', 7, EMPTY_SQUARE);
+    cb_set_board_value_at(board, 'D', 5, WHITE | PAWN);
+
+    short parameters[CB_EVAL_PARAMETER_COUNT];
+    signed char coefficients[CB_EVAL_PARAMETER_COUNT];
+    cb_evaluation_parameters(parameters);
+    cb_evaluation_coefficients(board, coefficients);
+
+    int expected_score = 0;
+    for(uchar i = 0; i < CB_EVAL_PARAMETER_COUNT; i++)
+    {
+        expected_score += parameters[i] * coefficients[i];
+    }
+
+    cb_evaluator evaluator;
+    cb_initialize_evaluator(&evaluator, CB_EVALUATOR_MATERIAL);
+
+    ASSERT_EQ_MSG(coefficients[CB_EVAL_PIECE_VALUES], 1, "White should have one more pawn.");
+    ASSERT_EQ_MSG(cb_evaluate(board, &evaluator), expected_score, "Coefficients should reproduce the evaluation.");
+
+    cb_free_chess_board(board);
+}
+
 TEST_SUITE(Evaluation)
 {
     ADD_TEST(cb_board_point_evaluation);
+    ADD_TEST(cb_pawn_structure_evaluation);
+    ADD_TEST(cb_pawn_hash_table);
+    ADD_TEST(cb_evaluation_coefficients);
 }
@@ -0,0 +1,58 @@
+/**
+ * @file explorer.test.c
+ * @author Nathan Seymour
+ * @brief Tests for the proton-chess opening explorer index.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "chess.h"
+#include "zobrist.h"
+#include "explorer.h"
+#include "scpunitc.h"
+
+#define TEST_INDEX_PATH "explorer.test.pcexp"
+
+TEST(cb_explorer_query)
+{
+    chess_board board;
+    cb_explorer explorer;
+    const cb_explorer_entry *entries;
+    cb_explorer_entry index[4];
+
+    cb_initialize_game(&board);
+    cb_hash_key initial_key = cb_zobrist_key(&board);
+
+    memset(index, 0, sizeof(index));
+    index[0] = (cb_explorer_entry){.key = initial_key - 1, .draws = 1, .from_square_index = 6, .to_square_index = 21};
+    index[1] = (cb_explorer_entry){.key = initial_key, .rating_sum = 4800, .white_wins = 2, .draws = 1, .rated_games = 2,
+                                   .from_square_index = 12, .to_square_index = 28};
+    index[2] = (cb_explorer_entry){.key = initial_key, .black_wins = 1, .from_square_index = 11, .to_square_index = 27};
+    index[3] = (cb_explorer_entry){.key = initial_key + 1, .draws = 1, .from_square_index = 1, .to_square_index = 18};
+
+    ASSERT_TRUE_MSG(cb_write_explorer_index(TEST_INDEX_PATH, index, 4), "The index should be written.");
+    ASSERT_TRUE_MSG(cb_open_explorer(&explorer, TEST_INDEX_PATH), "The index should be opened.");
+    ASSERT_EQ_MSG(explorer.count, 4, "Every entry should be found.");
+
+    ASSERT_EQ_MSG(cb_explorer_query(&explorer, &board, &entries), 2, "Two moves were played from the position.");
+    ASSERT_EQ_MSG(entries[0].to_square_index, 28, "e4 was played most.");
+    ASSERT_EQ_MSG(cb_explorer_entry_games(&entries[0]), 3, "e4 was played in three games.");
+    ASSERT_EQ_MSG(cb_explorer_entry_average_rating(&entries[0]), 2400, "The average rating should be 2400.");
+
+    cb_set_board_value_at_square_index(&board, 12, EMPTY_SQUARE);
+    ASSERT_EQ_MSG(cb_explorer_query(&explorer, &board, &entries), 0, "Nothing was played from the position.");
+
+    cb_close_explorer(&explorer);
+
+    FILE *file = fopen(TEST_INDEX_PATH, "wb");
+    fputs("not an index", file);
+    fclose(file);
+    ASSERT_TRUE_MSG(!cb_open_explorer(&explorer, TEST_INDEX_PATH), "Invalid files should be rejected.");
+
+    remove(TEST_INDEX_PATH);
+}
+
+TEST_SUITE(Explorer)
+{
+    ADD_TEST(cb_explorer_query);
+}
@@ -3,3 +3,87 @@
  * @author Nathan Seymour
  * @brief Tests for the Import-Export extensions of proton-chess.
  */
+
+#include <stdio.h>
+#include "scpunitc.h"
+#include "chess.h"
+
+#define TEST_BOARD_PATH "ie.test.pcgpf"
+
+TEST(cb_write_board_to_file)
+{
+    chess_board *board = cb_new_chess_board();
+    cb_initialize_game(board);
+    board->move_counter = 1001;
+    board->halfmove_clock = 300;
+
+    cb_write_board_to_file(board, TEST_BOARD_PATH);
+    chess_board *imported_board = cb_import_board_from_file(TEST_BOARD_PATH);
+
+    ASSERT_EQ_MSG(imported_board->move_counter, 1001, "The move counter should be restored.");
+    ASSERT_EQ_MSG(imported_board->halfmove_clock, 300, "The halfmove clock should be restored.");
+    ASSERT_EQ_MSG(imported_board->castling_rights, CASTLE_RIGHTS_ALL, "Castling rights should be restored.");
+    ASSERT_EQ_MSG(memcmp(imported_board->board, board->board, sizeof(cb_board_squares)), 0, "The position should be restored.");
+
+    cb_free_chess_board(imported_board);
+    cb_free_chess_board(board);
+    remove(TEST_BOARD_PATH);
+}
+
+TEST(cb_read_board_state_from_file)
+{
+    // A file written when every counter was a single byte.
+    uchar legacy_record[36] = {12, CASTLE_RIGHTS_ALL, 0xFF, 3};
+    memcpy(legacy_record + 4, cb_initial_chess_position, 32);
+
+    FILE *file = fopen(TEST_BOARD_PATH, "wb");
+    fwrite(legacy_record, 1, sizeof(legacy_record), file);
+    fclose(file);
+
+    chess_board *board = cb_new_chess_board();
+    cb_read_board_state_from_file(board, TEST_BOARD_PATH);
+
+    ASSERT_EQ_MSG(board->move_counter, 12, "The move counter should be read.");
+    ASSERT_EQ_MSG(board->halfmove_clock, 3, "The halfmove clock should be read.");
+    ASSERT_EQ_MSG(board->ep_target_square_index, (uchar)-1, "There should be no en passant square.");
+    uchar packed_board[32];
+    cb_pack_board(board, packed_board);
+    ASSERT_EQ_MSG(memcmp(packed_board, cb_initial_chess_position, 32), 0, "The position should be read.");
+
+    cb_free_chess_board(board);
+    remove(TEST_BOARD_PATH);
+}
+
+TEST(cb_write_position_entry)
+{
+    chess_board board, read_board;
+    cb_hash_key key;
+    uint32_t count;
+
+    cb_initialize_game(&board);
+    board.move_counter = 513;
+
+    FILE *file = fopen(TEST_BOARD_PATH, "wb");
+    ASSERT_TRUE_MSG(cb_write_board_record(file, &board), "The record should be written.");
+    ASSERT_TRUE_MSG(cb_write_position_entry(file, 0x0123456789ABCDEFULL, &board, 70000), "The entry should be written.");
+    fclose(file);
+
+    file = fopen(TEST_BOARD_PATH, "rb");
+    ASSERT_TRUE_MSG(cb_read_board_record(file, &read_board), "The record should be read.");
+    ASSERT_EQ_MSG(read_board.move_counter, 513, "The move counter should be read.");
+    ASSERT_TRUE_MSG(cb_read_position_entry(file, &key, &read_board, &count), "The entry should be read.");
+    ASSERT_TRUE_MSG(key == 0x0123456789ABCDEFULL, "The key should be read.");
+    ASSERT_EQ_MSG(count, 70000, "The count should be read.");
+    ASSERT_EQ_MSG(memcmp(read_board.board, board.board, sizeof(cb_board_squares)), 0, "The position should be read.");
+    ASSERT_TRUE_MSG(!cb_read_board_record(file, &read_board), "The file should be over.");
+    fclose(file);
+
+    remove(TEST_BOARD_PATH);
+}
+
+TEST_SUITE(IEExtensions)
+{
+    ADD_TEST(cb_write_board_to_file);
+    ADD_TEST(cb_read_board_state_from_file);
+    ADD_TEST(cb_write_position_entry);
+}
@@ -0,0 +1,154 @@
+/**
+ * @file game_encoding.test.c
+ * @author Nathan Seymour
+ * @brief Tests for the proton-chess compact game archives.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "chess.h"
+#include "legality.h"
+#include "movement.h"
+#include "game_encoding.h"
+#include "scpunitc.h"
+
+#define TEST_ARCHIVE_PATH "game_encoding.test.pcgames"
+#define TEST_GAMES 8
+#define TEST_GAME_LENGTH 120
+
+/*
+ * Play a game of pseudo-random legal moves, the same for a given seed.
+ */
+static ushort play_random_game(chess_board *board, cb_move *moves, unsigned int seed)
+{
+    ushort count = 0;
+
+    for(; count < TEST_GAME_LENGTH; count++)
+    {
+        cb_move_list list;
+        cb_move_undo undo;
+
+        if(cb_generate_legal_moves(board, &list) == 0)
+        {
+            break;
+        }
+
+        seed = seed * 1103515245u + 12345u;
+        moves[count] = list.moves[(seed >> 16) % list.count];
+        cb_make_move(board, &moves[count], &undo, NULL);
+    }
+
+    return count;
+}
+
+static long file_size(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    long size;
+
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fclose(file);
+
+    return size;
+}
+
+TEST(cb_move_to_index)
+{
+    chess_board board;
+    cb_move move = {12, 28, EMPTY_SQUARE};
+    cb_move decoded;
+    uchar count;
+
+    cb_initialize_game(&board);
+
+    uchar index = cb_move_to_index(&board, &move, &count);
+    ASSERT_EQ_MSG(count, 20, "There are 20 legal moves in the initial position.");
+    ASSERT_TRUE_MSG(cb_move_from_index(&board, index, &decoded), "The index should be valid.");
+    ASSERT_EQ_MSG(decoded.from_square_index, 12, "e4 should be decoded.");
+    ASSERT_EQ_MSG(decoded.to_square_index, 28, "e4 should be decoded.");
+
+    move = (cb_move){12, 36, EMPTY_SQUARE};
+    ASSERT_EQ_MSG(cb_move_to_index(&board, &move, NULL), 0xFF, "e5 is not legal.");
+    ASSERT_TRUE_MSG(!cb_move_from_index(&board, 20, &decoded), "There is no 21st move.");
+}
+
+TEST(cb_write_game)
+{
+    static cb_move games[TEST_GAMES][TEST_GAME_LENGTH];
+    ushort lengths[TEST_GAMES];
+    chess_board starts[TEST_GAMES];
+    chess_board ends[TEST_GAMES];
+    long sizes[2];
+
+    for(uchar encoding = CB_GAME_ENCODING_RAW; encoding <= CB_GAME_ENCODING_RANGE; encoding++)
+    {
+        cb_game_writer writer;
+        cb_game_reader reader;
+        cb_game_cursor cursor;
+        cb_move move;
+
+        ASSERT_TRUE_MSG(cb_open_game_writer(&writer, TEST_ARCHIVE_PATH, encoding), "The archive should be created.");
+
+        for(uchar i = 0; i < TEST_GAMES; i++)
+        {
+            cb_initialize_game(&starts[i]);
+
+            // Odd games start from the middle of another game.
+            if(i % 2 == 1)
+            {
+                play_random_game(&starts[i], games[i], 1000 + i);
+                starts[i].move_counter = 0;
+                starts[i].ep_target_square_index = -1;
+                starts[i].halfmove_clock = 0;
+            }
+
+            ends[i] = starts[i];
+            lengths[i] = play_random_game(&ends[i], games[i], i);
+            ASSERT_TRUE_MSG(cb_write_game(&writer, &starts[i], games[i], lengths[i], CB_GAME_RESULT_DRAW), "The game should be written.");
+        }
+
+        move = (cb_move){12, 36, EMPTY_SQUARE};
+        ASSERT_TRUE_MSG(!cb_write_game(&writer, &starts[0], &move, 1, CB_GAME_RESULT_UNKNOWN), "Illegal moves should be rejected.");
+        ASSERT_TRUE_MSG(cb_close_game_writer(&writer), "The archive should be completed.");
+
+        ASSERT_TRUE_MSG(cb_open_game_reader(&reader, TEST_ARCHIVE_PATH), "The archive should be opened.");
+        ASSERT_EQ_MSG(reader.count, TEST_GAMES, "Every game should be found.");
+
+        // Seek backwards, every game is reached through the offset table.
+        for(int i = TEST_GAMES - 1; i >= 0; i--)
+        {
+            ushort decoded = 0;
+
+            ASSERT_TRUE_MSG(cb_seek_game(&reader, i, &cursor), "The game should be found.");
+            ASSERT_EQ_MSG(cursor.move_count, lengths[i], "The number of moves should be kept.");
+            ASSERT_EQ_MSG(cursor.result, CB_GAME_RESULT_DRAW, "The result should be kept.");
+
+            while(cb_next_game_move(&cursor, &move))
+            {
+                ASSERT_EQ_MSG(move.from_square_index, games[i][decoded].from_square_index, "The move should round-trip.");
+                ASSERT_EQ_MSG(move.to_square_index, games[i][decoded].to_square_index, "The move should round-trip.");
+                decoded++;
+            }
+
+            ASSERT_EQ_MSG(decoded, lengths[i], "Every move should be decoded.");
+            ASSERT_EQ_MSG(memcmp(&cursor.board.board, &ends[i].board, sizeof(ends[i].board)), 0, "The final position should be reached.");
+            ASSERT_EQ_MSG(cursor.board.move_counter, ends[i].move_counter, "The final position should be reached.");
+        }
+
+        ASSERT_TRUE_MSG(!cb_seek_game(&reader, TEST_GAMES, &cursor), "There is no such game.");
+        cb_close_game_reader(&reader);
+
+        sizes[encoding] = file_size(TEST_ARCHIVE_PATH);
+    }
+
+    ASSERT_TRUE_MSG(sizes[CB_GAME_ENCODING_RANGE] < sizes[CB_GAME_ENCODING_RAW], "Range coding should be smaller.");
+
+    remove(TEST_ARCHIVE_PATH);
+}
+
+TEST_SUITE(GameEncoding)
+{
+    ADD_TEST(cb_move_to_index);
+    ADD_TEST(cb_write_game);
+}
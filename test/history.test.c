@@ -0,0 +1,145 @@
+/**
+ * @file history.test.c
+ * @author Nathan Seymour
+ * @brief Tests for proton-chess position history and repetition
+ * detection.
+ */
+
+#include "chess.h"
+#include "zobrist.h"
+#include "movement.h"
+#include "legality.h"
+#include "scpunitc.h"
+
+/**
+ * Walk the legal move tree and check that the incrementally updated key
+ * always matches a full hash of the position.
+ */
+static int check_incremental_keys(chess_board *board, cb_position_history *history, uchar depth)
+{
+    if(cb_history_current_key(history) != cb_zobrist_key(board))
+    {
+        return 0;
+    }
+
+    if(depth == 0)
+    {
+        return 1;
+    }
+
+    for(uchar from = 0; from < 64; from++)
+    {
+        for(uchar to = 0; to < 64; to++)
+        {
+            cb_move move = {from, to, KNIGHT};
+            cb_move_undo undo;
+
+            if(cb_is_move_legal(board, &move))
+            {
+                cb_make_move(board, &move, &undo, history);
+                int is_valid = check_incremental_keys(board, history, depth - 1);
+                cb_unmake_move(board, &move, &undo, history);
+
+                if(!is_valid)
+                {
+                    return 0;
+                }
+            }
+        }
+    }
+
+    return 1;
+}
+
+TEST(cb_push_history)
+{
+    chess_board *board = cb_new_chess_board();
+    cb_position_history *history = malloc(sizeof(cb_position_history));
+
+    const char *fen_strings[] = {
+            "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+            "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+            "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1"
+    };
+
+    for(uchar i = 0; i < 3; i++)
+    {
+        cb_parse_fen(board, fen_strings[i]);
+        cb_initialize_history(history, board);
+
+        ASSERT_TRUE_MSG(check_incremental_keys(board, history, 2), "Incremental keys should match full hashes.");
+        ASSERT_EQ_MSG(history->count, 1, "Every pushed position should have been popped.");
+    }
+
+    free(history);
+    cb_free_chess_board(board);
+}
+
+TEST(cb_count_repetitions)
+{
+    chess_board *board = cb_new_chess_board();
+    cb_position_history *history = malloc(sizeof(cb_position_history));
+    cb_move_undo undo;
+
+    cb_initialize_game(board);
+    cb_initialize_history(history, board);
+
+    // Nf3 Nf6 Ng1 Ng8, over and over.
+    cb_move moves[4] = {{6, 21, 0}, {62, 45, 0}, {21, 6, 0}, {45, 62, 0}};
+
+    for(uchar i = 0; i < 4; i++)
+    {
+        ASSERT_TRUE_MSG(!cb_is_draw(history, board), "There should be no repetition yet.");
+        cb_make_move(board, &moves[i], &undo, history);
+    }
+
+    ASSERT_EQ_MSG(cb_count_repetitions(history, board), 1, "The initial position should have occurred once before.");
+
+    for(uchar i = 0; i < 4; i++)
+    {
+        cb_make_move(board, &moves[i], &undo, history);
+    }
+
+    ASSERT_EQ_MSG(cb_count_repetitions(history, board), 2, "The initial position should have occurred twice before.");
+
+    cb_unmake_move(board, &moves[3], &undo, history);
+    ASSERT_EQ_MSG(history->count, 8, "Unmaking a move should pop its position.");
+    ASSERT_EQ_MSG(cb_count_repetitions(history, board), 1, "The position after 2. Ng1 should have occurred once before.");
+
+    cb_free_chess_board(board);
+    free(history);
+}
+
+TEST(wide_move_counter)
+{
+    chess_board *board = cb_new_chess_board();
+    cb_position_history *history = malloc(sizeof(cb_position_history));
+    cb_move_undo undo;
+
+    cb_initialize_game(board);
+    cb_initialize_history(history, board);
+
+    cb_move moves[4] = {{6, 21, 0}, {62, 45, 0}, {21, 6, 0}, {45, 62, 0}};
+    for(unsigned int i = 0; i < 600; i++)
+    {
+        cb_make_move(board, &moves[i % 4], &undo, history);
+    }
+
+    ASSERT_EQ_MSG(board->move_counter, 600, "The move counter should not overflow.");
+    ASSERT_EQ_MSG(board->halfmove_clock, 600, "The halfmove clock should not overflow.");
+    ASSERT_TRUE_MSG(cb_is_draw(history, board), "The position should be drawn.");
+
+    char fen_buffer[CB_FEN_NOTATION_LENGTH];
+    cb_generate_fen(board, fen_buffer, CB_FEN_NOTATION_LENGTH);
+    ASSERT_STR_EQ_MSG(fen_buffer, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 600 300", "FEN counters should be wide.");
+
+    cb_free_chess_board(board);
+    free(history);
+}
+
+TEST_SUITE(History)
+{
+    ADD_TEST(cb_push_history);
+    ADD_TEST(cb_count_repetitions);
+    ADD_TEST(wide_move_counter);
+}
@@ -0,0 +1,307 @@
+/**
+ * @file legality.test.c
+ * @author Nathan Seymour
+ * @brief Tests for proton-chess move legality checks.
+ */
+
+#include "chess.h"
+#include "movement.h"
+#include "legality.h"
+#include "scpunitc.h"
+
+/**
+ * Count the leaf nodes of the legal move tree (perft), by trying every
+ * from/to pair. Promotions count once per promotion piece.
+ */
+static unsigned long count_legal_moves(chess_board *board, uchar depth)
+{
+    unsigned long nodes = 0;
+
+    for(uchar from = 0; from < 64; from++)
+    {
+        for(uchar to = 0; to < 64; to++)
+        {
+            for(uchar promotion_piece = KNIGHT; promotion_piece <= QUEEN; promotion_piece++)
+            {
+                cb_move move = {from, to, promotion_piece};
+                cb_move_undo undo;
+
+                if(!cb_is_move_legal(board, &move))
+                {
+                    break;
+                }
+
+                uchar is_promotion = (cb_get_board_value_at_square_index(board, from) & COLOR_MASK) == PAWN && (to / 8 == 0 || to / 8 == 7);
+
+                if(depth == 1)
+                {
+                    nodes++;
+                }
+                else
+                {
+                    cb_make_move(board, &move, &undo, NULL);
+                    nodes += count_legal_moves(board, depth - 1);
+                    cb_unmake_move(board, &move, &undo, NULL);
+                }
+
+                if(!is_promotion)
+                {
+                    break;
+                }
+            }
+        }
+    }
+
+    return nodes;
+}
+
+static unsigned long perft(const char *fen, uchar depth)
+{
+    chess_board *board = cb_new_chess_board();
+    cb_parse_fen(board, fen);
+
+    unsigned long nodes = count_legal_moves(board, depth);
+
+    cb_free_chess_board(board);
+    return nodes;
+}
+
+TEST(cb_is_move_legal_perft)
+{
+    ASSERT_EQ_MSG(perft("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 3), 8902, "Initial position perft(3) should be 8902.");
+    ASSERT_EQ_MSG(perft("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 2), 2039, "Kiwipete perft(2) should be 2039.");
+    ASSERT_EQ_MSG(perft("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 3), 2812, "En passant pins perft(3) should be 2812.");
+    ASSERT_EQ_MSG(perft("r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 2), 264, "Promotions perft(2) should be 264.");
+    ASSERT_EQ_MSG(perft("rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 2), 1486, "Position 5 perft(2) should be 1486.");
+}
+
+static unsigned long generated_perft(chess_board *board, uchar depth)
+{
+    cb_move_list list;
+    unsigned long nodes = 0;
+
+    cb_generate_legal_moves(board, &list);
+    if(depth == 1)
+    {
+        return list.count;
+    }
+
+    for(uchar i = 0; i < list.count; i++)
+    {
+        cb_move_undo undo;
+
+        cb_make_move(board, &list.moves[i], &undo, NULL);
+        nodes += generated_perft(board, depth - 1);
+        cb_unmake_move(board, &list.moves[i], &undo, NULL);
+    }
+
+    return nodes;
+}
+
+static unsigned long generated_perft_of(const char *fen, uchar depth)
+{
+    chess_board board;
+    cb_parse_fen(&board, fen);
+
+    return generated_perft(&board, depth);
+}
+
+TEST(cb_generate_legal_moves_perft)
+{
+    ASSERT_EQ_MSG(generated_perft_of("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 4), 197281, "Initial position perft(4) should be 197281.");
+    ASSERT_EQ_MSG(generated_perft_of("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 3), 97862, "Kiwipete perft(3) should be 97862.");
+    ASSERT_EQ_MSG(generated_perft_of("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 4), 43238, "En passant pins perft(4) should be 43238.");
+    ASSERT_EQ_MSG(generated_perft_of("r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 3), 9467, "Promotions perft(3) should be 9467.");
+    ASSERT_EQ_MSG(generated_perft_of("rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 3), 62379, "Position 5 perft(3) should be 62379.");
+    ASSERT_EQ_MSG(generated_perft_of("r3k2r/8/8/8/8/8/8/R3K2R w KQkq - 0 1", 2), 568, "Castling perft(2) should be 568.");
+}
+
+TEST(cb_is_in_check)
+{
+    chess_board board;
+
+    cb_parse_fen(&board, "rnb1kbnr/pppp1ppp/8/4p3/6Pq/5P2/PPPPP2P/RNBQKBNR w KQkq - 1 3");
+    ASSERT_TRUE_MSG(cb_is_in_check(&board), "White should be in check.");
+
+    cb_move_list list;
+    ASSERT_EQ_MSG(cb_generate_legal_moves(&board, &list), 0, "White should be mated.");
+
+    cb_initialize_game(&board);
+    ASSERT_TRUE_MSG(!cb_is_in_check(&board), "No one is in check in the initial position.");
+}
+
+TEST(cb_attackers_to)
+{
+    chess_board board;
+
+    cb_parse_fen(&board, "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+    ASSERT_EQ_MSG(cb_attackers_to(&board, 35, WHITE), (1ULL << 18) | (1ULL << 28), "d5 should be defended by the c3 knight and the e4 pawn.");
+    ASSERT_EQ_MSG(cb_attackers_to(&board, 35, BLACK), (1ULL << 41) | (1ULL << 44) | (1ULL << 45), "d5 should be attacked by both knights and the e6 pawn.");
+    ASSERT_EQ_MSG(cb_attackers_to(&board, 21, BLACK), 0, "The g7 bishop should be blocked by the f6 knight.");
+    ASSERT_TRUE_MSG(!cb_is_square_attacked(&board, 57, WHITE), "b8 should not be attacked.");
+    ASSERT_EQ_MSG(cb_attackers_to(&board, 14, BLACK), 1ULL << 23, "g2 should only be attacked by the h3 pawn.");
+}
+
+/*
+ * The attack map should answer as the single queries do, on positions
+ * without a check, where seeing through the king changes nothing.
+ */
+static int attack_map_matches(const char *fen)
+{
+    chess_board board;
+    cb_attack_map map;
+
+    cb_parse_fen(&board, fen);
+    cb_load_attack_map(&board, &map);
+
+    for(uchar square_index = 0; square_index < 64; square_index++)
+    {
+        for(uchar color = WHITE; color <= BLACK; color += BLACK)
+        {
+            if(cb_attack_map_attackers_to(&map, square_index, color) != cb_attackers_to(&board, square_index, color)
+               || cb_attack_map_is_square_attacked(&map, square_index, color) != cb_is_square_attacked(&board, square_index, color))
+            {
+                return 0;
+            }
+        }
+    }
+
+    return map.checkers == 0;
+}
+
+TEST(cb_load_attack_map)
+{
+    chess_board board;
+    cb_attack_map map;
+    cb_move_list list;
+
+    ASSERT_TRUE_MSG(attack_map_matches("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"), "The initial position should be mapped.");
+    ASSERT_TRUE_MSG(attack_map_matches("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"), "Kiwipete should be mapped.");
+    ASSERT_TRUE_MSG(attack_map_matches("rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8"), "Position 5 should be mapped.");
+    ASSERT_TRUE_MSG(attack_map_matches("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1"), "En passant pins should be mapped.");
+
+    // The rook on a4 checks the king on e4, and sees through it to f4.
+    cb_parse_fen(&board, "8/8/8/8/R3k3/8/8/6K1 b - - 0 1");
+    cb_load_attack_map(&board, &map);
+    ASSERT_EQ_MSG(map.checkers, 1ULL << 24, "The rook should give check.");
+    ASSERT_EQ_MSG(map.king_square_index, 28, "The king should be found.");
+    ASSERT_TRUE_MSG(cb_attack_map_is_square_attacked(&map, 29, WHITE), "The king may not step back along the check.");
+    ASSERT_TRUE_MSG(!cb_is_square_attacked(&board, 29, WHITE), "The king still blocks the rook on the board.");
+    ASSERT_EQ_MSG(cb_generate_legal_moves_from_map(&board, &map, &list), cb_generate_legal_moves(&board, &list), "Both generators should agree.");
+
+    // The knight on d7 is pinned by the bishop on b5.
+    cb_parse_fen(&board, "4k3/3n4/8/1B6/8/8/8/4K3 b - - 0 1");
+    cb_load_attack_map(&board, &map);
+    ASSERT_EQ_MSG(map.pinned, 1ULL << 51, "The knight should be pinned.");
+    ASSERT_EQ_MSG(map.checkers, 0, "Black should not be in check.");
+}
+
+TEST(cb_is_move_legal)
+{
+    chess_board *board = cb_new_chess_board();
+
+    // The e5 pawn may not take en passant, it would expose its king on the rank.
+    cb_parse_fen(board, "8/8/8/K2pP2r/8/8/8/7k w - d6 0 2");
+    cb_move en_passant = {36, 43, 0};
+    ASSERT_TRUE_MSG(!cb_is_move_legal(board, &en_passant), "En passant discovering a check should be illegal.");
+
+    // f1 is attacked by the bishop on c4, so white may not castle king-side.
+    cb_parse_fen(board, "4k3/8/8/8/2b5/8/8/4K2R w K - 0 1");
+    cb_move castle = {4, 6, 0};
+    ASSERT_TRUE_MSG(!cb_is_move_legal(board, &castle), "Castling through check should be illegal.");
+
+    cb_parse_fen(board, "4k3/8/8/8/8/8/8/4K2R w K - 0 1");
+    ASSERT_TRUE_MSG(cb_is_move_legal(board, &castle), "Castling should be legal.");
+
+    cb_parse_fen(board, "4k3/8/8/8/8/8/8/4K2R b K - 0 1");
+    ASSERT_TRUE_MSG(!cb_is_move_legal(board, &castle), "Only the side to move may move.");
+
+    cb_free_chess_board(board);
+}
+
+/**
+ * Number of legal moves, promotions counted once rather than once per
+ * piece.
+ */
+static uchar count_distinct_moves(chess_board *board, cb_move_list *list)
+{
+    uchar count = 0;
+
+    cb_generate_legal_moves(board, list);
+    for(uchar i = 0; i < list->count; i++)
+    {
+        count += list->moves[i].promotion_piece == EMPTY_SQUARE || list->moves[i].promotion_piece == QUEEN;
+    }
+
+    return count;
+}
+
+TEST(cb_is_move_legal_from_map)
+{
+    static const char *fens[] = {
+            "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+            "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+            "8/8/8/K2pP2r/8/8/8/7k w - d6 0 2",
+            "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+            "4k3/8/8/8/1b6/8/3N4/R3K2R w KQ - 0 1",
+            "4k3/4r3/8/8/8/8/3n4/R3K2R w KQ - 0 1",
+    };
+    chess_board board;
+    cb_attack_map map;
+    cb_move_list list;
+
+    for(uchar i = 0; i < sizeof(fens) / sizeof(fens[0]); i++)
+    {
+        uchar legal_count = 0;
+        uchar mismatch_count = 0;
+
+        cb_parse_fen(&board, fens[i]);
+        cb_load_attack_map(&board, &map);
+
+        for(uchar from = 0; from < 64; from++)
+        {
+            for(uchar to = 0; to < 64; to++)
+            {
+                cb_move move = {from, to, QUEEN};
+                int is_legal = cb_is_move_legal_from_map(&board, &map, &move);
+
+                legal_count += is_legal;
+                mismatch_count += is_legal != cb_is_move_legal(&board, &move);
+            }
+        }
+
+        ASSERT_EQ_MSG(mismatch_count, 0, "The map should give the same answers as cb_is_move_legal.");
+        ASSERT_EQ_MSG(legal_count, count_distinct_moves(&board, &list),
+                      "Every generated move should be legal, promotions counted once.");
+    }
+}
+
+TEST(cb_validate_move_sequence)
+{
+    chess_board *board = cb_new_chess_board();
+    cb_initialize_game(board);
+
+    // 1. e4 e5 2. Ke2 Ke7 3. Ke3??
+    cb_move moves[5] = {{12, 28, 0}, {52, 36, 0}, {4, 12, 0}, {60, 52, 0}, {12, 20, 0}};
+
+    ASSERT_EQ_MSG(cb_validate_move_sequence(board, moves, 4), 4, "The first four moves should be legal.");
+    ASSERT_EQ_MSG(cb_validate_move_sequence(board, moves, 5), 5, "Ke3 should be legal.");
+
+    moves[4].to_square_index = 28;
+    ASSERT_EQ_MSG(cb_validate_move_sequence(board, moves, 5), 4, "The king may not move onto its own pawn.");
+    ASSERT_EQ_MSG(board->move_counter, 0, "The board should be left untouched.");
+
+    cb_free_chess_board(board);
+}
+
+TEST_SUITE(Legality)
+{
+    ADD_TEST(cb_is_move_legal_perft);
+    ADD_TEST(cb_generate_legal_moves_perft);
+    ADD_TEST(cb_is_in_check);
+    ADD_TEST(cb_attackers_to);
+    ADD_TEST(cb_load_attack_map);
+    ADD_TEST(cb_is_move_legal);
+    ADD_TEST(cb_is_move_legal_from_map);
+    ADD_TEST(cb_validate_move_sequence);
+}
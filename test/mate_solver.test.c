@@ -0,0 +1,120 @@
+/**
+ * @file mate_solver.test.c
+ * @author Nathan Seymour
+ * @brief Tests for the proton-chess mate solver.
+ */
+
+#include <stdlib.h>
+#include "chess.h"
+#include "movement.h"
+#include "legality.h"
+#include "mate_solver.h"
+#include "scpunitc.h"
+
+/*
+ * Solve a position with a fresh table.
+ */
+static void solve(const char *fen, uchar moves, unsigned long nodes, cb_mate_result *result)
+{
+    cb_mate_table table;
+    cb_mate_solver *solver = malloc(sizeof(cb_mate_solver));
+    cb_mate_limits limits = {moves, nodes, 0};
+    chess_board board;
+
+    cb_parse_fen(&board, fen);
+    cb_initialize_mate_table(&table, 1 << 20);
+    cb_initialize_mate_solver(solver, &table);
+    cb_solve_mate(solver, &board, &limits, result);
+
+    free(solver);
+    cb_free_mate_table(&table);
+}
+
+/*
+ * Whether a line is made of legal moves and ends in mate.
+ */
+static int is_mating_line(const char *fen, const cb_mate_result *result)
+{
+    chess_board board;
+    cb_move_list list;
+    cb_move_undo undo;
+
+    cb_parse_fen(&board, fen);
+
+    for(uchar i = 0; i < result->length; i++)
+    {
+        cb_move move = result->line[i];
+
+        if(!cb_is_move_legal(&board, &move))
+        {
+            return 0;
+        }
+
+        cb_make_move(&board, &move, &undo, NULL);
+    }
+
+    return cb_generate_legal_moves(&board, &list) == 0 && cb_is_in_check(&board);
+}
+
+TEST(cb_solve_mate)
+{
+    const char *back_rank = "6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1";
+    const char *rook_ending = "k7/8/2K5/8/8/8/8/7R w - - 0 1";
+    const char *sacrifice = "r1b3kr/ppp1Bp1p/1b6/n2P4/2p3q1/2Q2N2/P4PPP/RN2R1K1 w - - 1 0";
+    cb_mate_result result;
+
+    solve(back_rank, 3, 0, &result);
+    ASSERT_EQ_MSG(result.status, CB_MATE_PROVEN, "The back rank mate should be proven.");
+    ASSERT_EQ_MSG(result.mate_in, 1, "It should be a mate in one.");
+    ASSERT_EQ_MSG(result.length, 1, "The line should be Ra8#.");
+    ASSERT_EQ_MSG(result.line[0].to_square_index, 56, "The line should be Ra8#.");
+
+    // 1. Kb6 Kb8 2. Rh8#, the rook check alone lets the king out.
+    solve(rook_ending, 3, 0, &result);
+    ASSERT_EQ_MSG(result.status, CB_MATE_PROVEN, "The rook mate should be proven.");
+    ASSERT_EQ_MSG(result.mate_in, 2, "The shortest mate should be found.");
+    ASSERT_EQ_MSG(result.length, 3, "The defence should hold out to the last move.");
+    ASSERT_TRUE_MSG(is_mating_line(rook_ending, &result), "The line should end in mate.");
+
+    // 1. Qh8+ Kxh8 2. Bf6+ Kg8 3. Re8#
+    solve(sacrifice, 3, 0, &result);
+    ASSERT_EQ_MSG(result.status, CB_MATE_PROVEN, "The combination should be proven.");
+    ASSERT_EQ_MSG(result.mate_in, 3, "It should be a mate in three.");
+    ASSERT_TRUE_MSG(is_mating_line(sacrifice, &result), "The line should end in mate.");
+}
+
+TEST(cb_solve_mate_refutation)
+{
+    cb_mate_result result;
+
+    // Rh8+ is answered by Ka7, there is no mate in one.
+    solve("k7/8/2K5/8/8/8/8/7R w - - 0 1", 1, 0, &result);
+    ASSERT_EQ_MSG(result.status, CB_MATE_DISPROVEN, "There should be no mate in one.");
+    ASSERT_EQ_MSG(result.length, 2, "A try and its refutation should be returned.");
+
+    // The king has no move, but is not in check: stalemate is not mate.
+    solve("7k/8/5KQ1/8/8/8/8/8 b - - 0 1", 2, 0, &result);
+    ASSERT_EQ_MSG(result.status, CB_MATE_DISPROVEN, "A stalemated side has no mate.");
+    ASSERT_EQ_MSG(result.length, 0, "There is no try to refute.");
+
+    solve("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 8, 500, &result);
+    ASSERT_EQ_MSG(result.status, CB_MATE_UNKNOWN, "The node limit should stop the solver.");
+    ASSERT_TRUE_MSG(result.nodes <= 500, "The node limit should be kept.");
+}
+
+TEST(cb_attach_mate_table)
+{
+    static uchar memory[4096 + 32];
+    cb_mate_table table;
+
+    ASSERT_TRUE_MSG(!cb_attach_mate_table(&table, memory, sizeof(cb_mate_entry)), "Too little memory should be rejected.");
+    ASSERT_TRUE_MSG(cb_attach_mate_table(&table, memory + 3, sizeof(memory) - 3), "The table should be attached.");
+    ASSERT_TRUE_MSG((uchar*)(table.entries + table.size) <= memory + sizeof(memory), "The table should stay in its memory.");
+}
+
+TEST_SUITE(MateSolver)
+{
+    ADD_TEST(cb_solve_mate);
+    ADD_TEST(cb_solve_mate_refutation);
+    ADD_TEST(cb_attach_mate_table);
+}
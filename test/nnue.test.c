@@ -0,0 +1,189 @@
+/**
+ * @file nnue.test.c
+ * @author Nathan Seymour
+ * @brief Tests for the proton-chess NNUE evaluator.
+ */
+
+#include <stdio.h>
+#include "chess.h"
+#include "evaluation.h"
+#include "movement.h"
+#include "scpunitc.h"
+
+#define TEST_NETWORK_SIZE (CB_NNUE_HEADER_SIZE + (CB_NNUE_HIDDEN_SIZE + CB_NNUE_FEATURE_COUNT * CB_NNUE_HIDDEN_SIZE) * 2 + 2 * CB_NNUE_HIDDEN_SIZE)
+#define TEST_NETWORK_PATH "nnue.test.pcnn"
+
+static void write_u32(uchar *data, uint32_t value)
+{
+    data[0] = value & 0xFF;
+    data[1] = (value >> 8) & 0xFF;
+    data[2] = (value >> 16) & 0xFF;
+    data[3] = (value >> 24) & 0xFF;
+}
+
+/**
+ * Build a network file with pseudo-random weights small enough that the
+ * accumulator cannot overflow.
+ */
+static uchar *make_test_network()
+{
+    uchar *data = calloc(1, TEST_NETWORK_SIZE);
+    uint32_t state = 12345;
+
+    write_u32(data, CB_NNUE_MAGIC);
+    write_u32(data + 4, CB_NNUE_VERSION);
+    write_u32(data + 8, CB_NNUE_HIDDEN_SIZE);
+    write_u32(data + 12, 16);
+    write_u32(data + 16, 40);
+
+    int16_t *parameters = (int16_t*)(data + CB_NNUE_HEADER_SIZE);
+    for(int i = 0; i < CB_NNUE_HIDDEN_SIZE + CB_NNUE_FEATURE_COUNT * CB_NNUE_HIDDEN_SIZE; i++)
+    {
+        state = state * 1103515245 + 12345;
+        parameters[i] = (int16_t)((int)((state >> 16) % 41) - 12);
+    }
+
+    int8_t *output_weights = (int8_t*)(parameters + CB_NNUE_HIDDEN_SIZE + CB_NNUE_FEATURE_COUNT * CB_NNUE_HIDDEN_SIZE);
+    for(int i = 0; i < 2 * CB_NNUE_HIDDEN_SIZE; i++)
+    {
+        state = state * 1103515245 + 12345;
+        output_weights[i] = (int8_t)((int)((state >> 16) % 255) - 127);
+    }
+
+    return data;
+}
+
+TEST(cb_nnue_update_accumulator)
+{
+    uchar *data = make_test_network();
+    cb_nnue_network network;
+    ASSERT_TRUE_MSG(cb_nnue_init_network(&network, data, TEST_NETWORK_SIZE), "The test network should be valid.");
+
+    chess_board *board = cb_new_chess_board();
+    cb_initialize_game(board);
+
+    cb_nnue_accumulator incremental;
+    cb_nnue_accumulator refreshed;
+    cb_nnue_refresh_accumulator(&network, &incremental, board);
+
+    // 1. e4 d5 2. exd5
+    uchar moves[3][2] = {{12, 28}, {51, 35}, {28, 35}};
+    for(uchar i = 0; i < 3; i++)
+    {
+        cb_move move;
+        move.from_square_index = moves[i][0];
+        move.to_square_index = moves[i][1];
+
+        cb_nnue_update_accumulator(&network, &incremental, board, &move);
+        cb_perform_movement(board, &move);
+    }
+    cb_nnue_refresh_accumulator(&network, &refreshed, board);
+
+    ASSERT_EQ_MSG(memcmp(&incremental, &refreshed, sizeof(cb_nnue_accumulator)), 0, "Incremental updates should match a full refresh.");
+
+    // Scalar reference of the output layer for white to move.
+    int32_t expected_output = network.output_bias;
+    for(int i = 0; i < 2 * CB_NNUE_HIDDEN_SIZE; i++)
+    {
+        int16_t value = refreshed.values[i / CB_NNUE_HIDDEN_SIZE][i % CB_NNUE_HIDDEN_SIZE];
+        value = value < 0 ? 0 : (value > CB_NNUE_ACTIVATION_MAX ? CB_NNUE_ACTIVATION_MAX : value);
+        expected_output += value * network.output_weights[i];
+    }
+
+    ASSERT_EQ_MSG(cb_nnue_evaluate(&network, &incremental, WHITE), expected_output / network.output_scale, "Kernels should match the scalar reference.");
+
+    cb_free_chess_board(board);
+    free(data);
+}
+
+TEST(cb_nnue_update_special_moves)
+{
+    uchar *data = make_test_network();
+    cb_nnue_network network;
+    cb_nnue_init_network(&network, data, TEST_NETWORK_SIZE);
+
+    chess_board *board = cb_new_chess_board();
+    cb_initialize_game(board);
+
+    cb_nnue_accumulator incremental;
+    cb_nnue_accumulator refreshed;
+    cb_nnue_refresh_accumulator(&network, &incremental, board);
+
+    // 1. e4 a6 2. e5 d5 3. exd6 Nc6 4. Nf3 Be6 5. Be2 a5 6. O-O Qd7 7. dxc7 O-O-O 8. cxd8=N
+    struct {
+        uchar from;
+        uchar to;
+        uchar promotion_piece;
+        const char *message;
+    } moves[] = {
+        {12, 28, 0, "A double push should be followed."}, {48, 40, 0, "A quiet move should be followed."},
+        {28, 36, 0, "A quiet move should be followed."}, {51, 35, 0, "A double push should be followed."},
+        {36, 43, 0, "En passant should remove the pawn behind the target square."}, {57, 42, 0, "A quiet move should be followed."},
+        {6, 21, 0, "A quiet move should be followed."}, {58, 44, 0, "A quiet move should be followed."},
+        {5, 12, 0, "A quiet move should be followed."}, {40, 32, 0, "A quiet move should be followed."},
+        {4, 6, 0, "Castling kingside should move the rook."}, {59, 51, 0, "A quiet move should be followed."},
+        {43, 50, 0, "A capture should be followed."}, {60, 58, 0, "Castling queenside should move the rook."},
+        {50, 59, KNIGHT, "A capturing promotion should place the promoted piece."},
+    };
+
+    for(uchar i = 0; i < sizeof(moves) / sizeof(moves[0]); i++)
+    {
+        cb_move move;
+        cb_move_undo undo;
+
+        move.from_square_index = moves[i].from;
+        move.to_square_index = moves[i].to;
+        move.promotion_piece = moves[i].promotion_piece;
+
+        cb_nnue_update_accumulator(&network, &incremental, board, &move);
+        cb_make_move(board, &move, &undo, NULL);
+        cb_nnue_refresh_accumulator(&network, &refreshed, board);
+
+        ASSERT_EQ_MSG(memcmp(&incremental, &refreshed, sizeof(cb_nnue_accumulator)), 0, moves[i].message);
+    }
+
+    ASSERT_EQ_MSG(cb_board_get(board, 59), WHITE | KNIGHT, "The promotion should have been played.");
+
+    cb_free_chess_board(board);
+    free(data);
+}
+
+TEST(cb_nnue_load_network)
+{
+    uchar *data = make_test_network();
+    FILE *file = fopen(TEST_NETWORK_PATH, "wb");
+    fwrite(data, 1, TEST_NETWORK_SIZE, file);
+    fclose(file);
+
+    cb_nnue_network network;
+    ASSERT_TRUE_MSG(cb_nnue_load_network(&network, TEST_NETWORK_PATH), "The network file should load.");
+    ASSERT_TRUE_MSG(!cb_nnue_init_network(&network, data, TEST_NETWORK_SIZE - 1), "Truncated networks should be rejected.");
+
+    chess_board *board = cb_new_chess_board();
+    cb_initialize_game(board);
+
+    cb_nnue_accumulator accumulator;
+    cb_nnue_refresh_accumulator(&network, &accumulator, board);
+
+    cb_evaluator evaluator;
+    cb_initialize_evaluator(&evaluator, CB_EVALUATOR_NNUE);
+    evaluator.network = &network;
+    evaluator.accumulator = &accumulator;
+
+    ASSERT_EQ_MSG(cb_evaluate(board, &evaluator), cb_nnue_evaluate(&network, &accumulator, WHITE), "The NNUE evaluator should be selected.");
+
+    evaluator.type = CB_EVALUATOR_MATERIAL;
+    ASSERT_EQ_MSG(cb_evaluate(board, &evaluator), 0, "The material evaluator should be selected.");
+
+    cb_free_chess_board(board);
+    cb_nnue_free_network(&network);
+    remove(TEST_NETWORK_PATH);
+    free(data);
+}
+
+TEST_SUITE(NNUE)
+{
+    ADD_TEST(cb_nnue_update_accumulator);
+    ADD_TEST(cb_nnue_update_special_moves);
+    ADD_TEST(cb_nnue_load_network);
+}
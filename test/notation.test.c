@@ -0,0 +1,67 @@
+/**
+ * @file notation.test.c
+ * @author Nathan Seymour
+ * @brief Tests for proton-chess algebraic notation parsing.
+ */
+
+#include <string.h>
+#include "chess.h"
+#include "notation.h"
+#include "scpunitc.h"
+
+TEST(cb_parse_notation)
+{
+    chess_board board;
+    cb_move move;
+
+    cb_initialize_game(&board);
+    ASSERT_TRUE_MSG(cb_parse_notation(&board, "e4", &move), "e4 should be read.");
+    ASSERT_EQ_MSG(move.from_square_index, 12, "e4 should move the e2 pawn.");
+    ASSERT_EQ_MSG(move.to_square_index, 28, "e4 should move to e4.");
+
+    ASSERT_TRUE_MSG(cb_parse_notation(&board, "1.Nf3", &move), "Move numbers should be skipped.");
+    ASSERT_EQ_MSG(move.from_square_index, 6, "Nf3 should move the g1 knight.");
+    ASSERT_TRUE_MSG(!cb_parse_notation(&board, "Nd2", &move), "Nd2 is not legal.");
+    ASSERT_TRUE_MSG(!cb_parse_notation(&board, "Ke4", &move), "Ke4 is not legal.");
+
+    // Both black knights can take the rook, the rank tells which one.
+    cb_parse_fen(&board, "k7/5n2/3R4/5n2/8/8/K7/8 b - - 1 1");
+    ASSERT_TRUE_MSG(!cb_parse_notation(&board, "Nxd6", &move), "Nxd6 is ambiguous.");
+    ASSERT_TRUE_MSG(cb_parse_notation(&board, "N7xd6+", &move), "N7xd6 should be read.");
+    ASSERT_EQ_MSG(move.from_square_index, 53, "N7xd6 should move the f7 knight.");
+
+    cb_parse_fen(&board, "r3k2r/8/8/8/8/8/8/R3K2R w KQkq - 0 1");
+    ASSERT_TRUE_MSG(cb_parse_notation(&board, "O-O", &move), "O-O should be read.");
+    ASSERT_EQ_MSG(move.to_square_index, 6, "O-O should move the king to g1.");
+    ASSERT_TRUE_MSG(cb_parse_notation(&board, "0-0-0", &move), "0-0-0 should be read.");
+    ASSERT_EQ_MSG(move.to_square_index, 2, "0-0-0 should move the king to c1.");
+    ASSERT_TRUE_MSG(cb_parse_notation(&board, "Rab1", &move), "Rab1 should be read.");
+    ASSERT_EQ_MSG(move.from_square_index, 0, "Rab1 should move the a1 rook.");
+
+    cb_parse_fen(&board, "4k3/1P6/8/8/8/8/8/4K3 w - - 0 1");
+    ASSERT_TRUE_MSG(cb_parse_notation(&board, "b8=N", &move), "b8=N should be read.");
+    ASSERT_EQ_MSG(move.promotion_piece & COLOR_MASK, KNIGHT, "The pawn should become a knight.");
+    ASSERT_TRUE_MSG(cb_parse_notation(&board, "b8", &move), "b8 should be read.");
+    ASSERT_EQ_MSG(move.promotion_piece & COLOR_MASK, QUEEN, "The pawn should become a queen by default.");
+}
+
+TEST(cb_move_to_uci)
+{
+    chess_board board;
+    cb_move move;
+    char notation[6];
+
+    cb_initialize_game(&board);
+    cb_parse_notation(&board, "Nf3", &move);
+    ASSERT_TRUE_MSG(strcmp(cb_move_to_uci(&move, notation), "g1f3") == 0, "Nf3 should be written g1f3.");
+
+    cb_parse_fen(&board, "4k3/1P6/8/8/8/8/8/4K3 w - - 0 1");
+    cb_parse_notation(&board, "b8=N", &move);
+    ASSERT_TRUE_MSG(strcmp(cb_move_to_uci(&move, notation), "b7b8n") == 0, "b8=N should be written b7b8n.");
+}
+
+TEST_SUITE(Notation)
+{
+    ADD_TEST(cb_parse_notation);
+    ADD_TEST(cb_move_to_uci);
+}
@@ -0,0 +1,190 @@
+/**
+ * @file pool.test.c
+ * @author Nathan Seymour
+ * @brief Tests for proton-chess game pools.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "chess.h"
+#include "zobrist.h"
+#include "pool.h"
+#include "pcmem.h"
+#include "scpunitc.h"
+
+TEST(cb_pool_create_game)
+{
+    cb_game_pool pool;
+    chess_board initial_board, board;
+
+    ASSERT_TRUE_MSG(!cb_initialize_game_pool(&pool, CB_POOL_MAX_SHARDS + 1, 1), "Too many shards should be rejected.");
+    ASSERT_TRUE_MSG(cb_initialize_game_pool(&pool, 2, 3), "Pool should be allocated.");
+    ASSERT_TRUE_MSG(((size_t)pool.shards & (PCMEM_CACHE_LINE_SIZE - 1)) == 0, "Shards should be aligned on cache lines.");
+    ASSERT_TRUE_MSG(sizeof(cb_game_shard) % PCMEM_CACHE_LINE_SIZE == 0, "Shards should not share cache lines.");
+    ASSERT_TRUE_MSG(((size_t)pool.shards[1].boards & (PCMEM_CACHE_LINE_SIZE - 1)) == 0, "Boards should be aligned on cache lines.");
+
+    cb_game_handle first = cb_pool_create_game(&pool, 1);
+    cb_game_handle second = cb_pool_create_game(&pool, 1);
+    cb_game_handle third = cb_pool_create_game(&pool, 1);
+
+    ASSERT_TRUE_MSG(first != CB_INVALID_GAME_HANDLE && second != CB_INVALID_GAME_HANDLE && third != CB_INVALID_GAME_HANDLE, "Shard should hold three games.");
+    ASSERT_TRUE_MSG(cb_pool_create_game(&pool, 1) == CB_INVALID_GAME_HANDLE, "Full shard should not create games.");
+    ASSERT_TRUE_MSG(cb_pool_create_game(&pool, 2) == CB_INVALID_GAME_HANDLE, "Missing shard should not create games.");
+    ASSERT_EQ_MSG(cb_game_handle_shard(second), 1, "Game should be created in the requested shard.");
+    ASSERT_EQ_MSG(pool.shards[1].active_count, 3, "Shard should count its games.");
+
+    cb_initialize_game(&initial_board);
+    cb_pool_load_board(&pool, second, &board);
+    ASSERT_TRUE_MSG(memcmp(board.board, initial_board.board, sizeof(cb_board_squares)) == 0, "Game should start with the initial position.");
+    ASSERT_EQ_MSG(board.castling_rights, initial_board.castling_rights, "Game should start with all castling rights.");
+    ASSERT_TRUE_MSG(pool.shards[1].keys[cb_game_handle_slot(second)] == cb_zobrist_key(&initial_board), "Game key should match its position.");
+
+    cb_free_game_pool(&pool);
+}
+
+TEST(cb_pool_destroy_game)
+{
+    cb_game_pool pool;
+
+    cb_initialize_game_pool(&pool, 1, 2);
+
+    // Handle 0 addresses the first slot before any game was created in it.
+    cb_pool_destroy_game(&pool, 0);
+    ASSERT_TRUE_MSG(!cb_pool_is_valid_game(&pool, 0), "Free slots should not be valid games.");
+    ASSERT_EQ_MSG(pool.shards[0].active_count, 0, "Destroying a free slot should be ignored.");
+
+    cb_game_handle first = cb_pool_create_game(&pool, 0);
+    cb_game_handle second = cb_pool_create_game(&pool, 0);
+
+    cb_pool_destroy_game(&pool, first);
+    ASSERT_TRUE_MSG(!cb_pool_is_valid_game(&pool, first), "Destroyed game should not be valid.");
+    ASSERT_TRUE_MSG(cb_pool_is_valid_game(&pool, second), "Other games should remain valid.");
+
+    cb_game_handle reused = cb_pool_create_game(&pool, 0);
+    ASSERT_EQ_MSG(cb_game_handle_slot(reused), cb_game_handle_slot(first), "Freed slot should be reused.");
+    ASSERT_TRUE_MSG(reused != first, "Reused slot should get a new generation.");
+    ASSERT_TRUE_MSG(!cb_pool_is_valid_game(&pool, first), "Stale handle should not address the new game.");
+
+    cb_pool_destroy_game(&pool, first);
+    ASSERT_TRUE_MSG(cb_pool_is_valid_game(&pool, reused), "Destroying a stale handle should be ignored.");
+    ASSERT_EQ_MSG(pool.shards[0].active_count, 2, "Shard should still hold two games.");
+    ASSERT_TRUE_MSG(cb_pool_create_game(&pool, 0) == CB_INVALID_GAME_HANDLE, "No slot should have been freed twice.");
+
+    cb_free_game_pool(&pool);
+
+    // Reuse a single slot until its generation is exhausted.
+    cb_initialize_game_pool(&pool, 1, 1);
+    first = cb_pool_create_game(&pool, 0);
+    cb_pool_destroy_game(&pool, first);
+
+    unsigned int game_count = 1;
+    int stale_handle_valid = 0;
+    for(cb_game_handle handle = cb_pool_create_game(&pool, 0); handle != CB_INVALID_GAME_HANDLE; handle = cb_pool_create_game(&pool, 0))
+    {
+        game_count++;
+        stale_handle_valid |= cb_pool_is_valid_game(&pool, first);
+        cb_pool_destroy_game(&pool, handle);
+    }
+
+    ASSERT_EQ_MSG(game_count, (CB_POOL_MAX_GENERATION + 1) / 2, "Slot should host one game per odd generation.");
+    ASSERT_TRUE_MSG(!stale_handle_valid, "Stale handle should never address a later game.");
+    ASSERT_TRUE_MSG(!cb_pool_is_valid_game(&pool, first), "Retired slot should not be valid.");
+    ASSERT_EQ_MSG(pool.shards[0].active_count, 0, "Retired slot should not count as a game.");
+
+    cb_free_game_pool(&pool);
+}
+
+TEST(cb_pool_store_board)
+{
+    cb_game_pool pool;
+    chess_board board, loaded_board;
+
+    cb_initialize_game_pool(&pool, 1, 4);
+    cb_game_handle handle = cb_pool_create_game(&pool, 0);
+
+    cb_initialize_game(&board);
+    cb_set_board_value_at_square_index(&board, 12, EMPTY_SQUARE);
+    cb_set_board_value_at_square_index(&board, 28, WHITE | PAWN);
+    board.ep_target_square_index = 20;
+    board.move_counter = 1000;
+    board.halfmove_clock = 0;
+
+    cb_pool_store_board(&pool, handle, &board);
+    cb_pool_load_board(&pool, handle, &loaded_board);
+
+    ASSERT_TRUE_MSG(memcmp(loaded_board.board, board.board, sizeof(cb_board_squares)) == 0, "Stored board should be loaded back.");
+    ASSERT_EQ_MSG(loaded_board.ep_target_square_index, 20, "En passant square should be stored.");
+    ASSERT_EQ_MSG(loaded_board.move_counter, 1000, "Move counter should be stored.");
+    ASSERT_TRUE_MSG(pool.shards[0].keys[cb_game_handle_slot(handle)] == cb_zobrist_key(&board), "Game key should follow the stored board.");
+
+    cb_free_game_pool(&pool);
+}
+
+TEST(cb_pool_snapshot)
+{
+    cb_game_pool pool;
+    chess_board board;
+
+    cb_initialize_game_pool(&pool, 1, 8);
+    cb_game_handle kept = cb_pool_create_game(&pool, 0);
+    cb_game_handle destroyed = cb_pool_create_game(&pool, 0);
+
+    void *snapshot = malloc(cb_pool_snapshot_size(&pool, 0));
+    cb_pool_snapshot(&pool, 0, snapshot);
+
+    cb_initialize_game(&board);
+    cb_set_board_value_at_square_index(&board, 0, EMPTY_SQUARE);
+    cb_pool_store_board(&pool, kept, &board);
+    cb_pool_destroy_game(&pool, destroyed);
+    cb_pool_create_game(&pool, 0);
+    cb_pool_create_game(&pool, 0);
+
+    cb_pool_restore(&pool, 0, snapshot);
+
+    ASSERT_EQ_MSG(pool.shards[0].active_count, 2, "Restored shard should hold its two games.");
+    ASSERT_TRUE_MSG(cb_pool_is_valid_game(&pool, destroyed), "Games destroyed after the snapshot should be back.");
+    cb_pool_load_board(&pool, kept, &board);
+    ASSERT_EQ_MSG(cb_get_board_value_at_square_index(&board, 0), WHITE | ROOK, "Boards should be restored.");
+
+    cb_game_handle created = cb_pool_create_game(&pool, 0);
+    ASSERT_EQ_MSG(cb_game_handle_slot(created), 2, "Free slots should be restored.");
+
+    ASSERT_EQ_MSG(cb_pool_snapshot_size(&pool, 1), 0, "Missing shards should have no snapshot.");
+    cb_pool_snapshot(&pool, 1, snapshot);
+    cb_pool_restore(&pool, 1, snapshot);
+
+    free(snapshot);
+    cb_free_game_pool(&pool);
+}
+
+TEST(cb_attach_game_pool)
+{
+    static uchar memory[8192];
+    cb_game_pool pool;
+    size_t size = cb_game_pool_memory_size(3, 16);
+
+    ASSERT_TRUE_MSG(size <= sizeof(memory) - 1, "The test memory should hold the pool.");
+    ASSERT_TRUE_MSG(!cb_attach_game_pool(&pool, memory + 1, size - 1, 3, 16), "Too little memory should be rejected.");
+
+    // Deliberately misaligned, the pool aligns itself.
+    ASSERT_TRUE_MSG(cb_attach_game_pool(&pool, memory + 1, size, 3, 16), "The pool should be attached.");
+    ASSERT_TRUE_MSG(((size_t)pool.shards & (PCMEM_CACHE_LINE_SIZE - 1)) == 0, "Shards should be aligned on cache lines.");
+    ASSERT_TRUE_MSG(((size_t)pool.shards[2].boards & (PCMEM_CACHE_LINE_SIZE - 1)) == 0, "Boards should be aligned on cache lines.");
+    ASSERT_TRUE_MSG((uchar*)pool.shards[2].memory + pool.shards[2].memory_size <= memory + 1 + size, "The pool should stay in its memory.");
+
+    for(uint32_t i = 0; i < 16; i++)
+    {
+        ASSERT_TRUE_MSG(cb_pool_create_game(&pool, 2) != CB_INVALID_GAME_HANDLE, "Shard should hold 16 games.");
+    }
+    ASSERT_TRUE_MSG(cb_pool_create_game(&pool, 2) == CB_INVALID_GAME_HANDLE, "Full shard should not create games.");
+    ASSERT_EQ_MSG(pool.shards[0].active_count, 0, "Other shards should be untouched.");
+}
+
+TEST_SUITE(Pool)
+{
+    ADD_TEST(cb_pool_create_game);
+    ADD_TEST(cb_pool_destroy_game);
+    ADD_TEST(cb_pool_store_board);
+    ADD_TEST(cb_pool_snapshot);
+    ADD_TEST(cb_attach_game_pool);
+}
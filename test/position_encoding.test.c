@@ -0,0 +1,137 @@
+/**
+ * @file position_encoding.test.c
+ * @author Nathan Seymour
+ * @brief Tests for the proton-chess dense position encoding.
+ */
+
+#include <string.h>
+#include "chess.h"
+#include "legality.h"
+#include "movement.h"
+#include "position_encoding.h"
+#include "scpunitc.h"
+
+#define TEST_POSITIONS 256
+
+static int boards_equal(chess_board *first, chess_board *second)
+{
+    uchar first_packed[32];
+    uchar second_packed[32];
+
+    cb_pack_board(first, first_packed);
+    cb_pack_board(second, second_packed);
+
+    return memcmp(first_packed, second_packed, 32) == 0
+           && first->move_counter == second->move_counter
+           && first->castling_rights == second->castling_rights
+           && first->ep_target_square_index == second->ep_target_square_index
+           && first->halfmove_clock == second->halfmove_clock;
+}
+
+TEST(cb_encode_position)
+{
+    static const char *fens[] = {
+            "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+            "rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1",
+            "rnbqkbnr/ppp1pppp/8/3pP3/8/8/PPPP1PPP/RNBQKBNR w Kq d6 0 3",
+            "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R b KQkq - 17 40",
+            "8/8/8/8/8/8/8/K6k b - - 99 300",
+            // Castling right without its rook, and no black king: not folded.
+            "4k3/8/8/8/8/8/8/4K3 w K - 0 1",
+            "8/8/8/8/8/8/8/4K3 b - - 0 1",
+    };
+    chess_board board;
+    chess_board decoded;
+    uchar data[CB_POSITION_MAX_SIZE];
+
+    for(uchar i = 0; i < sizeof(fens) / sizeof(fens[0]); i++)
+    {
+        cb_parse_fen(&board, fens[i]);
+
+        uchar length = cb_encode_position(&board, data);
+        ASSERT_TRUE_MSG(length > 8 && length <= CB_POSITION_MAX_SIZE, "The position should be encoded.");
+        ASSERT_EQ_MSG(cb_decode_position(&decoded, data, length), length, "The whole position should be read.");
+        ASSERT_TRUE_MSG(boards_equal(&board, &decoded), "The position should round-trip.");
+        ASSERT_EQ_MSG(cb_decode_position(&decoded, data, length - 1), 0, "Truncated data should be rejected.");
+    }
+
+    cb_parse_fen(&board, fens[0]);
+    ASSERT_EQ_MSG(cb_encode_position(&board, data), 26, "The initial position should take 26 bytes.");
+    cb_parse_fen(&board, fens[4]);
+    ASSERT_EQ_MSG(cb_encode_position(&board, data), 12, "Bare kings should take 12 bytes.");
+
+    cb_set_board_value_at_square_index(&board, 20, BLACK);
+    ASSERT_EQ_MSG(cb_encode_position(&board, data), 0, "Invalid piece values should be rejected.");
+}
+
+TEST(cb_encode_position_piece_count)
+{
+    uchar data[CB_POSITION_MAX_SIZE + 16];
+    chess_board board;
+    chess_board decoded;
+
+    cb_initialize_game(&board);
+    cb_set_board_value_at_square_index(&board, 20, WHITE | PAWN);
+    ASSERT_EQ_MSG(cb_encode_position(&board, data), 0, "Boards with more than 32 pieces should be rejected.");
+
+    // A full board would take 8 + 32 bytes of board alone, then the counters.
+    for(uchar square_index = 16; square_index < 48; square_index++)
+    {
+        cb_set_board_value_at_square_index(&board, square_index, WHITE | PAWN);
+    }
+    memset(data, 0xAA, sizeof(data));
+
+    ASSERT_EQ_MSG(cb_encode_position(&board, data), 0, "Boards with more than 32 pieces should be rejected.");
+    ASSERT_EQ_MSG(cb_encode_positions(&board, 1, data), 0, "Boards with more than 32 pieces should be rejected.");
+    ASSERT_EQ_MSG(data[CB_POSITION_MAX_SIZE], 0xAA, "Nothing should be written past the buffer.");
+
+    // An occupancy of 33 squares, followed by enough data for its pieces.
+    memset(data, 0x11, sizeof(data));
+    memset(data, 0xFF, 4);
+    data[4] = 0x01;
+    ASSERT_EQ_MSG(cb_decode_position(&decoded, data, sizeof(data)), 0, "More than 32 pieces should be rejected.");
+}
+
+TEST(cb_encode_positions)
+{
+    static chess_board boards[TEST_POSITIONS];
+    static chess_board decoded[TEST_POSITIONS];
+    static uchar data[TEST_POSITIONS * CB_POSITION_MAX_SIZE];
+    chess_board board;
+    unsigned int seed = 7;
+
+    // Positions of pseudo-random games, with every kind of folded state.
+    cb_initialize_game(&board);
+
+    for(unsigned int i = 0; i < TEST_POSITIONS; i++)
+    {
+        cb_move_list list;
+        cb_move_undo undo;
+
+        if(cb_generate_legal_moves(&board, &list) == 0 || board.halfmove_clock >= 100)
+        {
+            cb_initialize_game(&board);
+            cb_generate_legal_moves(&board, &list);
+        }
+
+        seed = seed * 1103515245u + 12345u;
+        cb_make_move(&board, &list.moves[(seed >> 16) % list.count], &undo, NULL);
+        boards[i] = board;
+    }
+
+    size_t length = cb_encode_positions(boards, TEST_POSITIONS, data);
+    ASSERT_TRUE_MSG(length > 0 && length < TEST_POSITIONS * 26, "The positions should be encoded.");
+    ASSERT_EQ_MSG(cb_decode_positions(decoded, TEST_POSITIONS, data, length), length, "Every position should be read.");
+
+    for(unsigned int i = 0; i < TEST_POSITIONS; i++)
+    {
+        ASSERT_TRUE_MSG(boards_equal(&boards[i], &decoded[i]), "The positions should round-trip.");
+    }
+}
+
+TEST_SUITE(PositionEncoding)
+{
+    ADD_TEST(cb_encode_position);
+    ADD_TEST(cb_encode_position_piece_count);
+    ADD_TEST(cb_encode_positions);
+}
@@ -0,0 +1,177 @@
+/**
+ * @file scheduler.test.c
+ * @author Nathan Seymour
+ * @brief Tests for the proton-chess analysis scheduler.
+ */
+
+#include <string.h>
+#include "chess.h"
+#include "transposition.h"
+#include "search.h"
+#include "scheduler.h"
+#include "scpunitc.h"
+
+#define TEST_JOBS 8
+#define INITIAL_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+
+/*
+ * Jobs record the order they ended in through their user data.
+ */
+typedef struct {
+    uchar status;
+    cb_search_result result;
+    unsigned int order;
+} analysis_record;
+
+static unsigned int ended_jobs = 0;
+
+static void record_analysis(const cb_analysis_request *request, uchar status, const cb_search_result *result)
+{
+    analysis_record *record = request->user_data;
+
+    record->status = status;
+    record->result = *result;
+    record->order = __atomic_fetch_add(&ended_jobs, 1, __ATOMIC_RELAXED);
+}
+
+static void prepare_request(cb_analysis_request *request, analysis_record *record, const char *fen, uchar depth)
+{
+    memset(request, 0, sizeof(cb_analysis_request));
+    memset(record, 0, sizeof(analysis_record));
+
+    cb_parse_fen(&request->board, fen);
+    request->limits.depth = depth;
+    request->user_data = record;
+}
+
+#ifdef PCTHREADS_HAS_PTHREADS
+TEST(cb_submit_analysis)
+{
+    cb_transposition_table table;
+    cb_scheduler scheduler;
+    cb_analysis_request request;
+    analysis_record records[TEST_JOBS];
+
+    cb_initialize_transposition_table(&table, 1 << 20);
+    ASSERT_TRUE_MSG(cb_initialize_scheduler(&scheduler, &table, 2, TEST_JOBS, record_analysis), "The scheduler should start.");
+
+    // Back rank mate, Ra8#, searched by one thread or helped by the other.
+    for(uchar i = 0; i < TEST_JOBS; i++)
+    {
+        prepare_request(&request, &records[i], "6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1", 3);
+        request.threads = i % 2 + 1;
+        ASSERT_TRUE_MSG(cb_submit_analysis(&scheduler, &request) != 0, "The job should be queued.");
+    }
+
+    cb_wait_for_analyses(&scheduler);
+
+    for(uchar i = 0; i < TEST_JOBS; i++)
+    {
+        ASSERT_EQ_MSG(records[i].status, CB_ANALYSIS_DONE, "Every job should be searched.");
+        ASSERT_EQ_MSG(records[i].result.lines[0].moves[0].to_square_index, 56, "Ra8 should be found.");
+        ASSERT_EQ_MSG(records[i].result.lines[0].score, CB_MATE_SCORE - 1, "The mate should be found.");
+    }
+
+    cb_free_scheduler(&scheduler);
+    cb_free_transposition_table(&table);
+}
+
+/*
+ * Wait for a worker to take the queued jobs, looking at the queue the way
+ * the workers do.
+ */
+static void wait_until_started(cb_scheduler *scheduler)
+{
+    size_t queued = 1;
+
+    while(queued > 0)
+    {
+        pcthread_mutex_lock(&scheduler->mutex);
+        queued = scheduler->queue_count;
+        pcthread_mutex_unlock(&scheduler->mutex);
+    }
+}
+
+TEST(cb_scheduler_ordering)
+{
+    cb_transposition_table table;
+    cb_scheduler scheduler;
+    cb_analysis_request request;
+    analysis_record blocker, late, early, urgent, filler, expired, rejected, running;
+    unsigned long filler_id, running_id;
+
+    cb_initialize_transposition_table(&table, 1 << 20);
+    ASSERT_TRUE_MSG(cb_initialize_scheduler(&scheduler, &table, 1, 4, record_analysis), "The scheduler should start.");
+
+    // Keep the only worker busy while the other jobs are queued.
+    prepare_request(&request, &blocker, INITIAL_FEN, 0);
+    request.limits.time_ms = 300;
+    cb_submit_analysis(&scheduler, &request);
+    wait_until_started(&scheduler);
+
+    prepare_request(&request, &late, INITIAL_FEN, 2);
+    request.deadline_ms = 60000;
+    cb_submit_analysis(&scheduler, &request);
+
+    prepare_request(&request, &early, INITIAL_FEN, 2);
+    request.deadline_ms = 30000;
+    cb_submit_analysis(&scheduler, &request);
+
+    prepare_request(&request, &urgent, INITIAL_FEN, 2);
+    request.priority = 1;
+    cb_submit_analysis(&scheduler, &request);
+
+    prepare_request(&request, &filler, INITIAL_FEN, 2);
+    filler_id = cb_submit_analysis(&scheduler, &request);
+
+    prepare_request(&request, &rejected, INITIAL_FEN, 2);
+    ASSERT_EQ_MSG(cb_submit_analysis(&scheduler, &request), 0, "A full queue should reject jobs.");
+
+    // Make room for a job whose deadline passes while it is queued.
+    ASSERT_TRUE_MSG(cb_cancel_analysis(&scheduler, filler_id), "The queued job should be cancelled.");
+    prepare_request(&request, &expired, INITIAL_FEN, 2);
+    request.deadline_ms = 1;
+    request.priority = 2;
+    ASSERT_TRUE_MSG(cb_submit_analysis(&scheduler, &request) != 0, "The job should be queued.");
+
+    cb_wait_for_analyses(&scheduler);
+
+    ASSERT_EQ_MSG(blocker.status, CB_ANALYSIS_DONE, "The first job should be searched.");
+    ASSERT_EQ_MSG(filler.status, CB_ANALYSIS_CANCELLED, "The cancelled job should not be searched.");
+    ASSERT_EQ_MSG(filler.result.line_count, 0, "The cancelled job should have no result.");
+    ASSERT_EQ_MSG(expired.status, CB_ANALYSIS_EXPIRED, "The job past its deadline should be dropped.");
+    ASSERT_EQ_MSG(late.status, CB_ANALYSIS_DONE, "The queued jobs should be searched.");
+    ASSERT_TRUE_MSG(urgent.order < early.order, "Higher priorities should start first.");
+    ASSERT_TRUE_MSG(early.order < late.order, "Earlier deadlines should start first.");
+
+    // A running job is stopped after its first depth.
+    prepare_request(&request, &running, INITIAL_FEN, 0);
+    request.limits.time_ms = 60000;
+    running_id = cb_submit_analysis(&scheduler, &request);
+    wait_until_started(&scheduler);
+
+    ASSERT_TRUE_MSG(cb_cancel_analysis(&scheduler, running_id), "The running job should be cancelled.");
+    cb_wait_for_analyses(&scheduler);
+    ASSERT_EQ_MSG(running.status, CB_ANALYSIS_CANCELLED, "The job should be reported as cancelled.");
+    ASSERT_EQ_MSG(running.result.line_count, 1, "The first depth should be returned.");
+    ASSERT_TRUE_MSG(!cb_cancel_analysis(&scheduler, running_id), "An ended job cannot be cancelled.");
+
+    // The stop of the cancelled job does not carry over to the next one.
+    prepare_request(&request, &late, INITIAL_FEN, 4);
+    cb_submit_analysis(&scheduler, &request);
+    cb_wait_for_analyses(&scheduler);
+    ASSERT_EQ_MSG(late.status, CB_ANALYSIS_DONE, "The next job should be searched.");
+    ASSERT_EQ_MSG(late.result.depth, 4, "The next job should reach its depth.");
+
+    cb_free_scheduler(&scheduler);
+    cb_free_transposition_table(&table);
+}
+#endif
+
+TEST_SUITE(Scheduler)
+{
+#ifdef PCTHREADS_HAS_PTHREADS
+    ADD_TEST(cb_submit_analysis);
+    ADD_TEST(cb_scheduler_ordering);
+#endif
+}
@@ -0,0 +1,343 @@
+/**
+ * @file search.test.c
+ * @author Nathan Seymour
+ * @brief Tests for the proton-chess search and transposition table.
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include "chess.h"
+#include "history.h"
+#include "legality.h"
+#include "transposition.h"
+#include "search.h"
+#include "pcthreads.h"
+#include "scpunitc.h"
+
+typedef struct {
+    unsigned int depth_events;
+    unsigned int pv_events;
+    uchar last_depth;
+    int pv_valid;
+} search_progress;
+
+static void record_progress(const cb_search_info *info, void *user_data)
+{
+    search_progress *progress = user_data;
+
+    if(info->event == CB_SEARCH_EVENT_DEPTH)
+    {
+        progress->depth_events++;
+        progress->last_depth = info->depth;
+    }
+    else
+    {
+        progress->pv_events++;
+    }
+
+    if(info->pv_length == 0 || info->hashfull > 1000)
+    {
+        progress->pv_valid = 0;
+    }
+}
+
+typedef struct {
+    cb_searcher *searcher;
+    chess_board board;
+    cb_search_limits limits;
+    cb_search_result result;
+
+    /**
+     * Read from the test thread while the search runs.
+     */
+    uchar reported_depth;
+    int finished;
+} search_job;
+
+static void record_depth(const cb_search_info *info, void *user_data)
+{
+    search_job *job = user_data;
+
+    if(info->event == CB_SEARCH_EVENT_DEPTH)
+    {
+        __atomic_store_n(&job->reported_depth, info->depth, __ATOMIC_RELEASE);
+    }
+}
+
+static void *run_search(void *argument)
+{
+    search_job *job = argument;
+
+    cb_search(job->searcher, &job->board, NULL, &job->limits, &job->result);
+    __atomic_store_n(&job->finished, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+static void sleep_ms(long milliseconds)
+{
+    struct timespec duration = {milliseconds / 1000, milliseconds % 1000 * 1000000};
+    nanosleep(&duration, NULL);
+}
+
+/*
+ * Start a search in a thread, and wait until it has completed a depth, so
+ * that it is running when the test acts on it.
+ */
+static void start_search(pcthread *thread, search_job *job, uchar depth)
+{
+    job->reported_depth = 0;
+    job->finished = 0;
+    pcthread_create(thread, run_search, job);
+
+    while(__atomic_load_n(&job->reported_depth, __ATOMIC_ACQUIRE) < depth)
+    {
+        sleep_ms(1);
+    }
+}
+
+TEST(cb_tt_store)
+{
+    cb_transposition_table table;
+    cb_tt_data data;
+    cb_move move = {12, 28, 0};
+    cb_move no_move = {0, 0, 0};
+
+    ASSERT_TRUE_MSG(cb_initialize_transposition_table(&table, 1 << 16), "The table should be allocated.");
+    ASSERT_EQ_MSG(table.size, (1 << 16) / sizeof(cb_tt_entry), "The table should fill the given size.");
+
+    ASSERT_TRUE_MSG(!cb_tt_probe(&table, 0x1234567890ABCDEFULL, &data), "An empty table has no entries.");
+
+    cb_tt_store(&table, 0x1234567890ABCDEFULL, &move, -1234, 7, CB_BOUND_LOWER);
+    ASSERT_TRUE_MSG(cb_tt_probe(&table, 0x1234567890ABCDEFULL, &data), "The stored entry should be found.");
+    ASSERT_EQ_MSG(data.score, -1234, "The score should be kept.");
+    ASSERT_EQ_MSG(data.depth, 7, "The depth should be kept.");
+    ASSERT_EQ_MSG(data.bound, CB_BOUND_LOWER, "The bound should be kept.");
+    ASSERT_EQ_MSG(data.move.from_square_index, 12, "The move should be kept.");
+    ASSERT_EQ_MSG(data.move.to_square_index, 28, "The move should be kept.");
+
+    // Without a move, the move of the previous search of the position is kept.
+    cb_tt_store(&table, 0x1234567890ABCDEFULL, &no_move, 50, 9, CB_BOUND_EXACT);
+    ASSERT_TRUE_MSG(cb_tt_probe(&table, 0x1234567890ABCDEFULL, &data), "The entry should be replaced.");
+    ASSERT_EQ_MSG(data.score, 50, "The score should be replaced.");
+    ASSERT_EQ_MSG(data.move.to_square_index, 28, "The move should be kept.");
+
+    cb_clear_transposition_table(&table);
+    ASSERT_TRUE_MSG(!cb_tt_probe(&table, 0x1234567890ABCDEFULL, &data), "A cleared table has no entries.");
+
+    cb_free_transposition_table(&table);
+}
+
+TEST(cb_attach_transposition_table)
+{
+    static uchar memory[4096 + 32];
+    cb_transposition_table table;
+    cb_tt_data data;
+    cb_move move = {12, 28, 0};
+
+    ASSERT_TRUE_MSG(!cb_attach_transposition_table(&table, memory, sizeof(cb_tt_entry) - 1), "Too little memory should be rejected.");
+
+    // Deliberately misaligned, the entries are aligned and the size rounded down.
+    ASSERT_TRUE_MSG(cb_attach_transposition_table(&table, memory + 3, sizeof(memory) - 3), "The table should be attached.");
+    ASSERT_TRUE_MSG((size_t)table.entries % sizeof(cb_tt_entry) == 0, "The entries should be aligned.");
+    ASSERT_EQ_MSG(table.size, 4096 / sizeof(cb_tt_entry), "The table should fill a power of two of the memory.");
+    ASSERT_TRUE_MSG((uchar*)(table.entries + table.size) <= memory + sizeof(memory), "The table should stay in its memory.");
+
+    cb_tt_store(&table, 0x1234567890ABCDEFULL, &move, 77, 3, CB_BOUND_UPPER);
+    ASSERT_TRUE_MSG(cb_tt_probe(&table, 0x1234567890ABCDEFULL, &data), "The stored entry should be found.");
+    ASSERT_EQ_MSG(data.score, 77, "The score should be kept.");
+}
+
+TEST(cb_search_mate)
+{
+    cb_transposition_table table;
+    cb_searcher *searcher = malloc(sizeof(cb_searcher));
+    cb_search_limits limits = {.depth = 4, .multi_pv = 1};
+    cb_search_result result;
+    chess_board board;
+
+    cb_initialize_transposition_table(&table, 1 << 20);
+    cb_initialize_searcher(searcher, &table);
+
+    // Back rank mate, Ra8#.
+    cb_parse_fen(&board, "6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1");
+    ushort move_counter = board.move_counter;
+    cb_search(searcher, &board, NULL, &limits, &result);
+
+    ASSERT_EQ_MSG(result.line_count, 1, "One line should be returned.");
+    ASSERT_EQ_MSG(result.lines[0].moves[0].from_square_index, 0, "Ra8 should be played.");
+    ASSERT_EQ_MSG(result.lines[0].moves[0].to_square_index, 56, "Ra8 should be played.");
+    ASSERT_EQ_MSG(result.lines[0].score, CB_MATE_SCORE - 1, "The mate should be in one ply.");
+    ASSERT_EQ_MSG(board.move_counter, move_counter, "The board should be left untouched.");
+
+    // Mated side, every move loses.
+    cb_parse_fen(&board, "6k1/5ppp/8/8/8/8/8/R5K1 b - - 0 1");
+    limits.depth = 3;
+    cb_search(searcher, &board, NULL, &limits, &result);
+    ASSERT_TRUE_MSG(result.lines[0].score > -(CB_MATE_SCORE - CB_MAX_PLY), "Black can escape with h6 or g6.");
+
+    cb_free_transposition_table(&table);
+    free(searcher);
+}
+
+TEST(cb_search_multi_pv)
+{
+    cb_transposition_table table;
+    cb_searcher *searcher = malloc(sizeof(cb_searcher));
+    cb_search_limits limits = {.depth = 3, .multi_pv = 3};
+    cb_search_result result;
+    chess_board board;
+
+    cb_initialize_transposition_table(&table, 1 << 20);
+    cb_initialize_searcher(searcher, &table);
+
+    // White can take the queen or the knight.
+    cb_parse_fen(&board, "4k3/8/8/2n1q3/3B4/8/K7/8 w - - 0 1");
+    cb_search(searcher, &board, NULL, &limits, &result);
+
+    ASSERT_EQ_MSG(result.line_count, 3, "Three lines should be returned.");
+    ASSERT_EQ_MSG(result.depth, 3, "Every depth should be completed.");
+
+    for(uchar i = 0; i < result.line_count; i++)
+    {
+        ASSERT_TRUE_MSG(result.lines[i].length > 0, "Every line should have moves.");
+
+        for(uchar j = 0; j < i; j++)
+        {
+            ASSERT_TRUE_MSG(result.lines[j].score >= result.lines[i].score, "Lines should be sorted by score.");
+            ASSERT_TRUE_MSG(result.lines[j].moves[0].from_square_index != result.lines[i].moves[0].from_square_index
+                            || result.lines[j].moves[0].to_square_index != result.lines[i].moves[0].to_square_index,
+                            "Lines should start with different moves.");
+        }
+    }
+
+    ASSERT_EQ_MSG(result.lines[0].moves[0].to_square_index, 36, "Taking the queen should be best.");
+
+    // Fewer legal moves than requested lines.
+    cb_parse_fen(&board, "k7/8/1K6/8/8/8/8/8 b - - 0 1");
+    limits.multi_pv = 5;
+    cb_search(searcher, &board, NULL, &limits, &result);
+    ASSERT_EQ_MSG(result.line_count, 1, "Black has a single legal move.");
+
+    cb_free_transposition_table(&table);
+    free(searcher);
+}
+
+TEST(cb_search_limits)
+{
+    cb_transposition_table table;
+    cb_searcher *searcher = malloc(sizeof(cb_searcher));
+    cb_search_limits limits = {.nodes = 5000, .multi_pv = 1};
+    cb_search_result result;
+    chess_board board;
+
+    cb_initialize_transposition_table(&table, 1 << 20);
+    cb_initialize_searcher(searcher, &table);
+    cb_initialize_game(&board);
+
+    cb_search(searcher, &board, NULL, &limits, &result);
+
+    ASSERT_EQ_MSG(result.line_count, 1, "A move should be returned.");
+    ASSERT_TRUE_MSG(result.depth >= 1, "The first depth should be completed.");
+    ASSERT_TRUE_MSG(result.nodes < 5000 + 2 * 1024, "The node limit should be respected.");
+    ASSERT_TRUE_MSG(cb_is_move_legal(&board, &result.lines[0].moves[0]), "The move should be legal.");
+
+    cb_free_transposition_table(&table);
+    free(searcher);
+}
+
+TEST(cb_search_callback)
+{
+    cb_transposition_table table;
+    cb_searcher *searcher = malloc(sizeof(cb_searcher));
+    cb_search_limits limits = {.depth = 4, .multi_pv = 2};
+    cb_search_result result;
+    search_progress progress = {0, 0, 0, 1};
+    chess_board board;
+
+    cb_initialize_transposition_table(&table, 1 << 20);
+    cb_initialize_searcher(searcher, &table);
+    cb_set_search_callback(searcher, record_progress, &progress);
+    cb_initialize_game(&board);
+
+    cb_search(searcher, &board, NULL, &limits, &result);
+
+    ASSERT_EQ_MSG(progress.depth_events, 4 * 2, "Every line of every depth should be reported.");
+    ASSERT_EQ_MSG(progress.last_depth, 4, "The last depth should be reported.");
+    ASSERT_TRUE_MSG(progress.pv_valid, "Reported lines should have moves.");
+
+    cb_free_transposition_table(&table);
+    free(searcher);
+}
+
+#ifdef PCTHREADS_HAS_PTHREADS
+TEST(cb_stop_search)
+{
+    cb_transposition_table table;
+    search_job job;
+    pcthread thread;
+
+    job.searcher = malloc(sizeof(cb_searcher));
+    job.limits = (cb_search_limits){.multi_pv = 1, .infinite = 1};
+    cb_initialize_transposition_table(&table, 1 << 20);
+    cb_initialize_searcher(job.searcher, &table);
+    cb_set_search_callback(job.searcher, record_depth, &job);
+    cb_initialize_game(&job.board);
+
+    // An infinite search runs until stopped from another thread.
+    start_search(&thread, &job, 3);
+    sleep_ms(20);
+    ASSERT_TRUE_MSG(!__atomic_load_n(&job.finished, __ATOMIC_ACQUIRE), "An infinite search should keep running.");
+    cb_stop_search(job.searcher);
+    pcthread_join(&thread);
+
+    ASSERT_EQ_MSG(job.result.line_count, 1, "A move should be returned.");
+    ASSERT_TRUE_MSG(job.result.depth >= 3, "The depths completed before the stop should be kept.");
+    ASSERT_TRUE_MSG(job.result.time_ms >= 20, "The search should have run until stopped.");
+    ASSERT_TRUE_MSG(cb_is_move_legal(&job.board, &job.result.lines[0].moves[0]), "The move should be legal.");
+
+    // A stop sent before the search thread gets going is kept for it.
+    job.limits = (cb_search_limits){.multi_pv = 1, .infinite = 1};
+    pcthread_create(&thread, run_search, &job);
+    cb_stop_search(job.searcher);
+    pcthread_join(&thread);
+    ASSERT_TRUE_MSG(job.result.line_count == 1 && job.result.stopped, "An infinite search stopped at once should return.");
+
+    // A stop while no search is running carries over to the next one, unless reset.
+    job.limits = (cb_search_limits){.depth = 3, .multi_pv = 1};
+    cb_stop_search(job.searcher);
+    cb_search(job.searcher, &job.board, NULL, &job.limits, &job.result);
+    ASSERT_EQ_MSG(job.result.depth, 1, "The next search should stop after its first depth.");
+
+    cb_stop_search(job.searcher);
+    cb_reset_search(job.searcher);
+    cb_search(job.searcher, &job.board, NULL, &job.limits, &job.result);
+    ASSERT_EQ_MSG(job.result.depth, 3, "A reset should drop the stop.");
+
+    // A ponder search ignores its limits until the ponder hit, then follows them.
+    job.limits = (cb_search_limits){.time_ms = 50, .multi_pv = 1, .ponder = 1};
+    start_search(&thread, &job, 1);
+    sleep_ms(100);
+    ASSERT_TRUE_MSG(!__atomic_load_n(&job.finished, __ATOMIC_ACQUIRE), "A ponder search should ignore the time limit.");
+    cb_ponder_hit(job.searcher);
+    pcthread_join(&thread);
+
+    ASSERT_TRUE_MSG(job.result.time_ms >= 150, "The time limit should count from the ponder hit.");
+
+    cb_free_transposition_table(&table);
+    free(job.searcher);
+}
+#endif
+
+TEST_SUITE(Search)
+{
+    ADD_TEST(cb_tt_store);
+    ADD_TEST(cb_attach_transposition_table);
+    ADD_TEST(cb_search_mate);
+    ADD_TEST(cb_search_multi_pv);
+    ADD_TEST(cb_search_limits);
+    ADD_TEST(cb_search_callback);
+#ifdef PCTHREADS_HAS_PTHREADS
+    ADD_TEST(cb_stop_search);
+#endif
+}
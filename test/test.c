@@ -10,27 +10,80 @@
 DEFINE_SUITE(ProtonChessMain);
 DEFINE_SUITE(Evaluation);
 DEFINE_SUITE(Movement);
+DEFINE_SUITE(Zobrist);
+DEFINE_SUITE(Pool);
+DEFINE_SUITE(Batch);
+DEFINE_SUITE(Counters);
+DEFINE_SUITE(Trace);
+DEFINE_SUITE(Explorer);
+DEFINE_SUITE(GameEncoding);
 DEFINE_SUITE(PCStrings);
 DEFINE_SUITE(PCMath);
 
 #ifdef FEN_EXTENSIONS
 DEFINE_SUITE(FENExtensions);
+DEFINE_SUITE(Legality);
+DEFINE_SUITE(History);
+DEFINE_SUITE(Search);
+DEFINE_SUITE(Notation);
+DEFINE_SUITE(PositionEncoding);
+DEFINE_SUITE(Concurrency);
+DEFINE_SUITE(Scheduler);
+DEFINE_SUITE(MateSolver);
 #endif
 
 #ifdef IMPORT_EXPORT_EXTENSIONS
+DEFINE_SUITE(IEExtensions);
+#endif
+
+#ifdef NNUE_EVALUATION
+DEFINE_SUITE(NNUE);
+#endif
+
+#ifdef TOOLS_TESTS
+DEFINE_SUITE(Tools);
 #endif
 
 int main()
 {
-    RUN_SUITE(ProtonChessMain);
-    RUN_SUITE(Evaluation);
-    RUN_SUITE(Movement);
-    RUN_SUITE(PCStrings);
-    RUN_SUITE(PCMath);
+    test_runner runner = {0};
+
+    RUN_SUITE(&runner, ProtonChessMain);
+    RUN_SUITE(&runner, Evaluation);
+    RUN_SUITE(&runner, Movement);
+    RUN_SUITE(&runner, Zobrist);
+    RUN_SUITE(&runner, Pool);
+    RUN_SUITE(&runner, Batch);
+    RUN_SUITE(&runner, Counters);
+    RUN_SUITE(&runner, Trace);
+    RUN_SUITE(&runner, Explorer);
+    RUN_SUITE(&runner, GameEncoding);
+    RUN_SUITE(&runner, PCStrings);
+    RUN_SUITE(&runner, PCMath);
 
 #ifdef FEN_EXTENSIONS
-    RUN_SUITE(FENExtensions);
+    RUN_SUITE(&runner, FENExtensions);
+    RUN_SUITE(&runner, Legality);
+    RUN_SUITE(&runner, History);
+    RUN_SUITE(&runner, Search);
+    RUN_SUITE(&runner, Notation);
+    RUN_SUITE(&runner, PositionEncoding);
+    RUN_SUITE(&runner, Concurrency);
+    RUN_SUITE(&runner, Scheduler);
+    RUN_SUITE(&runner, MateSolver);
+#endif
+
+#ifdef IMPORT_EXPORT_EXTENSIONS
+    RUN_SUITE(&runner, IEExtensions);
+#endif
+
+#ifdef NNUE_EVALUATION
+    RUN_SUITE(&runner, NNUE);
+#endif
+
+#ifdef TOOLS_TESTS
+    RUN_SUITE(&runner, Tools);
 #endif
 
-    return _has_error;
+    return runner.failed_tests != 0;
 }
\ No newline at end of file
@@ -0,0 +1,41 @@
+/**
+ * @file tools.test.c
+ * @author Nathan Seymour
+ * @brief Tests for the helpers shared by the proton-chess tools.
+ */
+
+#include "chess.h"
+#include "tools.h"
+#include "scpunitc.h"
+
+TEST(count_resign_ply)
+{
+    resign_counter counter;
+    int winner = -1;
+
+    reset_resign_counter(&counter);
+    for(unsigned int ply = 0; ply < 8 && winner == -1; ply++)
+    {
+        // Both engines think they are winning.
+        winner = count_resign_ply(&counter, 1500, ply % 2 == 0 ? WHITE : BLACK, 1000, 4);
+    }
+    ASSERT_EQ_MSG(winner, -1, "Disagreeing scores should not resign.");
+    ASSERT_EQ_MSG(counter.plies, 1, "A change of the favoured side should restart the run.");
+
+    reset_resign_counter(&counter);
+    ASSERT_EQ_MSG(count_resign_ply(&counter, 1200, WHITE, 1000, 4), -1, "A short run should not resign.");
+    ASSERT_EQ_MSG(count_resign_ply(&counter, -1100, BLACK, 1000, 4), -1, "A short run should not resign.");
+    ASSERT_EQ_MSG(count_resign_ply(&counter, 1300, WHITE, 1000, 4), -1, "A short run should not resign.");
+    ASSERT_EQ_MSG(count_resign_ply(&counter, -1000, BLACK, 1000, 4), WHITE, "Agreeing scores should resign for black.");
+
+    reset_resign_counter(&counter);
+    count_resign_ply(&counter, 1200, BLACK, 1000, 2);
+    count_resign_ply(&counter, 500, WHITE, 1000, 2);
+    ASSERT_EQ_MSG(count_resign_ply(&counter, -1200, WHITE, 1000, 2), -1, "A score within the threshold should end the run.");
+    ASSERT_EQ_MSG(count_resign_ply(&counter, 1200, BLACK, 1000, 2), BLACK, "Agreeing scores should resign for white.");
+}
+
+TEST_SUITE(Tools)
+{
+    ADD_TEST(count_resign_ply);
+}
@@ -0,0 +1,150 @@
+/**
+ * @file trace.test.c
+ * @author Nathan Seymour
+ * @brief Tests for the proton-chess search trace.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chess.h"
+#include "history.h"
+#include "transposition.h"
+#include "search.h"
+#include "trace.h"
+#include "pcthreads.h"
+#include "scpunitc.h"
+
+#define TRACE_PATH "trace.pctrace"
+#define RECORDED_EVENTS 100
+
+static void *record_events(void *argument)
+{
+    static cb_trace_event memory[64];
+
+    // Misaligned, so that 64 events no longer fit.
+    *(int*)argument = cb_trace_attach_thread((uchar*)memory + 1, sizeof(memory) - 1);
+
+    for(int i = 0; i < RECORDED_EVENTS; i++)
+    {
+        CB_TRACE(CB_TRACE_NODE, 1, 2, i, -i);
+    }
+
+    return NULL;
+}
+
+static void *search_traced(void *argument)
+{
+    cb_search_limits limits = {.depth = 3, .multi_pv = 1};
+    cb_transposition_table table;
+    cb_search_result result;
+    chess_board board;
+    cb_searcher *searcher = malloc(sizeof(cb_searcher));
+
+    (void)argument;
+
+    cb_initialize_game(&board);
+    cb_initialize_transposition_table(&table, 1 << 20);
+    cb_initialize_searcher(searcher, &table);
+    cb_search(searcher, &board, NULL, &limits, &result);
+
+    free(searcher);
+    cb_free_transposition_table(&table);
+
+    return NULL;
+}
+
+TEST(cb_trace_snapshot)
+{
+    static cb_trace_event events[RECORDED_EVENTS];
+    unsigned int thread_index = cb_trace_thread_count();
+    int attached = 0;
+    pcthread thread;
+
+    pcthread_create(&thread, record_events, &attached);
+    pcthread_join(&thread);
+
+#ifdef SEARCH_TRACE
+    size_t count = cb_trace_snapshot(thread_index, events, RECORDED_EVENTS);
+
+    ASSERT_TRUE_MSG(attached, "The buffer should be attached.");
+    ASSERT_EQ_MSG(count, 31, "The largest power of two of events should fit in the buffer, less the slot being written.");
+    ASSERT_EQ_MSG(events[0].values[0], RECORDED_EVENTS - 31, "The oldest events should be overwritten.");
+    ASSERT_EQ_MSG(events[30].values[1], -(RECORDED_EVENTS - 1), "The last event should be kept.");
+    ASSERT_TRUE_MSG(events[0].type == CB_TRACE_NODE && events[0].ply == 1 && events[0].argument == 2, "Events should be kept as recorded.");
+    ASSERT_TRUE_MSG(events[0].time_ns <= events[30].time_ns, "Events should be in order.");
+    ASSERT_EQ_MSG(cb_trace_snapshot(thread_index, events, 4), 4, "Only the last events should be copied.");
+    ASSERT_EQ_MSG(events[3].values[0], RECORDED_EVENTS - 1, "Only the last events should be copied.");
+#else
+    ASSERT_TRUE_MSG(!attached && cb_trace_thread_count() == 0 && cb_trace_snapshot(thread_index, events, RECORDED_EVENTS) == 0,
+                    "The trace should be compiled out.");
+#endif
+}
+
+TEST(cb_trace_dump)
+{
+#ifdef SEARCH_TRACE
+    unsigned int thread_index = cb_trace_thread_count();
+#endif
+    pcthread thread;
+
+    pcthread_create(&thread, search_traced, NULL);
+    pcthread_join(&thread);
+
+#ifdef SEARCH_TRACE
+    FILE *file;
+    char magic[8];
+    uint32_t header[2];
+    uint32_t block[2];
+    int found = 0;
+
+    ASSERT_TRUE_MSG(cb_trace_dump(TRACE_PATH), "The trace should be dumped.");
+
+    file = fopen(TRACE_PATH, "rb");
+    ASSERT_TRUE_MSG(file != NULL, "The dump should be written.");
+    ASSERT_TRUE_MSG(fread(magic, 1, 8, file) == 8 && memcmp(magic, "PCTRACE1", 8) == 0, "The dump should start with its magic.");
+    ASSERT_TRUE_MSG(fread(header, sizeof(uint32_t), 2, file) == 2 && header[1] == sizeof(cb_trace_event), "The dump should give the size of an event.");
+
+    while(fread(block, sizeof(uint32_t), 2, file) == 2)
+    {
+        cb_trace_event *events = malloc((block[1] + 1) * sizeof(cb_trace_event));
+        long depth = 0;
+        int ordered = 1;
+
+        ASSERT_TRUE_MSG(fread(events, sizeof(cb_trace_event), block[1], file) == block[1], "Blocks should hold their events.");
+
+        if(block[0] == thread_index)
+        {
+            ASSERT_TRUE_MSG(block[1] > 0 && events[0].type == CB_TRACE_SEARCH, "The trace should start with the search.");
+
+            for(uint32_t i = 0; i < block[1]; i++)
+            {
+                uchar type = events[i].type;
+
+                depth += type == CB_TRACE_ITERATION || type == CB_TRACE_NODE || type == CB_TRACE_QUIESCENCE;
+                depth -= type == CB_TRACE_EXIT;
+                ordered &= i == 0 || events[i - 1].time_ns <= events[i].time_ns;
+            }
+
+            found = 1;
+            ASSERT_EQ_MSG(depth, 0, "Every node entered should be exited.");
+            ASSERT_TRUE_MSG(ordered, "Events should be in order.");
+        }
+
+        free(events);
+    }
+
+    fclose(file);
+    remove(TRACE_PATH);
+
+    ASSERT_TRUE_MSG(found, "The search should be in the dump.");
+#else
+    ASSERT_TRUE_MSG(!cb_trace_dump(TRACE_PATH), "The trace should be compiled out.");
+#endif
+}
+
+TEST_SUITE(Trace)
+{
+    ADD_TEST(cb_trace_snapshot);
+    ADD_TEST(cb_trace_dump);
+}
@@ -0,0 +1,60 @@
+/**
+ * @file zobrist.test.c
+ * @author Nathan Seymour
+ * @brief Tests for proton-chess Zobrist hashing.
+ */
+
+#include "chess.h"
+#include "zobrist.h"
+#include "movement.h"
+#include "scpunitc.h"
+
+TEST(cb_zobrist_key)
+{
+    chess_board *board = cb_new_chess_board();
+    cb_initialize_game(board);
+
+    cb_hash_key initial_key = cb_zobrist_key(board);
+    ASSERT_TRUE_MSG(initial_key == cb_zobrist_key(board), "Hashing should be deterministic.");
+
+    board->move_counter++;
+    ASSERT_TRUE_MSG(cb_zobrist_key(board) == (initial_key ^ cb_zobrist_side_key()), "The side to move should be hashed.");
+    board->move_counter--;
+
+    board->castling_rights = CASTLE_RIGHTS_NONE;
+    ASSERT_TRUE_MSG(cb_zobrist_key(board) != initial_key, "Castling rights should be hashed.");
+
+    cb_free_chess_board(board);
+}
+
+TEST(cb_zobrist_pawn_key)
+{
+    chess_board *board = cb_new_chess_board();
+    cb_initialize_game(board);
+
+    cb_hash_key initial_pawn_key = cb_zobrist_pawn_key(board);
+
+    cb_move movement;
+    movement.from_square_index = cb_square_index(cb_file_id('G'), cb_rank_id(1));
+    movement.to_square_index = cb_square_index(cb_file_id('F'), cb_rank_id(3));
+    cb_perform_movement(board, &movement);
+
+    ASSERT_TRUE_MSG(cb_zobrist_pawn_key(board) == initial_pawn_key, "Piece moves should not change the pawn key.");
+
+    movement.from_square_index = cb_square_index(cb_file_id('E'), cb_rank_id(2));
+    movement.to_square_index = cb_square_index(cb_file_id('E'), cb_rank_id(4));
+    cb_perform_movement(board, &movement);
+
+    cb_hash_key expected_key = initial_pawn_key
+            ^ cb_zobrist_piece_key(WHITE | PAWN, movement.from_square_index)
+            ^ cb_zobrist_piece_key(WHITE | PAWN, movement.to_square_index);
+    ASSERT_TRUE_MSG(cb_zobrist_pawn_key(board) == expected_key, "Pawn keys should be incrementally updatable.");
+
+    cb_free_chess_board(board);
+}
+
+TEST_SUITE(Zobrist)
+{
+    ADD_TEST(cb_zobrist_key);
+    ADD_TEST(cb_zobrist_pawn_key);
+}
@@ -0,0 +1,684 @@
+/**
+ * @file analysis-server.c
+ * @author Nathan Seymour
+ * @brief Serves analysis requests as JSON lines, over stdin and stdout or
+ * a Unix socket, with an analysis scheduler.
+ *
+ * Usage: analysis-server [-t threads] [-m hash] [-q queue] [-u socket]
+ *
+ * Every line read is a request, a flat JSON object. Analysis requests hold
+ * a position and limits, all optional except the FEN, which must have all
+ * six fields:
+ *
+ *     {"id": "a1", "fen": "...", "depth": 12, "nodes": 0, "movetime": 500,
+ *      "deadline": 2000, "priority": 1, "multipv": 2, "threads": 2}
+ *
+ * movetime and deadline are in milliseconds, the deadline counting from
+ * when the request is read. Jobs are started by priority, then earliest
+ * deadline (see scheduler.h). Queued or running jobs are cancelled with:
+ *
+ *     {"id": "a1", "cmd": "cancel"}
+ *
+ * Each analysis ends with exactly one line, in the order the jobs end:
+ *
+ *     {"id":"a1","status":"done","depth":12,"nodes":81234,"time":498,
+ *      "lines":[{"score":31,"pv":["e2e4","e7e5"]},{"mate":-3,"pv":[...]}]}
+ *
+ * The status is done, cancelled (with the lines searched so far), expired
+ * (the deadline passed before a worker was free) or error, with a message
+ * in "error" for invalid requests and when the queue is full. Ids are
+ * echoed as strings.
+ *
+ * Reading from stdin, the server exits at the end of the input, once every
+ * job has ended. With -u, it listens on a Unix socket instead and serves
+ * every connection in its own thread, until killed. All jobs share the
+ * workers (one per core by default) and the transposition table (64MB by
+ * default).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chess.h"
+#include "notation.h"
+#include "transposition.h"
+#include "search.h"
+#include "scheduler.h"
+#include "pcthreads.h"
+#include "tools.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define HAS_UNIX_SOCKETS
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#define MAX_LINE_LENGTH 1024
+#define MAX_ID_LENGTH 64
+#define MAX_FIELD_LENGTH 128
+#define MAX_FEN_LENGTH 100
+#define MAX_CONNECTIONS 64
+
+struct job_context;
+
+/**
+ * A client: stdin and stdout, or a socket. Answers of concurrent jobs are
+ * written one line at a time under the lock.
+ */
+typedef struct {
+    FILE *input;
+    FILE *output;
+    pcthread_mutex lock;
+    pcthread_condition idle;
+    struct job_context *pending;
+    pcthread thread;
+    int finished;
+} connection;
+
+/**
+ * A job of a connection. Referenced by the reader of the connection until
+ * the job is submitted, and by the scheduler until it ends; freed by the
+ * last of them.
+ */
+typedef struct job_context {
+    connection *client;
+    char id[MAX_ID_LENGTH];
+    unsigned long job_id;
+    int references;
+    struct job_context *next;
+} job_context;
+
+static cb_scheduler scheduler;
+
+/*
+ * Find the value of a key in a flat JSON object. Strings are returned
+ * without their quotes, escapes untouched; other values up to the next
+ * separator.
+ */
+static int json_value(const char *line, const char *key, char *value, size_t size)
+{
+    size_t key_length = strlen(key);
+    const char *cursor = line;
+
+    while((cursor = strchr(cursor, '"')) != NULL)
+    {
+        const char *name = cursor + 1;
+        size_t length = 0;
+
+        cursor = name;
+        while(*cursor != '\0' && *cursor != '"')
+        {
+            cursor += *cursor == '\\' && cursor[1] != '\0' ? 2 : 1;
+        }
+        if(*cursor == '\0') return 0;
+
+        length = cursor - name;
+        cursor++;
+        while(*cursor == ' ' || *cursor == '\t') cursor++;
+
+        // A string value rather than a key, skip it.
+        if(*cursor != ':') continue;
+
+        cursor++;
+        while(*cursor == ' ' || *cursor == '\t') cursor++;
+
+        if(length != key_length || strncmp(name, key, key_length) != 0)
+        {
+            continue;
+        }
+
+        size_t written = 0;
+
+        if(*cursor == '"')
+        {
+            cursor++;
+            while(*cursor != '\0' && *cursor != '"' && written + 2 < size)
+            {
+                if(*cursor == '\\' && cursor[1] != '\0') value[written++] = *cursor++;
+                value[written++] = *cursor++;
+            }
+        }
+        else
+        {
+            while(*cursor != '\0' && strchr(",} \t\r\n", *cursor) == NULL && written + 1 < size)
+            {
+                value[written++] = *cursor++;
+            }
+        }
+
+        value[written] = '\0';
+        return 1;
+    }
+
+    return 0;
+}
+
+static unsigned long json_number(const char *line, const char *key)
+{
+    char value[MAX_FIELD_LENGTH];
+
+    return json_value(line, key, value, sizeof(value)) ? strtoul(value, NULL, 10) : 0;
+}
+
+static void write_result(FILE *output, const char *id, uchar status, const cb_search_result *result)
+{
+    static const char *status_names[] = {"done", "expired", "cancelled"};
+
+    fprintf(output, "{\"id\":\"%s\",\"status\":\"%s\",\"depth\":%u,\"nodes\":%lu,\"time\":%lu,\"lines\":[",
+            id, status_names[status], result->depth, result->nodes, result->time_ms);
+
+    for(uchar i = 0; i < result->line_count; i++)
+    {
+        const cb_principal_variation *line = &result->lines[i];
+        int score = line->score;
+
+        if(cb_is_mate_score(score))
+        {
+            int moves = score > 0 ? (CB_MATE_SCORE - score + 1) / 2 : -((CB_MATE_SCORE + score) / 2);
+            fprintf(output, "%s{\"mate\":%d,\"pv\":[", i > 0 ? "," : "", moves);
+        }
+        else
+        {
+            fprintf(output, "%s{\"score\":%d,\"pv\":[", i > 0 ? "," : "", score);
+        }
+
+        for(uchar j = 0; j < line->length; j++)
+        {
+            char move[6];
+
+            cb_move_to_uci(&line->moves[j], move);
+            fprintf(output, "%s\"%s\"", j > 0 ? "," : "", move);
+        }
+
+        fprintf(output, "]}");
+    }
+
+    fprintf(output, "]}\n");
+    fflush(output);
+}
+
+static void write_error(connection *client, const char *id, const char *error)
+{
+    pcthread_mutex_lock(&client->lock);
+    fprintf(client->output, "{\"id\":\"%s\",\"status\":\"error\",\"error\":\"%s\"}\n", id, error);
+    fflush(client->output);
+    pcthread_mutex_unlock(&client->lock);
+}
+
+/*
+ * Drop a reference to a job, unlinking and freeing it with the last one.
+ * Called with the lock of its connection held.
+ */
+static void release_job(job_context *context)
+{
+    connection *client = context->client;
+
+    if(--context->references > 0)
+    {
+        return;
+    }
+
+    for(job_context **link = &client->pending; *link != NULL; link = &(*link)->next)
+    {
+        if(*link == context)
+        {
+            *link = context->next;
+            break;
+        }
+    }
+
+    free(context);
+    pcthread_condition_broadcast(&client->idle);
+}
+
+static void job_ended(const cb_analysis_request *request, uchar status, const cb_search_result *result)
+{
+    job_context *context = request->user_data;
+    connection *client = context->client;
+
+    pcthread_mutex_lock(&client->lock);
+    write_result(client->output, context->id, status, result);
+    release_job(context);
+    pcthread_mutex_unlock(&client->lock);
+}
+
+/*
+ * Skip a run of digits, at least one and at most five.
+ */
+static const char *skip_number(const char *cursor)
+{
+    const char *begin = cursor;
+
+    while(*cursor >= '0' && *cursor <= '9' && cursor - begin < 5)
+    {
+        cursor++;
+    }
+
+    return cursor > begin ? cursor : NULL;
+}
+
+/*
+ * Whether a FEN has the shape cb_parse_fen expects, which reads it without
+ * any check: 8 ranks of 8 squares, the side to move, the castling rights,
+ * the en passant square and both move counters.
+ */
+static int is_valid_fen(const char *fen)
+{
+    const char *cursor = fen;
+    uchar ranks = 0;
+
+    if(strlen(fen) > MAX_FEN_LENGTH)
+    {
+        return 0;
+    }
+
+    while(ranks < 8)
+    {
+        uchar files = 0;
+
+        for(; *cursor != '\0' && *cursor != '/' && *cursor != ' '; cursor++)
+        {
+            if(*cursor >= '1' && *cursor <= '8')
+            {
+                files += (uchar)(*cursor - '0');
+            }
+            else if(strchr("pnbrqkPNBRQK", *cursor) != NULL)
+            {
+                files++;
+            }
+            else
+            {
+                return 0;
+            }
+
+            if(files > 8)
+            {
+                return 0;
+            }
+        }
+
+        if(files != 8 || *cursor != (++ranks < 8 ? '/' : ' '))
+        {
+            return 0;
+        }
+
+        cursor++;
+    }
+
+    if((*cursor != 'w' && *cursor != 'b') || cursor[1] != ' ')
+    {
+        return 0;
+    }
+
+    cursor += 2;
+
+    if(*cursor == '-')
+    {
+        cursor++;
+    }
+    else
+    {
+        const char *rights = cursor;
+
+        while(*cursor != '\0' && strchr("KQkq", *cursor) != NULL && cursor - rights < 4)
+        {
+            cursor++;
+        }
+
+        if(cursor == rights)
+        {
+            return 0;
+        }
+    }
+
+    if(*cursor++ != ' ')
+    {
+        return 0;
+    }
+
+    if(*cursor == '-')
+    {
+        cursor++;
+    }
+    else if(*cursor >= 'a' && *cursor <= 'h' && (cursor[1] == '3' || cursor[1] == '6'))
+    {
+        cursor += 2;
+    }
+    else
+    {
+        return 0;
+    }
+
+    if(*cursor++ != ' ' || (cursor = skip_number(cursor)) == NULL || *cursor++ != ' ' || (cursor = skip_number(cursor)) == NULL)
+    {
+        return 0;
+    }
+
+    return *cursor == '\0';
+}
+
+/*
+ * Whether a parsed position has a king of each color, which is as much as
+ * can be checked of the position itself.
+ */
+static int has_kings(chess_board *board)
+{
+    uchar white_kings = 0;
+    uchar black_kings = 0;
+
+    for(uchar square = 0; square < 64; square++)
+    {
+        uchar piece = cb_get_board_value_at_square_index(board, square);
+
+        white_kings += piece == (WHITE | KING);
+        black_kings += piece == (BLACK | KING);
+    }
+
+    return white_kings == 1 && black_kings == 1;
+}
+
+static void submit_request(connection *client, const char *line, const char *id)
+{
+    cb_analysis_request request;
+    char fen[MAX_FIELD_LENGTH];
+
+    memset(&request, 0, sizeof(cb_analysis_request));
+
+    if(!json_value(line, "fen", fen, sizeof(fen)))
+    {
+        write_error(client, id, "missing fen");
+        return;
+    }
+
+    if(!is_valid_fen(fen))
+    {
+        write_error(client, id, "invalid fen");
+        return;
+    }
+
+    cb_parse_fen(&request.board, fen);
+    if(!has_kings(&request.board))
+    {
+        write_error(client, id, "invalid fen");
+        return;
+    }
+
+    request.limits.depth = (uchar)json_number(line, "depth");
+    request.limits.nodes = json_number(line, "nodes");
+    request.limits.time_ms = json_number(line, "movetime");
+    request.limits.multi_pv = (uchar)json_number(line, "multipv");
+    request.deadline_ms = json_number(line, "deadline");
+    request.priority = (uchar)json_number(line, "priority");
+    request.threads = (uchar)json_number(line, "threads");
+
+    job_context *context = checked_malloc(sizeof(job_context));
+    context->client = client;
+    strcpy(context->id, id);
+    context->job_id = 0;
+    context->references = 2;
+    request.user_data = context;
+
+    pcthread_mutex_lock(&client->lock);
+    context->next = client->pending;
+    client->pending = context;
+    pcthread_mutex_unlock(&client->lock);
+
+    // The job may end before the submission returns, hence the references.
+    unsigned long job_id = cb_submit_analysis(&scheduler, &request);
+
+    pcthread_mutex_lock(&client->lock);
+    context->job_id = job_id;
+    if(job_id == 0)
+    {
+        context->references--;
+    }
+    release_job(context);
+    pcthread_mutex_unlock(&client->lock);
+
+    if(job_id == 0)
+    {
+        write_error(client, id, "queue full");
+    }
+}
+
+static void cancel_request(connection *client, const char *id)
+{
+    unsigned long job_ids[MAX_LINE_LENGTH];
+    size_t count = 0;
+
+    pcthread_mutex_lock(&client->lock);
+    for(job_context *context = client->pending; context != NULL && count < MAX_LINE_LENGTH; context = context->next)
+    {
+        if(strcmp(context->id, id) == 0 && context->job_id != 0)
+        {
+            job_ids[count++] = context->job_id;
+        }
+    }
+    pcthread_mutex_unlock(&client->lock);
+
+    for(size_t i = 0; i < count; i++)
+    {
+        cb_cancel_analysis(&scheduler, job_ids[i]);
+    }
+}
+
+/*
+ * Answer the requests of a client until the end of its input, then wait
+ * for its jobs to end.
+ */
+static void *serve_connection(void *argument)
+{
+    connection *client = argument;
+    char line[MAX_LINE_LENGTH];
+
+    while(fgets(line, sizeof(line), client->input) != NULL)
+    {
+        char id[MAX_ID_LENGTH] = "";
+        char command[MAX_FIELD_LENGTH] = "analyze";
+
+        if(strchr(line, '{') == NULL)
+        {
+            continue;
+        }
+
+        json_value(line, "id", id, sizeof(id));
+        json_value(line, "cmd", command, sizeof(command));
+
+        if(strcmp(command, "cancel") == 0)
+        {
+            cancel_request(client, id);
+        }
+        else if(strcmp(command, "analyze") == 0)
+        {
+            submit_request(client, line, id);
+        }
+        else
+        {
+            write_error(client, id, "unknown cmd");
+        }
+    }
+
+    pcthread_mutex_lock(&client->lock);
+    while(client->pending != NULL)
+    {
+        pcthread_condition_wait(&client->idle, &client->lock);
+    }
+    pcthread_mutex_unlock(&client->lock);
+
+    return NULL;
+}
+
+static void open_connection(connection *client, FILE *input, FILE *output)
+{
+    client->input = input;
+    client->output = output;
+    client->pending = NULL;
+    client->finished = 0;
+    pcthread_mutex_init(&client->lock);
+    pcthread_condition_init(&client->idle);
+}
+
+static void close_connection(connection *client)
+{
+    pcthread_condition_destroy(&client->idle);
+    pcthread_mutex_destroy(&client->lock);
+}
+
+#ifdef HAS_UNIX_SOCKETS
+/*
+ * Serve a socket client, closing the socket as soon as it is answered.
+ */
+static void *serve_socket_connection(void *argument)
+{
+    connection *client = argument;
+
+    serve_connection(client);
+    fclose(client->input);
+    fclose(client->output);
+    __atomic_store_n(&client->finished, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+static int serve_socket(const char *path)
+{
+    static connection connections[MAX_CONNECTIONS];
+    int used[MAX_CONNECTIONS] = {0};
+    struct sockaddr_un address;
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    unlink(path);
+
+    if(listener < 0 || bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 16) != 0)
+    {
+        fprintf(stderr, "Could not listen on %s.\n", path);
+        return 1;
+    }
+
+    fprintf(stderr, "Listening on %s.\n", path);
+
+    for(;;)
+    {
+        int descriptor = accept(listener, NULL, NULL);
+        int slot = -1;
+
+        if(descriptor < 0)
+        {
+            continue;
+        }
+
+        // Reap the connections that are done, and take the first free slot.
+        for(int i = 0; i < MAX_CONNECTIONS; i++)
+        {
+            if(used[i] && __atomic_load_n(&connections[i].finished, __ATOMIC_ACQUIRE))
+            {
+                pcthread_join(&connections[i].thread);
+                close_connection(&connections[i]);
+                used[i] = 0;
+            }
+
+            if(!used[i] && slot < 0)
+            {
+                slot = i;
+            }
+        }
+
+        if(slot < 0)
+        {
+            close(descriptor);
+            continue;
+        }
+
+        open_connection(&connections[slot], fdopen(descriptor, "r"), fdopen(dup(descriptor), "w"));
+        used[slot] = 1;
+
+        if(!pcthread_create(&connections[slot].thread, serve_socket_connection, &connections[slot]))
+        {
+            fclose(connections[slot].input);
+            fclose(connections[slot].output);
+            close_connection(&connections[slot]);
+            used[slot] = 0;
+        }
+    }
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    unsigned int thread_count = pcthread_hardware_concurrency();
+    size_t hash_size = (size_t)64 << 20;
+    size_t queue_capacity = 256;
+    const char *socket_path = NULL;
+    cb_transposition_table table;
+    int status = 0;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            thread_count = (unsigned int)atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+        {
+            hash_size = strtoul(argv[++i], NULL, 10) << 20;
+        }
+        else if(strcmp(argv[i], "-q") == 0 && i + 1 < argc)
+        {
+            queue_capacity = strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "-u") == 0 && i + 1 < argc)
+        {
+            socket_path = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [-t threads] [-m hash] [-q queue] [-u socket]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(thread_count == 0 || thread_count > CB_SCHEDULER_MAX_WORKERS)
+    {
+        thread_count = thread_count == 0 ? 1 : CB_SCHEDULER_MAX_WORKERS;
+    }
+
+    if(!cb_initialize_transposition_table(&table, hash_size))
+    {
+        fprintf(stderr, "Could not allocate the transposition table.\n");
+        return 1;
+    }
+
+    if(!cb_initialize_scheduler(&scheduler, &table, (uchar)thread_count, queue_capacity, job_ended))
+    {
+        fprintf(stderr, "Could not start the scheduler.\n");
+        cb_free_transposition_table(&table);
+        return 1;
+    }
+
+    if(socket_path != NULL)
+    {
+#ifdef HAS_UNIX_SOCKETS
+        status = serve_socket(socket_path);
+#else
+        fprintf(stderr, "Unix sockets are not available on this platform.\n");
+        status = 1;
+#endif
+    }
+    else
+    {
+        connection client;
+
+        open_connection(&client, stdin, stdout);
+        serve_connection(&client);
+        close_connection(&client);
+    }
+
+    cb_free_scheduler(&scheduler);
+    cb_free_transposition_table(&table);
+
+    return status;
+}
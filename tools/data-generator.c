@@ -0,0 +1,666 @@
+/**
+ * @file data-generator.c
+ * @author Nathan Seymour
+ * @brief Generates positions labeled with a search score and the game
+ * result, to train evaluations on.
+ *
+ * Usage: data-generator <output> [-n positions] [-t threads] [-d nodes] [-m hash]
+ *                       [-r random plies] [-s seed] [-i input] [-f]
+ *
+ * By default games are played against itself, from the initial position
+ * followed by a few random moves (8 by default), searching a fixed number
+ * of nodes per move (5000 by default), until the output holds the
+ * requested number of positions (1000000 by default). With -i, the
+ * positions of an earlier output are rescored instead, keeping their
+ * results.
+ *
+ * Positions in check, positions whose best move is a capture or a
+ * promotion, and mate scores are left out.
+ *
+ * The output is a sequence of blocks, one per game (or per rescored input
+ * block):
+ *
+ *     "PCTD", payload length (4 bytes), number of records (4 bytes),
+ *     checksum of the payload (4 bytes), unit index (8 bytes), payload
+ *
+ * Every number is little endian. A record is a dense position (see
+ * cb_encode_position), the score from the side to move (2 bytes) and the
+ * result (0 black wins, 1 draw, 2 white wins).
+ *
+ * Workers fill their own 1MB buffer, then claim the next range of the
+ * file with an atomic add and write the buffer there, without any lock.
+ * An interrupted run is resumed by running the same command again: the
+ * output is truncated after its last complete block and the units it is
+ * missing (at most a buffer per thread) are played again. Games only
+ * depend on the seed and their index, so they are the games an
+ * uninterrupted run would have played. -f starts over instead.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "chess.h"
+#include "history.h"
+#include "movement.h"
+#include "legality.h"
+#include "transposition.h"
+#include "search.h"
+#include "position_encoding.h"
+#include "pcmem.h"
+#include "pcthreads.h"
+#include "tools.h"
+
+#define MAX_THREADS 256
+
+#define BLOCK_MAGIC "PCTD"
+#define BLOCK_HEADER_SIZE 24
+#define RECORD_MAX_SIZE (CB_POSITION_MAX_SIZE + 3)
+#define BUFFER_SIZE (1 << 20)
+
+#define MAX_GAME_PLIES 400
+#define RESIGN_SCORE 1000
+#define RESIGN_PLIES 8
+
+#define RESULT_BLACK_WINS 0
+#define RESULT_DRAW 1
+#define RESULT_WHITE_WINS 2
+
+/**
+ * A block of an output file.
+ */
+typedef struct {
+    size_t offset;
+    uint32_t length;
+    uint32_t records;
+    uint64_t unit;
+} block_info;
+
+/**
+ * A generation run. Threads claim games or input blocks through next_unit,
+ * reserve their place in the output by moving file_end on, and count the
+ * positions and units written, all atomically.
+ */
+typedef struct {
+    int file;
+    uint64_t file_end;
+
+    unsigned long nodes;
+    size_t hash_size;
+    unsigned int random_plies;
+    uint64_t seed;
+    unsigned long target;
+
+    // Rescoring input, NULL when playing games.
+    const uchar *input;
+    const block_info *input_blocks;
+    size_t input_block_count;
+
+    // Units already in the output when resuming.
+    const uchar *done;
+    size_t done_count;
+
+    unsigned long next_unit;
+    unsigned long positions;
+    unsigned long units;
+    int failed;
+} generator;
+
+/**
+ * Records of the game being played, written once its result is known.
+ */
+typedef struct {
+    uchar data[RECORD_MAX_SIZE];
+    uchar length;
+} pending_record;
+
+typedef struct {
+    generator *state;
+    cb_searcher *searcher;
+    uchar *buffer;
+    size_t buffer_length;
+    pending_record records[MAX_GAME_PLIES];
+    unsigned int record_count;
+} worker;
+
+static void write_le(uchar *bytes, uint64_t value, uchar size)
+{
+    for(uchar i = 0; i < size; i++)
+    {
+        bytes[i] = (uchar)(value >> (8 * i));
+    }
+}
+
+static uint64_t read_le(const uchar *bytes, uchar size)
+{
+    uint64_t value = 0;
+
+    for(uchar i = 0; i < size; i++)
+    {
+        value |= (uint64_t)bytes[i] << (8 * i);
+    }
+
+    return value;
+}
+
+// FNV-1a, enough to catch blocks cut short or never written.
+static uint32_t checksum(const uchar *data, size_t length)
+{
+    uint32_t hash = 2166136261u;
+
+    for(size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+static uint64_t split_mix(uint64_t *state)
+{
+    uint64_t value = (*state += 0x9E3779B97F4A7C15ull);
+
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+
+    return value ^ (value >> 31);
+}
+
+/**
+ * List the complete blocks of a file, up to the first one that is cut
+ * short or corrupted.
+ * @return Number of bytes of complete blocks.
+ */
+static size_t scan_blocks(const uchar *data, size_t size, block_info **blocks, size_t *count)
+{
+    size_t offset = 0;
+    size_t capacity = 0;
+
+    *blocks = NULL;
+    *count = 0;
+
+    while(size - offset >= BLOCK_HEADER_SIZE && memcmp(data + offset, BLOCK_MAGIC, 4) == 0)
+    {
+        block_info block;
+
+        block.offset = offset;
+        block.length = (uint32_t)read_le(data + offset + 4, 4);
+        block.records = (uint32_t)read_le(data + offset + 8, 4);
+        block.unit = read_le(data + offset + 16, 8);
+
+        if(size - offset - BLOCK_HEADER_SIZE < block.length
+           || checksum(data + offset + BLOCK_HEADER_SIZE, block.length) != (uint32_t)read_le(data + offset + 12, 4))
+        {
+            break;
+        }
+
+        if(*count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 1024;
+            *blocks = checked_realloc(*blocks, capacity * sizeof(block_info));
+        }
+
+        (*blocks)[(*count)++] = block;
+        offset += BLOCK_HEADER_SIZE + block.length;
+    }
+
+    return offset;
+}
+
+/**
+ * Write the buffer of a worker at the end of the output.
+ */
+static void flush_buffer(worker *self)
+{
+    generator *state = self->state;
+    uint64_t offset;
+    size_t written = 0;
+
+    if(self->buffer_length == 0)
+    {
+        return;
+    }
+
+    offset = __atomic_fetch_add(&state->file_end, self->buffer_length, __ATOMIC_RELAXED);
+
+    while(written < self->buffer_length)
+    {
+        ssize_t result = pwrite(state->file, self->buffer + written, self->buffer_length - written, (off_t)(offset + written));
+
+        if(result <= 0)
+        {
+            fprintf(stderr, "Could not write the output.\n");
+            __atomic_store_n(&state->failed, 1, __ATOMIC_RELAXED);
+            break;
+        }
+
+        written += (size_t)result;
+    }
+
+    self->buffer_length = 0;
+}
+
+/**
+ * Append the pending records of a unit to the worker's buffer as a block.
+ * @param result Result of the game, or 0xFF to keep the result already
+ * stored in each record.
+ */
+static void emit_block(worker *self, uint64_t unit, uchar result)
+{
+    size_t length = 0;
+    uchar *block;
+
+    for(unsigned int i = 0; i < self->record_count; i++)
+    {
+        length += self->records[i].length;
+    }
+
+    if(self->buffer_length + BLOCK_HEADER_SIZE + length > BUFFER_SIZE)
+    {
+        flush_buffer(self);
+    }
+
+    block = self->buffer + self->buffer_length;
+    length = BLOCK_HEADER_SIZE;
+
+    for(unsigned int i = 0; i < self->record_count; i++)
+    {
+        pending_record *record = &self->records[i];
+
+        if(result != 0xFF)
+        {
+            record->data[record->length - 1] = result;
+        }
+
+        memcpy(block + length, record->data, record->length);
+        length += record->length;
+    }
+
+    memcpy(block, BLOCK_MAGIC, 4);
+    write_le(block + 4, length - BLOCK_HEADER_SIZE, 4);
+    write_le(block + 8, self->record_count, 4);
+    write_le(block + 12, checksum(block + BLOCK_HEADER_SIZE, length - BLOCK_HEADER_SIZE), 4);
+    write_le(block + 16, unit, 8);
+
+    self->buffer_length += length;
+    __atomic_fetch_add(&self->state->positions, self->record_count, __ATOMIC_RELAXED);
+    self->record_count = 0;
+}
+
+/**
+ * Search a position and keep it as a record, unless it is filtered out.
+ * @return The best move, with its score from the side to move.
+ */
+static cb_principal_variation *label_position(worker *self, chess_board *board, cb_position_history *history,
+                                              cb_search_result *result, uchar game_result)
+{
+    cb_search_limits limits = {.nodes = self->state->nodes, .multi_pv = 1};
+    pending_record *record;
+    cb_move *best;
+    int score;
+
+    cb_search(self->searcher, board, history, &limits, result);
+
+    if(result->line_count == 0 || result->lines[0].length == 0)
+    {
+        return NULL;
+    }
+
+    best = &result->lines[0].moves[0];
+    score = result->lines[0].score;
+
+    if(cb_is_in_check(board) || cb_is_mate_score(score) || cb_board_get(board, best->to_square_index) != EMPTY_SQUARE
+       || ((cb_board_get(board, best->from_square_index) & COLOR_MASK) == PAWN
+           && (best->to_square_index == board->ep_target_square_index || best->to_square_index < 8 || best->to_square_index >= 56)))
+    {
+        return &result->lines[0];
+    }
+
+    record = &self->records[self->record_count++];
+    record->length = cb_encode_position(board, record->data);
+    write_le(record->data + record->length, (uint16_t)(int16_t)score, 2);
+    record->data[record->length + 2] = game_result;
+    record->length += 3;
+
+    return &result->lines[0];
+}
+
+/**
+ * Neither side can mate: bare kings, or a single minor piece left.
+ */
+static int is_insufficient_material(chess_board *board)
+{
+    uchar minor_pieces = 0;
+
+    for(uchar square_index = 0; square_index < 64; square_index++)
+    {
+        uchar type = cb_board_get(board, square_index) & COLOR_MASK;
+
+        if(type == KNIGHT || type == BISHOP)
+        {
+            minor_pieces++;
+        }
+        else if(type != EMPTY_SQUARE && type != KING)
+        {
+            return 0;
+        }
+    }
+
+    return minor_pieces <= 1;
+}
+
+static void play_game(worker *self, uint64_t unit)
+{
+    chess_board board;
+    cb_position_history history;
+    cb_move_list moves;
+    cb_move_undo undo;
+    cb_search_result result;
+    uint64_t random = self->state->seed ^ (unit * 0xD1B54A32D192ED03ull);
+    uchar game_result = RESULT_DRAW;
+    resign_counter resign;
+
+    cb_initialize_game(&board);
+    reset_resign_counter(&resign);
+    cb_initialize_history(&history, &board);
+    cb_clear_transposition_table(self->searcher->table);
+
+    for(unsigned int ply = 0; ply < MAX_GAME_PLIES; ply++)
+    {
+        uchar color = board.move_counter % 2 == 0 ? WHITE : BLACK;
+        cb_principal_variation *line;
+
+        if(cb_generate_legal_moves(&board, &moves) == 0)
+        {
+            if(cb_is_in_check(&board))
+            {
+                game_result = color == WHITE ? RESULT_BLACK_WINS : RESULT_WHITE_WINS;
+            }
+            break;
+        }
+
+        if(board.halfmove_clock >= 100 || cb_count_repetitions(&history, &board) >= 2 || is_insufficient_material(&board))
+        {
+            break;
+        }
+
+        if(ply < self->state->random_plies)
+        {
+            cb_make_move(&board, &moves.moves[split_mix(&random) % moves.count], &undo, &history);
+            continue;
+        }
+
+        line = label_position(self, &board, &history, &result, RESULT_DRAW);
+
+        if(line == NULL)
+        {
+            break;
+        }
+
+        int winner = count_resign_ply(&resign, line->score, color, RESIGN_SCORE, RESIGN_PLIES);
+
+        if(winner != -1)
+        {
+            game_result = winner == WHITE ? RESULT_WHITE_WINS : RESULT_BLACK_WINS;
+            break;
+        }
+
+        cb_make_move(&board, &line->moves[0], &undo, &history);
+    }
+
+    emit_block(self, unit, game_result);
+}
+
+static void rescore_block(worker *self, const block_info *block)
+{
+    const uchar *data = self->state->input + block->offset + BLOCK_HEADER_SIZE;
+    const uchar *end = data + block->length;
+    cb_search_result result;
+
+    if(block->records > MAX_GAME_PLIES)
+    {
+        fprintf(stderr, "Input block %llu has too many records.\n", (unsigned long long)block->unit);
+        return;
+    }
+
+    cb_clear_transposition_table(self->searcher->table);
+
+    for(uint32_t i = 0; i < block->records; i++)
+    {
+        chess_board board;
+        uchar length = cb_decode_position(&board, data, (size_t)(end - data));
+
+        if(length == 0 || end - data < length + 3)
+        {
+            fprintf(stderr, "Invalid record in input block %llu.\n", (unsigned long long)block->unit);
+            break;
+        }
+
+        label_position(self, &board, NULL, &result, data[length + 2]);
+        data += length + 3;
+    }
+
+    emit_block(self, block->unit, 0xFF);
+}
+
+static void *run_worker(void *argument)
+{
+    worker *self = argument;
+    generator *state = self->state;
+    cb_transposition_table table;
+
+    if(!cb_initialize_transposition_table(&table, state->hash_size))
+    {
+        fprintf(stderr, "Could not allocate the transposition table.\n");
+        exit(1);
+    }
+
+    self->searcher = checked_malloc(sizeof(cb_searcher));
+    cb_initialize_searcher(self->searcher, &table);
+
+    while(!__atomic_load_n(&state->failed, __ATOMIC_RELAXED))
+    {
+        unsigned long unit = __atomic_fetch_add(&state->next_unit, 1, __ATOMIC_RELAXED);
+
+        if(state->input != NULL ? unit >= state->input_block_count : __atomic_load_n(&state->positions, __ATOMIC_RELAXED) >= state->target)
+        {
+            break;
+        }
+
+        if(unit < state->done_count && state->done[unit])
+        {
+            continue;
+        }
+
+        if(state->input != NULL)
+        {
+            rescore_block(self, &state->input_blocks[unit]);
+        }
+        else
+        {
+            play_game(self, unit);
+        }
+
+        if(__atomic_add_fetch(&state->units, 1, __ATOMIC_RELAXED) % 1000 == 0)
+        {
+            fprintf(stderr, "%lu units, %lu positions.\n", __atomic_load_n(&state->units, __ATOMIC_RELAXED),
+                    __atomic_load_n(&state->positions, __ATOMIC_RELAXED));
+        }
+    }
+
+    flush_buffer(self);
+
+    cb_free_transposition_table(&table);
+    free(self->searcher);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int thread_count = pcthread_hardware_concurrency();
+    const char *path = NULL;
+    const char *input_path = NULL;
+    int restart = 0;
+    generator state;
+    pcmem_file_mapping input;
+    pcmem_file_mapping existing;
+    block_info *blocks = NULL;
+    size_t block_count = 0;
+    block_info *input_blocks = NULL;
+    uchar *done = NULL;
+    size_t valid_end = 0;
+
+    memset(&state, 0, sizeof(generator));
+    state.nodes = 5000;
+    state.hash_size = 8 << 20;
+    state.random_plies = 8;
+    state.seed = 1;
+    state.target = 1000000;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            state.target = strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            thread_count = (unsigned int)atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+        {
+            state.nodes = strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+        {
+            state.hash_size = strtoul(argv[++i], NULL, 10) << 20;
+        }
+        else if(strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+        {
+            state.random_plies = (unsigned int)atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+        {
+            state.seed = strtoull(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+        {
+            input_path = argv[++i];
+        }
+        else if(strcmp(argv[i], "-f") == 0)
+        {
+            restart = 1;
+        }
+        else
+        {
+            path = argv[i];
+        }
+    }
+
+    if(path == NULL)
+    {
+        fprintf(stderr, "Usage: %s <output> [-n positions] [-t threads] [-d nodes] [-m hash] [-r random plies] [-s seed] [-i input] [-f]\n", argv[0]);
+        return 1;
+    }
+
+    if(thread_count < 1 || thread_count > MAX_THREADS)
+    {
+        thread_count = thread_count < 1 ? 1 : MAX_THREADS;
+    }
+
+    if(input_path != NULL)
+    {
+        if(!pcmem_map_file(&input, input_path))
+        {
+            fprintf(stderr, "Could not open %s.\n", input_path);
+            return 1;
+        }
+
+        scan_blocks(input.data, input.size, &input_blocks, &state.input_block_count);
+        state.input = input.data;
+        state.input_blocks = input_blocks;
+    }
+
+    // Resume: keep the complete blocks of an existing output.
+    if(!restart && pcmem_map_file(&existing, path))
+    {
+        valid_end = scan_blocks(existing.data, existing.size, &blocks, &block_count);
+
+        for(size_t i = 0; i < block_count; i++)
+        {
+            if(blocks[i].unit >= state.done_count)
+            {
+                state.done_count = (size_t)blocks[i].unit + 1;
+            }
+        }
+
+        done = calloc(state.done_count + 1, 1);
+
+        for(size_t i = 0; i < block_count; i++)
+        {
+            done[blocks[i].unit] = 1;
+            state.positions += blocks[i].records;
+        }
+
+        state.units = block_count;
+        pcmem_unmap_file(&existing);
+        free(blocks);
+
+        if(block_count > 0)
+        {
+            fprintf(stderr, "Resuming after %lu units and %lu positions.\n", state.units, state.positions);
+        }
+    }
+
+    state.done = done;
+    state.file = open(path, O_RDWR | O_CREAT | (restart ? O_TRUNC : 0), 0644);
+
+    if(state.file < 0 || ftruncate(state.file, (off_t)valid_end) != 0)
+    {
+        fprintf(stderr, "Could not open %s.\n", path);
+        return 1;
+    }
+
+    state.file_end = valid_end;
+
+    worker *workers = checked_malloc(thread_count * sizeof(worker));
+    pcthread threads[MAX_THREADS];
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for(unsigned int t = 0; t < thread_count; t++)
+    {
+        workers[t].state = &state;
+        workers[t].buffer = checked_malloc(BUFFER_SIZE);
+        workers[t].buffer_length = 0;
+        workers[t].record_count = 0;
+        pcthread_create(&threads[t], run_worker, &workers[t]);
+    }
+
+    for(unsigned int t = 0; t < thread_count; t++)
+    {
+        pcthread_join(&threads[t]);
+        free(workers[t].buffer);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    close(state.file);
+    free(workers);
+    free(done);
+
+    if(input_path != NULL)
+    {
+        free(input_blocks);
+        pcmem_unmap_file(&input);
+    }
+
+    fprintf(stderr, "Wrote %llu bytes in %.1fs.\n", (unsigned long long)state.file_end,
+            (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9);
+
+    return state.failed;
+}
@@ -0,0 +1,509 @@
+/**
+ * @file dedup-positions.c
+ * @author Nathan Seymour
+ * @brief Deduplicates positions by Zobrist key, for corpora larger than
+ * the memory available.
+ *
+ * Usage: dedup-positions <output> <inputs...> [-m megabytes] [-t threads] [-f]
+ *
+ * Inputs are files of '.pcgpf' records written one after the other (see
+ * cb_write_board_record), or position databases ('.pcpdb' extension) whose
+ * counts are added up. With -f, inputs are text files with a FEN per line.
+ *
+ * The output is a position database: one entry per Zobrist key, sorted by
+ * key, with the number of times the position occurred in the inputs.
+ *
+ * Positions are read into as many buffers as threads, splitting the memory
+ * budget (256MB by default) between them. Full buffers are sorted by key
+ * and collapsed in parallel, then spilled to disk as sorted runs next to
+ * the output. The runs are finally k-way merged into the output, in several
+ * passes when there are too many of them to be opened at once.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chess.h"
+#include "zobrist.h"
+#include "pcthreads.h"
+#include "tools.h"
+
+#define MAX_LINE_LENGTH 256
+#define MAX_THREADS 256
+#define MAX_PATH_LENGTH 1024
+
+/**
+ * Most runs merged at once, to stay well below the limit of open files.
+ */
+#define MAX_MERGE_FAN_IN 64
+
+typedef struct {
+    cb_hash_key key;
+    uint32_t count;
+    chess_board board;
+} position_entry;
+
+/**
+ * Reads the positions of all the inputs, in order.
+ */
+typedef struct {
+    char **paths;
+    int path_count;
+    int path_index;
+    FILE *file;
+    int fen_input;
+    int database_input;
+} position_reader;
+
+/**
+ * Positions read in memory, to be sorted and written as a run.
+ */
+typedef struct {
+    position_entry *entries;
+    size_t count;
+    size_t capacity;
+    char path[MAX_PATH_LENGTH];
+    int failed;
+} run_buffer;
+
+/**
+ * A run being merged, with its smallest position not merged yet.
+ */
+typedef struct {
+    FILE *file;
+    char *buffer;
+    position_entry entry;
+} run_cursor;
+
+static const char *output_path;
+static unsigned int run_counter;
+
+static int has_extension(const char *path, const char *extension)
+{
+    size_t path_length = strlen(path);
+    size_t extension_length = strlen(extension);
+
+    return path_length >= extension_length && strcmp(path + path_length - extension_length, extension) == 0;
+}
+
+static void next_run_path(char path[MAX_PATH_LENGTH])
+{
+    snprintf(path, MAX_PATH_LENGTH, "%s.%u.run", output_path, run_counter++);
+}
+
+/**
+ * @return 1 if a position was read, 0 once every input was read.
+ */
+static int read_position(position_reader *reader, position_entry *entry)
+{
+    while(1)
+    {
+        if(reader->file == NULL)
+        {
+            if(reader->path_index == reader->path_count)
+            {
+                return 0;
+            }
+
+            const char *path = reader->paths[reader->path_index++];
+            reader->database_input = has_extension(path, ".pcpdb");
+            reader->file = fopen(path, reader->fen_input ? "r" : "rb");
+
+            if(reader->file == NULL)
+            {
+                fprintf(stderr, "Could not open %s, skipped.\n", path);
+                continue;
+            }
+        }
+
+#ifdef FEN_EXTENSIONS
+        if(reader->fen_input)
+        {
+            char line[MAX_LINE_LENGTH];
+
+            if(fgets(line, sizeof(line), reader->file) != NULL)
+            {
+                if(line[0] == '\n' || line[0] == '\0')
+                {
+                    continue;
+                }
+
+                cb_parse_fen(&entry->board, line);
+                entry->key = cb_zobrist_key(&entry->board);
+                entry->count = 1;
+                return 1;
+            }
+        }
+        else
+#endif
+        if(reader->database_input)
+        {
+            if(cb_read_position_entry(reader->file, &entry->key, &entry->board, &entry->count))
+            {
+                return 1;
+            }
+        }
+        else if(cb_read_board_record(reader->file, &entry->board))
+        {
+            entry->key = cb_zobrist_key(&entry->board);
+            entry->count = 1;
+            return 1;
+        }
+
+        fclose(reader->file);
+        reader->file = NULL;
+    }
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    cb_hash_key key_a = ((const position_entry *)a)->key;
+    cb_hash_key key_b = ((const position_entry *)b)->key;
+
+    return key_a < key_b ? -1 : key_a > key_b;
+}
+
+static uint32_t add_counts(uint32_t a, uint32_t b)
+{
+    return a > UINT32_MAX - b ? UINT32_MAX : a + b;
+}
+
+/**
+ * Sort a buffer, collapse its duplicates and write it as a run.
+ */
+static void *write_run(void *argument)
+{
+    run_buffer *run = argument;
+    FILE *file = fopen(run->path, "wb");
+    size_t unique = 0;
+
+    run->failed = file == NULL;
+    if(run->failed)
+    {
+        return NULL;
+    }
+
+    qsort(run->entries, run->count, sizeof(position_entry), compare_entries);
+
+    for(size_t i = 1; i < run->count; i++)
+    {
+        if(run->entries[i].key == run->entries[unique].key)
+        {
+            run->entries[unique].count = add_counts(run->entries[unique].count, run->entries[i].count);
+        }
+        else
+        {
+            run->entries[++unique] = run->entries[i];
+        }
+    }
+
+    for(size_t i = 0; i <= unique; i++)
+    {
+        position_entry *entry = &run->entries[i];
+
+        if(!cb_write_position_entry(file, entry->key, &entry->board, entry->count))
+        {
+            run->failed = 1;
+            break;
+        }
+    }
+
+    run->failed |= fclose(file) != 0;
+
+    return NULL;
+}
+
+static void sift_down(run_cursor **heap, size_t size, size_t index)
+{
+    while(1)
+    {
+        size_t smallest = index;
+        size_t left = index * 2 + 1;
+        size_t right = left + 1;
+
+        if(left < size && heap[left]->entry.key < heap[smallest]->entry.key) smallest = left;
+        if(right < size && heap[right]->entry.key < heap[smallest]->entry.key) smallest = right;
+
+        if(smallest == index)
+        {
+            return;
+        }
+
+        run_cursor *cursor = heap[index];
+        heap[index] = heap[smallest];
+        heap[smallest] = cursor;
+        index = smallest;
+    }
+}
+
+/**
+ * Merge sorted runs into a single one, adding up the counts of the
+ * positions found in several runs. The runs are deleted.
+ * @return The number of unique positions written, or (size_t)-1 on failure.
+ */
+static size_t merge_runs(char **paths, size_t path_count, const char *destination, size_t memory_budget)
+{
+    run_cursor *cursors = checked_malloc((path_count + 1) * sizeof(run_cursor));
+    run_cursor **heap = checked_malloc((path_count + 1) * sizeof(run_cursor *));
+    size_t buffer_size = memory_budget / (path_count + 1);
+    size_t heap_size = 0;
+    size_t unique = 0;
+    FILE *output = fopen(destination, "wb");
+    int failed = output == NULL;
+
+    if(buffer_size < 4096) buffer_size = 4096;
+    if(buffer_size > (1 << 20)) buffer_size = 1 << 20;
+
+    for(size_t i = 0; i < path_count; i++)
+    {
+        run_cursor *cursor = &cursors[i];
+
+        cursor->file = fopen(paths[i], "rb");
+        cursor->buffer = NULL;
+
+        if(cursor->file == NULL)
+        {
+            failed = 1;
+            continue;
+        }
+
+        cursor->buffer = checked_malloc(buffer_size);
+        setvbuf(cursor->file, cursor->buffer, _IOFBF, buffer_size);
+
+        if(cb_read_position_entry(cursor->file, &cursor->entry.key, &cursor->entry.board, &cursor->entry.count))
+        {
+            heap[heap_size++] = cursor;
+        }
+    }
+
+    for(size_t i = heap_size; i-- > 0;)
+    {
+        sift_down(heap, heap_size, i);
+    }
+
+    while(heap_size > 0 && !failed)
+    {
+        position_entry entry = heap[0]->entry;
+        entry.count = 0;
+
+        // Pull every copy of the position, from all the runs.
+        while(heap_size > 0 && heap[0]->entry.key == entry.key)
+        {
+            run_cursor *cursor = heap[0];
+            entry.count = add_counts(entry.count, cursor->entry.count);
+
+            if(!cb_read_position_entry(cursor->file, &cursor->entry.key, &cursor->entry.board, &cursor->entry.count))
+            {
+                heap[0] = heap[--heap_size];
+            }
+
+            sift_down(heap, heap_size, 0);
+        }
+
+        failed = !cb_write_position_entry(output, entry.key, &entry.board, entry.count);
+        unique++;
+    }
+
+    for(size_t i = 0; i < path_count; i++)
+    {
+        if(cursors[i].file != NULL)
+        {
+            fclose(cursors[i].file);
+        }
+
+        free(cursors[i].buffer);
+        remove(paths[i]);
+    }
+
+    if(output != NULL)
+    {
+        failed |= fclose(output) != 0;
+    }
+
+    free(cursors);
+    free(heap);
+
+    return failed ? (size_t)-1 : unique;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int thread_count = pcthread_hardware_concurrency();
+    size_t memory_budget = (size_t)256 << 20;
+    position_reader reader;
+    char **inputs = checked_malloc(argc * sizeof(char *));
+    int input_count = 0;
+
+    memset(&reader, 0, sizeof(position_reader));
+    output_path = NULL;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+        {
+            memory_budget = (size_t)strtoul(argv[++i], NULL, 10) << 20;
+        }
+        else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            thread_count = (unsigned int)atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-f") == 0)
+        {
+            reader.fen_input = 1;
+        }
+        else if(output_path == NULL)
+        {
+            output_path = argv[i];
+        }
+        else
+        {
+            inputs[input_count++] = argv[i];
+        }
+    }
+
+    if(output_path == NULL || input_count == 0)
+    {
+        fprintf(stderr, "Usage: %s <output> <inputs...> [-m megabytes] [-t threads] [-f]\n", argv[0]);
+        return 1;
+    }
+
+#ifndef FEN_EXTENSIONS
+    if(reader.fen_input)
+    {
+        fprintf(stderr, "FEN inputs require the FEN extensions.\n");
+        return 1;
+    }
+#endif
+
+    if(thread_count < 1 || thread_count > MAX_THREADS)
+    {
+        thread_count = thread_count < 1 ? 1 : MAX_THREADS;
+    }
+
+    reader.paths = inputs;
+    reader.path_count = input_count;
+
+    run_buffer *runs = checked_malloc(thread_count * sizeof(run_buffer));
+    size_t run_capacity = memory_budget / thread_count / sizeof(position_entry);
+    if(run_capacity < 1024) run_capacity = 1024;
+
+    for(unsigned int t = 0; t < thread_count; t++)
+    {
+        runs[t].entries = checked_malloc(run_capacity * sizeof(position_entry));
+        runs[t].capacity = run_capacity;
+    }
+
+    char **run_paths = NULL;
+    size_t run_path_count = 0;
+    size_t run_path_capacity = 0;
+    unsigned long positions = 0;
+    int done = 0;
+
+    // Fill every buffer, then sort and spill them all in parallel.
+    while(!done)
+    {
+        pcthread threads[MAX_THREADS];
+        unsigned int started = 0;
+
+        for(unsigned int t = 0; t < thread_count && !done; t++)
+        {
+            run_buffer *run = &runs[t];
+            run->count = 0;
+
+            while(run->count < run->capacity)
+            {
+                if(!read_position(&reader, &run->entries[run->count]))
+                {
+                    done = 1;
+                    break;
+                }
+
+                run->count++;
+            }
+
+            if(run->count == 0)
+            {
+                break;
+            }
+
+            positions += run->count;
+            next_run_path(run->path);
+            pcthread_create(&threads[t], write_run, run);
+            started++;
+        }
+
+        for(unsigned int t = 0; t < started; t++)
+        {
+            pcthread_join(&threads[t]);
+
+            if(runs[t].failed)
+            {
+                fprintf(stderr, "Could not write the run %s.\n", runs[t].path);
+                return 1;
+            }
+
+            if(run_path_count == run_path_capacity)
+            {
+                run_path_capacity = run_path_capacity ? run_path_capacity * 2 : 64;
+                run_paths = realloc(run_paths, run_path_capacity * sizeof(char *));
+            }
+
+            run_paths[run_path_count] = checked_malloc(MAX_PATH_LENGTH);
+            strcpy(run_paths[run_path_count++], runs[t].path);
+        }
+    }
+
+    for(unsigned int t = 0; t < thread_count; t++)
+    {
+        free(runs[t].entries);
+    }
+    free(runs);
+
+    fprintf(stderr, "Read %lu positions into %zu runs.\n", positions, run_path_count);
+
+    // Merge the oldest runs together until they can all be merged at once.
+    size_t first_run = 0;
+    while(run_path_count - first_run > MAX_MERGE_FAN_IN)
+    {
+        char *merged_path = checked_malloc(MAX_PATH_LENGTH);
+        next_run_path(merged_path);
+
+        if(merge_runs(run_paths + first_run, MAX_MERGE_FAN_IN, merged_path, memory_budget) == (size_t)-1)
+        {
+            fprintf(stderr, "Could not merge the runs into %s.\n", merged_path);
+            return 1;
+        }
+
+        for(size_t i = first_run; i < first_run + MAX_MERGE_FAN_IN; i++)
+        {
+            free(run_paths[i]);
+        }
+        first_run += MAX_MERGE_FAN_IN;
+
+        if(run_path_count == run_path_capacity)
+        {
+            run_path_capacity *= 2;
+            run_paths = realloc(run_paths, run_path_capacity * sizeof(char *));
+        }
+        run_paths[run_path_count++] = merged_path;
+    }
+
+    size_t unique = merge_runs(run_paths + first_run, run_path_count - first_run, output_path, memory_budget);
+
+    for(size_t i = first_run; i < run_path_count; i++)
+    {
+        free(run_paths[i]);
+    }
+    free(run_paths);
+    free(inputs);
+
+    if(unique == (size_t)-1)
+    {
+        fprintf(stderr, "Could not write %s.\n", output_path);
+        return 1;
+    }
+
+    fprintf(stderr, "Wrote %zu unique positions to %s.\n", unique, output_path);
+
+    return 0;
+}
@@ -0,0 +1,498 @@
+/**
+ * @file explorer-builder.c
+ * @author Nathan Seymour
+ * @brief Builds an opening explorer index from PGN files.
+ *
+ * Usage: explorer-builder <output> <pgn files...> [-t threads] [-p plies]
+ *
+ * Every game is replayed up to the given number of plies (40 by default).
+ * Each position reached and the move played from it are counted with the
+ * result of the game and the average rating of its players ("WhiteElo" and
+ * "BlackElo" tags). Games without a result, or with a move that cannot be
+ * read, are skipped from that move on.
+ *
+ * Games are split between the threads, each one aggregating its share in a
+ * table sorted by position and move. The tables are then merged into the
+ * index, queried with cb_explorer_query.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chess.h"
+#include "zobrist.h"
+#include "movement.h"
+#include "notation.h"
+#include "explorer.h"
+#include "pcmem.h"
+#include "pcthreads.h"
+#include "tools.h"
+
+#define MAX_THREADS 256
+#define MAX_TOKEN_LENGTH 64
+#define AGGREGATION_THRESHOLD (1 << 22)
+
+#define RESULT_WHITE_WINS 0
+#define RESULT_DRAW 1
+#define RESULT_BLACK_WINS 2
+#define RESULT_UNKNOWN 3
+
+typedef struct {
+    const char *begin;
+    const char *end;
+} game_text;
+
+/**
+ * Work of one thread: a range of games, aggregated into sorted entries.
+ */
+typedef struct {
+    const game_text *games;
+    size_t begin;
+    size_t end;
+    unsigned int max_plies;
+
+    cb_explorer_entry *entries;
+    size_t count;
+    size_t capacity;
+    unsigned long skipped_moves;
+} build_slice;
+
+/**
+ * Split PGN text into games, each starting at a tag section.
+ */
+static void split_games(const char *text, size_t size, game_text **games, size_t *count, size_t *capacity)
+{
+    const char *end = text + size;
+    const char *game_begin = NULL;
+    int in_moves = 0;
+
+    for(const char *line = text; line < end;)
+    {
+        const char *line_end = memchr(line, '\n', end - line);
+        if(line_end == NULL) line_end = end;
+
+        if(line[0] == '[' && (game_begin == NULL || in_moves))
+        {
+            if(game_begin != NULL)
+            {
+                if(*count == *capacity)
+                {
+                    *capacity = *capacity ? *capacity * 2 : 1024;
+                    *games = checked_realloc(*games, *capacity * sizeof(game_text));
+                }
+
+                (*games)[(*count)++] = (game_text){game_begin, line};
+            }
+
+            game_begin = line;
+            in_moves = 0;
+        }
+        else if(line[0] != '[' && line[0] != '\n' && line[0] != '\r' && game_begin != NULL)
+        {
+            in_moves = 1;
+        }
+
+        line = line_end + 1;
+    }
+
+    if(game_begin != NULL)
+    {
+        if(*count == *capacity)
+        {
+            *capacity = *capacity ? *capacity * 2 : 1024;
+            *games = checked_realloc(*games, *capacity * sizeof(game_text));
+        }
+
+        (*games)[(*count)++] = (game_text){game_begin, end};
+    }
+}
+
+/**
+ * Value of a tag of the game, Ex: "1-0" for the tag Result.
+ * @return 1 if the tag was found.
+ */
+static int read_tag(const game_text *game, const char *name, char *value, size_t value_size)
+{
+    size_t name_length = strlen(name);
+
+    for(const char *line = game->begin; line < game->end && *line == '[';)
+    {
+        const char *line_end = memchr(line, '\n', game->end - line);
+        if(line_end == NULL) line_end = game->end;
+
+        if((size_t)(line_end - line) > name_length + 2 && strncmp(line + 1, name, name_length) == 0 && line[name_length + 1] == ' ')
+        {
+            const char *quote = memchr(line, '"', line_end - line);
+            const char *closing_quote = quote != NULL ? memchr(quote + 1, '"', line_end - quote - 1) : NULL;
+
+            if(closing_quote != NULL && (size_t)(closing_quote - quote - 1) < value_size)
+            {
+                memcpy(value, quote + 1, closing_quote - quote - 1);
+                value[closing_quote - quote - 1] = '\0';
+                return 1;
+            }
+        }
+
+        line = line_end + 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Next move of the movetext, skipping move numbers, comments, variations,
+ * numeric annotations and the result.
+ * @return 1 if a move was read, 0 at the end of the game.
+ */
+static int next_move_token(const char **cursor, const char *end, char token[MAX_TOKEN_LENGTH])
+{
+    const char *text = *cursor;
+    int variation_depth = 0;
+
+    while(text < end)
+    {
+        char c = *text;
+
+        if(c == '{')
+        {
+            const char *closing = memchr(text, '}', end - text);
+            text = closing != NULL ? closing + 1 : end;
+        }
+        else if(c == ';')
+        {
+            const char *line_end = memchr(text, '\n', end - text);
+            text = line_end != NULL ? line_end + 1 : end;
+        }
+        else if(c == '(')
+        {
+            variation_depth++;
+            text++;
+        }
+        else if(c == ')')
+        {
+            variation_depth -= variation_depth > 0;
+            text++;
+        }
+        else if(c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '.' || variation_depth > 0)
+        {
+            text++;
+        }
+        else
+        {
+            size_t length = 0;
+            size_t digits = 0;
+
+            // Move numbers, also when written against the move ("1.e4").
+            while(text + digits < end && text[digits] >= '0' && text[digits] <= '9')
+            {
+                digits++;
+            }
+
+            if(digits > 0 && text + digits < end && text[digits] == '.')
+            {
+                text += digits;
+                continue;
+            }
+
+            while(text + length < end && strchr(" \t\r\n{}();", text[length]) == NULL)
+            {
+                length++;
+            }
+
+            const char *word = text;
+            text += length;
+
+            // Numeric annotations and results. Castling may be written with zeros.
+            if(word[0] == '$' || word[0] == '*' || (digits > 0 && strncmp(word, "0-0", length < 3 ? length : 3) != 0))
+            {
+                continue;
+            }
+
+            if(length >= MAX_TOKEN_LENGTH) length = MAX_TOKEN_LENGTH - 1;
+            memcpy(token, word, length);
+            token[length] = '\0';
+
+            *cursor = text;
+            return 1;
+        }
+    }
+
+    *cursor = end;
+    return 0;
+}
+
+static void add_entry(build_slice *slice, cb_hash_key key, cb_move *move, uchar result, uint32_t rating)
+{
+    if(slice->count == slice->capacity)
+    {
+        slice->capacity = slice->capacity ? slice->capacity * 2 : 65536;
+        slice->entries = checked_realloc(slice->entries, slice->capacity * sizeof(cb_explorer_entry));
+    }
+
+    cb_explorer_entry *entry = &slice->entries[slice->count++];
+    memset(entry, 0, sizeof(cb_explorer_entry));
+
+    entry->key = key;
+    entry->from_square_index = move->from_square_index;
+    entry->to_square_index = move->to_square_index;
+    entry->promotion_piece = move->promotion_piece & COLOR_MASK;
+    entry->white_wins = result == RESULT_WHITE_WINS;
+    entry->draws = result == RESULT_DRAW;
+    entry->black_wins = result == RESULT_BLACK_WINS;
+    entry->rated_games = rating != 0;
+    entry->rating_sum = rating;
+}
+
+static int compare_moves(const void *a, const void *b)
+{
+    const cb_explorer_entry *entry_a = a;
+    const cb_explorer_entry *entry_b = b;
+
+    if(entry_a->key != entry_b->key) return entry_a->key < entry_b->key ? -1 : 1;
+    if(entry_a->from_square_index != entry_b->from_square_index) return entry_a->from_square_index - entry_b->from_square_index;
+    if(entry_a->to_square_index != entry_b->to_square_index) return entry_a->to_square_index - entry_b->to_square_index;
+    return entry_a->promotion_piece - entry_b->promotion_piece;
+}
+
+static int compare_popularity(const void *a, const void *b)
+{
+    const cb_explorer_entry *entry_a = a;
+    const cb_explorer_entry *entry_b = b;
+    uint32_t games_a = cb_explorer_entry_games(entry_a);
+    uint32_t games_b = cb_explorer_entry_games(entry_b);
+
+    if(entry_a->key != entry_b->key) return entry_a->key < entry_b->key ? -1 : 1;
+    if(games_a != games_b) return games_a > games_b ? -1 : 1;
+    return compare_moves(a, b);
+}
+
+/**
+ * Sort entries by position and move, adding up the entries of the same move.
+ * @return The number of entries left.
+ */
+static size_t aggregate_entries(cb_explorer_entry *entries, size_t count)
+{
+    size_t unique = 0;
+
+    if(count == 0)
+    {
+        return 0;
+    }
+
+    qsort(entries, count, sizeof(cb_explorer_entry), compare_moves);
+
+    for(size_t i = 1; i < count; i++)
+    {
+        cb_explorer_entry *last = &entries[unique];
+
+        if(compare_moves(last, &entries[i]) == 0)
+        {
+            last->white_wins += entries[i].white_wins;
+            last->draws += entries[i].draws;
+            last->black_wins += entries[i].black_wins;
+            last->rated_games += entries[i].rated_games;
+            last->rating_sum += entries[i].rating_sum;
+        }
+        else
+        {
+            entries[++unique] = entries[i];
+        }
+    }
+
+    return unique + 1;
+}
+
+static void replay_game(build_slice *slice, const game_text *game)
+{
+    chess_board board;
+    char value[128];
+    char token[MAX_TOKEN_LENGTH];
+    uchar result = RESULT_UNKNOWN;
+    uint32_t rating = 0;
+
+    if(read_tag(game, "Result", value, sizeof(value)))
+    {
+        if(strcmp(value, "1-0") == 0) result = RESULT_WHITE_WINS;
+        else if(strcmp(value, "0-1") == 0) result = RESULT_BLACK_WINS;
+        else if(strcmp(value, "1/2-1/2") == 0) result = RESULT_DRAW;
+    }
+
+    if(result == RESULT_UNKNOWN)
+    {
+        return;
+    }
+
+    uint32_t white_rating = read_tag(game, "WhiteElo", value, sizeof(value)) ? (uint32_t)strtoul(value, NULL, 10) : 0;
+    uint32_t black_rating = read_tag(game, "BlackElo", value, sizeof(value)) ? (uint32_t)strtoul(value, NULL, 10) : 0;
+    if(white_rating != 0 && black_rating != 0)
+    {
+        rating = (white_rating + black_rating) / 2;
+    }
+
+    cb_initialize_game(&board);
+
+#ifdef FEN_EXTENSIONS
+    if(read_tag(game, "FEN", value, sizeof(value)))
+    {
+        cb_parse_fen(&board, value);
+    }
+#endif
+
+    // Skip the tag section.
+    const char *cursor = game->begin;
+    while(cursor < game->end && *cursor == '[')
+    {
+        const char *line_end = memchr(cursor, '\n', game->end - cursor);
+        cursor = line_end != NULL ? line_end + 1 : game->end;
+    }
+
+    for(unsigned int ply = 0; ply < slice->max_plies && next_move_token(&cursor, game->end, token); ply++)
+    {
+        cb_move move;
+        cb_move_undo undo;
+
+        if(!cb_parse_notation(&board, token, &move))
+        {
+            slice->skipped_moves++;
+            return;
+        }
+
+        add_entry(slice, cb_zobrist_key(&board), &move, result, rating);
+        cb_make_move(&board, &move, &undo, NULL);
+    }
+}
+
+/*
+ * Entries are aggregated as the games are replayed, so that memory follows
+ * the number of unique moves. Each aggregation waits for twice as many
+ * entries as were left by the previous one, keeping the total cost of the
+ * sorts amortised O(n log n) however many unique moves there are.
+ */
+static void *build_slice_entries(void *argument)
+{
+    build_slice *slice = argument;
+    size_t threshold = AGGREGATION_THRESHOLD;
+
+    for(size_t i = slice->begin; i < slice->end; i++)
+    {
+        replay_game(slice, &slice->games[i]);
+
+        if(slice->count > threshold)
+        {
+            slice->count = aggregate_entries(slice->entries, slice->count);
+            threshold = slice->count * 2 > AGGREGATION_THRESHOLD ? slice->count * 2 : AGGREGATION_THRESHOLD;
+        }
+    }
+
+    slice->count = aggregate_entries(slice->entries, slice->count);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int thread_count = pcthread_hardware_concurrency();
+    unsigned int max_plies = 40;
+    const char *output_path = NULL;
+    pcmem_file_mapping *mappings = malloc(argc * sizeof(pcmem_file_mapping));
+    int mapping_count = 0;
+    game_text *games = NULL;
+    size_t game_count = 0;
+    size_t game_capacity = 0;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            thread_count = (unsigned int)atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+        {
+            max_plies = (unsigned int)atoi(argv[++i]);
+        }
+        else if(output_path == NULL)
+        {
+            output_path = argv[i];
+        }
+        else if(pcmem_map_file(&mappings[mapping_count], argv[i]))
+        {
+            split_games(mappings[mapping_count].data, mappings[mapping_count].size, &games, &game_count, &game_capacity);
+            mapping_count++;
+        }
+        else
+        {
+            fprintf(stderr, "Could not open %s, skipped.\n", argv[i]);
+        }
+    }
+
+    if(output_path == NULL || mapping_count == 0)
+    {
+        fprintf(stderr, "Usage: %s <output> <pgn files...> [-t threads] [-p plies]\n", argv[0]);
+        return 1;
+    }
+
+    if(thread_count < 1 || thread_count > MAX_THREADS)
+    {
+        thread_count = thread_count < 1 ? 1 : MAX_THREADS;
+    }
+
+    fprintf(stderr, "Replaying %zu games on %u threads.\n", game_count, thread_count);
+
+    static build_slice slices[MAX_THREADS];
+    pcthread threads[MAX_THREADS];
+
+    for(unsigned int t = 0; t < thread_count; t++)
+    {
+        memset(&slices[t], 0, sizeof(build_slice));
+        slices[t].games = games;
+        slices[t].begin = game_count * t / thread_count;
+        slices[t].end = game_count * (t + 1) / thread_count;
+        slices[t].max_plies = max_plies;
+        pcthread_create(&threads[t], build_slice_entries, &slices[t]);
+    }
+
+    cb_explorer_entry *entries = NULL;
+    size_t count = 0;
+    unsigned long skipped_moves = 0;
+
+    for(unsigned int t = 0; t < thread_count; t++)
+    {
+        pcthread_join(&threads[t]);
+
+        entries = checked_realloc(entries, (count + slices[t].count + 1) * sizeof(cb_explorer_entry));
+        memcpy(entries + count, slices[t].entries, slices[t].count * sizeof(cb_explorer_entry));
+        count += slices[t].count;
+        skipped_moves += slices[t].skipped_moves;
+        free(slices[t].entries);
+    }
+
+    count = aggregate_entries(entries, count);
+    qsort(entries, count, sizeof(cb_explorer_entry), compare_popularity);
+
+    if(skipped_moves > 0)
+    {
+        fprintf(stderr, "Stopped %lu games at a move that could not be read.\n", skipped_moves);
+    }
+
+    int written = cb_write_explorer_index(output_path, entries, count);
+
+    if(written)
+    {
+        fprintf(stderr, "Wrote %zu moves to %s.\n", count, output_path);
+    }
+    else
+    {
+        fprintf(stderr, "Could not write %s.\n", output_path);
+    }
+
+    for(int i = 0; i < mapping_count; i++)
+    {
+        pcmem_unmap_file(&mappings[i]);
+    }
+
+    free(mappings);
+    free(games);
+    free(entries);
+
+    return written ? 0 : 1;
+}
@@ -0,0 +1,578 @@
+/**
+ * @file match-runner.c
+ * @author Nathan Seymour
+ * @brief Plays games between two engine configurations, reporting the Elo
+ * difference and running a sequential probability ratio test (SPRT).
+ *
+ * Usage: match-runner <openings> [-a config] [-b config] [-t threads] [-g games]
+ *                     [-e elo0,elo1] [-p alpha,beta]
+ *
+ * Every line of the openings file holds a FEN. Each opening is played twice,
+ * each configuration taking both colors. Empty lines and lines starting
+ * with '#' are skipped.
+ *
+ * A configuration is a list of comma separated settings, Ex:
+ *
+ *     nodes=20000,hash=16
+ *     time=50,nnue=network.nnue
+ *
+ * Settings: nodes, depth and time (milliseconds) per move, hash (MB per
+ * game) and nnue (network file, requires NNUE_EVALUATION). The default is
+ * nodes=10000,hash=8.
+ *
+ * Games are played concurrently, one per thread. Mates, stalemates, the
+ * fifty-move rule, threefold repetition and insufficient material end the
+ * games. They are also adjudicated:
+ *  - as won, when only a king is left against a king and a queen or a rook;
+ *  - as won, when both engines agree on a score above 1000 centipawns for
+ *    8 moves in a row;
+ *  - as drawn, after move 40, when both engines agree on a score within
+ *    10 centipawns for 16 moves in a row, or at 400 moves.
+ *
+ * The run stops early once the SPRT of H0: elo = elo0 against H1: elo = elo1
+ * (0,5 by default) accepts either hypothesis, with the error rates alpha
+ * and beta (0.05,0.05 by default).
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chess.h"
+#include "history.h"
+#include "movement.h"
+#include "legality.h"
+#include "transposition.h"
+#include "search.h"
+#include "pcthreads.h"
+#include "tools.h"
+
+#define MAX_LINE_LENGTH 256
+#define MAX_THREADS 256
+
+#define MAX_GAME_PLIES 800
+#define RESIGN_SCORE 1000
+#define RESIGN_PLIES 16
+#define DRAW_SCORE 10
+#define DRAW_PLIES 32
+#define DRAW_MIN_PLIES 80
+
+#define RESULT_A_WINS 0
+#define RESULT_DRAW 1
+#define RESULT_B_WINS 2
+
+typedef struct {
+    cb_search_limits limits;
+    size_t hash_size;
+#ifdef NNUE_EVALUATION
+    cb_nnue_network network;
+    int has_network;
+#endif
+} engine_config;
+
+typedef struct {
+    char **fens;
+    size_t count;
+} opening_book;
+
+/**
+ * A match between the two engines, played by every thread. Threads claim
+ * games through next_game and add their results to results, both
+ * atomically, and stop once the SPRT bounds are crossed.
+ */
+typedef struct {
+    const opening_book *openings;
+    engine_config *engines[2];
+    unsigned long game_count;
+    double elo0, elo1;
+    double lower_bound, upper_bound;
+
+    unsigned long next_game;
+    unsigned long results[3];
+    int stop;
+} match;
+
+static int parse_config(engine_config *config, char *specification)
+{
+    for(char *setting = strtok(specification, ","); setting != NULL; setting = strtok(NULL, ","))
+    {
+        char *value = strchr(setting, '=');
+        if(value == NULL)
+        {
+            return 0;
+        }
+        *value++ = '\0';
+
+        if(strcmp(setting, "nodes") == 0)
+        {
+            config->limits.nodes = strtoul(value, NULL, 10);
+        }
+        else if(strcmp(setting, "depth") == 0)
+        {
+            config->limits.depth = (uchar)atoi(value);
+        }
+        else if(strcmp(setting, "time") == 0)
+        {
+            config->limits.time_ms = strtoul(value, NULL, 10);
+        }
+        else if(strcmp(setting, "hash") == 0)
+        {
+            config->hash_size = strtoul(value, NULL, 10) << 20;
+        }
+#ifdef NNUE_EVALUATION
+        else if(strcmp(setting, "nnue") == 0)
+        {
+            if(!cb_nnue_load_network(&config->network, value))
+            {
+                fprintf(stderr, "Could not load the network %s.\n", value);
+                return 0;
+            }
+            config->has_network = 1;
+        }
+#endif
+        else
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static void initialize_config(engine_config *config)
+{
+    memset(config, 0, sizeof(engine_config));
+    config->limits.nodes = 10000;
+    config->limits.multi_pv = 1;
+    config->hash_size = 8 << 20;
+}
+
+static int load_openings(opening_book *openings, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if(file == NULL)
+    {
+        return 0;
+    }
+
+    char line[MAX_LINE_LENGTH];
+    size_t capacity = 0;
+
+    memset(openings, 0, sizeof(opening_book));
+
+    while(fgets(line, sizeof(line), file) != NULL)
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+
+        if(line[0] == '\0' || line[0] == '#')
+        {
+            continue;
+        }
+
+        if(openings->count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 256;
+            openings->fens = realloc(openings->fens, capacity * sizeof(char *));
+        }
+
+        openings->fens[openings->count] = checked_malloc(strlen(line) + 1);
+        strcpy(openings->fens[openings->count], line);
+        openings->count++;
+    }
+
+    fclose(file);
+
+    return 1;
+}
+
+static void free_openings(opening_book *openings)
+{
+    for(size_t i = 0; i < openings->count; i++)
+    {
+        free(openings->fens[i]);
+    }
+
+    free(openings->fens);
+}
+
+/**
+ * Neither side can mate: bare kings, or a single minor piece left.
+ */
+static int is_insufficient_material(chess_board *board)
+{
+    uchar minor_pieces = 0;
+
+    for(uchar square_index = 0; square_index < 64; square_index++)
+    {
+        uchar type = cb_board_get(board, square_index) & COLOR_MASK;
+
+        if(type == KNIGHT || type == BISHOP)
+        {
+            minor_pieces++;
+        }
+        else if(type != EMPTY_SQUARE && type != KING)
+        {
+            return 0;
+        }
+    }
+
+    return minor_pieces <= 1;
+}
+
+/**
+ * Known wins of a queen or a rook against a bare king. Not adjudicated when
+ * the bare king can take the piece.
+ * @return The color winning, or -1.
+ */
+static int adjudicate_endgame(chess_board *board, cb_move_list *moves)
+{
+    uchar heavy_square = 0;
+    uchar heavy_pieces = 0;
+    uchar piece_count = 0;
+
+    for(uchar square_index = 0; square_index < 64; square_index++)
+    {
+        uchar piece = cb_board_get(board, square_index);
+
+        if(piece == EMPTY_SQUARE)
+        {
+            continue;
+        }
+
+        piece_count++;
+
+        if((piece & COLOR_MASK) == QUEEN || (piece & COLOR_MASK) == ROOK)
+        {
+            heavy_square = square_index;
+            heavy_pieces++;
+        }
+    }
+
+    if(piece_count != 3 || heavy_pieces != 1)
+    {
+        return -1;
+    }
+
+    for(uchar i = 0; i < moves->count; i++)
+    {
+        if(moves->moves[i].to_square_index == heavy_square)
+        {
+            return -1;
+        }
+    }
+
+    return cb_board_get(board, heavy_square) & BLACK;
+}
+
+/**
+ * Play one game.
+ * @param engine_of_color Index of the engine playing white, then black.
+ * @return One of the results, Ex: RESULT_A_WINS.
+ */
+static int play_game(match *state, cb_searcher *searchers[2], const char *fen, const uchar engine_of_color[2])
+{
+    chess_board board;
+    cb_position_history history;
+    cb_move_list moves;
+    cb_move_undo undo;
+    cb_search_result result;
+    int winner = -1;
+    resign_counter resign;
+    unsigned int draw_plies = 0;
+
+    cb_parse_fen(&board, fen);
+    reset_resign_counter(&resign);
+    cb_initialize_history(&history, &board);
+
+    for(uchar engine = 0; engine < 2; engine++)
+    {
+        cb_clear_transposition_table(searchers[engine]->table);
+    }
+
+    for(unsigned int ply = 0; ply < MAX_GAME_PLIES; ply++)
+    {
+        uchar color = board.move_counter % 2 == 0 ? WHITE : BLACK;
+        uchar engine = engine_of_color[color == WHITE ? 0 : 1];
+
+        if(cb_generate_legal_moves(&board, &moves) == 0)
+        {
+            winner = cb_is_in_check(&board) ? (color ^ BLACK) : -1;
+            break;
+        }
+
+        if(board.halfmove_clock >= 100 || cb_count_repetitions(&history, &board) >= 2 || is_insufficient_material(&board))
+        {
+            break;
+        }
+
+        winner = adjudicate_endgame(&board, &moves);
+        if(winner != -1)
+        {
+            break;
+        }
+
+        cb_search(searchers[engine], &board, &history, &state->engines[engine]->limits, &result);
+
+        // The engines alternate, so a run of plies means both agree on it.
+        int score = result.lines[0].score;
+
+        draw_plies = abs(score) <= DRAW_SCORE ? draw_plies + 1 : 0;
+        winner = count_resign_ply(&resign, score, color, RESIGN_SCORE, RESIGN_PLIES);
+
+        if(winner != -1)
+        {
+            break;
+        }
+
+        if(ply >= DRAW_MIN_PLIES && draw_plies >= DRAW_PLIES)
+        {
+            break;
+        }
+
+        cb_make_move(&board, &result.lines[0].moves[0], &undo, &history);
+    }
+
+    if(winner == -1)
+    {
+        return RESULT_DRAW;
+    }
+
+    return engine_of_color[winner == WHITE ? 0 : 1] == 0 ? RESULT_A_WINS : RESULT_B_WINS;
+}
+
+static double elo_of_score(double score)
+{
+    if(score <= 0.0) score = 1e-6;
+    if(score >= 1.0) score = 1.0 - 1e-6;
+
+    return -400.0 * log10(1.0 / score - 1.0);
+}
+
+/**
+ * Elo difference with its 95% error margin, and the log-likelihood ratio of
+ * the SPRT, using the normal approximation of the trinomial model.
+ */
+static void compute_statistics(match *state, const unsigned long results[3], double *elo, double *margin, double *llr)
+{
+    double games = (double)(results[0] + results[1] + results[2]);
+    double wins = (double)results[RESULT_A_WINS] / games;
+    double draws = (double)results[RESULT_DRAW] / games;
+    double losses = (double)results[RESULT_B_WINS] / games;
+    double score = wins + draws / 2.0;
+    double variance = wins * (1.0 - score) * (1.0 - score) + draws * (0.5 - score) * (0.5 - score) + losses * score * score;
+
+    *elo = elo_of_score(score);
+    *margin = (elo_of_score(score + 1.96 * sqrt(variance / games)) - elo_of_score(score - 1.96 * sqrt(variance / games))) / 2.0;
+    *llr = 0.0;
+
+    if(variance > 0.0)
+    {
+        double score0 = 1.0 / (1.0 + pow(10.0, -state->elo0 / 400.0));
+        double score1 = 1.0 / (1.0 + pow(10.0, -state->elo1 / 400.0));
+
+        *llr = games * (score1 - score0) * (2.0 * score - score0 - score1) / (2.0 * variance);
+    }
+}
+
+static void report(match *state, const unsigned long results[3])
+{
+    double elo, margin, llr;
+    compute_statistics(state, results, &elo, &margin, &llr);
+
+    fprintf(stderr, "Games %lu: +%lu -%lu =%lu  Elo %.1f +/- %.1f  LLR %.2f [%.2f, %.2f]\n",
+            results[0] + results[1] + results[2], results[RESULT_A_WINS], results[RESULT_B_WINS], results[RESULT_DRAW],
+            elo, margin, llr, state->lower_bound, state->upper_bound);
+}
+
+static void *run_worker(void *argument)
+{
+    match *state = argument;
+    cb_transposition_table tables[2];
+    cb_searcher *searchers[2];
+
+    for(uchar engine = 0; engine < 2; engine++)
+    {
+        if(!cb_initialize_transposition_table(&tables[engine], state->engines[engine]->hash_size))
+        {
+            fprintf(stderr, "Could not allocate the transposition table.\n");
+            exit(1);
+        }
+
+        searchers[engine] = checked_malloc(sizeof(cb_searcher));
+        cb_initialize_searcher(searchers[engine], &tables[engine]);
+
+#ifdef NNUE_EVALUATION
+        if(state->engines[engine]->has_network)
+        {
+            searchers[engine]->evaluator.type = CB_EVALUATOR_NNUE;
+            searchers[engine]->evaluator.network = &state->engines[engine]->network;
+        }
+#endif
+    }
+
+    while(!__atomic_load_n(&state->stop, __ATOMIC_RELAXED))
+    {
+        unsigned long game = __atomic_fetch_add(&state->next_game, 1, __ATOMIC_RELAXED);
+        if(game >= state->game_count)
+        {
+            break;
+        }
+
+        // Games come in pairs, the second one with the colors swapped.
+        const uchar engine_of_color[2] = {game % 2, 1 - game % 2};
+        const char *fen = state->openings->fens[(game / 2) % state->openings->count];
+        int result = play_game(state, searchers, fen, engine_of_color);
+
+        unsigned long results[3];
+        __atomic_fetch_add(&state->results[result], 1, __ATOMIC_RELAXED);
+
+        for(uchar i = 0; i < 3; i++)
+        {
+            results[i] = __atomic_load_n(&state->results[i], __ATOMIC_RELAXED);
+        }
+
+        double elo, margin, llr;
+        compute_statistics(state, results, &elo, &margin, &llr);
+
+        if(llr <= state->lower_bound || llr >= state->upper_bound)
+        {
+            __atomic_store_n(&state->stop, 1, __ATOMIC_RELAXED);
+        }
+
+        if((results[0] + results[1] + results[2]) % 10 == 0)
+        {
+            report(state, results);
+        }
+    }
+
+    for(uchar engine = 0; engine < 2; engine++)
+    {
+        cb_free_transposition_table(&tables[engine]);
+        free(searchers[engine]);
+    }
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int thread_count = pcthread_hardware_concurrency();
+    engine_config engines[2];
+    double alpha = 0.05, beta = 0.05;
+    const char *path = NULL;
+    match state;
+
+    memset(&state, 0, sizeof(match));
+    state.elo0 = 0.0;
+    state.elo1 = 5.0;
+    initialize_config(&engines[0]);
+    initialize_config(&engines[1]);
+
+    for(int i = 1; i < argc; i++)
+    {
+        if((strcmp(argv[i], "-a") == 0 || strcmp(argv[i], "-b") == 0) && i + 1 < argc)
+        {
+            engine_config *config = &engines[argv[i][1] == 'a' ? 0 : 1];
+
+            if(!parse_config(config, argv[++i]))
+            {
+                fprintf(stderr, "Invalid configuration for %s.\n", argv[i - 1]);
+                return 1;
+            }
+        }
+        else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            thread_count = (unsigned int)atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-g") == 0 && i + 1 < argc)
+        {
+            state.game_count = strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "-e") == 0 && i + 1 < argc)
+        {
+            sscanf(argv[++i], "%lf,%lf", &state.elo0, &state.elo1);
+        }
+        else if(strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+        {
+            sscanf(argv[++i], "%lf,%lf", &alpha, &beta);
+        }
+        else
+        {
+            path = argv[i];
+        }
+    }
+
+    if(path == NULL)
+    {
+        fprintf(stderr, "Usage: %s <openings> [-a config] [-b config] [-t threads] [-g games] [-e elo0,elo1] [-p alpha,beta]\n", argv[0]);
+        return 1;
+    }
+
+    if(thread_count < 1 || thread_count > MAX_THREADS)
+    {
+        thread_count = thread_count < 1 ? 1 : MAX_THREADS;
+    }
+
+    opening_book openings;
+    if(!load_openings(&openings, path) || openings.count == 0)
+    {
+        fprintf(stderr, "Could not load any opening from %s.\n", path);
+        return 1;
+    }
+
+    state.openings = &openings;
+    state.engines[0] = &engines[0];
+    state.engines[1] = &engines[1];
+    state.lower_bound = log(beta / (1.0 - alpha));
+    state.upper_bound = log((1.0 - beta) / alpha);
+
+    if(state.game_count == 0)
+    {
+        state.game_count = openings.count * 2;
+    }
+
+    fprintf(stderr, "Playing %lu games from %zu openings on %u threads.\n", state.game_count, openings.count, thread_count);
+
+    pcthread threads[MAX_THREADS];
+    for(unsigned int t = 0; t < thread_count; t++)
+    {
+        pcthread_create(&threads[t], run_worker, &state);
+    }
+
+    for(unsigned int t = 0; t < thread_count; t++)
+    {
+        pcthread_join(&threads[t]);
+    }
+
+    report(&state, state.results);
+
+    double elo, margin, llr;
+    compute_statistics(&state, state.results, &elo, &margin, &llr);
+
+    if(llr >= state.upper_bound)
+    {
+        printf("H1 accepted: A is stronger by at least %.1f Elo.\n", state.elo1);
+    }
+    else if(llr <= state.lower_bound)
+    {
+        printf("H0 accepted: A is not stronger by %.1f Elo.\n", state.elo1);
+    }
+    else
+    {
+        printf("Inconclusive after %lu games.\n", state.results[0] + state.results[1] + state.results[2]);
+    }
+
+#ifdef NNUE_EVALUATION
+    for(uchar engine = 0; engine < 2; engine++)
+    {
+        if(engines[engine].has_network)
+        {
+            cb_nnue_free_network(&engines[engine].network);
+        }
+    }
+#endif
+
+    free_openings(&openings);
+
+    return 0;
+}
@@ -0,0 +1,374 @@
+/**
+ * @file puzzle-verifier.c
+ * @author Nathan Seymour
+ * @brief Checks "mate in n" puzzles with the mate solver.
+ *
+ * Usage: puzzle-verifier <puzzles> [-t threads] [-m hash] [-T milliseconds] [-n nodes]
+ *
+ * Each line of the input is a puzzle in EPD: a FEN, with or without its
+ * move counters, and a "dm" operation giving the number of moves of the
+ * mate (Ex: "6k1/5ppp/8/8/8/8/8/R5K1 w - - dm 1;"). Empty lines and lines
+ * starting with '#' are skipped.
+ *
+ * Every puzzle is solved with a table of the given size in MB (16 by
+ * default) per thread, and gives up after the given time (10000ms by
+ * default) or number of nodes (no limit by default). One line per puzzle
+ * is printed, in the order of the input:
+ *
+ *     <line number> <status> <mate in> <nodes> <milliseconds> <line>
+ *
+ * The status is "ok" when the shortest mate is the one announced,
+ * "shorter" when there is a shorter one (the line is that mate), "fail"
+ * when there is no mate in the moves announced (the line is the best try
+ * and its refutation), "timeout" when a limit was reached first, and
+ * "invalid" when the line could not be read. Moves are in the coordinate
+ * notation of UCI. The counts of each status are printed to stderr at the
+ * end, and the exit code is 1 if any puzzle is not "ok".
+ *
+ * Workers claim the next puzzle with an atomic add, and clear their table
+ * between two puzzles.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "chess.h"
+#include "notation.h"
+#include "movement.h"
+#include "legality.h"
+#include "mate_solver.h"
+#include "pcthreads.h"
+#include "tools.h"
+
+#define MAX_THREADS 256
+#define MAX_FEN_LENGTH 128
+
+#define VERDICT_OK 0
+#define VERDICT_SHORTER 1
+#define VERDICT_FAIL 2
+#define VERDICT_TIMEOUT 3
+#define VERDICT_INVALID 4
+
+static const char *verdict_names[] = {"ok", "shorter", "fail", "timeout", "invalid"};
+
+typedef struct {
+    unsigned long line_number;
+    char fen[MAX_FEN_LENGTH];
+    uchar moves;
+
+    uchar verdict;
+    cb_mate_result result;
+} puzzle;
+
+/**
+ * Puzzles being verified and the limits of the solver. Threads claim the
+ * puzzles one at a time through next_puzzle, atomically, and write their
+ * verdict in the puzzle itself.
+ */
+typedef struct {
+    puzzle *puzzles;
+    size_t puzzle_count;
+
+    size_t hash_size;
+    unsigned long nodes;
+    unsigned long time_ms;
+
+    size_t next_puzzle;
+} verifier;
+
+/*
+ * Read a puzzle from an EPD line: the four fields of the position, the
+ * move counters when given, then the operations.
+ * @return 0 if the line has no position or no "dm" operation.
+ */
+static int parse_puzzle(const char *line, puzzle *entry)
+{
+    const char *cursor = line;
+    const char *operation;
+    size_t length = 0;
+    uchar fields = 0;
+
+    while(fields < 6)
+    {
+        const char *begin;
+
+        while(*cursor == ' ' || *cursor == '\t')
+        {
+            cursor++;
+        }
+
+        begin = cursor;
+
+        while(*cursor != '\0' && *cursor != ' ' && *cursor != '\t' && *cursor != '\n' && *cursor != '\r')
+        {
+            cursor++;
+        }
+
+        // The move counters are optional in EPD.
+        if(cursor == begin || (fields >= 4 && (*begin < '0' || *begin > '9')))
+        {
+            cursor = begin;
+            break;
+        }
+
+        if(length + (size_t)(cursor - begin) + 6 >= MAX_FEN_LENGTH)
+        {
+            return 0;
+        }
+
+        if(fields > 0)
+        {
+            entry->fen[length++] = ' ';
+        }
+
+        memcpy(entry->fen + length, begin, (size_t)(cursor - begin));
+        length += (size_t)(cursor - begin);
+        fields++;
+    }
+
+    if(fields < 4)
+    {
+        return 0;
+    }
+
+    if(fields == 4)
+    {
+        memcpy(entry->fen + length, " 0 1", 4);
+        length += 4;
+    }
+
+    entry->fen[length] = '\0';
+
+    operation = strstr(cursor, "dm ");
+    if(operation == NULL)
+    {
+        return 0;
+    }
+
+    int moves = atoi(operation + 3);
+    if(moves < 1 || moves > CB_MATE_MAX_MOVES)
+    {
+        return 0;
+    }
+
+    entry->moves = (uchar)moves;
+
+    return 1;
+}
+
+/*
+ * Read every line of the input as a puzzle, the unreadable ones marked
+ * invalid.
+ */
+static puzzle *read_puzzles(FILE *input, size_t *count)
+{
+    char line[1024];
+    unsigned long line_number = 0;
+    size_t capacity = 0;
+    puzzle *puzzles = NULL;
+
+    *count = 0;
+
+    while(fgets(line, sizeof(line), input) != NULL)
+    {
+        const char *begin = line;
+
+        line_number++;
+
+        while(*begin == ' ' || *begin == '\t')
+        {
+            begin++;
+        }
+
+        if(*begin == '\0' || *begin == '\n' || *begin == '\r' || *begin == '#')
+        {
+            continue;
+        }
+
+        if(*count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 1024;
+            puzzles = checked_realloc(puzzles, capacity * sizeof(puzzle));
+        }
+
+        puzzle *entry = &puzzles[(*count)++];
+
+        memset(entry, 0, sizeof(puzzle));
+        entry->line_number = line_number;
+        entry->verdict = parse_puzzle(begin, entry) ? VERDICT_TIMEOUT : VERDICT_INVALID;
+    }
+
+    return puzzles;
+}
+
+static void verify_puzzle(cb_mate_solver *solver, const verifier *state, puzzle *entry)
+{
+    cb_mate_limits limits = {entry->moves, state->nodes, state->time_ms};
+    chess_board board;
+
+    cb_parse_fen(&board, entry->fen);
+    cb_clear_mate_table(solver->table);
+    cb_solve_mate(solver, &board, &limits, &entry->result);
+
+    switch(entry->result.status)
+    {
+        case CB_MATE_PROVEN:
+            entry->verdict = entry->result.mate_in < entry->moves ? VERDICT_SHORTER : VERDICT_OK;
+            break;
+        case CB_MATE_DISPROVEN:
+            entry->verdict = VERDICT_FAIL;
+            break;
+        default:
+            entry->verdict = VERDICT_TIMEOUT;
+            break;
+    }
+}
+
+static void *run_worker(void *argument)
+{
+    verifier *state = argument;
+    cb_mate_table table;
+    cb_mate_solver *solver = checked_malloc(sizeof(cb_mate_solver));
+
+    if(!cb_initialize_mate_table(&table, state->hash_size))
+    {
+        fprintf(stderr, "Could not allocate the mate table.\n");
+        exit(1);
+    }
+
+    cb_initialize_mate_solver(solver, &table);
+
+    while(1)
+    {
+        size_t index = __atomic_fetch_add(&state->next_puzzle, 1, __ATOMIC_RELAXED);
+
+        if(index >= state->puzzle_count)
+        {
+            break;
+        }
+
+        if(state->puzzles[index].verdict != VERDICT_INVALID)
+        {
+            verify_puzzle(solver, state, &state->puzzles[index]);
+        }
+    }
+
+    cb_free_mate_table(&table);
+    free(solver);
+
+    return NULL;
+}
+
+static void print_puzzle(const puzzle *entry)
+{
+    const cb_mate_result *result = &entry->result;
+
+    printf("%lu %s %u %lu %lu", entry->line_number, verdict_names[entry->verdict], result->mate_in,
+           result->nodes, result->time_ms);
+
+    for(uchar i = 0; i < result->length; i++)
+    {
+        char move[6];
+
+        cb_move_to_uci(&result->line[i], move);
+        printf(" %s", move);
+    }
+
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int thread_count = pcthread_hardware_concurrency();
+    const char *path = NULL;
+    verifier state;
+    FILE *input;
+
+    memset(&state, 0, sizeof(verifier));
+    state.hash_size = 16 << 20;
+    state.time_ms = 10000;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            thread_count = (unsigned int)atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+        {
+            state.hash_size = strtoul(argv[++i], NULL, 10) << 20;
+        }
+        else if(strcmp(argv[i], "-T") == 0 && i + 1 < argc)
+        {
+            state.time_ms = strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            state.nodes = strtoul(argv[++i], NULL, 10);
+        }
+        else
+        {
+            path = argv[i];
+        }
+    }
+
+    if(path == NULL)
+    {
+        fprintf(stderr, "Usage: %s <puzzles> [-t threads] [-m hash] [-T milliseconds] [-n nodes]\n", argv[0]);
+        return 1;
+    }
+
+    if(thread_count < 1 || thread_count > MAX_THREADS)
+    {
+        thread_count = thread_count < 1 ? 1 : MAX_THREADS;
+    }
+
+    input = fopen(path, "r");
+    if(input == NULL)
+    {
+        fprintf(stderr, "Could not open %s.\n", path);
+        return 1;
+    }
+
+    state.puzzles = read_puzzles(input, &state.puzzle_count);
+    fclose(input);
+
+    if(thread_count > state.puzzle_count)
+    {
+        thread_count = state.puzzle_count > 0 ? (unsigned int)state.puzzle_count : 1;
+    }
+
+    pcthread threads[MAX_THREADS];
+    unsigned long counts[5] = {0};
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for(unsigned int t = 0; t < thread_count; t++)
+    {
+        pcthread_create(&threads[t], run_worker, &state);
+    }
+
+    for(unsigned int t = 0; t < thread_count; t++)
+    {
+        pcthread_join(&threads[t]);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for(size_t i = 0; i < state.puzzle_count; i++)
+    {
+        print_puzzle(&state.puzzles[i]);
+        counts[state.puzzles[i].verdict]++;
+    }
+
+    fprintf(stderr, "%lu puzzles in %.1fs: %lu ok, %lu shorter, %lu fail, %lu timeout, %lu invalid.\n",
+            (unsigned long)state.puzzle_count,
+            (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9,
+            counts[VERDICT_OK], counts[VERDICT_SHORTER], counts[VERDICT_FAIL], counts[VERDICT_TIMEOUT], counts[VERDICT_INVALID]);
+
+    free(state.puzzles);
+
+    return counts[VERDICT_OK] != state.puzzle_count;
+}
@@ -0,0 +1,363 @@
+/**
+ * @file texel-tuner.c
+ * @author Nathan Seymour
+ * @brief Tunes the weights of the material evaluator on a set of
+ * labeled positions, using the Texel method.
+ *
+ * Usage: texel-tuner <positions> [-t threads] [-i iterations] [-k scaling] [-r rate]
+ *
+ * Every line of the positions file holds a FEN followed by the game result,
+ * either as "1-0", "0-1" and "1/2-1/2", or as a score between brackets
+ * ("[1.0]", "[0.5]", "[0.0]"), Ex:
+ *
+ *     rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1 [0.5]
+ *
+ * Positions are only parsed once. Each one is reduced to the coefficients
+ * of the evaluation weights (see cb_evaluation_coefficients), stored in a
+ * compressed sparse row layout. An iteration is then a sparse dot product
+ * per position, split across all cores.
+ *
+ * The tuned weights are printed as the C tables found in evaluation.c.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chess.h"
+#include "evaluation.h"
+#include "pcthreads.h"
+
+#define MAX_LINE_LENGTH 256
+#define MAX_THREADS 256
+
+/**
+ * Positions in compressed sparse row form: the coefficients of position i
+ * are found at indices [offsets[i], offsets[i + 1]).
+ */
+typedef struct {
+    size_t count;
+    size_t capacity;
+    size_t entries_count;
+    size_t entries_capacity;
+    uint32_t *offsets;
+    uchar *indices;
+    signed char *coefficients;
+    float *results;
+} position_set;
+
+/**
+ * Work of one thread for one iteration.
+ */
+typedef struct {
+    const position_set *positions;
+    const double *parameters;
+    size_t begin;
+    size_t end;
+    double scaling;
+    double loss;
+    double gradient[CB_EVAL_PARAMETER_COUNT];
+} tuning_slice;
+
+static int parse_result(const char *line, float *result)
+{
+    const char *bracket = strchr(line, '[');
+
+    if(bracket != NULL)
+    {
+        *result = strtof(bracket + 1, NULL);
+    }
+    else if(strstr(line, "1/2-1/2") != NULL)
+    {
+        *result = 0.5f;
+    }
+    else if(strstr(line, "1-0") != NULL)
+    {
+        *result = 1.0f;
+    }
+    else if(strstr(line, "0-1") != NULL)
+    {
+        *result = 0.0f;
+    }
+    else
+    {
+        return 0;
+    }
+
+    return 1;
+}
+
+static void add_position(position_set *positions, chess_board *board, float result)
+{
+    signed char coefficients[CB_EVAL_PARAMETER_COUNT];
+    cb_evaluation_coefficients(board, coefficients);
+
+    if(positions->count + 1 >= positions->capacity)
+    {
+        positions->capacity = positions->capacity ? positions->capacity * 2 : 4096;
+        positions->offsets = realloc(positions->offsets, (positions->capacity + 1) * sizeof(uint32_t));
+        positions->results = realloc(positions->results, positions->capacity * sizeof(float));
+    }
+
+    if(positions->entries_count + CB_EVAL_PARAMETER_COUNT >= positions->entries_capacity)
+    {
+        positions->entries_capacity = positions->entries_capacity ? positions->entries_capacity * 2 : 65536;
+        positions->indices = realloc(positions->indices, positions->entries_capacity);
+        positions->coefficients = realloc(positions->coefficients, positions->entries_capacity);
+    }
+
+    for(uchar i = 0; i < CB_EVAL_PARAMETER_COUNT; i++)
+    {
+        if(coefficients[i] != 0)
+        {
+            positions->indices[positions->entries_count] = i;
+            positions->coefficients[positions->entries_count] = coefficients[i];
+            positions->entries_count++;
+        }
+    }
+
+    positions->results[positions->count] = result;
+    positions->count++;
+    positions->offsets[positions->count] = (uint32_t)positions->entries_count;
+}
+
+static int load_positions(position_set *positions, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if(file == NULL)
+    {
+        return 0;
+    }
+
+    chess_board *board = cb_new_chess_board();
+    char line[MAX_LINE_LENGTH];
+    size_t skipped = 0;
+
+    memset(positions, 0, sizeof(position_set));
+    positions->offsets = malloc(sizeof(uint32_t));
+    positions->offsets[0] = 0;
+
+    while(fgets(line, sizeof(line), file) != NULL)
+    {
+        float result;
+        if(!parse_result(line, &result))
+        {
+            skipped++;
+            continue;
+        }
+
+        cb_parse_fen(board, line);
+        add_position(positions, board, result);
+    }
+
+    if(skipped > 0)
+    {
+        fprintf(stderr, "Skipped %zu lines without a result.\n", skipped);
+    }
+
+    cb_free_chess_board(board);
+    fclose(file);
+
+    return 1;
+}
+
+static void free_positions(position_set *positions)
+{
+    free(positions->offsets);
+    free(positions->indices);
+    free(positions->coefficients);
+    free(positions->results);
+}
+
+/**
+ * Mean squared error and its gradient over a slice of the positions, with
+ * the win probability modelled as sigmoid(scaling * evaluation / 400).
+ */
+static void *tune_slice(void *argument)
+{
+    tuning_slice *slice = argument;
+    const position_set *positions = slice->positions;
+    const double *parameters = slice->parameters;
+    const double factor = slice->scaling * log(10.0) / 400.0;
+
+    slice->loss = 0;
+    memset(slice->gradient, 0, sizeof(slice->gradient));
+
+    for(size_t i = slice->begin; i < slice->end; i++)
+    {
+        uint32_t begin = positions->offsets[i];
+        uint32_t end = positions->offsets[i + 1];
+        double evaluation = 0;
+
+        for(uint32_t entry = begin; entry < end; entry++)
+        {
+            evaluation += parameters[positions->indices[entry]] * positions->coefficients[entry];
+        }
+
+        double prediction = 1.0 / (1.0 + exp(-factor * evaluation));
+        double error = positions->results[i] - prediction;
+        double derivative = -2.0 * error * prediction * (1.0 - prediction) * factor;
+
+        slice->loss += error * error;
+
+        for(uint32_t entry = begin; entry < end; entry++)
+        {
+            slice->gradient[positions->indices[entry]] += derivative * positions->coefficients[entry];
+        }
+    }
+
+    return NULL;
+}
+
+static double compute_gradient(const position_set *positions, const double *parameters, double scaling, unsigned int thread_count, double *gradient)
+{
+    static tuning_slice slices[MAX_THREADS];
+    pcthread threads[MAX_THREADS];
+    double loss = 0;
+
+    for(unsigned int t = 0; t < thread_count; t++)
+    {
+        slices[t].positions = positions;
+        slices[t].parameters = parameters;
+        slices[t].scaling = scaling;
+        slices[t].begin = positions->count * t / thread_count;
+        slices[t].end = positions->count * (t + 1) / thread_count;
+        pcthread_create(&threads[t], tune_slice, &slices[t]);
+    }
+
+    memset(gradient, 0, CB_EVAL_PARAMETER_COUNT * sizeof(double));
+
+    for(unsigned int t = 0; t < thread_count; t++)
+    {
+        pcthread_join(&threads[t]);
+
+        loss += slices[t].loss;
+        for(uchar i = 0; i < CB_EVAL_PARAMETER_COUNT; i++)
+        {
+            gradient[i] += slices[t].gradient[i] / (double)positions->count;
+        }
+    }
+
+    return loss / (double)positions->count;
+}
+
+static void print_table(const char *declaration, const double *parameters, uchar count)
+{
+    printf("static const short %s[%u] = {", declaration, count);
+    for(uchar i = 0; i < count; i++)
+    {
+        printf(i == 0 ? "%ld" : ", %ld", lround(parameters[i]));
+    }
+    printf("};\n");
+}
+
+/**
+ * Print the weights in the form of the tables found in evaluation.c.
+ */
+static void print_parameters(const double *parameters)
+{
+    double piece_values[7] = {0};
+    for(uchar i = 0; i < 5; i++)
+    {
+        piece_values[PAWN + i] = parameters[CB_EVAL_PIECE_VALUES + i];
+    }
+
+    print_table("cb_piece_centipawn_values", piece_values, 7);
+    print_table("cb_passed_pawn_bonus", parameters + CB_EVAL_PASSED_PAWN, 8);
+    printf("static const short cb_isolated_pawn_penalty = %ld;\n", lround(parameters[CB_EVAL_ISOLATED_PAWN]));
+    printf("static const short cb_doubled_pawn_penalty = %ld;\n", lround(parameters[CB_EVAL_DOUBLED_PAWN]));
+    printf("static const short cb_backward_pawn_penalty = %ld;\n", lround(parameters[CB_EVAL_BACKWARD_PAWN]));
+    print_table("cb_pawn_shield_bonus", parameters + CB_EVAL_PAWN_SHIELD, 2);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int thread_count = pcthread_hardware_concurrency();
+    unsigned int iterations = 1000;
+    double scaling = 1.0;
+    double rate = 1.0;
+    const char *path = NULL;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            thread_count = (unsigned int)atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+        {
+            iterations = (unsigned int)atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-k") == 0 && i + 1 < argc)
+        {
+            scaling = atof(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+        {
+            rate = atof(argv[++i]);
+        }
+        else
+        {
+            path = argv[i];
+        }
+    }
+
+    if(path == NULL)
+    {
+        fprintf(stderr, "Usage: %s <positions> [-t threads] [-i iterations] [-k scaling] [-r rate]\n", argv[0]);
+        return 1;
+    }
+
+    if(thread_count < 1 || thread_count > MAX_THREADS)
+    {
+        thread_count = thread_count < 1 ? 1 : MAX_THREADS;
+    }
+
+    position_set positions;
+    if(!load_positions(&positions, path) || positions.count == 0)
+    {
+        fprintf(stderr, "Could not load any position from %s.\n", path);
+        return 1;
+    }
+
+    fprintf(stderr, "Loaded %zu positions (%zu coefficients), tuning on %u threads.\n", positions.count, positions.entries_count, thread_count);
+
+    short initial_parameters[CB_EVAL_PARAMETER_COUNT];
+    double parameters[CB_EVAL_PARAMETER_COUNT];
+    double gradient[CB_EVAL_PARAMETER_COUNT];
+    double first_moment[CB_EVAL_PARAMETER_COUNT] = {0};
+    double second_moment[CB_EVAL_PARAMETER_COUNT] = {0};
+
+    cb_evaluation_parameters(initial_parameters);
+    for(uchar i = 0; i < CB_EVAL_PARAMETER_COUNT; i++)
+    {
+        parameters[i] = initial_parameters[i];
+    }
+
+    // Adam, as weights of very different scales are tuned together.
+    for(unsigned int iteration = 1; iteration <= iterations; iteration++)
+    {
+        double loss = compute_gradient(&positions, parameters, scaling, thread_count, gradient);
+
+        for(uchar i = 0; i < CB_EVAL_PARAMETER_COUNT; i++)
+        {
+            first_moment[i] = 0.9 * first_moment[i] + 0.1 * gradient[i];
+            second_moment[i] = 0.999 * second_moment[i] + 0.001 * gradient[i] * gradient[i];
+
+            double corrected_first = first_moment[i] / (1.0 - pow(0.9, iteration));
+            double corrected_second = second_moment[i] / (1.0 - pow(0.999, iteration));
+
+            parameters[i] -= rate * corrected_first / (sqrt(corrected_second) + 1e-8);
+        }
+
+        if(iteration == 1 || iteration % 100 == 0 || iteration == iterations)
+        {
+            fprintf(stderr, "Iteration %u: error %.6f\n", iteration, loss);
+        }
+    }
+
+    print_parameters(parameters);
+    free_positions(&positions);
+
+    return 0;
+}
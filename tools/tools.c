@@ -0,0 +1,60 @@
+/**
+ * @file tools.c
+ * @author Nathan Seymour
+ * @brief Helpers shared by the proton-chess development tools.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "chess.h"
+#include "tools.h"
+
+void *checked_malloc(size_t size)
+{
+    return checked_realloc(NULL, size);
+}
+
+void *checked_realloc(void *memory, size_t size)
+{
+    memory = realloc(memory, size);
+
+    if(memory == NULL)
+    {
+        fprintf(stderr, "Out of memory.\n");
+        exit(1);
+    }
+
+    return memory;
+}
+
+void reset_resign_counter(resign_counter *counter)
+{
+    counter->plies = 0;
+    counter->white_winning = 0;
+}
+
+int count_resign_ply(resign_counter *counter, int score, unsigned char color, int threshold, unsigned int plies)
+{
+    int white_score = color == WHITE ? score : -score;
+
+    if(abs(white_score) < threshold)
+    {
+        counter->plies = 0;
+        return -1;
+    }
+
+    if(counter->plies == 0 || counter->white_winning != (white_score > 0))
+    {
+        counter->plies = 0;
+        counter->white_winning = white_score > 0;
+    }
+
+    counter->plies++;
+
+    if(counter->plies < plies)
+    {
+        return -1;
+    }
+
+    return counter->white_winning ? WHITE : BLACK;
+}
@@ -0,0 +1,55 @@
+/**
+ * @file tools.h
+ * @author Nathan Seymour
+ * @brief Helpers shared by the proton-chess development tools.
+ */
+
+#ifndef PROTON_CHESS_TOOLS_H
+#define PROTON_CHESS_TOOLS_H
+
+#include <stddef.h>
+
+/**
+ * Allocate memory, exiting the tool when there is not enough.
+ * @param size Size in bytes.
+ * @return The memory.
+ */
+void *checked_malloc(size_t size);
+
+/**
+ * Resize memory, exiting the tool when there is not enough.
+ * @param memory Memory to resize, or NULL to allocate it.
+ * @param size New size in bytes.
+ * @return The memory, possibly moved.
+ */
+void *checked_realloc(void *memory, size_t size);
+
+/**
+ * Run of plies whose scores all favour the same side, to adjudicate
+ * resignations.
+ */
+typedef struct {
+    unsigned int plies;
+    int white_winning;
+} resign_counter;
+
+/**
+ * Clear a resign counter, for a new game.
+ * @param counter Counter to clear.
+ */
+void reset_resign_counter(resign_counter *counter);
+
+/**
+ * Count the score of a ply. The run grows while the scores are beyond the
+ * threshold in favour of the same side, restarts when the favoured side
+ * changes and ends when a score is within the threshold.
+ * @param counter Counter of the game.
+ * @param score Score of the ply, from the side to move.
+ * @param color Side to move, WHITE or BLACK.
+ * @param threshold Smallest score in favour of a side, in centipawns.
+ * @param plies Length of the run at which the losing side resigns.
+ * @return The winning color, or -1 while no side resigns.
+ */
+int count_resign_ply(resign_counter *counter, int score, unsigned char color, int threshold, unsigned int plies);
+
+#endif //PROTON_CHESS_TOOLS_H
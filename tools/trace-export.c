@@ -0,0 +1,503 @@
+/**
+ * @file trace-export.c
+ * @author Nathan Seymour
+ * @brief Rebuilds the search trees of a search trace dump, and exports
+ * them for viewing.
+ *
+ * Usage: trace-export <dump> [-f json|dot] [-t thread] [-p plies]
+ *
+ * The dump is written by cb_trace_dump, in a build with the SEARCH_TRACE
+ * CMake option. The tree of each thread is rebuilt from its events: every
+ * search, then every iteration of the search, then the nodes, each one
+ * under the move leading to it. Nodes keep their window and depth on
+ * entry, their score on exit, their transposition table hit and store,
+ * their cutoff, and the nanoseconds spent in them.
+ *
+ * Buffers overwrite their oldest events, so the tree of a thread may start
+ * in the middle of a search: the nodes whose entry is lost are left out,
+ * and the nodes entered before the lost part are put directly under the
+ * thread. Nodes without an exit, Ex: when dumped during the search, have
+ * no score.
+ *
+ * With -f json (the default), the trees are written as nested objects;
+ * with -f dot, as a Graphviz graph, which is only readable for small
+ * trees: -t keeps a single thread and -p the nodes up to a ply.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chess.h"
+#include "notation.h"
+#include "trace.h"
+#include "tools.h"
+
+#define TRACE_MAGIC "PCTRACE1"
+#define TRACE_BYTE_ORDER_MARK 0x01020304
+
+#define KIND_THREAD 0
+#define KIND_SEARCH 1
+#define KIND_ITERATION 2
+#define KIND_NODE 3
+#define KIND_QUIESCENCE 4
+
+#define NO_NODE ((size_t)-1)
+#define MAX_NESTING 256
+
+static const char *kind_names[] = {"thread", "search", "iteration", "node", "quiescence"};
+static const char *bound_names[] = {"exact", "lower", "upper", "?"};
+
+typedef struct {
+    uchar kind;
+    uchar ply;
+
+    /**
+     * Move leading to the node, 0 for none, and the window of the node.
+     */
+    uint16_t move;
+    int alpha;
+    int beta;
+
+    /**
+     * Depth of the node, or of the iteration, and the thread index for the
+     * thread.
+     */
+    unsigned int depth;
+
+    int score;
+    int exited;
+
+    uint64_t start_ns;
+    uint64_t end_ns;
+
+    int tt_hit;
+    uint16_t tt_hit_move;
+    int tt_hit_score;
+    uint16_t tt_hit_flags;
+
+    int tt_store;
+    uint16_t tt_store_move;
+    int tt_store_score;
+    uint16_t tt_store_flags;
+
+    int cutoff;
+    uint16_t cutoff_move;
+    int cutoff_index;
+
+    /**
+     * Last move searched from the node, given to the next child.
+     */
+    uint16_t pending_move;
+
+    size_t first_child;
+    size_t last_child;
+    size_t next_sibling;
+} tree_node;
+
+typedef struct {
+    tree_node *nodes;
+    size_t count;
+    size_t capacity;
+} tree;
+
+static size_t add_node(tree *nodes, size_t parent, uchar kind, uchar ply)
+{
+    tree_node *node;
+
+    if(nodes->count == nodes->capacity)
+    {
+        nodes->capacity = nodes->capacity ? nodes->capacity * 2 : 1024;
+        nodes->nodes = checked_realloc(nodes->nodes, nodes->capacity * sizeof(tree_node));
+    }
+
+    node = &nodes->nodes[nodes->count];
+    memset(node, 0, sizeof(tree_node));
+    node->kind = kind;
+    node->ply = ply;
+    node->first_child = node->last_child = node->next_sibling = NO_NODE;
+
+    if(parent != NO_NODE)
+    {
+        tree_node *parent_node = &nodes->nodes[parent];
+
+        node->move = parent_node->pending_move;
+        parent_node->pending_move = 0;
+
+        if(parent_node->last_child == NO_NODE)
+        {
+            parent_node->first_child = nodes->count;
+        }
+        else
+        {
+            nodes->nodes[parent_node->last_child].next_sibling = nodes->count;
+        }
+
+        parent_node->last_child = nodes->count;
+    }
+
+    return nodes->count++;
+}
+
+/*
+ * Rebuild the tree of a thread under a node of its own, from its events in
+ * order. The stack holds the nodes entered and not yet exited, the thread
+ * at its bottom.
+ */
+static void rebuild_thread(tree *nodes, unsigned int thread_index, const cb_trace_event *events, size_t count)
+{
+    size_t stack[MAX_NESTING];
+    unsigned int top = 0;
+
+    stack[0] = add_node(nodes, NO_NODE, KIND_THREAD, 0);
+    nodes->nodes[stack[0]].depth = thread_index;
+
+    for(size_t i = 0; i < count; i++)
+    {
+        const cb_trace_event *event = &events[i];
+        tree_node *current = &nodes->nodes[stack[top]];
+        size_t node;
+
+        switch(event->type)
+        {
+            case CB_TRACE_SEARCH:
+                top = 0;
+                node = add_node(nodes, stack[0], KIND_SEARCH, 0);
+                nodes->nodes[node].start_ns = event->time_ns;
+                stack[++top] = node;
+                break;
+
+            case CB_TRACE_ITERATION:
+                while(top > 0 && nodes->nodes[stack[top]].kind != KIND_SEARCH)
+                {
+                    top--;
+                }
+
+                node = add_node(nodes, stack[top], KIND_ITERATION, 0);
+                nodes->nodes[node].depth = event->argument;
+                nodes->nodes[node].start_ns = event->time_ns;
+                stack[++top] = node;
+                break;
+
+            case CB_TRACE_NODE:
+            case CB_TRACE_QUIESCENCE:
+                if(top + 1 >= sizeof(stack) / sizeof(stack[0]))
+                {
+                    fprintf(stderr, "Thread %u nests too deep, event %lu skipped.\n", thread_index, (unsigned long)i);
+                    break;
+                }
+
+                node = add_node(nodes, stack[top], event->type == CB_TRACE_NODE ? KIND_NODE : KIND_QUIESCENCE, event->ply);
+                nodes->nodes[node].depth = event->argument;
+                nodes->nodes[node].alpha = event->values[0];
+                nodes->nodes[node].beta = event->values[1];
+                nodes->nodes[node].start_ns = event->time_ns;
+                stack[++top] = node;
+                break;
+
+            case CB_TRACE_MOVE:
+                current->pending_move = event->argument;
+                break;
+
+            case CB_TRACE_CUTOFF:
+                current->cutoff = 1;
+                current->cutoff_move = event->argument;
+                current->cutoff_index = event->values[1];
+                break;
+
+            case CB_TRACE_TT_HIT:
+                current->tt_hit = 1;
+                current->tt_hit_move = event->argument;
+                current->tt_hit_score = event->values[0];
+                current->tt_hit_flags = (uint16_t)event->values[1];
+                break;
+
+            case CB_TRACE_TT_STORE:
+                current->tt_store = 1;
+                current->tt_store_move = event->argument;
+                current->tt_store_score = event->values[0];
+                current->tt_store_flags = (uint16_t)event->values[1];
+                break;
+
+            case CB_TRACE_EXIT:
+                // Exits of the nodes entered before the oldest event have nothing to close.
+                if(current->kind == KIND_THREAD || current->kind == KIND_SEARCH)
+                {
+                    break;
+                }
+
+                current->score = event->values[0];
+                current->exited = 1;
+                current->end_ns = event->time_ns;
+                top--;
+                break;
+
+            default:
+                fprintf(stderr, "Unknown event %u in thread %u.\n", event->type, thread_index);
+                break;
+        }
+    }
+}
+
+/*
+ * Write a packed move in the coordinate notation of UCI, Ex: "e7e8q".
+ */
+static void format_move(uint16_t move, char buffer[6])
+{
+    cb_move unpacked = {0};
+
+    unpacked.from_square_index = move & 0x3F;
+    unpacked.to_square_index = (move >> 6) & 0x3F;
+    unpacked.promotion_piece = move >> 12;
+    cb_move_to_uci(&unpacked, buffer);
+}
+
+static void write_table_entry_json(FILE *output, const char *name, uint16_t move, int score, uint16_t flags)
+{
+    char notation[6];
+
+    format_move(move, notation);
+    fprintf(output, ",\"%s\":{\"move\":\"%s\",\"score\":%d,\"depth\":%u,\"bound\":\"%s\"}", name, notation, score,
+            flags >> 2, bound_names[flags & 0x3]);
+}
+
+static void write_json(FILE *output, const tree *nodes, size_t index, unsigned int max_ply, unsigned int indent)
+{
+    const tree_node *node = &nodes->nodes[index];
+    char notation[6];
+    int first = 1;
+
+    fprintf(output, "%*s{\"type\":\"%s\"", indent * 2, "", kind_names[node->kind]);
+
+    switch(node->kind)
+    {
+        case KIND_THREAD:
+            fprintf(output, ",\"thread\":%u", node->depth);
+            break;
+        case KIND_ITERATION:
+            fprintf(output, ",\"depth\":%u", node->depth);
+            break;
+        case KIND_NODE:
+        case KIND_QUIESCENCE:
+            if(node->move != 0)
+            {
+                format_move(node->move, notation);
+                fprintf(output, ",\"move\":\"%s\"", notation);
+            }
+            fprintf(output, ",\"ply\":%u,\"alpha\":%d,\"beta\":%d", node->ply, node->alpha, node->beta);
+            if(node->kind == KIND_NODE)
+            {
+                fprintf(output, ",\"depth\":%u", node->depth);
+            }
+            break;
+    }
+
+    if(node->exited)
+    {
+        fprintf(output, ",\"score\":%d,\"time_ns\":%llu", node->score, (unsigned long long)(node->end_ns - node->start_ns));
+    }
+
+    if(node->tt_hit)
+    {
+        write_table_entry_json(output, "tt_hit", node->tt_hit_move, node->tt_hit_score, node->tt_hit_flags);
+    }
+
+    if(node->tt_store)
+    {
+        write_table_entry_json(output, "tt_store", node->tt_store_move, node->tt_store_score, node->tt_store_flags);
+    }
+
+    if(node->cutoff)
+    {
+        format_move(node->cutoff_move, notation);
+        fprintf(output, ",\"cutoff\":{\"move\":\"%s\",\"index\":%d}", notation, node->cutoff_index);
+    }
+
+    for(size_t child = node->first_child; child != NO_NODE; child = nodes->nodes[child].next_sibling)
+    {
+        if(nodes->nodes[child].ply > max_ply)
+        {
+            continue;
+        }
+
+        fprintf(output, first ? ",\"children\":[\n" : ",\n");
+        write_json(output, nodes, child, max_ply, indent + 1);
+        first = 0;
+    }
+
+    fprintf(output, first ? "}" : "\n%*s]}", indent * 2, "");
+}
+
+static void write_dot(FILE *output, const tree *nodes, size_t index, unsigned int max_ply)
+{
+    const tree_node *node = &nodes->nodes[index];
+    char notation[6];
+
+    fprintf(output, "  n%lu [label=\"", (unsigned long)index);
+
+    switch(node->kind)
+    {
+        case KIND_THREAD:
+            fprintf(output, "thread %u", node->depth);
+            break;
+        case KIND_SEARCH:
+            fprintf(output, "search");
+            break;
+        case KIND_ITERATION:
+            fprintf(output, "depth %u", node->depth);
+            break;
+        default:
+            if(node->move != 0)
+            {
+                format_move(node->move, notation);
+                fprintf(output, "%s\\n", notation);
+            }
+            if(node->kind == KIND_NODE)
+            {
+                fprintf(output, "d%u ", node->depth);
+            }
+            else
+            {
+                fprintf(output, "q ");
+            }
+            fprintf(output, "[%d, %d]", node->alpha, node->beta);
+            break;
+    }
+
+    if(node->exited)
+    {
+        fprintf(output, "\\n= %d", node->score);
+    }
+
+    if(node->tt_hit)
+    {
+        fprintf(output, "\\ntt %d %s", node->tt_hit_score, bound_names[node->tt_hit_flags & 0x3]);
+    }
+
+    if(node->cutoff)
+    {
+        format_move(node->cutoff_move, notation);
+        fprintf(output, "\\ncut %s #%d", notation, node->cutoff_index);
+    }
+
+    fprintf(output, "\"%s];\n", node->cutoff ? ", color=red" : "");
+
+    for(size_t child = node->first_child; child != NO_NODE; child = nodes->nodes[child].next_sibling)
+    {
+        if(nodes->nodes[child].ply > max_ply)
+        {
+            continue;
+        }
+
+        fprintf(output, "  n%lu -> n%lu;\n", (unsigned long)index, (unsigned long)child);
+        write_dot(output, nodes, child, max_ply);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = NULL;
+    int dot = 0;
+    long thread_filter = -1;
+    unsigned int max_ply = MAX_NESTING;
+    char magic[8];
+    uint32_t header[2];
+    uint32_t block[2];
+    tree nodes = {NULL, 0, 0};
+    size_t *threads = NULL;
+    size_t thread_count = 0;
+    FILE *file;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+        {
+            dot = strcmp(argv[++i], "dot") == 0;
+        }
+        else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            thread_filter = atol(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+        {
+            max_ply = (unsigned int)atoi(argv[++i]);
+        }
+        else
+        {
+            path = argv[i];
+        }
+    }
+
+    if(path == NULL)
+    {
+        fprintf(stderr, "Usage: %s <dump> [-f json|dot] [-t thread] [-p plies]\n", argv[0]);
+        return 1;
+    }
+
+    file = fopen(path, "rb");
+    if(file == NULL)
+    {
+        fprintf(stderr, "Could not open %s.\n", path);
+        return 1;
+    }
+
+    if(fread(magic, 1, 8, file) != 8 || memcmp(magic, TRACE_MAGIC, 8) != 0 || fread(header, sizeof(uint32_t), 2, file) != 2
+       || header[0] != TRACE_BYTE_ORDER_MARK || header[1] != sizeof(cb_trace_event))
+    {
+        fprintf(stderr, "%s is not a trace dump of this machine.\n", path);
+        return 1;
+    }
+
+    while(fread(block, sizeof(uint32_t), 2, file) == 2)
+    {
+        cb_trace_event *events = checked_realloc(NULL, ((size_t)block[1] + 1) * sizeof(cb_trace_event));
+
+        if(fread(events, sizeof(cb_trace_event), block[1], file) != block[1])
+        {
+            fprintf(stderr, "The block of thread %u is cut short.\n", block[0]);
+            free(events);
+            break;
+        }
+
+        if(thread_filter < 0 || thread_filter == block[0])
+        {
+            threads = checked_realloc(threads, (thread_count + 1) * sizeof(size_t));
+            threads[thread_count++] = nodes.count;
+            rebuild_thread(&nodes, block[0], events, block[1]);
+        }
+
+        free(events);
+    }
+
+    fclose(file);
+
+    if(dot)
+    {
+        printf("digraph trace {\n  node [shape=box, fontname=monospace];\n");
+    }
+    else
+    {
+        printf("[\n");
+    }
+
+    for(size_t i = 0; i < thread_count; i++)
+    {
+        if(dot)
+        {
+            write_dot(stdout, &nodes, threads[i], max_ply);
+        }
+        else
+        {
+            write_json(stdout, &nodes, threads[i], max_ply, 1);
+            printf(i + 1 < thread_count ? ",\n" : "\n");
+        }
+    }
+
+    printf(dot ? "}\n" : "]\n");
+
+    fprintf(stderr, "%lu threads, %lu nodes.\n", (unsigned long)thread_count, (unsigned long)nodes.count);
+
+    free(threads);
+    free(nodes.nodes);
+
+    return 0;
+}
@@ -0,0 +1,376 @@
+/**
+ * @file protonchess.c
+ * @author Nathan Seymour
+ * @brief WebAssembly bindings of proton-chess, used by protonchess.js.
+ *
+ * Every call crossing the JS boundary works on a whole batch of boards,
+ * so that JS pays for one call per batch instead of one per square or move.
+ * Boards live in the wasm heap, in arrays allocated by cb_wasm_new_boards.
+ * Moves are passed as three bytes each (from, to, promotion piece), the
+ * layout of cb_move.
+ *
+ * When built with WASM_THREADS, batch evaluation is split across a pool of
+ * threads (Web Workers sharing the wasm memory), and a search runs in a
+ * worker of its own, so that batches can be evaluated while it runs. One
+ * search runs at a time; without threads it runs to completion when
+ * started.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <emscripten.h>
+#include "chess.h"
+#include "evaluation.h"
+#include "legality.h"
+#include "batch.h"
+#include "transposition.h"
+#include "search.h"
+#include "pcthreads.h"
+
+#ifdef NNUE_EVALUATION
+#include "nnue.h"
+#endif
+
+#ifndef WASM_THREAD_POOL_SIZE
+#define WASM_THREAD_POOL_SIZE 1
+#endif
+
+typedef struct {
+    chess_board *boards;
+    uint32_t begin;
+    uint32_t end;
+    uchar evaluator_type;
+    int32_t *scores;
+} cb_wasm_evaluation_slice;
+
+/**
+ * The search started by cb_wasm_start_search, owned by the calling thread
+ * until cb_wasm_finish_search. Only done is shared with the search thread.
+ */
+typedef struct {
+    cb_transposition_table table;
+    cb_searcher *searcher;
+    chess_board board;
+    cb_search_limits limits;
+    cb_search_result result;
+    pcthread thread;
+    int threaded;
+    int done;
+} cb_wasm_search;
+
+#ifdef NNUE_EVALUATION
+static cb_nnue_network cb_wasm_network;
+static int cb_wasm_has_network = 0;
+#endif
+
+static cb_wasm_search *cb_wasm_running_search = NULL;
+
+/**
+ * Size of a chess board in the wasm heap, to walk arrays of boards from JS.
+ */
+EMSCRIPTEN_KEEPALIVE uint32_t cb_wasm_board_size()
+{
+    return sizeof(chess_board);
+}
+
+/**
+ * Largest number of threads cb_wasm_evaluate can use. Threads beyond the
+ * pool would wait for the main thread to spawn their worker, which it
+ * cannot do while it waits for them. The calling thread evaluates a share
+ * of the batch itself, which leaves a worker of the pool to the search.
+ */
+EMSCRIPTEN_KEEPALIVE uint32_t cb_wasm_max_threads()
+{
+    return WASM_THREAD_POOL_SIZE;
+}
+
+EMSCRIPTEN_KEEPALIVE chess_board *cb_wasm_new_boards(uint32_t count)
+{
+    chess_board *boards = malloc(sizeof(chess_board) * (count > 0 ? count : 1));
+
+    for(uint32_t i = 0; boards != NULL && i < count; i++)
+    {
+        cb_initialize_game(&boards[i]);
+    }
+
+    return boards;
+}
+
+EMSCRIPTEN_KEEPALIVE void cb_wasm_free_boards(chess_board *boards)
+{
+    free(boards);
+}
+
+/**
+ * Parse FENs, separated by new lines, into an array of boards.
+ * @return Number of FENs parsed.
+ */
+EMSCRIPTEN_KEEPALIVE uint32_t cb_wasm_parse_fens(chess_board *boards, char *fens, uint32_t count)
+{
+    uint32_t parsed_count = 0;
+
+    while(parsed_count < count && *fens != '\0')
+    {
+        char *line_end = strchr(fens, '\n');
+        if(line_end != NULL)
+        {
+            *line_end = '\0';
+        }
+
+        cb_parse_fen(&boards[parsed_count++], fens);
+
+        if(line_end == NULL)
+        {
+            break;
+        }
+        fens = line_end + 1;
+    }
+
+    return parsed_count;
+}
+
+/**
+ * Write the FEN of each board into slots of CB_FEN_NOTATION_LENGTH bytes.
+ */
+EMSCRIPTEN_KEEPALIVE void cb_wasm_generate_fens(chess_board *boards, uint32_t count, char *buffer)
+{
+    for(uint32_t i = 0; i < count; i++)
+    {
+        cb_generate_fen(&boards[i], buffer + i * CB_FEN_NOTATION_LENGTH, CB_FEN_NOTATION_LENGTH);
+    }
+}
+
+EMSCRIPTEN_KEEPALIVE uint32_t cb_wasm_perform_movements(chess_board *boards, cb_move *moves, uint32_t count, uchar flags, uchar *results)
+{
+    return (uint32_t)cb_perform_movements(boards, moves, count, flags, results);
+}
+
+/**
+ * Check moves[i] on boards[i] without playing it. results[i] is 1 if the
+ * move is legal, 0 if it is not.
+ */
+EMSCRIPTEN_KEEPALIVE void cb_wasm_check_moves(chess_board *boards, cb_move *moves, uint32_t count, uchar *results)
+{
+    for(uint32_t i = 0; i < count; i++)
+    {
+        results[i] = (uchar)cb_is_move_legal(&boards[i], &moves[i]);
+    }
+}
+
+#ifdef NNUE_EVALUATION
+/**
+ * Attach a network for CB_EVALUATOR_NNUE evaluations. The network is read
+ * in place, so the data must stay allocated while it is used.
+ * @return 1 if the network was accepted.
+ */
+EMSCRIPTEN_KEEPALIVE int cb_wasm_load_network(const void *data, uint32_t size)
+{
+    cb_wasm_has_network = cb_nnue_init_network(&cb_wasm_network, data, size);
+    return cb_wasm_has_network;
+}
+#endif
+
+static void *cb_wasm_evaluate_slice(void *argument)
+{
+    cb_wasm_evaluation_slice *slice = argument;
+    cb_pawn_hash_table *pawn_table = malloc(sizeof(cb_pawn_hash_table));
+    cb_evaluator evaluator;
+
+    cb_initialize_evaluator(&evaluator, slice->evaluator_type);
+    if(pawn_table != NULL)
+    {
+        cb_clear_pawn_hash_table(pawn_table);
+        evaluator.pawn_table = pawn_table;
+    }
+
+#ifdef NNUE_EVALUATION
+    cb_nnue_accumulator accumulator;
+
+    if(cb_wasm_has_network)
+    {
+        evaluator.network = &cb_wasm_network;
+        evaluator.accumulator = &accumulator;
+    }
+#endif
+
+    for(uint32_t i = slice->begin; i < slice->end; i++)
+    {
+#ifdef NNUE_EVALUATION
+        if(evaluator.type == CB_EVALUATOR_NNUE && cb_wasm_has_network)
+        {
+            cb_nnue_refresh_accumulator(&cb_wasm_network, &accumulator, &slice->boards[i]);
+        }
+#endif
+        slice->scores[i] = cb_evaluate(&slice->boards[i], &evaluator);
+    }
+
+    free(pawn_table);
+    return NULL;
+}
+
+/**
+ * Evaluate every board, in centipawns from the side to move, split across
+ * up to thread_count threads.
+ * @param evaluator_type Ex: CB_EVALUATOR_MATERIAL.
+ */
+EMSCRIPTEN_KEEPALIVE void cb_wasm_evaluate(chess_board *boards, uint32_t count, uchar evaluator_type, int32_t *scores, uint32_t thread_count)
+{
+    cb_wasm_evaluation_slice slices[WASM_THREAD_POOL_SIZE];
+    pcthread threads[WASM_THREAD_POOL_SIZE];
+
+    if(thread_count < 1 || thread_count > WASM_THREAD_POOL_SIZE)
+    {
+        thread_count = thread_count < 1 ? 1 : WASM_THREAD_POOL_SIZE;
+    }
+
+    for(uint32_t t = 0; t < thread_count; t++)
+    {
+        slices[t].boards = boards;
+        slices[t].begin = (uint32_t)((uint64_t)count * t / thread_count);
+        slices[t].end = (uint32_t)((uint64_t)count * (t + 1) / thread_count);
+        slices[t].evaluator_type = evaluator_type;
+        slices[t].scores = scores;
+
+        // The calling thread takes the first slice itself.
+        if(t > 0 && !pcthread_create(&threads[t], cb_wasm_evaluate_slice, &slices[t]))
+        {
+            cb_wasm_evaluate_slice(&slices[t]);
+        }
+    }
+
+    cb_wasm_evaluate_slice(&slices[0]);
+
+    for(uint32_t t = 1; t < thread_count; t++)
+    {
+        pcthread_join(&threads[t]);
+    }
+}
+
+static void *cb_wasm_run_search(void *argument)
+{
+    cb_wasm_search *search = argument;
+
+    cb_search(search->searcher, &search->board, NULL, &search->limits, &search->result);
+    __atomic_store_n(&search->done, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+/**
+ * Largest number of moves in the line returned by cb_wasm_finish_search.
+ */
+EMSCRIPTEN_KEEPALIVE uint32_t cb_wasm_max_line_length()
+{
+    return CB_MAX_PLY;
+}
+
+/**
+ * Start searching a position, in a worker of its own when built with
+ * WASM_THREADS, and otherwise to completion before returning. The search
+ * uses the NNUE evaluator when a network is attached. Zero limits are no
+ * limits, as in cb_search.
+ * @param board Position to search, copied.
+ * @param hash_size Size of the transposition table of the search, in bytes.
+ * @return 1 if the search was started, 0 if one is already running or the
+ * memory could not be allocated.
+ */
+EMSCRIPTEN_KEEPALIVE int cb_wasm_start_search(chess_board *board, uint32_t depth, uint32_t nodes, uint32_t time_ms, uint32_t hash_size)
+{
+    cb_wasm_search *search;
+
+    if(cb_wasm_running_search != NULL || (search = calloc(1, sizeof(cb_wasm_search))) == NULL)
+    {
+        return 0;
+    }
+
+    search->searcher = malloc(sizeof(cb_searcher));
+    if(search->searcher == NULL || !cb_initialize_transposition_table(&search->table, hash_size))
+    {
+        free(search->searcher);
+        free(search);
+        return 0;
+    }
+
+    cb_initialize_searcher(search->searcher, &search->table);
+
+#ifdef NNUE_EVALUATION
+    if(cb_wasm_has_network)
+    {
+        search->searcher->evaluator.type = CB_EVALUATOR_NNUE;
+        search->searcher->evaluator.network = &cb_wasm_network;
+    }
+#endif
+
+    search->board = *board;
+    search->limits = (cb_search_limits){.depth = (uchar)(depth < CB_MAX_PLY ? depth : 0), .nodes = nodes, .time_ms = time_ms, .multi_pv = 1};
+    search->threaded = pcthread_create(&search->thread, cb_wasm_run_search, search);
+
+    if(!search->threaded)
+    {
+        cb_wasm_run_search(search);
+    }
+
+    cb_wasm_running_search = search;
+    return 1;
+}
+
+/**
+ * Whether the running search is over, so that cb_wasm_finish_search returns
+ * without waiting.
+ */
+EMSCRIPTEN_KEEPALIVE int cb_wasm_search_done()
+{
+    return cb_wasm_running_search == NULL || __atomic_load_n(&cb_wasm_running_search->done, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Stop the running search, which then returns the lines of its last
+ * completed depth, the first depth always being completed.
+ */
+EMSCRIPTEN_KEEPALIVE void cb_wasm_stop_search()
+{
+    if(cb_wasm_running_search != NULL)
+    {
+        cb_stop_search(cb_wasm_running_search->searcher);
+    }
+}
+
+/**
+ * Wait for the running search to end and release it.
+ * @param moves Receives the best line, up to cb_wasm_max_line_length moves.
+ * @param info Receives the score of the line in centipawns from the side to
+ * move (mates as in cb_search), the depth, the nodes and the milliseconds.
+ * @return Number of moves of the line, 0 if no search was running.
+ */
+EMSCRIPTEN_KEEPALIVE uint32_t cb_wasm_finish_search(cb_move *moves, int32_t *info)
+{
+    cb_wasm_search *search = cb_wasm_running_search;
+    const cb_principal_variation *line;
+    uint32_t length;
+
+    if(search == NULL)
+    {
+        return 0;
+    }
+
+    if(search->threaded)
+    {
+        pcthread_join(&search->thread);
+    }
+
+    line = &search->result.lines[0];
+    length = search->result.line_count > 0 ? line->length : 0;
+
+    memcpy(moves, line->moves, sizeof(cb_move) * length);
+    info[0] = length > 0 ? line->score : 0;
+    info[1] = search->result.depth;
+    info[2] = (int32_t)search->result.nodes;
+    info[3] = (int32_t)search->result.time_ms;
+
+    cb_free_transposition_table(&search->table);
+    free(search->searcher);
+    free(search);
+    cb_wasm_running_search = NULL;
+
+    return length;
+}
@@ -0,0 +1,243 @@
+/**
+ * @file protonchess.js
+ * @author Nathan Seymour
+ * @brief Batch-oriented JavaScript API of the proton-chess WebAssembly
+ * build.
+ *
+ * Positions and moves cross the JS/wasm boundary as whole arrays: each
+ * method below is a single call into wasm, however many positions it is
+ * given. Moves are objects {from, to, promotion} of square indices (a1 = 0,
+ * h8 = 63), the promotion being a piece value (Ex: ProtonChess.KNIGHT).
+ *
+ *     const ProtonChess = require('./protonchess.js');
+ *     const chess = await ProtonChess.create(require('./protonchess-wasm.js'));
+ *     const scores = chess.evaluate(['rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1']);
+ *
+ * A search runs in a worker of its own, so batches can be evaluated while
+ * it runs.
+ */
+
+'use strict';
+
+const FEN_NOTATION_LENGTH = 92;
+const MOVE_SIZE = 3;
+const SEARCH_POLL_MS = 5;
+
+class ProtonChess {
+    /**
+     * Instantiate the wasm module.
+     * @param createModule Factory emitted by the build (protonchess-wasm.js).
+     * @returns {Promise<ProtonChess>}
+     */
+    static async create(createModule) {
+        return new ProtonChess(await createModule());
+    }
+
+    constructor(module) {
+        this.module = module;
+        this.boardSize = module._cb_wasm_board_size();
+        this.maxThreads = module._cb_wasm_max_threads();
+        this.maxLineLength = module._cb_wasm_max_line_length();
+    }
+
+    /**
+     * Evaluate positions, in centipawns from the side to move.
+     * @param {string[]} fens Positions to evaluate.
+     * @param {object} [options] {threads, evaluator: ProtonChess.MATERIAL or ProtonChess.NNUE}.
+     * @returns {Int32Array} One score per position.
+     */
+    evaluate(fens, options = {}) {
+        const threads = Math.min(options.threads || this.maxThreads, this.maxThreads);
+        const evaluator = options.evaluator || ProtonChess.MATERIAL;
+
+        return this._withBoards(fens, (boards) => {
+            const scores = this._alloc(fens.length * 4);
+            try {
+                this.module._cb_wasm_evaluate(boards, fens.length, evaluator, scores, threads);
+                return new Int32Array(this.module.HEAP32.buffer, scores, fens.length).slice();
+            } finally {
+                this.module._free(scores);
+            }
+        });
+    }
+
+    /**
+     * Check one move per position, without playing it.
+     * @param {string[]} fens Positions.
+     * @param {object[]} moves One move per position.
+     * @returns {boolean[]} Whether each move is legal.
+     */
+    checkMoves(fens, moves) {
+        return this._withBoards(fens, (boards) => this._withMoves(moves, (movesPointer, results) => {
+            this.module._cb_wasm_check_moves(boards, movesPointer, fens.length, results);
+            return Array.from(this.module.HEAPU8.subarray(results, results + fens.length), (result) => result === 1);
+        }));
+    }
+
+    /**
+     * Play one move per position.
+     * @param {string[]} fens Positions.
+     * @param {object[]} moves One move per position.
+     * @param {object} [options] {legalOnly}: check every move and play it with all of the rules.
+     * @returns {{fens: string[], results: Uint8Array}} New positions, and a result
+     * code per move (ProtonChess.MOVE_APPLIED, ProtonChess.ILLEGAL_MOVE, ...).
+     */
+    applyMoves(fens, moves, options = {}) {
+        const flags = options.legalOnly ? 1 : 0;
+
+        return this._withBoards(fens, (boards) => this._withMoves(moves, (movesPointer, results) => {
+            this.module._cb_wasm_perform_movements(boards, movesPointer, fens.length, flags, results);
+            return {
+                fens: this._generateFens(boards, fens.length),
+                results: this.module.HEAPU8.slice(results, results + fens.length),
+            };
+        }));
+    }
+
+    /**
+     * Search the best move of a position. One search runs at a time; without
+     * WASM_THREADS it runs to completion before the promise is returned.
+     * @param {string} fen Position to search.
+     * @param {object} [options] {depth, nodes, time} limits, time in
+     * milliseconds, and hash, the size of the table in MB (16 by default).
+     * Without any limit, the search runs until stopSearch is called.
+     * Searches use the NNUE evaluator once a network is loaded.
+     * @returns {Promise<{moves: object[], score: number, depth: number, nodes: number, time: number}>}
+     * The best line, its score in centipawns from the side to move, and the
+     * depth completed.
+     */
+    async search(fen, options = {}) {
+        const hashSize = (options.hash || 16) * 1024 * 1024;
+
+        const started = this._withBoards([fen], (boards) =>
+            this.module._cb_wasm_start_search(boards, options.depth || 0, options.nodes || 0, options.time || 0, hashSize));
+        if (started !== 1) {
+            throw new Error('proton-chess: a search is already running or out of wasm memory');
+        }
+
+        // Only finishing blocks, so the search is polled for in the meantime.
+        while (this.module._cb_wasm_search_done() !== 1) {
+            await new Promise((resolve) => setTimeout(resolve, SEARCH_POLL_MS));
+        }
+
+        const movesPointer = this._alloc(this.maxLineLength * MOVE_SIZE);
+        const info = this._alloc(4 * 4);
+
+        try {
+            const length = this.module._cb_wasm_finish_search(movesPointer, info);
+            const heap = this.module.HEAPU8;
+            const [score, depth, nodes, time] = new Int32Array(this.module.HEAP32.buffer, info, 4);
+            const moves = [];
+
+            for (let i = 0; i < length; i++) {
+                moves.push({
+                    from: heap[movesPointer + i * MOVE_SIZE],
+                    to: heap[movesPointer + i * MOVE_SIZE + 1],
+                    promotion: heap[movesPointer + i * MOVE_SIZE + 2] & 0x7,
+                });
+            }
+
+            return {moves, score, depth, nodes, time};
+        } finally {
+            this.module._free(info);
+            this.module._free(movesPointer);
+        }
+    }
+
+    /**
+     * Stop the running search, whose promise then resolves with the line of
+     * the last depth completed.
+     */
+    stopSearch() {
+        this.module._cb_wasm_stop_search();
+    }
+
+    /**
+     * Attach a network, as found in .nnue files, for ProtonChess.NNUE
+     * evaluations. Requires a build with NNUE_EVALUATION.
+     * @param {Uint8Array} bytes Contents of the network file.
+     * @returns {boolean} Whether the network was accepted.
+     */
+    loadNetwork(bytes) {
+        if (typeof this.module._cb_wasm_load_network !== 'function') {
+            return false;
+        }
+
+        // Kept allocated: the network is read in place.
+        const data = this._alloc(bytes.length);
+        this.module.HEAPU8.set(bytes, data);
+        return this.module._cb_wasm_load_network(data, bytes.length) === 1;
+    }
+
+    _alloc(size) {
+        const pointer = this.module._malloc(Math.max(size, 1));
+        if (pointer === 0) {
+            throw new Error('proton-chess: out of wasm memory');
+        }
+        return pointer;
+    }
+
+    _withBoards(fens, callback) {
+        const text = fens.join('\n');
+        const textSize = this.module.lengthBytesUTF8(text) + 1;
+        const textPointer = this._alloc(textSize);
+        const boards = this.module._cb_wasm_new_boards(fens.length);
+
+        try {
+            this.module.stringToUTF8(text, textPointer, textSize);
+            this.module._cb_wasm_parse_fens(boards, textPointer, fens.length);
+            return callback(boards);
+        } finally {
+            this.module._cb_wasm_free_boards(boards);
+            this.module._free(textPointer);
+        }
+    }
+
+    _withMoves(moves, callback) {
+        const movesPointer = this._alloc(moves.length * MOVE_SIZE);
+        const results = this._alloc(moves.length);
+
+        try {
+            const heap = this.module.HEAPU8;
+            moves.forEach((move, i) => {
+                heap[movesPointer + i * MOVE_SIZE] = move.from;
+                heap[movesPointer + i * MOVE_SIZE + 1] = move.to;
+                heap[movesPointer + i * MOVE_SIZE + 2] = move.promotion || 0;
+            });
+            return callback(movesPointer, results);
+        } finally {
+            this.module._free(results);
+            this.module._free(movesPointer);
+        }
+    }
+
+    _generateFens(boards, count) {
+        const buffer = this._alloc(count * FEN_NOTATION_LENGTH);
+
+        try {
+            this.module._cb_wasm_generate_fens(boards, count, buffer);
+            const fens = [];
+            for (let i = 0; i < count; i++) {
+                fens.push(this.module.UTF8ToString(buffer + i * FEN_NOTATION_LENGTH, FEN_NOTATION_LENGTH));
+            }
+            return fens;
+        } finally {
+            this.module._free(buffer);
+        }
+    }
+}
+
+ProtonChess.MATERIAL = 0;
+ProtonChess.NNUE = 1;
+
+ProtonChess.KNIGHT = 2;
+ProtonChess.BISHOP = 3;
+ProtonChess.ROOK = 4;
+ProtonChess.QUEEN = 5;
+
+ProtonChess.MOVE_APPLIED = 0;
+ProtonChess.INVALID_SQUARE = 1;
+ProtonChess.EMPTY_SQUARE = 2;
+ProtonChess.ILLEGAL_MOVE = 3;
+
+module.exports = ProtonChess;
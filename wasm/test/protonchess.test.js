@@ -0,0 +1,100 @@
+/**
+ * @file protonchess.test.js
+ * @author Nathan Seymour
+ * @brief Tests for the proton-chess JavaScript API, run under Node.
+ *
+ * Usage: node protonchess.test.js <build directory>
+ */
+
+'use strict';
+
+const assert = require('assert');
+const path = require('path');
+
+const buildDirectory = path.resolve(process.argv[2] || '.');
+const ProtonChess = require(path.join(buildDirectory, 'protonchess.js'));
+const createModule = require(path.join(buildDirectory, 'protonchess-wasm.js'));
+
+const INITIAL_FEN = 'rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1';
+const QUEEN_UP_FEN = 'rnb1kbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1';
+const BACK_RANK_MATE_FEN = '6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1';
+
+const tests = {
+    async evaluate(chess) {
+        const fens = [];
+        for (let i = 0; i < 1000; i++) {
+            fens.push(i % 2 === 0 ? INITIAL_FEN : QUEEN_UP_FEN);
+        }
+
+        const scores = chess.evaluate(fens);
+        assert.strictEqual(scores.length, fens.length, 'There should be a score per position.');
+        assert.strictEqual(scores[0], 0, 'The initial position should be balanced.');
+        assert.strictEqual(scores[1], 900, 'White should be a queen up.');
+
+        const singleThreaded = chess.evaluate(fens, {threads: 1});
+        assert.deepStrictEqual(singleThreaded, scores, 'Scores should not depend on the number of threads.');
+    },
+
+    async applyMoves(chess) {
+        const fens = [INITIAL_FEN, INITIAL_FEN, INITIAL_FEN];
+        const moves = [
+            {from: 12, to: 28},     // e2e4
+            {from: 12, to: 36},     // e2e5
+            {from: 20, to: 28},     // e3 is empty
+        ];
+
+        const {fens: played, results} = chess.applyMoves(fens, moves, {legalOnly: true});
+        assert.deepStrictEqual(Array.from(results), [ProtonChess.MOVE_APPLIED, ProtonChess.ILLEGAL_MOVE, ProtonChess.EMPTY_SQUARE]);
+        assert.strictEqual(played[0], 'rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1');
+        assert.strictEqual(played[1], INITIAL_FEN, 'Boards should be untouched by illegal moves.');
+    },
+
+    async checkMoves(chess) {
+        const legal = chess.checkMoves([INITIAL_FEN, INITIAL_FEN], [{from: 6, to: 21}, {from: 6, to: 22}]);
+        assert.deepStrictEqual(legal, [true, false]);
+    },
+
+    async search(chess) {
+        const searching = chess.search(BACK_RANK_MATE_FEN, {depth: 4, hash: 1});
+
+        // Evaluated while the search runs in its worker.
+        const scores = chess.evaluate([INITIAL_FEN, QUEEN_UP_FEN]);
+        assert.deepStrictEqual(Array.from(scores), [0, 900], 'Batches should be evaluated during a search.');
+
+        const result = await searching;
+        assert.deepStrictEqual(result.moves[0], {from: 0, to: 56, promotion: 0}, 'Ra8 should be found.');
+        assert.ok(result.score >= 30000, 'The mate should be scored as one.');
+        assert.ok(result.depth >= 1 && result.nodes > 0, 'The search should be reported.');
+    },
+
+    async stopSearch(chess) {
+        // The time limit only keeps a broken stop from hanging the test.
+        const searching = chess.search(INITIAL_FEN, {time: 10000, hash: 1});
+
+        await new Promise((resolve) => setTimeout(resolve, 100));
+        chess.stopSearch();
+
+        const result = await searching;
+        assert.ok(result.time < 10000, 'The search should stop when asked to.');
+        assert.ok(result.moves.length > 0, 'The line of the last depth should be returned.');
+    },
+};
+
+(async () => {
+    const chess = await ProtonChess.create(createModule);
+    let failed = 0;
+
+    console.log(`Running with up to ${chess.maxThreads} threads.`);
+
+    for (const [name, test] of Object.entries(tests)) {
+        try {
+            await test(chess);
+            console.log(`Test ${name} PASSED`);
+        } catch (error) {
+            failed++;
+            console.log(`Test ${name} FAILED\n\t${error.message}`);
+        }
+    }
+
+    process.exit(failed === 0 ? 0 : 1);
+})();